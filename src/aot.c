@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "aot.h"
+#include "asm.h"
+#include "decode.h"
+#include "util.h"
+
+static const char *mode_names[] = {
+	"Immediate", "ZeroPage", "ZeroPage_X", "ZeroPage_Y", "Absolute",
+	"Absolute_X", "Absolute_Y", "Indirect_X", "Indirect_Y", "NoneAddressing",
+	"ZeroPage_Indirect",
+};
+
+static void lower(char *out, const char *mnemonic) {
+	for (int i = 0; i < 4; ++i)
+		out[i] = (char) tolower((unsigned char) mnemonic[i]);
+}
+
+/// Instructions that may leave program_counter somewhere else.
+static uint8_t is_control(uint8_t code) {
+	return (code & 0x1F) == 0x10 || code == 0x4C || code == 0x6C || code == 0x20
+		|| code == 0x60 || code == 0x40;
+}
+
+/// One instruction at `addr`, in the same way step() executes it.
+static void emit_insn(FILE *out, CPU *cpu, uint16_t addr) {
+	uint8_t code = cpu->memory[addr];
+	OPCODE op = opcode_lookup_table[code];
+	uint16_t operand = addr + 1;
+	char name[4];
+	lower(name, op.mnemonic);
+
+	if (code == 0x00) {
+		fprintf(out, "\tcpu->program_counter = 0x%04X;\n\treturn AOT_HALT;\n", operand);
+		return;
+	}
+	if (code == 0xEA)
+		return;
+
+	if (is_control(code)) {
+		const char *fn = name;
+		if (code == 0x4C) fn = "jmp_absolute";
+		if (code == 0x6C) fn = "jmp_indirect";
+		// the handlers leave the program counter on the next instruction
+		fprintf(out, "\tcpu->program_counter = 0x%04X;\n\t%s(cpu);\n", operand, fn);
+		fprintf(out, "\treturn cpu->program_counter;\n");
+		return;
+	}
+
+	if (op.mode == NoneAddressing) {
+		// accumulator forms of the shifts, otherwise implied
+		if (code == 0x0A || code == 0x4A || code == 0x2A || code == 0x6A)
+			fprintf(out, "\t%s_accumulator(cpu);\n", name);
+		else
+			fprintf(out, "\t%s(cpu);\n", name);
+		return;
+	}
+	fprintf(out, "\tcpu->program_counter = 0x%04X;\n\t%s(cpu, %s);\n", operand, name, mode_names[op.mode]);
+}
+
+static void emit_block(FILE *out, CPU *cpu, DCACHE *cache, BLOCK *block) {
+	uint16_t addr = block->start;
+	uint16_t end = addr;
+
+	for (uint16_t i = 0; i < block->ninsns; ++i)
+		end += cache->insns[end].len;
+
+	fprintf(out, "static const uint8_t code_%04X[] = {", block->start);
+	for (uint16_t a = block->start; a != end; ++a)
+		fprintf(out, "%s0x%02X", a == block->start ? " " : ", ", cpu->memory[a]);
+	fprintf(out, " };\n\n");
+
+	fprintf(out, "static int32_t block_%04X(CPU *cpu) {\n", block->start);
+	fprintf(out, "\tif (memcmp(&cpu->memory[0x%04X], code_%04X, sizeof(code_%04X)))\n",
+		block->start, block->start, block->start);
+	fprintf(out, "\t\treturn AOT_INTERPRET;\n");
+	fprintf(out, "\tcpu->cycles += %u;\n", block->cycles);
+
+	uint16_t last = addr;
+	for (uint16_t i = 0; i < block->ninsns; ++i) {
+		emit_insn(out, cpu, addr);
+		last = addr;
+		addr += cache->insns[addr].len;
+	}
+	// blocks cut short by the next leader fall through
+	if (!(cache->insns[last].flags & INSN_END))
+		fprintf(out, "\treturn 0x%04X;\n", end);
+	fprintf(out, "}\n\n");
+}
+
+/// Writes the translation of the image loaded in `cpu`, only the cache's
+/// hot blocks if it has a hot list.
+static uint32_t translate(FILE *out, CPU *cpu, DCACHE *cache, uint8_t *image, size_t len, const char *source) {
+	DCACHE_HEADER *header = cache->header;
+	uint32_t nhot = cache->header->nhot;
+	uint32_t n = nhot ? nhot : cache->header->nblocks;
+
+	fprintf(out, "/* Translated from %s by aot, do not edit */\n\n", source);
+	fprintf(out, "#include \"aot.h\"\n\n");
+
+	fprintf(out, "const uint16_t aot_load = 0x%04X;\n", header->load);
+	fprintf(out, "const uint16_t aot_vectors[3] = { 0x%04X, 0x%04X, 0x%04X };\n",
+		header->vectors[0], header->vectors[1], header->vectors[2]);
+	fprintf(out, "const size_t aot_image_len = %lu;\n", len);
+	fprintf(out, "const uint8_t aot_image[] = {");
+	for (size_t i = 0; i < len; ++i)
+		fprintf(out, "%s0x%02X", i % 16 ? ", " : (i ? ",\n\t" : "\n\t"), image[i]);
+	fprintf(out, "\n};\n\n");
+
+	for (uint32_t i = 0; i < n; ++i)
+		emit_block(out, cpu, cache, &cache->blocks[nhot ? cache->hot[i] : i]);
+
+	fprintf(out, "const AOT_BLOCK aot_blocks[MEMORY_SIZE] = {\n");
+	for (uint32_t i = 0; i < n; ++i) {
+		uint16_t start = cache->blocks[nhot ? cache->hot[i] : i].start;
+		fprintf(out, "\t[0x%04X] = block_%04X,\n", start, start);
+	}
+	fprintf(out, "};\n");
+	return n;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-o out.c] [-d cache_dir] [-l load] image.bin|source.asm\n", name);
+	fprintf(stderr, "  an image is loaded at $8000 like load(), or at -l with the reset vector\n");
+	fprintf(stderr, "  there, a .asm or .s source is assembled like `emu --asm`; code is found\n");
+	fprintf(stderr, "  from the vectors\n");
+	fprintf(stderr, "  -d takes the blocks from the decode cache, only the hot ones once\n");
+	fprintf(stderr, "  `emu --cache cache_dir` has profiled the same program\n");
+}
+
+int main(int argc, char **argv) {
+	const char *out_path = NULL, *cache_dir = NULL;
+	long origin = -1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "o:d:l:")) != -1) {
+		switch (opt) {
+			case 'o': out_path = optarg; break;
+			case 'd': cache_dir = optarg; break;
+			case 'l': origin = strtol(optarg, NULL, 0) & 0xFFFF; break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	const char *path = argv[optind];
+
+	static CPU cpu;
+	DCACHE cache;
+	createCPU(&cpu);
+	createDCACHE(&cache);
+
+	size_t len;
+	uint8_t *image;
+	uint16_t load_at;
+	if (asm_is_source(path)) {
+		// the program as `emu --asm` sees it, so both find the same cache file
+		ASSEMBLER as;
+		char error[ASM_MAX_ERROR + 32];
+		createASSEMBLER(&as);
+		if (!assemble_file(&as, path, cpu.memory, error, sizeof(error))) {
+			fprintf(stderr, "%s: %s\n", path, error);
+			return 1;
+		}
+		load_at = as.start;
+		len = as.bytes ? (size_t) (as.end - as.start) + 1 : 0;
+		image = malloc(len ? len : 1);
+		memcpy(image, &cpu.memory[as.start], len);
+		destroyASSEMBLER(&as);
+	} else {
+		load_at = origin >= 0 ? (uint16_t) origin : 0x8000;
+		if (!(image = read_file(path, &len))) {
+			perror(path);
+			return 1;
+		}
+		if (len > (size_t) (MEMORY_SIZE - load_at)) {
+			fprintf(stderr, "%s: image does not fit at $%04X\n", path, load_at);
+			return 1;
+		}
+		memcpy(&cpu.memory[load_at], image, len);
+		mem_write_u16(&cpu, 0xFFFC, load_at);
+	}
+
+	if (cache_dir) {
+		dcache_open(&cache, cache_dir, &cpu, image, len, load_at);
+		if (cache.header->load != load_at) {
+			fprintf(stderr, "%s: decode cache is for a program at $%04X, not $%04X\n",
+				cache_dir, cache.header->load, load_at);
+			return 1;
+		}
+	} else {
+		decode_image(&cache, &cpu, image, len, load_at);
+	}
+
+	FILE *out = out_path ? fopen(out_path, "w") : stdout;
+	if (!out) {
+		perror(out_path);
+		return 1;
+	}
+	uint32_t translated = translate(out, &cpu, &cache, image, len, path);
+	if (out != stdout)
+		fclose(out);
+	fprintf(stderr, "%u of %u blocks translated%s\n", translated, cache.header->nblocks,
+		cache.header->nhot ? ", the cache's hot list" : "");
+
+	destroyDCACHE(&cache);
+	destroyCPU(&cpu);
+	free(image);
+	return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <stdint.h>
+
+#include "cpu_6502.h"
+
+/* Block results besides the next program counter */
+#define AOT_HALT	-1
+#define AOT_INTERPRET	-2
+
+/// # Ahead of time translation
+///
+/// `aot` turns an image into C: every basic block found by decode_image()
+/// becomes a function that runs its instructions through the same
+/// instruction functions as step(), with the decode and dispatch resolved at
+/// translation time. A block returns the next program counter, AOT_HALT on
+/// BRK, or AOT_INTERPRET when its code bytes no longer match the image
+/// (self-modifying code). aot_run() interprets wherever there is no block,
+/// e.g. after an indirect jump to code the translator never saw.
+///
+/// Build the result with the same flags as everything else:
+///
+///     ./aot -o prog.c image.bin
+///     gcc $(CFLAGS) -DCPU_DIRTY_PAGES -Isrc -o prog prog.c
+///         src/aot_run.c src/lockstep.c src/util.c src/cpu_6502.c -lm
+///
+/// `prog -c` checks the translation against the interpreter, see lockstep.h.
+///
+typedef int32_t (*AOT_BLOCK)(CPU *cpu);
+
+/* Defined by the generated file */
+extern const AOT_BLOCK aot_blocks[MEMORY_SIZE];
+extern const uint16_t aot_load;
+extern const uint16_t aot_vectors[3];
+extern const uint8_t aot_image[];
+extern const size_t aot_image_len;
+
+uint8_t aot_run(CPU *cpu, const AOT_BLOCK *blocks, uint64_t *interpreted);
+uint8_t aot_advance(CPU *cpu, void *data);
+
+#endif
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "aot.h"
+#include "lockstep.h"
+#include "util.h"
+
+/// Runs translated blocks until BRK, interpreting single instructions where
+/// no block applies. Counts the interpreted ones in `interpreted` if given.
+/// Returns 0 like step() on BRK.
+uint8_t aot_run(CPU *cpu, const AOT_BLOCK *blocks, uint64_t *interpreted) {
+	uint64_t fallback = 0;
+
+	for (;;) {
+		AOT_BLOCK block = blocks[cpu->program_counter];
+		int32_t next = block ? block(cpu) : AOT_INTERPRET;
+
+		if (next >= 0) {
+			cpu->program_counter = (uint16_t) next;
+			continue;
+		}
+		if (next == AOT_HALT)
+			break;
+		fallback += 1;
+		if (!step(cpu))
+			break;
+	}
+
+	if (interpreted)
+		*interpreted = fallback;
+	return 0;
+}
+
+/// One block, or one interpreted instruction where there is none; the
+/// lockstep BACKEND for translated code, `data` is the block table.
+uint8_t aot_advance(CPU *cpu, void *data) {
+	const AOT_BLOCK *blocks = data;
+	AOT_BLOCK block = blocks[cpu->program_counter];
+	int32_t next = block ? block(cpu) : AOT_INTERPRET;
+
+	if (next >= 0) {
+		cpu->program_counter = (uint16_t) next;
+		return 1;
+	}
+	if (next == AOT_HALT)
+		return 0;
+	return step(cpu);
+}
+
+/// Runs the translated image, with -i the same image interpreted, with -c
+/// both in lockstep (exit status 1 on divergence).
+int main(int argc, char **argv) {
+	uint8_t interpret = argc > 1 && !strcmp(argv[1], "-i");
+	uint8_t check = argc > 1 && !strcmp(argv[1], "-c");
+	uint64_t fallback = 0;
+	static CPU cpu;
+
+	createCPU(&cpu);
+	// where aot found it, with the vectors it decoded from
+	memcpy(&cpu.memory[aot_load], aot_image, aot_image_len);
+	mem_write_u16(&cpu, 0xFFFC, aot_vectors[0]);
+	mem_write_u16(&cpu, 0xFFFA, aot_vectors[1]);
+	mem_write_u16(&cpu, 0xFFFE, aot_vectors[2]);
+	reset(&cpu);
+
+	if (check) {
+		LOCKSTEP ls;
+		BACKEND backend = { "translated", aot_advance, (void *) aot_blocks };
+		createLOCKSTEP(&ls, &cpu);
+		uint8_t same = lockstep_run(&ls, &cpu, &backend, stderr);
+		if (same)
+			printf("translated matches the interpreter: %lu instructions, %lu syncs\n",
+				ls.instructions, ls.syncs);
+		destroyLOCKSTEP(&ls);
+		destroyCPU(&cpu);
+		return !same;
+	}
+
+	double start = now();
+	if (interpret)
+		run(&cpu);
+	else
+		aot_run(&cpu, aot_blocks, &fallback);
+	double elapsed = now() - start;
+
+	printf("register_a: %u\n", cpu.register_a);
+	printf("register_x: %u\n", cpu.register_x);
+	printf("register_y: %u\n", cpu.register_y);
+	printf("status: 0x%02X\n", cpu.status);
+	printf("program_counter: 0x%04X\n", cpu.program_counter);
+	printf("cycles: %lu\n", cpu.cycles);
+	printf("%s: %.3f s, %.1f MHz", interpret ? "interpreted" : "translated",
+		elapsed, (double) cpu.cycles / elapsed / 1e6);
+	if (!interpret)
+		printf(", %lu instructions interpreted", fallback);
+	printf("\n");
+	destroyCPU(&cpu);
+	return 0;
+}
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+
+_Static_assert(sizeof(ARCHIVE_HEADER) % ARCHIVE_ALIGN == 0, "header breaks the alignment");
+_Static_assert(sizeof(ARCHIVE_ENTRY) % ARCHIVE_ALIGN == 0, "entries break the alignment");
+
+static inline uint64_t align(uint64_t n) {
+	return (n + ARCHIVE_ALIGN - 1) & ~(uint64_t) (ARCHIVE_ALIGN - 1);
+}
+
+/// Maps `path` and checks its index. Returns 0 if it cannot be read or
+/// is not a well formed archive.
+uint8_t createARCHIVE(ARCHIVE *archive, const char *path) {
+	memset(archive, 0, sizeof(*archive));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	struct stat st;
+	if (fstat(fd, &st) || (size_t) st.st_size < sizeof(ARCHIVE_HEADER)) {
+		close(fd);
+		return 0;
+	}
+	void *base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return 0;
+	archive->base = base;
+	archive->size = (size_t) st.st_size;
+
+	const ARCHIVE_HEADER *header = base;
+	uint64_t index_end = sizeof(ARCHIVE_HEADER) + (uint64_t) header->count * sizeof(ARCHIVE_ENTRY);
+	uint8_t ok = !memcmp(header->magic, ARCHIVE_MAGIC, sizeof(header->magic))
+		&& header->version == ARCHIVE_VERSION
+		&& index_end <= header->names_offset
+		&& header->names_offset <= archive->size
+		&& header->names_size <= archive->size - header->names_offset
+		&& (!header->count || (header->names_size && archive->base[header->names_offset + header->names_size - 1] == 0));
+	archive->entries = (const ARCHIVE_ENTRY *) (archive->base + sizeof(ARCHIVE_HEADER));
+	archive->names = (const char *) (archive->base + header->names_offset);
+	archive->count = header->count;
+
+	// the last name is terminated, so any name offset inside is too
+	for (uint32_t i = 0; ok && i < archive->count; ++i) {
+		const ARCHIVE_ENTRY *e = &archive->entries[i];
+		ok = e->offset <= archive->size && e->length <= archive->size - e->offset
+			&& (uint64_t) e->load + e->length <= MEMORY_SIZE
+			&& e->name < header->names_size;
+	}
+	if (!ok) {
+		destroyARCHIVE(archive);
+		return 0;
+	}
+	return 1;
+}
+
+void destroyARCHIVE(ARCHIVE *archive) {
+	if (archive->base)
+		munmap((void *) archive->base, archive->size);
+	archive->base = NULL;
+	archive->count = 0;
+}
+
+const char *archive_name(const ARCHIVE *archive, uint32_t i) {
+	return archive->names + archive->entries[i].name;
+}
+
+/// The image itself, inside the mapping.
+const uint8_t *archive_image(const ARCHIVE *archive, uint32_t i) {
+	return archive->base + archive->entries[i].offset;
+}
+
+/// Copies program `i` into `cpu` and sets the registers it starts with.
+/// Memory outside the image is left as it is.
+void archive_load(const ARCHIVE *archive, uint32_t i, CPU *cpu) {
+	const ARCHIVE_ENTRY *e = &archive->entries[i];
+	memcpy(&cpu->memory[e->load], archive_image(archive, i), e->length);
+	cpu->register_a = e->register_a;
+	cpu->register_x = e->register_x;
+	cpu->register_y = e->register_y;
+	cpu->status = e->status;
+	cpu->stack_pointer = e->stack_pointer;
+	cpu->program_counter = e->entry;
+	cpu->cycles = 0;
+}
+
+static uint8_t pad(FILE *f, uint64_t from) {
+	static const uint8_t zeros[ARCHIVE_ALIGN];
+	size_t n = (size_t) (align(from) - from);
+	return fwrite(zeros, 1, n, f) == n;
+}
+
+/// Writes `count` programs to `path` in one go, names and images in the
+/// order given.
+uint8_t archive_write(const char *path, const ARCHIVE_PROGRAM *programs, uint32_t count) {
+	ARCHIVE_HEADER header = { .magic = ARCHIVE_MAGIC, .version = ARCHIVE_VERSION, .count = count };
+	ARCHIVE_ENTRY *entries = calloc(count ? count : 1, sizeof(ARCHIVE_ENTRY));
+
+	header.names_offset = sizeof(header) + (uint64_t) count * sizeof(ARCHIVE_ENTRY);
+	for (uint32_t i = 0; i < count; ++i) {
+		entries[i].name = (uint32_t) header.names_size;
+		header.names_size += strlen(programs[i].name) + 1;
+	}
+	uint64_t offset = align(header.names_offset + header.names_size);
+	for (uint32_t i = 0; i < count; ++i) {
+		const ARCHIVE_PROGRAM *p = &programs[i];
+		entries[i].offset = offset;
+		entries[i].length = p->length;
+		entries[i].load = p->load;
+		entries[i].entry = p->entry;
+		entries[i].register_a = p->register_a;
+		entries[i].register_x = p->register_x;
+		entries[i].register_y = p->register_y;
+		entries[i].status = p->status;
+		entries[i].stack_pointer = p->stack_pointer;
+		offset = align(offset + p->length);
+	}
+
+	FILE *f = fopen(path, "wb");
+	if (!f) {
+		free(entries);
+		return 0;
+	}
+	uint8_t ok = fwrite(&header, sizeof(header), 1, f) == 1
+		&& fwrite(entries, sizeof(ARCHIVE_ENTRY), count, f) == count;
+	for (uint32_t i = 0; ok && i < count; ++i)
+		ok = fwrite(programs[i].name, strlen(programs[i].name) + 1, 1, f) == 1;
+	ok = ok && pad(f, header.names_offset + header.names_size);
+	for (uint32_t i = 0; ok && i < count; ++i)
+		ok = fwrite(programs[i].image, 1, programs[i].length, f) == programs[i].length
+			&& pad(f, entries[i].offset + programs[i].length);
+	free(entries);
+	return fclose(f) == 0 && ok;
+}
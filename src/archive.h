@@ -0,0 +1,84 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cpu_6502.h"
+
+#define ARCHIVE_MAGIC	"6502PAK"
+#define ARCHIVE_VERSION	1
+#define ARCHIVE_ALIGN	16
+
+/// # Program archive
+///
+/// Many program images in one file, read through mmap() so any number of
+/// threads or processes can pick programs by index without opening or
+/// copying anything but the image itself into the cpu.
+///
+/// File layout, all little endian, every part ARCHIVE_ALIGN aligned:
+///
+///  - ARCHIVE_HEADER
+///  - `count` ARCHIVE_ENTRY, the index
+///  - the names, NUL terminated, `names_size` bytes
+///  - the images, at the offsets the entries give
+///
+/// An entry says where the image goes and the registers to start it
+/// with: archive_load() is the archive's reset(). createARCHIVE() checks
+/// every entry against the file once, so lookups afterwards do not.
+///
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint64_t names_offset;
+	uint64_t names_size;
+} ARCHIVE_HEADER;
+
+typedef struct {
+	uint64_t offset;
+	uint32_t length;
+	/* Into the names */
+	uint32_t name;
+	uint16_t load;
+	uint16_t entry;
+	uint8_t register_a;
+	uint8_t register_x;
+	uint8_t register_y;
+	uint8_t status;
+	uint8_t stack_pointer;
+	uint8_t reserved[7];
+} ARCHIVE_ENTRY;
+
+typedef struct {
+	const uint8_t *base;
+	size_t size;
+	const ARCHIVE_ENTRY *entries;
+	const char *names;
+	uint32_t count;
+} ARCHIVE;
+
+/// One program for archive_write(), registers as archive_load() sets them.
+typedef struct {
+	const char *name;
+	const uint8_t *image;
+	uint32_t length;
+	uint16_t load;
+	uint16_t entry;
+	uint8_t register_a;
+	uint8_t register_x;
+	uint8_t register_y;
+	uint8_t status;
+	uint8_t stack_pointer;
+} ARCHIVE_PROGRAM;
+
+uint8_t createARCHIVE(ARCHIVE *archive, const char *path);
+void destroyARCHIVE(ARCHIVE *archive);
+
+const char *archive_name(const ARCHIVE *archive, uint32_t i);
+const uint8_t *archive_image(const ARCHIVE *archive, uint32_t i);
+void archive_load(const ARCHIVE *archive, uint32_t i, CPU *cpu);
+
+uint8_t archive_write(const char *path, const ARCHIVE_PROGRAM *programs, uint32_t count);
+
+#endif
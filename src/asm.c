@@ -0,0 +1,573 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <strings.h>
+#include <stdarg.h>
+
+#include "asm.h"
+#include "util.h"
+
+typedef struct {
+	ASSEMBLER *as;
+	const char *p;
+	uint16_t pc;
+	uint8_t pass;
+	/* Set when an expression used a symbol not defined yet */
+	uint8_t unknown;
+	uint8_t failed;
+} STATE;
+
+static void fail(STATE *st, const char *fmt, ...) {
+	va_list args;
+	if (st->failed)
+		return;
+	va_start(args, fmt);
+	vsnprintf(st->as->error, ASM_MAX_ERROR, fmt, args);
+	va_end(args);
+	st->failed = 1;
+}
+
+static uint16_t pack_mnemonic(const char *s) {
+	return (uint16_t) (((toupper(s[0]) - 'A') & 31) << 10 | ((toupper(s[1]) - 'A') & 31) << 5 | ((toupper(s[2]) - 'A') & 31));
+}
+
+static ASM_MODE mode_of(const OPCODE *op) {
+	switch (op->mode) {
+		case Immediate: return ASM_IMMEDIATE;
+		case ZeroPage: return ASM_ZEROPAGE;
+		case ZeroPage_X: return ASM_ZEROPAGE_X;
+		case ZeroPage_Y: return ASM_ZEROPAGE_Y;
+		case Absolute: return ASM_ABSOLUTE;
+		case Absolute_X: return ASM_ABSOLUTE_X;
+		case Absolute_Y: return ASM_ABSOLUTE_Y;
+		case Indirect_X: return ASM_INDIRECT_X;
+		case Indirect_Y: return ASM_INDIRECT_Y;
+		case ZeroPage_Indirect: return ASM_INDIRECT;
+		case NoneAddressing: break;
+	}
+	// NoneAddressing covers implied, branches and the two jumps
+	if (op->len == 1) return ASM_IMPLIED;
+	if (op->len == 2) return ASM_RELATIVE;
+	if (op->code == 0x6C) return ASM_INDIRECT;
+	return ASM_ABSOLUTE;
+}
+
+void createASSEMBLER(ASSEMBLER *as) {
+	uint8_t next_id = 0;
+
+	memset(as->mnemonic_id, 0, sizeof(as->mnemonic_id));
+	for (int i = 0; i < 64; ++i)
+		for (int m = 0; m < ASM_MODES; ++m)
+			as->encoding[i][m] = -1;
+
+	for (int code = 0; code < 256; ++code) {
+		const OPCODE *op = &opcode_lookup_table[code];
+		if (!op->len)
+			continue;
+		uint16_t key = pack_mnemonic(op->mnemonic);
+		if (!as->mnemonic_id[key])
+			as->mnemonic_id[key] = ++next_id;
+		as->encoding[as->mnemonic_id[key] - 1][mode_of(op)] = (int16_t) code;
+	}
+
+	as->symbols_cap = 256;
+	as->symbols = calloc(as->symbols_cap, sizeof(SYMBOL));
+	as->nsymbols = 0;
+	as->wide_cap = 256;
+	as->wide = malloc(as->wide_cap);
+	as->lines = NULL;
+	as->start = 0;
+	as->end = 0;
+	as->bytes = 0;
+	as->line = 0;
+	as->error[0] = 0;
+}
+
+void destroyASSEMBLER(ASSEMBLER *as) {
+	free(as->symbols);
+	free(as->wide);
+	as->symbols = NULL;
+	as->wide = NULL;
+}
+
+/* Symbols, open addressing */
+
+static uint32_t hash_name(const char *name, size_t len) {
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; ++i)
+		h = (h ^ (uint8_t) toupper(name[i])) * 16777619u;
+	return h;
+}
+
+static SYMBOL *find_symbol(ASSEMBLER *as, const char *name, size_t len) {
+	size_t mask = as->symbols_cap - 1;
+	for (size_t i = hash_name(name, len) & mask; ; i = (i + 1) & mask) {
+		SYMBOL *sym = &as->symbols[i];
+		if (!sym->used || (!strncasecmp(sym->name, name, len) && !sym->name[len]))
+			return sym;
+	}
+}
+
+static void grow_symbols(ASSEMBLER *as) {
+	SYMBOL *old = as->symbols;
+	size_t old_cap = as->symbols_cap;
+
+	as->symbols_cap *= 2;
+	as->symbols = calloc(as->symbols_cap, sizeof(SYMBOL));
+	for (size_t i = 0; i < old_cap; ++i) {
+		if (!old[i].used)
+			continue;
+		*find_symbol(as, old[i].name, strlen(old[i].name)) = old[i];
+	}
+	free(old);
+}
+
+static void define_symbol(STATE *st, const char *name, size_t len, uint16_t value) {
+	ASSEMBLER *as = st->as;
+	if (len >= ASM_MAX_NAME) {
+		fail(st, "symbol name too long");
+		return;
+	}
+
+	SYMBOL *sym = find_symbol(as, name, len);
+	if (sym->used) {
+		if (st->pass == 1)
+			fail(st, "symbol '%.*s' defined twice", (int) len, name);
+		sym->value = value;
+		return;
+	}
+	if ((as->nsymbols + 1) * 2 > as->symbols_cap) {
+		grow_symbols(as);
+		sym = find_symbol(as, name, len);
+	}
+	memcpy(sym->name, name, len);
+	sym->name[len] = 0;
+	sym->value = value;
+	sym->used = 1;
+	as->nsymbols += 1;
+}
+
+uint8_t asm_symbol(ASSEMBLER *as, const char *name, uint16_t *value) {
+	SYMBOL *sym = find_symbol(as, name, strlen(name));
+	if (!sym->used)
+		return 0;
+	*value = sym->value;
+	return 1;
+}
+
+/* Expressions */
+
+static void skip_space(STATE *st) {
+	while (*st->p == ' ' || *st->p == '\t')
+		st->p++;
+}
+
+static uint8_t is_name_start(char c) {
+	return isalpha((unsigned char) c) || c == '_' || c == '.' || c == '@';
+}
+
+static uint8_t is_name_char(char c) {
+	return isalnum((unsigned char) c) || c == '_' || c == '.' || c == '@';
+}
+
+static int32_t expr(STATE *st);
+
+static int32_t primary(STATE *st) {
+	skip_space(st);
+	char c = *st->p;
+	int32_t value = 0;
+
+	if (c == '(') {
+		st->p++;
+		value = expr(st);
+		skip_space(st);
+		if (*st->p != ')')
+			fail(st, "missing ')'");
+		else
+			st->p++;
+		return value;
+	}
+	if (c == '-') { st->p++; return -primary(st); }
+	if (c == '~') { st->p++; return ~primary(st); }
+	if (c == '<') { st->p++; return primary(st) & 0xFF; }
+	if (c == '>') { st->p++; return (primary(st) >> 8) & 0xFF; }
+	if (c == '*') { st->p++; return st->pc; }
+	if (c == '\'' && st->p[1] && st->p[2] == '\'') {
+		value = (uint8_t) st->p[1];
+		st->p += 3;
+		return value;
+	}
+	if (c == '$' || (c == '0' && (st->p[1] == 'x' || st->p[1] == 'X'))) {
+		st->p += c == '$' ? 1 : 2;
+		if (!isxdigit((unsigned char) *st->p))
+			fail(st, "bad hex number");
+		while (isxdigit((unsigned char) *st->p)) {
+			char d = (char) tolower(*st->p++);
+			value = value * 16 + (d <= '9' ? d - '0' : d - 'a' + 10);
+		}
+		return value;
+	}
+	if (c == '%') {
+		st->p++;
+		if (*st->p != '0' && *st->p != '1')
+			fail(st, "bad binary number");
+		while (*st->p == '0' || *st->p == '1')
+			value = value * 2 + (*st->p++ - '0');
+		return value;
+	}
+	if (isdigit((unsigned char) c)) {
+		while (isdigit((unsigned char) *st->p))
+			value = value * 10 + (*st->p++ - '0');
+		return value;
+	}
+	if (is_name_start(c)) {
+		const char *name = st->p;
+		while (is_name_char(*st->p))
+			st->p++;
+		SYMBOL *sym = find_symbol(st->as, name, (size_t) (st->p - name));
+		if (sym->used)
+			return sym->value;
+		if (st->pass == 2)
+			fail(st, "undefined symbol '%.*s'", (int) (st->p - name), name);
+		st->unknown = 1;
+		return 0;
+	}
+
+	fail(st, "expected expression");
+	return 0;
+}
+
+static int32_t term(STATE *st) {
+	int32_t value = primary(st);
+	while (1) {
+		skip_space(st);
+		char op = *st->p;
+		if (op != '*' && op != '/')
+			return value;
+		st->p++;
+		int32_t rhs = primary(st);
+		if (op == '*') {
+			value *= rhs;
+		} else if (rhs) {
+			value /= rhs;
+		} else if (!st->unknown) {
+			fail(st, "division by zero");
+		}
+	}
+}
+
+static int32_t sum(STATE *st) {
+	int32_t value = term(st);
+	while (1) {
+		skip_space(st);
+		char op = *st->p;
+		if (op != '+' && op != '-')
+			return value;
+		st->p++;
+		int32_t rhs = term(st);
+		value = op == '+' ? value + rhs : value - rhs;
+	}
+}
+
+static int32_t expr(STATE *st) {
+	int32_t value = sum(st);
+	while (1) {
+		skip_space(st);
+		char op = *st->p;
+		if (op != '&' && op != '|' && op != '^')
+			return value;
+		st->p++;
+		int32_t rhs = sum(st);
+		if (op == '&') value &= rhs;
+		else if (op == '|') value |= rhs;
+		else value ^= rhs;
+	}
+}
+
+/* Output */
+
+static void emit(STATE *st, uint8_t *memory, uint8_t byte) {
+	ASSEMBLER *as = st->as;
+	if (st->pass == 2) {
+		memory[st->pc] = byte;
+		if (!as->bytes || st->pc < as->start) as->start = st->pc;
+		if (!as->bytes || st->pc > as->end) as->end = st->pc;
+		as->bytes += 1;
+	}
+	st->pc += 1;
+}
+
+static uint8_t at_end(STATE *st) {
+	skip_space(st);
+	return !*st->p || *st->p == ';' || *st->p == '\n' || *st->p == '\r';
+}
+
+/// Case-insensitive match of `suffix` at the end of [from, to), ignoring spaces.
+static const char *ends_with(const char *from, const char *to, const char *suffix) {
+	size_t n = strlen(suffix);
+	while (n) {
+		while (to > from && (to[-1] == ' ' || to[-1] == '\t'))
+			to--;
+		if (to == from || toupper(to[-1]) != suffix[n - 1])
+			return NULL;
+		to--;
+		n--;
+	}
+	return to;
+}
+
+static void instruction(STATE *st, uint8_t *memory, uint8_t id, size_t index) {
+	ASSEMBLER *as = st->as;
+	int16_t *enc = as->encoding[id - 1];
+	ASM_MODE mode;
+	int32_t value = 0;
+
+	skip_space(st);
+	const char *operand = st->p;
+	const char *end = operand;
+	while (*end && *end != ';' && *end != '\n' && *end != '\r')
+		end++;
+	while (end > operand && (end[-1] == ' ' || end[-1] == '\t'))
+		end--;
+
+	st->unknown = 0;
+	if (end == operand || (end - operand == 1 && toupper(*operand) == 'A')) {
+		mode = ASM_IMPLIED;
+		st->p = end;
+	} else if (*operand == '#') {
+		st->p = operand + 1;
+		value = expr(st);
+		mode = ASM_IMMEDIATE;
+	} else {
+		const char *inner;
+		uint8_t indexed_x = 0, indexed_y = 0;
+
+		if (*operand == '(' && (inner = ends_with(operand, end, ",X)"))) {
+			mode = ASM_INDIRECT_X;
+		} else if (*operand == '(' && (inner = ends_with(operand, end, "),Y"))) {
+			mode = ASM_INDIRECT_Y;
+		} else if (*operand == '(' && enc[ASM_INDIRECT] >= 0 && (inner = ends_with(operand, end, ")"))) {
+			mode = ASM_INDIRECT;
+		} else {
+			inner = end;
+			if ((inner = ends_with(operand, end, ",X")))
+				indexed_x = 1;
+			else if ((inner = ends_with(operand, end, ",Y")))
+				indexed_y = 1;
+			else
+				inner = end;
+			mode = ASM_ABSOLUTE;
+		}
+
+		st->p = mode == ASM_ABSOLUTE ? operand : operand + 1;
+		value = expr(st);
+		skip_space(st);
+		if (st->p != inner)
+			fail(st, "junk in operand");
+		st->p = end;
+
+		if (mode == ASM_ABSOLUTE) {
+			if (enc[ASM_RELATIVE] >= 0 && !indexed_x && !indexed_y) {
+				mode = ASM_RELATIVE;
+			} else {
+				// zero page only when pass 1 already knew the value fits,
+				// so both passes agree on the size
+				if (st->pass == 1)
+					as->wide[index] = st->unknown || value < 0 || value > 0xFF;
+				uint8_t wide = as->wide[index];
+				ASM_MODE zp = indexed_x ? ASM_ZEROPAGE_X : indexed_y ? ASM_ZEROPAGE_Y : ASM_ZEROPAGE;
+				ASM_MODE abs = indexed_x ? ASM_ABSOLUTE_X : indexed_y ? ASM_ABSOLUTE_Y : ASM_ABSOLUTE;
+				mode = !wide && enc[zp] >= 0 ? zp : abs;
+				if (enc[mode] < 0 && enc[zp] >= 0)
+					mode = zp;
+			}
+		}
+	}
+
+	if (enc[mode] < 0) {
+		fail(st, "addressing mode not available for this instruction");
+		return;
+	}
+
+	uint8_t code = (uint8_t) enc[mode];
+	uint8_t len = opcode_lookup_table[code].len;
+	uint16_t pc = st->pc;
+
+	if (mode == ASM_RELATIVE) {
+		int32_t offset = value - (pc + 2);
+		if (st->pass == 2 && (offset < -128 || offset > 127))
+			fail(st, "branch out of range");
+		value = offset & 0xFF;
+	} else if (st->pass == 2 && (value < -128 || value > (len == 2 ? 0xFF : 0xFFFF))) {
+		fail(st, "operand out of range");
+	}
+
+	if (st->pass == 2 && as->lines)
+		as->lines[pc] = (uint32_t) as->line;
+	emit(st, memory, code);
+	if (len > 1) emit(st, memory, (uint8_t) value);
+	if (len > 2) emit(st, memory, (uint8_t) (value >> 8));
+}
+
+static void directive(STATE *st, uint8_t *memory, const char *name, size_t len) {
+	if (len == 4 && !strncasecmp(name, ".org", 4)) {
+		st->unknown = 0;
+		int32_t value = expr(st);
+		if (st->unknown)
+			fail(st, ".org needs a known address");
+		st->pc = (uint16_t) value;
+		return;
+	}
+
+	uint8_t word = len == 5 && !strncasecmp(name, ".word", 5);
+	if (!word && !(len == 5 && !strncasecmp(name, ".byte", 5))) {
+		fail(st, "unknown directive '%.*s'", (int) len, name);
+		return;
+	}
+
+	do {
+		skip_space(st);
+		if (!word && *st->p == '"') {
+			st->p++;
+			while (*st->p && *st->p != '"' && *st->p != '\n')
+				emit(st, memory, (uint8_t) *st->p++);
+			if (*st->p != '"')
+				fail(st, "unterminated string");
+			else
+				st->p++;
+		} else {
+			int32_t value = expr(st);
+			emit(st, memory, (uint8_t) value);
+			if (word)
+				emit(st, memory, (uint8_t) (value >> 8));
+		}
+		skip_space(st);
+	} while (*st->p == ',' && st->p++);
+}
+
+static uint8_t pass(ASSEMBLER *as, const char *source, uint8_t *memory, uint8_t n) {
+	STATE st = { as, source, 0x8000, n, 0, 0 };
+	size_t index = 0;
+
+	as->line = 1;
+	while (*st.p && !st.failed) {
+		skip_space(&st);
+
+		if (is_name_start(*st.p)) {
+			const char *name = st.p;
+			while (is_name_char(*st.p))
+				st.p++;
+			size_t len = (size_t) (st.p - name);
+			skip_space(&st);
+
+			if (*st.p == ':') {
+				st.p++;
+				define_symbol(&st, name, len, st.pc);
+				skip_space(&st);
+				name = st.p;
+				while (is_name_char(*st.p))
+					st.p++;
+				len = (size_t) (st.p - name);
+			} else if (*st.p == '=') {
+				st.p++;
+				st.unknown = 0;
+				int32_t value = expr(&st);
+				if (st.unknown)
+					fail(&st, "constant '%.*s' uses an undefined symbol", (int) len, name);
+				define_symbol(&st, name, len, (uint16_t) value);
+				len = 0;
+			}
+
+			if (len && *name == '.') {
+				directive(&st, memory, name, len);
+			} else if (len == 3 && as->mnemonic_id[pack_mnemonic(name)]
+					&& isalpha((unsigned char) name[0]) && isalpha((unsigned char) name[1])
+					&& isalpha((unsigned char) name[2])) {
+				if (index == as->wide_cap) {
+					as->wide_cap *= 2;
+					as->wide = realloc(as->wide, as->wide_cap);
+				}
+				instruction(&st, memory, as->mnemonic_id[pack_mnemonic(name)], index++);
+			} else if (len) {
+				fail(&st, "unknown instruction '%.*s'", (int) len, name);
+			}
+		}
+
+		if (!at_end(&st))
+			fail(&st, "unexpected '%c'", *st.p);
+		while (*st.p && *st.p != '\n')
+			st.p++;
+		if (*st.p == '\n') {
+			st.p++;
+			if (!st.failed)
+				as->line += 1;
+		}
+	}
+
+	return !st.failed;
+}
+
+/// Assembles `source` into `memory` (64 KiB). Code starts at $8000 unless
+/// the source sets .org. Returns 0 on error, with as->error and as->line set.
+uint8_t assemble(ASSEMBLER *as, const char *source, uint8_t *memory) {
+	memset(as->symbols, 0, as->symbols_cap * sizeof(SYMBOL));
+	as->nsymbols = 0;
+	as->bytes = 0;
+	as->start = 0;
+	as->end = 0;
+	as->error[0] = 0;
+
+	return pass(as, source, memory, 1) && pass(as, source, memory, 2);
+}
+
+/// assemble() for a whole program: reset points at the code unless the
+/// source sets the vector.
+uint8_t assemble_program(ASSEMBLER *as, const char *source, uint8_t *memory) {
+	if (!assemble(as, source, memory))
+		return 0;
+	if (!(memory[0xFFFC] | memory[0xFFFD] << 8)) {
+		memory[0xFFFC] = (uint8_t) as->start;
+		memory[0xFFFD] = (uint8_t) (as->start >> 8);
+	}
+	return 1;
+}
+
+/// assemble_program() from a file. Returns 0 with `error` set on failure.
+uint8_t assemble_file(ASSEMBLER *as, const char *path, uint8_t *memory, char *error, size_t error_len) {
+	size_t len;
+	char *source = (char *) read_file(path, &len);
+	if (!source) {
+		snprintf(error, error_len, "cannot read");
+		return 0;
+	}
+	uint8_t ok = assemble_program(as, source, memory);
+	if (!ok)
+		snprintf(error, error_len, "line %lu: %s", as->line, as->error);
+	free(source);
+	return ok;
+}
+
+/// Whether the tools take `path` as assembler source, by its suffix.
+uint8_t asm_is_source(const char *path) {
+	size_t len = strlen(path);
+	return (len > 4 && !strcmp(path + len - 4, ".asm")) || (len > 2 && !strcmp(path + len - 2, ".s"));
+}
+
+/// What the tools take as a program: .asm and .s sources through the
+/// assembler, anything else as a raw image at $8000 like load(). Returns 0
+/// with `error` set on failure.
+uint8_t load_program(CPU *cpu, ASSEMBLER *as, const char *path, char *error, size_t error_len) {
+	if (asm_is_source(path))
+		return assemble_file(as, path, cpu->memory, error, error_len);
+
+	size_t len;
+	uint8_t *image = read_file(path, &len);
+	if (!image || len > MEMORY_SIZE - 0x8000) {
+		snprintf(error, error_len, image ? "image larger than 32 KiB" : "cannot read");
+		free(image);
+		return 0;
+	}
+	load(cpu, image, len);
+	free(image);
+	return 1;
+}
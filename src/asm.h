@@ -0,0 +1,82 @@
+#ifndef ASM_H
+#define ASM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cpu_6502.h"
+
+#define ASM_MAX_NAME	32
+#define ASM_MAX_ERROR	128
+
+/// # Assembler
+///
+/// Two-pass assembler writing straight into a 64 KiB memory image, with the
+/// encodings taken from `opcode_lookup_table`. Meant to be created once and
+/// reused for many programs.
+///
+///  - labels: `name:`, constants: `name = expr`
+///  - expressions: numbers ($hex, 0xhex, %bin, decimal, 'c'), symbols, `*`,
+///    + - * / & | ^ ~, < (low byte), > (high byte) and parentheses
+///  - directives: .org, .byte (numbers and "strings"), .word
+///  - operands: #imm, zp, zp,X, zp,Y, abs, abs,X, abs,Y, (zp,X), (zp),Y,
+///    (abs) and A or nothing for accumulator/implied
+///
+typedef enum {
+	ASM_IMPLIED,
+	ASM_IMMEDIATE,
+	ASM_ZEROPAGE,
+	ASM_ZEROPAGE_X,
+	ASM_ZEROPAGE_Y,
+	ASM_ABSOLUTE,
+	ASM_ABSOLUTE_X,
+	ASM_ABSOLUTE_Y,
+	ASM_INDIRECT_X,
+	ASM_INDIRECT_Y,
+	ASM_INDIRECT,
+	ASM_RELATIVE,
+	ASM_MODES,
+} ASM_MODE;
+
+typedef struct {
+	char name[ASM_MAX_NAME];
+	uint16_t value;
+	uint8_t used;
+} SYMBOL;
+
+typedef struct {
+	/* Mnemonic (3 letters packed in 15 bits) to index + 1, and encodings */
+	uint8_t mnemonic_id[1 << 15];
+	int16_t encoding[64][ASM_MODES];
+
+	SYMBOL *symbols;
+	size_t symbols_cap;
+	size_t nsymbols;
+
+	/* Operand size chosen in pass 1 for each instruction, reused in pass 2 */
+	uint8_t *wide;
+	size_t wide_cap;
+
+	/* Source line of each instruction's first byte (MEMORY_SIZE entries,
+	 * 0 elsewhere), filled by assemble() when set */
+	uint32_t *lines;
+
+	/* Result of the last assemble() */
+	uint16_t start;
+	uint16_t end;
+	size_t bytes;
+	size_t line;
+	char error[ASM_MAX_ERROR];
+} ASSEMBLER;
+
+void createASSEMBLER(ASSEMBLER *as);
+void destroyASSEMBLER(ASSEMBLER *as);
+
+uint8_t assemble(ASSEMBLER *as, const char *source, uint8_t *memory);
+uint8_t assemble_program(ASSEMBLER *as, const char *source, uint8_t *memory);
+uint8_t assemble_file(ASSEMBLER *as, const char *path, uint8_t *memory, char *error, size_t error_len);
+uint8_t asm_is_source(const char *path);
+uint8_t load_program(CPU *cpu, ASSEMBLER *as, const char *path, char *error, size_t error_len);
+uint8_t asm_symbol(ASSEMBLER *as, const char *name, uint16_t *value);
+
+#endif
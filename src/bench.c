@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "asm.h"
+#include "perf.h"
+#include "util.h"
+
+#define MAX_WORKLOADS	64
+#define STEP_LIMIT	1000000000ULL
+#define VARIANTS	(RICOH_2A03 + 1)
+
+/// # Benchmark
+///
+/// Runs each workload from reset to BRK on each core, as many times as
+/// fit in the time given, and reports emulated MIPS. With -p the host's
+/// instructions, cycles, branch misses and cache misses are counted
+/// around the runs and reported per emulated instruction, which tells a
+/// dispatch problem (branch misses in execute()'s switch) from a memory
+/// one (cache misses on the 64 KiB CPU struct).
+///
+/// The built in workloads lean on one thing each: `alu` is register
+/// arithmetic, so mostly dispatch; `memory` sums every page, so it walks
+/// the whole struct; `sort` bubble sorts pseudo random bytes, so the
+/// emulated branches are data dependent.
+///
+
+typedef struct {
+	const char *name;
+	const char *dispatch;
+	CPU_VARIANT variant;
+	uint8_t cycle_exact;
+} CORE;
+
+typedef struct {
+	char name[64];
+	uint8_t *memory;
+	/* Instructions from reset to BRK, BRK included, per variant */
+	uint64_t instructions[VARIANTS];
+} WORKLOAD;
+
+static const CORE cores[] = {
+	{ "nmos", "switch", NMOS_6502, 0 },
+	{ "65c02", "switch", CMOS_65C02, 0 },
+	{ "2a03", "switch", RICOH_2A03, 0 },
+	{ "nmos", "bus", NMOS_6502, 1 },
+	{ "65c02", "bus", CMOS_65C02, 1 },
+	{ "2a03", "bus", RICOH_2A03, 1 },
+};
+
+#define CORES	(sizeof(cores) / sizeof(cores[0]))
+
+static const struct {
+	const char *name;
+	const char *source;
+} builtins[] = {
+	{ "alu",
+		".org $8000\n"
+		"\tlda #64\n"
+		"\tsta $10\n"
+		"\tldx #0\n"
+		"\tldy #0\n"
+		"loop:\n"
+		"\ttxa\n"
+		"\tclc\n"
+		"\tadc #7\n"
+		"\teor #$5A\n"
+		"\tasl\n"
+		"\trol\n"
+		"\ttax\n"
+		"\tiny\n"
+		"\tbne loop\n"
+		"\tdec $10\n"
+		"\tbne loop\n"
+		"\tbrk\n" },
+	{ "memory",
+		".org $8000\n"
+		"\tlda #4\n"
+		"\tsta $12\n"
+		"pass:\n"
+		"\tlda #0\n"
+		"\tsta $10\n"
+		"\tlda #2\n"
+		"\tsta $11\n"
+		"\tldx #254\n"
+		"page:\n"
+		"\tldy #0\n"
+		"byte:\n"
+		"\tlda ($10),y\n"
+		"\tclc\n"
+		"\tadc $13\n"
+		"\tsta $13\n"
+		"\tiny\n"
+		"\tbne byte\n"
+		"\tinc $11\n"
+		"\tdex\n"
+		"\tbne page\n"
+		"\tdec $12\n"
+		"\tbne pass\n"
+		"\tbrk\n" },
+	{ "sort",
+		".org $8000\n"
+		"\tldx #0\n"
+		"\tlda #1\n"
+		"fill:\n"
+		"\tasl\n"
+		"\tbcc keep\n"
+		"\teor #$1D\n"
+		"keep:\n"
+		"\tsta $0300,x\n"
+		"\tinx\n"
+		"\tbne fill\n"
+		"outer:\n"
+		"\tldy #0\n"
+		"\tldx #0\n"
+		"inner:\n"
+		"\tlda $0300,x\n"
+		"\tcmp $0301,x\n"
+		"\tbcc next\n"
+		"\tbeq next\n"
+		"\tpha\n"
+		"\tlda $0301,x\n"
+		"\tsta $0300,x\n"
+		"\tpla\n"
+		"\tsta $0301,x\n"
+		"\tldy #1\n"
+		"next:\n"
+		"\tinx\n"
+		"\tcpx #$FF\n"
+		"\tbne inner\n"
+		"\tdey\n"
+		"\tbeq outer\n"
+		"\tbrk\n" },
+};
+
+static uint8_t assemble_workload(ASSEMBLER *as, WORKLOAD *w, const char *source) {
+	w->memory = calloc(MEMORY_SIZE, 1);
+	if (!assemble_program(as, source, w->memory)) {
+		fprintf(stderr, "%s: line %lu: %s\n", w->name, as->line, as->error);
+		return 0;
+	}
+	return 1;
+}
+
+static uint8_t load_workload(ASSEMBLER *as, WORKLOAD *w, const char *path) {
+	char error[ASM_MAX_ERROR + 32];
+	CPU *cpu = malloc(sizeof(CPU));
+
+	snprintf(w->name, sizeof(w->name), "%s", path);
+	createCPU(cpu);
+	uint8_t ok = load_program(cpu, as, path, error, sizeof(error));
+	if (ok) {
+		w->memory = malloc(MEMORY_SIZE);
+		memcpy(w->memory, cpu->memory, MEMORY_SIZE);
+	} else {
+		fprintf(stderr, "%s: %s\n", path, error);
+	}
+	free(cpu);
+	return ok;
+}
+
+static void setup(CPU *cpu, const CORE *core, const WORKLOAD *w) {
+#ifdef CPU_CYCLE_EXACT
+	if (core->cycle_exact)
+		createCPUCycleExact(cpu, core->variant);
+	else
+#endif
+		createCPUVariant(cpu, core->variant);
+	memcpy(cpu->memory, w->memory, MEMORY_SIZE);
+	reset(cpu);
+}
+
+/// Counts the instructions once per variant, on its fast core, so the
+/// timed runs are plain run() calls. The variants can take different
+/// paths through the same code.
+static uint8_t count_instructions(CPU *cpu, WORKLOAD *w) {
+	for (size_t c = 0; c < CORES; ++c) {
+		if (cores[c].cycle_exact)
+			continue;
+		uint64_t *n = &w->instructions[cores[c].variant];
+		setup(cpu, &cores[c], w);
+		for (*n = 1; step(cpu); ++*n) {
+			if (*n == STEP_LIMIT) {
+				fprintf(stderr, "%s: no BRK after %llu instructions on %s\n", w->name, STEP_LIMIT, cores[c].name);
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-p] [-t seconds] [-c switch|bus|core]... [-w workload]... [image.bin | source.asm]...\n"
+			"\truns each workload to BRK on each core and reports MIPS, -p adds host\n"
+			"\tcounters per emulated instruction. Cores are dispatch/variant, e.g. bus/nmos\n", name);
+}
+
+int main(int argc, char **argv) {
+	double seconds = 1;
+	uint8_t counters = 0;
+	const char *core_names[argc], *workload_names[argc];
+	int ncores = 0, nworkloads = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "pt:c:w:")) != -1) {
+		switch (opt) {
+			case 'p': counters = 1; break;
+			case 't': seconds = strtod(optarg, NULL); break;
+			case 'c': core_names[ncores++] = optarg; break;
+			case 'w': workload_names[nworkloads++] = optarg; break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+
+	static WORKLOAD workloads[MAX_WORKLOADS];
+	size_t n = 0;
+	ASSEMBLER as;
+	createASSEMBLER(&as);
+	for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i) {
+		uint8_t wanted = !nworkloads;
+		for (int k = 0; k < nworkloads; ++k)
+			wanted |= !strcmp(workload_names[k], builtins[i].name);
+		if (!wanted)
+			continue;
+		snprintf(workloads[n].name, sizeof(workloads[n].name), "%s", builtins[i].name);
+		if (!assemble_workload(&as, &workloads[n], builtins[i].source))
+			return 1;
+		n += 1;
+	}
+	for (int i = optind; i < argc; ++i) {
+		if (n == MAX_WORKLOADS) {
+			fprintf(stderr, "%s: more than %d workloads\n", argv[i], MAX_WORKLOADS);
+			return 1;
+		}
+		if (!load_workload(&as, &workloads[n], argv[i]))
+			return 1;
+		n += 1;
+	}
+	destroyASSEMBLER(&as);
+	if (!n) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	CPU *cpu = malloc(sizeof(CPU));
+	for (size_t i = 0; i < n; ++i)
+		if (!count_instructions(cpu, &workloads[i]))
+			return 1;
+
+	PERF perf;
+	if (counters && !createPERF(&perf)) {
+		fprintf(stderr, "perf_event_open: %s, running without counters\n", strerror(perf.error));
+		destroyPERF(&perf);
+		counters = 0;
+	}
+
+	printf("%-12s %-12s %12s %8s %9s", "workload", "core", "instructions", "runs", "MIPS");
+	if (counters)
+		printf(" %10s %10s %10s %10s", "host-ins", "host-cyc", "br-miss", "cache-miss");
+	printf("\n");
+
+	for (size_t i = 0; i < n; ++i) {
+		WORKLOAD *w = &workloads[i];
+		for (size_t c = 0; c < CORES; ++c) {
+			const CORE *core = &cores[c];
+			char name[32];
+			snprintf(name, sizeof(name), "%s/%s", core->dispatch, core->name);
+			uint8_t wanted = !ncores;
+			for (int k = 0; k < ncores; ++k)
+				wanted |= !strcmp(core_names[k], name) || !strcmp(core_names[k], core->dispatch)
+					|| !strcmp(core_names[k], core->name);
+#ifndef CPU_CYCLE_EXACT
+			wanted &= !core->cycle_exact;
+#endif
+			if (!wanted)
+				continue;
+
+			// setup and its 64 KiB copy stay outside the measurement
+			uint64_t runs = 0;
+			double elapsed = 0;
+			if (counters)
+				perf_clear(&perf);
+			do {
+				setup(cpu, core, w);
+				double start = now();
+				if (counters)
+					perf_start(&perf);
+				run(cpu);
+				if (counters)
+					perf_stop(&perf);
+				elapsed += now() - start;
+				runs += 1;
+			} while (elapsed < seconds);
+
+			uint64_t instructions = w->instructions[core->variant];
+			double total = (double) (instructions * runs);
+			printf("%-12s %-12s %12lu %8lu %9.1f", w->name, name, instructions, runs, total / elapsed / 1e6);
+			for (int k = 0; counters && k < PERF_COUNTERS; ++k) {
+				if (perf_available(&perf, (PERF_COUNTER) k))
+					printf(" %10.3f", (double) perf.counts[k] / total);
+				else
+					printf(" %10s", "-");
+			}
+			printf("\n");
+		}
+	}
+	if (counters) {
+		printf("host counters per emulated instruction:");
+		for (int k = 0; k < PERF_COUNTERS; ++k)
+			printf(" %s%s", perf_name((PERF_COUNTER) k), k + 1 < PERF_COUNTERS ? "," : "\n");
+		destroyPERF(&perf);
+	}
+
+	for (size_t i = 0; i < n; ++i)
+		free(workloads[i].memory);
+	free(cpu);
+	return 0;
+}
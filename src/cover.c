@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "archive.h"
+#include "asm.h"
+#include "coverage.h"
+#include "util.h"
+
+typedef struct {
+	const char *path;
+	/* From the suite's archive rather than a file */
+	uint8_t packed;
+	uint32_t program;
+	uint64_t cycles;
+	uint8_t loaded;
+	uint8_t halted;
+	char error[ASM_MAX_ERROR + 32];
+} TEST;
+
+typedef struct {
+	TEST *tests;
+	size_t ntests;
+	uint64_t cycle_limit;
+	_Atomic size_t next;
+	ARCHIVE archive;
+
+	pthread_mutex_t lock;
+	COVERAGE *total;
+} SUITE;
+
+static void *cover_worker(void *arg) {
+	SUITE *suite = arg;
+	CPU *cpu = malloc(sizeof(CPU));
+	COVERAGE *cov = malloc(sizeof(COVERAGE));
+	ASSEMBLER as;
+
+	createASSEMBLER(&as);
+	createCOVERAGE(cov, NULL);
+	for (size_t i; (i = atomic_fetch_add(&suite->next, 1)) < suite->ntests;) {
+		TEST *test = &suite->tests[i];
+		createCPU(cpu);
+		// archived programs come with their registers, they are their own reset
+		if (test->packed)
+			archive_load(&suite->archive, test->program, cpu);
+		else if (!(test->loaded = load_program(cpu, &as, test->path, test->error, sizeof(test->error))))
+			continue;
+		else
+			reset(cpu);
+		test->loaded = 1;
+		// every test adds to the same maps
+		cpu->coverage = cov->maps;
+		test->halted = !run_cycles(cpu, suite->cycle_limit);
+		test->cycles = cpu->cycles;
+		destroyCPU(cpu);
+	}
+
+	pthread_mutex_lock(&suite->lock);
+	coverage_merge(suite->total, cov);
+	pthread_mutex_unlock(&suite->lock);
+
+	destroyCOVERAGE(cov, NULL);
+	destroyASSEMBLER(&as);
+	free(cov);
+	free(cpu);
+	return NULL;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-j jobs] [-c cycle_limit] [-i in.cov]... [-o out.cov] [-l listing.asm]\n"
+			"\t[-r report.info] [-t test_name] [-a tests.pak] [test.bin | test.asm]...\n"
+			"\truns every test from reset to BRK and merges their coverage, -a adds\n"
+			"\tevery program of an archive built by pack\n", name);
+}
+
+int main(int argc, char **argv) {
+	uint32_t jobs = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t cycle_limit = 100000000;
+	const char *inputs[argc];
+	size_t ninputs = 0;
+	const char *out_file = NULL, *listing = NULL, *report = NULL, *test_name = "cover", *archive = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "j:c:i:o:l:r:t:a:")) != -1) {
+		switch (opt) {
+			case 'j': jobs = (uint32_t) strtoul(optarg, NULL, 0); break;
+			case 'c': cycle_limit = strtoull(optarg, NULL, 0); break;
+			case 'i': inputs[ninputs++] = optarg; break;
+			case 'o': out_file = optarg; break;
+			case 'l': listing = optarg; break;
+			case 'r': report = optarg; break;
+			case 't': test_name = optarg; break;
+			case 'a': archive = optarg; break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (!jobs || (optind == argc && !ninputs && !archive)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	COVERAGE *total = malloc(sizeof(COVERAGE));
+	createCOVERAGE(total, NULL);
+	for (size_t i = 0; i < ninputs; ++i) {
+		if (!coverage_load(total, inputs[i])) {
+			fprintf(stderr, "%s: not a coverage file\n", inputs[i]);
+			return 1;
+		}
+	}
+
+	SUITE suite = { .ntests = (size_t) (argc - optind), .cycle_limit = cycle_limit, .total = total };
+	if (archive && !createARCHIVE(&suite.archive, archive)) {
+		fprintf(stderr, "%s: not a program archive\n", archive);
+		return 1;
+	}
+	suite.tests = calloc(suite.ntests + suite.archive.count + 1, sizeof(TEST));
+	for (size_t i = 0; i < suite.ntests; ++i)
+		suite.tests[i].path = argv[optind + i];
+	for (uint32_t i = 0; i < suite.archive.count; ++i) {
+		TEST *test = &suite.tests[suite.ntests++];
+		test->path = archive_name(&suite.archive, i);
+		test->packed = 1;
+		test->program = i;
+	}
+	atomic_init(&suite.next, 0);
+	pthread_mutex_init(&suite.lock, NULL);
+
+	if (jobs > suite.ntests)
+		jobs = suite.ntests ? (uint32_t) suite.ntests : 1;
+	pthread_t threads[jobs];
+	for (uint32_t i = 0; i < jobs; ++i)
+		pthread_create(&threads[i], NULL, cover_worker, &suite);
+	for (uint32_t i = 0; i < jobs; ++i)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&suite.lock);
+
+	int ret = 0;
+	for (size_t i = 0; i < suite.ntests; ++i) {
+		TEST *test = &suite.tests[i];
+		if (!test->loaded) {
+			fprintf(stderr, "%s: %s\n", test->path, test->error);
+			ret = 1;
+		} else {
+			printf("%s: %s after %lu cycles\n", test->path, test->halted ? "BRK" : "stopped", test->cycles);
+		}
+	}
+
+	size_t taken = coverage_count(total, COVER_TAKEN), not_taken = coverage_count(total, COVER_NOT_TAKEN);
+	size_t both = 0;
+	for (size_t i = 0; i < COVER_WORDS; ++i)
+		both += (size_t) __builtin_popcountll(total->maps[COVER_TAKEN][i] & total->maps[COVER_NOT_TAKEN][i]);
+	printf("%lu instructions executed, %lu branches: %lu both ways, %lu taken only, %lu not taken only\n",
+		coverage_count(total, COVER_EXEC), taken + not_taken - both, both, taken - both, not_taken - both);
+
+	if (out_file && !coverage_save(total, out_file)) {
+		perror(out_file);
+		ret = 1;
+	}
+
+	if (report) {
+		uint8_t *memory = NULL;
+		uint32_t *lines = NULL;
+		if (listing) {
+			ASSEMBLER as;
+			char error[ASM_MAX_ERROR + 32];
+			createASSEMBLER(&as);
+			memory = calloc(MEMORY_SIZE, 1);
+			lines = as.lines = calloc(MEMORY_SIZE, sizeof(uint32_t));
+			if (!assemble_file(&as, listing, memory, error, sizeof(error))) {
+				fprintf(stderr, "%s: %s\n", listing, error);
+				return 1;
+			}
+			destroyASSEMBLER(&as);
+		}
+
+		FILE *f = fopen(report, "w");
+		if (!f) {
+			perror(report);
+			return 1;
+		}
+		coverage_lcov(total, f, test_name, listing ? listing : "memory", lines, memory);
+		fclose(f);
+		free(lines);
+		free(memory);
+	}
+
+	destroyCOVERAGE(total, NULL);
+	destroyARCHIVE(&suite.archive);
+	free(total);
+	free(suite.tests);
+	return ret;
+}
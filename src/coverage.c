@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "coverage.h"
+
+static inline uint8_t covered(COVERAGE *cov, int kind, uint32_t add) {
+	return (cov->maps[kind][add >> 6] >> (add & 63)) & 1;
+}
+
+/// Conditional branches, all encoded as xxx10000
+static inline uint8_t is_branch(uint8_t code) {
+	return (code & 0x1F) == 0x10;
+}
+
+void createCOVERAGE(COVERAGE *cov, CPU *cpu) {
+	memset(cov->maps, 0, sizeof(cov->maps));
+	if (cpu)
+		cpu->coverage = cov->maps;
+}
+
+void destroyCOVERAGE(COVERAGE *cov, CPU *cpu) {
+	(void) cov;
+	if (cpu)
+		cpu->coverage = NULL;
+}
+
+void coverage_merge(COVERAGE *cov, const COVERAGE *other) {
+	for (int kind = 0; kind < 3; ++kind)
+		for (size_t i = 0; i < COVER_WORDS; ++i)
+			cov->maps[kind][i] |= other->maps[kind][i];
+}
+
+uint8_t coverage_save(COVERAGE *cov, const char *path) {
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return 0;
+	char magic[8] = COVERAGE_MAGIC;
+	uint32_t version = COVERAGE_VERSION;
+	uint8_t ok = fwrite(magic, sizeof(magic), 1, f) == 1
+		&& fwrite(&version, sizeof(version), 1, f) == 1
+		&& fwrite(cov->maps, sizeof(cov->maps), 1, f) == 1;
+	return fclose(f) == 0 && ok;
+}
+
+/// Merges the maps saved in `path` into `cov`.
+uint8_t coverage_load(COVERAGE *cov, const char *path) {
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return 0;
+	char magic[8];
+	uint32_t version;
+	COVERAGE *saved = malloc(sizeof(COVERAGE));
+	uint8_t ok = fread(magic, sizeof(magic), 1, f) == 1 && !memcmp(magic, COVERAGE_MAGIC, sizeof(magic))
+		&& fread(&version, sizeof(version), 1, f) == 1 && version == COVERAGE_VERSION
+		&& fread(saved->maps, sizeof(saved->maps), 1, f) == 1;
+	fclose(f);
+	if (ok)
+		coverage_merge(cov, saved);
+	free(saved);
+	return ok;
+}
+
+/// Number of bits set in one of the maps, COVER_*.
+size_t coverage_count(COVERAGE *cov, int kind) {
+	size_t count = 0;
+	for (size_t i = 0; i < COVER_WORDS; ++i)
+		count += (size_t) __builtin_popcountll(cov->maps[kind][i]);
+	return count;
+}
+
+/// Writes an lcov tracefile for `source`. With `lines` (see ASSEMBLER)
+/// every instruction is reported under its source line, executed or not.
+/// Without, only executed addresses are known and each is reported with
+/// its address as the line number. `memory` holds the code so branches
+/// that never ran are counted too; without it only those seen are.
+void coverage_lcov(COVERAGE *cov, FILE *out, const char *test, const char *source,
+		const uint32_t *lines, const uint8_t *memory) {
+	size_t found = 0, hit = 0, branches = 0, branches_hit = 0;
+
+	fprintf(out, "TN:%s\nSF:%s\n", test, source);
+	for (uint32_t add = 0; add < MEMORY_SIZE; ++add) {
+		uint8_t executed = covered(cov, COVER_EXEC, add);
+		uint32_t line = lines ? lines[add] : add;
+		if (lines ? !line : !executed)
+			continue;
+		fprintf(out, "DA:%u,%u\n", line, executed);
+		found += 1;
+		hit += executed;
+
+		uint8_t taken = covered(cov, COVER_TAKEN, add);
+		uint8_t not_taken = covered(cov, COVER_NOT_TAKEN, add);
+		if (memory ? !is_branch(memory[add]) : !(taken | not_taken))
+			continue;
+		if (executed)
+			fprintf(out, "BRDA:%u,0,0,%u\nBRDA:%u,0,1,%u\n", line, taken, line, not_taken);
+		else
+			fprintf(out, "BRDA:%u,0,0,-\nBRDA:%u,0,1,-\n", line, line);
+		branches += 2;
+		branches_hit += taken + not_taken;
+	}
+	fprintf(out, "BRF:%lu\nBRH:%lu\nLF:%lu\nLH:%lu\nend_of_record\n", branches, branches_hit, found, hit);
+}
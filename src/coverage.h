@@ -0,0 +1,38 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cpu_6502.h"
+
+#define COVERAGE_MAGIC		"6502COV"
+#define COVERAGE_VERSION	1
+
+/// # Coverage
+///
+/// Execution coverage for a cpu built with CPU_COVERAGE: one bit per
+/// address for the instructions executed, and per branch instruction one
+/// bit for each outcome seen. Without the flag the hooks in the opcode
+/// fetch and branch() compile to nothing. Maps are merged by or-ing them,
+/// so runs can go on any number of cpus, threads or processes (through
+/// coverage_save() and coverage_load()) in any order.
+///
+/// File layout: COVERAGE_MAGIC, COVERAGE_VERSION (u32), the three maps.
+///
+typedef struct {
+	uint64_t maps[3][COVER_WORDS];
+} COVERAGE;
+
+void createCOVERAGE(COVERAGE *cov, CPU *cpu);
+void destroyCOVERAGE(COVERAGE *cov, CPU *cpu);
+
+void coverage_merge(COVERAGE *cov, const COVERAGE *other);
+uint8_t coverage_save(COVERAGE *cov, const char *path);
+uint8_t coverage_load(COVERAGE *cov, const char *path);
+
+size_t coverage_count(COVERAGE *cov, int kind);
+void coverage_lcov(COVERAGE *cov, FILE *out, const char *test, const char *source,
+	const uint32_t *lines, const uint8_t *memory);
+
+#endif
@@ -1,5 +1,49 @@
 #include "cpu_6502.h"
 
+#ifdef CPU_FUZZ
+/// AFL style edge coverage: hash the destination and count the
+/// (previous, current) pair, shifting prev so A->B and B->A differ.
+static inline void edge(CPU *cpu, uint16_t to) {
+	uint16_t cur = (uint16_t) (to * 40503u);
+	cpu->edge_map[cur ^ cpu->prev_loc] += 1;
+	cpu->prev_loc = cur >> 1;
+}
+#define EDGE(cpu, to) edge(cpu, to)
+#else
+#define EDGE(cpu, to)
+#endif
+
+#ifdef CPU_HEATMAP
+static inline void heat(CPU *cpu, uint16_t add, int kind) {
+	if (!cpu->heat_pages)
+		return;
+	cpu->heat_pages[add >> 8][kind] += 1;
+	if (cpu->heat_bytes)
+		cpu->heat_bytes[add][kind] += 1;
+}
+#define HEAT(cpu, add, kind) heat(cpu, add, kind)
+#else
+#define HEAT(cpu, add, kind)
+#endif
+
+#ifdef CPU_COVERAGE
+static inline void cover(CPU *cpu, uint16_t add, int kind) {
+	if (cpu->coverage)
+		cpu->coverage[kind][add >> 6] |= 1ULL << (add & 63);
+}
+#define COVER(cpu, add, kind) cover(cpu, add, kind)
+#else
+#define COVER(cpu, add, kind)
+#endif
+
+#ifdef CPU_PROFILE
+#define PROF_CALL(cpu, to, pushed) do { if (cpu->profiler) prof_call(cpu, to, pushed); } while (0)
+#define PROF_RETURN(cpu) do { if (cpu->profiler) prof_return(cpu); } while (0)
+#else
+#define PROF_CALL(cpu, to, pushed)
+#define PROF_RETURN(cpu)
+#endif
+
 void createCPU(CPU *cpu) {
 	cpu->register_a = 0;
 	cpu->register_x = 0;
@@ -7,16 +51,102 @@ void createCPU(CPU *cpu) {
 	cpu->status = NEGATIV | INTERRUPT_DISABLE;
 	cpu->program_counter = 0;
 	cpu->stack_pointer = STACK_RESET;
-	memset(cpu->memory, 0, 0xFFFF);
+	cpu->cycles = 0;
+	cpu->variant = NMOS_6502;
+#ifdef CPU_DIRTY_PAGES
+	memset(cpu->dirty, 0, sizeof(cpu->dirty));
+#endif
+#ifdef CPU_FUZZ
+	cpu->edge_map = NULL;
+	cpu->prev_loc = 0;
+	cpu->fault = 0;
+#endif
+#ifdef CPU_WATCH
+	cpu->watch = -1;
+	cpu->watch_hit = 0;
+#endif
+#ifdef CPU_HEATMAP
+	cpu->heat_pages = NULL;
+	cpu->heat_bytes = NULL;
+#endif
+#ifdef CPU_COVERAGE
+	cpu->coverage = NULL;
+#endif
+#ifdef CPU_HLE
+	cpu->hle = NULL;
+#endif
+#ifdef CPU_PROFILE
+	cpu->profiler = NULL;
+#endif
+#ifdef CPU_IO
+	cpu->io_input = -1;
+	cpu->io_pending = 0;
+	cpu->io_out_lo = 1;
+	cpu->io_out_hi = 0;
+	cpu->io_yield = YIELD_NONE;
+	cpu->io_addr = 0;
+	cpu->io_value = 0;
+#endif
+#ifdef CPU_MMIO
+	memset(cpu->devices, 0, sizeof(cpu->devices));
+#endif
+#ifdef CPU_CYCLE_EXACT
+	cpu->cycle_exact = 0;
+	cpu->cycle_hook = NULL;
+	cpu->cycle_data = NULL;
+#endif
+#ifdef CPU_SHARED_BUS
+	for (int page = 0; page < 0x100; ++page) {
+		cpu->read_pages[page] = &cpu->memory[page << 8];
+		cpu->write_pages[page] = &cpu->memory[page << 8];
+	}
+#endif
+	memset(cpu->memory, 0, MEMORY_SIZE);
+}
+
+/// Same as createCPU() but for another member of the family, see CPU_VARIANT.
+void createCPUVariant(CPU *cpu, CPU_VARIANT variant) {
+	createCPU(cpu);
+	cpu->variant = variant;
 }
 
+#ifdef CPU_CYCLE_EXACT
+/// Same as createCPUVariant() but executed by the bus level core.
+void createCPUCycleExact(CPU *cpu, CPU_VARIANT variant) {
+	createCPUVariant(cpu, variant);
+	cpu->cycle_exact = 1;
+}
+#endif
+
 void destroyCPU(CPU *cpu) {
 	(void) cpu;
 	return;
 }
 
-uint8_t mem_read(CPU *cpu, uint16_t add) {
+static inline uint8_t bus_read(CPU *cpu, uint16_t add) {
+#ifdef CPU_SHARED_BUS
+	return cpu->read_pages[add >> 8][add & 0xFF];
+#else
 	return cpu->memory[add];
+#endif
+}
+
+uint8_t mem_read(CPU *cpu, uint16_t add) {
+	HEAT(cpu, add, HEAT_READ);
+#ifdef CPU_IO
+	// reading consumes the fed value, reading nothing suspends
+	if (add == cpu->io_input) {
+		if (!cpu->io_pending)
+			cpu->io_yield = YIELD_INPUT;
+		cpu->io_pending = 0;
+	}
+#endif
+#ifdef CPU_MMIO
+	const DEVICE *device = cpu->devices[add >> 8];
+	if (device)
+		return device->read(device->data, add);
+#endif
+	return bus_read(cpu, add);
 }
 
 uint16_t mem_read_u16(CPU *cpu, uint16_t add) {
@@ -26,8 +156,46 @@ uint16_t mem_read_u16(CPU *cpu, uint16_t add) {
 }
 
 void mem_write(CPU *cpu, uint16_t add, uint8_t data) {
+#ifdef CPU_IO
+	// the instruction will run again once input is fed
+	if (cpu->io_yield == YIELD_INPUT)
+		return;
+	if (add >= cpu->io_out_lo && add <= cpu->io_out_hi) {
+		cpu->io_yield = YIELD_OUTPUT;
+		cpu->io_addr = add;
+		cpu->io_value = data;
+	}
+#endif
+	HEAT(cpu, add, HEAT_WRITE);
+#ifdef CPU_DIRTY_PAGES
+	cpu->dirty[add >> 14] |= 1ULL << ((add >> 8) & 63);
+#endif
+#ifdef CPU_WATCH
+	if (add == cpu->watch)
+		cpu->watch_hit = 1;
+#endif
+#ifdef CPU_MMIO
+	const DEVICE *device = cpu->devices[add >> 8];
+	if (device) {
+		device->write(device->data, add, data);
+		return;
+	}
+#endif
+#ifdef CPU_SHARED_BUS
+	cpu->write_pages[add >> 8][add & 0xFF] = data;
+#else
 	cpu->memory[add] = data;
+#endif
+}
+
+#ifdef CPU_MMIO
+/// Hands pages `first_page` to `first_page + pages - 1` to `device`, NULL
+/// gives them back to memory.
+void map_device(CPU *cpu, uint8_t first_page, uint16_t pages, const DEVICE *device) {
+	for (uint16_t page = first_page; page < first_page + pages && page < 0x100; ++page)
+		cpu->devices[page] = device;
 }
+#endif
 
 void mem_write_u16(CPU *cpu, uint16_t add, uint16_t data) {
 	uint8_t hi = (uint8_t) (data >> 8);
@@ -55,8 +223,9 @@ void stack_push(CPU *cpu, uint8_t data) {
 void stack_push_u16(CPU *cpu, uint16_t data) {
 	uint8_t hi = (uint8_t) (data >> 8);
 	uint8_t lo = (uint8_t) (data & 0xFF);
-	stack_push(cpu, lo);
+	// high byte first, so stack_pop_u16() gets the low byte first
 	stack_push(cpu, hi);
+	stack_push(cpu, lo);
 }
 
 uint16_t get_operand_address(CPU *cpu, AddressingMode mode) {
@@ -74,11 +243,11 @@ uint16_t get_operand_address(CPU *cpu, AddressingMode mode) {
 		break;
 
 		case ZeroPage_X:
-			return (uint16_t) ((uint16_t) mem_read(cpu, cpu->program_counter) + (uint16_t) cpu->register_x);
+			return (uint16_t) (uint8_t) (mem_read(cpu, cpu->program_counter) + cpu->register_x);
 		break;
 
 		case ZeroPage_Y:
-			return (uint16_t) ((uint16_t) mem_read(cpu, cpu->program_counter) + (uint16_t) cpu->register_y);
+			return (uint16_t) (uint8_t) (mem_read(cpu, cpu->program_counter) + cpu->register_y);
 		break;
 
 		case Absolute_X:
@@ -108,6 +277,15 @@ uint16_t get_operand_address(CPU *cpu, AddressingMode mode) {
 			}
 		break;
 
+		case ZeroPage_Indirect:
+			{
+				uint8_t ptr = mem_read(cpu, cpu->program_counter);
+				uint16_t lo = mem_read(cpu, (uint16_t) ptr);
+				uint16_t hi = mem_read(cpu, (uint16_t) (uint8_t) (ptr + 1));
+				return ((uint16_t) hi) << 8 | (uint16_t) lo;
+			}
+		break;
+
 		case NoneAddressing:
 			assert(0 && "Mode not supported");
 		break;
@@ -116,6 +294,19 @@ uint16_t get_operand_address(CPU *cpu, AddressingMode mode) {
 	return 0;
 }
 
+/// Operand address for instructions that only read it: indexing across a
+/// page costs them one more cycle.
+static inline uint16_t read_operand_address(CPU *cpu, AddressingMode mode) {
+	uint16_t addr = get_operand_address(cpu, mode);
+	uint16_t base = addr;
+	if (mode == Absolute_X)
+		base -= cpu->register_x;
+	else if (mode == Absolute_Y || mode == Indirect_Y)
+		base -= cpu->register_y;
+	cpu->cycles += (base ^ addr) >> 8 ? 1 : 0;
+	return addr;
+}
+
 void load_and_run(CPU *cpu, uint8_t *program, size_t len) {
 	load(cpu, program, len);
 	reset(cpu);
@@ -135,419 +326,712 @@ void reset(CPU *cpu) {
 	cpu->register_y = 0;
 	cpu->status = NEGATIV | INTERRUPT_DISABLE;
 	cpu->stack_pointer = STACK_RESET;
+	cpu->cycles = 0;
 	cpu->program_counter = mem_read_u16(cpu, 0xFFFC);
 }
 
+/// Saves the full machine state into `snap` and starts a new dirty page epoch.
+void snapshot(CPU *cpu, CPU *snap) {
+	memcpy(snap, cpu, sizeof(CPU));
+#ifdef CPU_DIRTY_PAGES
+	memset(cpu->dirty, 0, sizeof(cpu->dirty));
+#endif
+}
+
+/// Puts `cpu` back into the state saved by snapshot(). With CPU_DIRTY_PAGES
+/// only the pages written since then are copied back.
+void restore(CPU *cpu, CPU *snap) {
+	cpu->register_a = snap->register_a;
+	cpu->register_x = snap->register_x;
+	cpu->register_y = snap->register_y;
+	cpu->status = snap->status;
+	cpu->program_counter = snap->program_counter;
+	cpu->stack_pointer = snap->stack_pointer;
+	cpu->cycles = snap->cycles;
+#ifdef CPU_FUZZ
+	cpu->prev_loc = 0;
+	cpu->fault = 0;
+#endif
+#ifdef CPU_IO
+	cpu->io_pending = 0;
+	cpu->io_yield = YIELD_NONE;
+#endif
+#ifdef CPU_DIRTY_PAGES
+	for (int i = 0; i < 4; ++i) {
+		while (cpu->dirty[i]) {
+			int page = i * 64 + __builtin_ctzll(cpu->dirty[i]);
+			memcpy(&cpu->memory[page << 8], &snap->memory[page << 8], 0x100);
+			cpu->dirty[i] &= cpu->dirty[i] - 1;
+		}
+	}
+#else
+	memcpy(cpu->memory, snap->memory, MEMORY_SIZE);
+#endif
+}
+
+/* One specialized interpreter per variant, see execute() */
+static uint8_t step_nmos(CPU *cpu);
+static uint8_t step_65c02(CPU *cpu);
+static uint8_t step_2a03(CPU *cpu);
+
+#ifdef CPU_CYCLE_EXACT
+/* The bus level core, specialized the same way, see the end of the file */
+typedef uint8_t (*STEP_FN)(CPU *cpu);
+static STEP_FN cycle_stepper(CPU_VARIANT variant);
+#endif
+
+/* The loops pick the variant once, not per instruction */
 void run(CPU *cpu) {
-	while (1) {
-		uint8_t code = mem_read(cpu, cpu->program_counter);
-		cpu->program_counter += 1;
-		uint16_t program_counter_state = cpu->program_counter;
-
-		OPCODE opcode = opcode_lookup_table[code];
-
-		switch (code) {
-			/* ADC */
-			case 0x69:
-			case 0x65:
-			case 0x75:
-			case 0x6D:
-			case 0x7D:
-			case 0x79:
-			case 0x61:
-			case 0x71:
-                		adc(cpu, opcode.mode);
+#ifdef CPU_CYCLE_EXACT
+	if (cpu->cycle_exact) {
+		STEP_FN step_fn = cycle_stepper(cpu->variant);
+		while (step_fn(cpu));
+		return;
+	}
+#endif
+	switch (cpu->variant) {
+		case CMOS_65C02: while (step_65c02(cpu)); break;
+		case RICOH_2A03: while (step_2a03(cpu)); break;
+		default: while (step_nmos(cpu)); break;
+	}
+}
+
+static uint8_t run_until(CPU *cpu, uint64_t target, uint8_t (*step_fn)(CPU *cpu)) {
+	while (cpu->cycles < target) {
+		if (!step_fn(cpu))
+			return 0;
+	}
+	return 1;
+}
+
+/// Runs until at least `budget` more cycles have elapsed.
+/// Returns 0 if the program hit BRK before the budget ran out.
+uint8_t run_cycles(CPU *cpu, uint64_t budget) {
+	uint64_t target = cpu->cycles + budget;
+#ifdef CPU_CYCLE_EXACT
+	if (cpu->cycle_exact)
+		return run_until(cpu, target, cycle_stepper(cpu->variant));
+#endif
+	switch (cpu->variant) {
+		case CMOS_65C02: return run_until(cpu, target, step_65c02);
+		case RICOH_2A03: return run_until(cpu, target, step_2a03);
+		default: return run_until(cpu, target, step_nmos);
+	}
+}
+
+#ifdef CPU_IO
+/// Polls `input` (-1 for none) and treats writes to `out_lo`-`out_hi` as
+/// output, an empty range (out_lo > out_hi) for none.
+void io_attach(CPU *cpu, int32_t input, uint16_t out_lo, uint16_t out_hi) {
+	cpu->io_input = input;
+	cpu->io_pending = 0;
+	cpu->io_out_lo = out_lo;
+	cpu->io_out_hi = out_hi;
+}
+
+/// Data for the next read of the input address.
+void io_feed(CPU *cpu, uint8_t value) {
+	if (cpu->io_input >= 0)
+		mem_write(cpu, (uint16_t) cpu->io_input, value);
+	cpu->io_pending = 1;
+}
+
+static YIELD_REASON resume_until(CPU *cpu, uint64_t target, uint8_t (*step_fn)(CPU *cpu)) {
+	while (cpu->cycles < target) {
+		// enough to roll back an instruction that read missing input
+		uint8_t a = cpu->register_a, x = cpu->register_x, y = cpu->register_y;
+		uint8_t status = cpu->status, sp = cpu->stack_pointer;
+		uint16_t pc = cpu->program_counter;
+		uint64_t cycles = cpu->cycles;
+
+		cpu->io_yield = YIELD_NONE;
+		if (!step_fn(cpu))
+			return YIELD_BRK;
+		if (cpu->io_yield == YIELD_INPUT) {
+			cpu->register_a = a;
+			cpu->register_x = x;
+			cpu->register_y = y;
+			cpu->status = status;
+			cpu->stack_pointer = sp;
+			cpu->program_counter = pc;
+			cpu->cycles = cycles;
+			// the host can write memory again until the next resume()
+			cpu->io_yield = YIELD_NONE;
+			return YIELD_INPUT;
+		}
+		if (cpu->io_yield)
+			return (YIELD_REASON) cpu->io_yield;
+	}
+	return YIELD_BUDGET;
+}
+
+/// Runs until an I/O event, BRK or `budget` more cycles (0 for no limit),
+/// see YIELD_REASON. Everything is kept in `cpu`, so calling it again
+/// continues exactly where it stopped.
+YIELD_REASON resume(CPU *cpu, uint64_t budget) {
+	uint64_t target = budget ? cpu->cycles + budget : UINT64_MAX;
+#ifdef CPU_CYCLE_EXACT
+	if (cpu->cycle_exact)
+		return resume_until(cpu, target, cycle_stepper(cpu->variant));
+#endif
+	switch (cpu->variant) {
+		case CMOS_65C02: return resume_until(cpu, target, step_65c02);
+		case RICOH_2A03: return resume_until(cpu, target, step_2a03);
+		default: return resume_until(cpu, target, step_nmos);
+	}
+}
+#endif
+
+/// Executes up to `n` instructions recording the registers into `out`.
+/// Stops after BRK, when `out->stop` says so, or before reaching
+/// `out->stop_pc` (unless that is where the batch starts, so a caller can
+/// resume from it). Returns the number of rows written.
+size_t run_steps(CPU *cpu, size_t n, TRACE *out) {
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		if (cpu->program_counter == out->stop_pc && i)
 			break;
 
+		if (out->program_counter) out->program_counter[i] = cpu->program_counter;
+		if (out->register_a) out->register_a[i] = cpu->register_a;
+		if (out->register_x) out->register_x[i] = cpu->register_x;
+		if (out->register_y) out->register_y[i] = cpu->register_y;
+		if (out->status) out->status[i] = cpu->status;
+		if (out->stack_pointer) out->stack_pointer[i] = cpu->stack_pointer;
+		if (out->cycles) out->cycles[i] = cpu->cycles;
+
+		if (!step(cpu) || (out->stop && out->stop(cpu, out->data)))
+			return i + 1;
+	}
+
+	return i;
+}
+
+/* Variant dependent instructions, defined with the others below */
+static inline void adc_variant(CPU *cpu, AddressingMode mode, const CPU_VARIANT variant);
+static inline void sbc_variant(CPU *cpu, AddressingMode mode, const CPU_VARIANT variant);
+static inline void jmp_indirect_variant(CPU *cpu, const CPU_VARIANT variant);
+
+/// Executes a single instruction, returns 0 on BRK. Only ever called with a
+/// constant `variant`, so each step_*() below is a specialized copy and
+/// opcodes the variant lacks are rejected through its table.
+static inline __attribute__((always_inline)) uint8_t execute(CPU *cpu, const CPU_VARIANT variant) {
+	// opcode fetches count as execution, not as reads
+	HEAT(cpu, cpu->program_counter, HEAT_EXEC);
+	COVER(cpu, cpu->program_counter, COVER_EXEC);
+	uint8_t code = bus_read(cpu, cpu->program_counter);
+	cpu->program_counter += 1;
+
+	OPCODE opcode = variant_opcodes(variant)[code];
+	cpu->cycles += opcode.cycles;
+	if (!opcode.len)
+		goto unsupported;
+
+	switch (code) {
+		/* ADC */
+		case 0x69:
+		case 0x65:
+		case 0x75:
+		case 0x6D:
+		case 0x7D:
+		case 0x79:
+		case 0x61:
+		case 0x71:
+		case 0x72:
+                		adc_variant(cpu, opcode.mode, variant);
+		break;
+
                 	/* SBC */
-			case 0xE9:
-			case 0xE5:
-			case 0xF5:
-			case 0xED:
-			case 0xFD:
-			case 0xF9:
-			case 0xE1:
-			case 0xF1:
-                		sbc(cpu, opcode.mode);
-			break;
+		case 0xE9:
+		case 0xE5:
+		case 0xF5:
+		case 0xED:
+		case 0xFD:
+		case 0xF9:
+		case 0xE1:
+		case 0xF1:
+		case 0xF2:
+                		sbc_variant(cpu, opcode.mode, variant);
+		break;
 
                 	/* AND */
-			case 0x29:
-			case 0x25:
-			case 0x35:
-			case 0x2D:
-			case 0x3D:
-			case 0x39:
-			case 0x21:
-			case 0x31:
+		case 0x29:
+		case 0x25:
+		case 0x35:
+		case 0x2D:
+		case 0x3D:
+		case 0x39:
+		case 0x21:
+		case 0x31:
+		case 0x32:
                 		and(cpu, opcode.mode);
-			break;
+		break;
 
                 	/* EOR */
-			case 0x49:
-			case 0x45:
-			case 0x55:
-			case 0x4D:
-			case 0x5D:
-			case 0x59:
-			case 0x41:
-			case 0x51:
+		case 0x49:
+		case 0x45:
+		case 0x55:
+		case 0x4D:
+		case 0x5D:
+		case 0x59:
+		case 0x41:
+		case 0x51:
+		case 0x52:
                 		eor(cpu, opcode.mode);
-			break;
+		break;
 
-	                /* ORA */
-			case 0x09:
-			case 0x05:
-			case 0x15:
-			case 0x0D:
-			case 0x1D:
-			case 0x19:
-			case 0x01:
-			case 0x11:
+                /* ORA */
+		case 0x09:
+		case 0x05:
+		case 0x15:
+		case 0x0D:
+		case 0x1D:
+		case 0x19:
+		case 0x01:
+		case 0x11:
+		case 0x12:
                     		ora(cpu, opcode.mode);
                 	break;
 
-			/* LDA */
-			case 0xA9:
-			case 0xA5:
-			case 0xB5:
-			case 0xAD:
-			case 0xBD:
-			case 0xB9:
-			case 0xA1:
-			case 0xB1:
-				lda(cpu, opcode.mode);
-			break;
+		/* LDA */
+		case 0xA9:
+		case 0xA5:
+		case 0xB5:
+		case 0xAD:
+		case 0xBD:
+		case 0xB9:
+		case 0xA1:
+		case 0xB1:
+		case 0xB2:
+			lda(cpu, opcode.mode);
+		break;
 
-			/* LDX */
-			case 0xa2:
-			case 0xa6:
-			case 0xb6:
-			case 0xae:
-			case 0xbe:
-				ldx(cpu, opcode.mode);
-			break;
+		/* LDX */
+		case 0xa2:
+		case 0xa6:
+		case 0xb6:
+		case 0xae:
+		case 0xbe:
+			ldx(cpu, opcode.mode);
+		break;
 
                 	/* LDY */
-			case 0xa0:
-			case 0xa4:
-			case 0xb4:
-			case 0xac:
-			case 0xbc:
-				ldy(cpu, opcode.mode);
-			break;
+		case 0xa0:
+		case 0xa4:
+		case 0xb4:
+		case 0xac:
+		case 0xbc:
+			ldy(cpu, opcode.mode);
+		break;
 
-			/* STA */
-			case 0x85:
-			case 0x95:
-			case 0x8D:
-			case 0x9D:
-			case 0x99:
-			case 0x81:
-			case 0x91:
-				sta(cpu, opcode.mode);
-			break;
+		/* STA */
+		case 0x85:
+		case 0x95:
+		case 0x8D:
+		case 0x9D:
+		case 0x99:
+		case 0x81:
+		case 0x91:
+		case 0x92:
+			sta(cpu, opcode.mode);
+		break;
 
-			/* STX */
-			case 0x86:
-			case 0x96:
-			case 0x8e:
-				stx(cpu, opcode.mode);
-			break;
+		/* STX */
+		case 0x86:
+		case 0x96:
+		case 0x8e:
+			stx(cpu, opcode.mode);
+		break;
 
-			/* STY */
-			case 0x84:
-			case 0x94:
-			case 0x8c:
-				sty(cpu, opcode.mode);
-			break;
+		/* STY */
+		case 0x84:
+		case 0x94:
+		case 0x8c:
+			sty(cpu, opcode.mode);
+		break;
 
-			/* PHA */
-			case 0x48:
-				pha(cpu);
-			break;
+		/* PHA */
+		case 0x48:
+			pha(cpu);
+		break;
 
                 	/* PLA */
-			case 0x68:
+		case 0x68:
                     		pla(cpu);
-			break;
+		break;
 
-			/* PHP */
-			case 0x08:
-				php(cpu);
-			break;
+		/* PHP */
+		case 0x08:
+			php(cpu);
+		break;
 
-			/* PLP */
-			case 0x28:
-				plp(cpu);
-			break;
+		/* PLP */
+		case 0x28:
+			plp(cpu);
+		break;
 
                 	/* CLD */
-			case 0xd8:
-				cld(cpu);
-			break;
+		case 0xd8:
+			cld(cpu);
+		break;
 
                 	/* CLI */
-			case 0x58:
-				cli(cpu);
-			break;
+		case 0x58:
+			cli(cpu);
+		break;
 
                 	/* CLV */
-			case 0xb8:
-				clv(cpu);
-			break;
+		case 0xb8:
+			clv(cpu);
+		break;
 
                 	/* CLC */
-			case 0x18:
-				clc(cpu);
-			break;
+		case 0x18:
+			clc(cpu);
+		break;
 
                 	/* SEC */
-			case 0x38:
-				sec(cpu);
-			break;
+		case 0x38:
+			sec(cpu);
+		break;
 
                 	/* SEI */
-			case 0x78:
-				sei(cpu);
-			break;
+		case 0x78:
+			sei(cpu);
+		break;
 
                 	/* SED */
-			case 0xf8:
-				sed(cpu);
-			break;
-
-			/* TAX */
-			case 0xAA:
-				tax(cpu);
-			break;
-
-			/* TAY */
-			case 0xA8:
-				tay(cpu);
-			break;
-
-			/* TSX */
-			case 0xBA:
-				tsx(cpu);
-			break;
+		case 0xf8:
+			sed(cpu);
+		break;
 
-			/* TXA */
-			case 0x8A:
-				txa(cpu);
-			break;
+		/* TAX */
+		case 0xAA:
+			tax(cpu);
+		break;
 
-			/* TXS */
-			case 0x9A:
-				txs(cpu);
-			break;
+		/* TAY */
+		case 0xA8:
+			tay(cpu);
+		break;
 
-			/* TYA */
-			case 0x98:
-				tya(cpu);
-			break;
+		/* TSX */
+		case 0xBA:
+			tsx(cpu);
+		break;
 
-			/* JMP Absolute */
-			case 0x4c:
-				jmp_absolute(cpu);
-			break;
+		/* TXA */
+		case 0x8A:
+			txa(cpu);
+		break;
 
-			/* JMP Indirect */
-			case 0x6c:
-				jmp_indirect(cpu);
-			break;
+		/* TXS */
+		case 0x9A:
+			txs(cpu);
+		break;
 
-			/* JSR */
-			case 0x20:
-				jsr(cpu);
-			break;
+		/* TYA */
+		case 0x98:
+			tya(cpu);
+		break;
 
-			/* RTS */
-			case 0x60:
-				rts(cpu);
-			break;
+		/* JMP Absolute */
+		case 0x4c:
+			jmp_absolute(cpu);
+		return 1;
+
+		/* JMP Indirect */
+		case 0x6c:
+			jmp_indirect_variant(cpu, variant);
+		return 1;
+
+		/* JMP (Absolute,X) */
+		case 0x7C:
+			jmp_indexed_indirect(cpu);
+		return 1;
+
+		/* BRA */
+		case 0x80:
+			bra(cpu);
+		return 1;
+
+		/* JSR */
+		case 0x20:
+			jsr(cpu);
+		return 1;
+
+		/* RTS */
+		case 0x60:
+			rts(cpu);
+		return 1;
+
+		/* RTI */
+		case 0x40:
+			rti(cpu);
+		return 1;
+
+		/* BNE */
+		case 0xd0:
+			bne(cpu);
+		return 1;
+
+		/* BVS */
+		case 0x70:
+			bvs(cpu);
+		return 1;
+
+		/* BVC */
+		case 0x50:
+			bvc(cpu);
+		return 1;
+
+		/* BPL */
+		case 0x10:
+			bpl(cpu);
+		return 1;
+
+		/* BMI */
+		case 0x30:
+			bmi(cpu);
+		return 1;
+
+		/* BEQ */
+		case 0xf0:
+			beq(cpu);
+		return 1;
+
+		/* BCS */
+		case 0xb0:
+			bcs(cpu);
+		return 1;
+
+		/* BCC */
+		case 0x90:
+			bcc(cpu);
+		return 1;
+
+		/* BIT */
+		case 0x24:
+		case 0x2c:
+		case 0x34:
+		case 0x3C:
+			bit(cpu, opcode.mode);
+		break;
 
-			/* RTI */
-			case 0x40:
-				rti(cpu);
-			break;
+		/* BIT Immediate */
+		case 0x89:
+			bit_immediate(cpu);
+		break;
 
-			/* BNE */
-			case 0xd0:
-				bne(cpu);
-			break;
+		/* TSB */
+		case 0x04:
+		case 0x0C:
+			tsb(cpu, opcode.mode);
+		break;
 
-			/* BVS */
-			case 0x70:
-				bvs(cpu);
-			break;
+		/* TRB */
+		case 0x14:
+		case 0x1C:
+			trb(cpu, opcode.mode);
+		break;
 
-			/* BVC */
-			case 0x50:
-				bvc(cpu);
-			break;
+		/* STZ */
+		case 0x64:
+		case 0x74:
+		case 0x9C:
+		case 0x9E:
+			stz(cpu, opcode.mode);
+		break;
 
-			/* BPL */
-			case 0x10:
-				bpl(cpu);
-			break;
+		/* PHX, PHY, PLX, PLY */
+		case 0xDA:
+			phx(cpu);
+		break;
 
-			/* BMI */
-			case 0x30:
-				bmi(cpu);
-			break;
+		case 0x5A:
+			phy(cpu);
+		break;
 
-			/* BEQ */
-			case 0xf0:
-				beq(cpu);
-			break;
+		case 0xFA:
+			plx(cpu);
+		break;
 
-			/* BCS */
-			case 0xb0:
-				bcs(cpu);
-			break;
+		case 0x7A:
+			ply(cpu);
+		break;
 
-			/* BCC */
-			case 0x90:
-				bcc(cpu);
-			break;
+		/* INC A, DEC A */
+		case 0x1A:
+			inc_accumulator(cpu);
+		break;
 
-			/* BIT */
-			case 0x24:
-			case 0x2c:
-				bit(cpu, opcode.mode);
-			break;
+		case 0x3A:
+			dec_accumulator(cpu);
+		break;
 
                 	/* ASL */
-			case 0x0a:
-				asl_accumulator(cpu);
-			break;
+		case 0x0a:
+			asl_accumulator(cpu);
+		break;
 
                 	/* ASL */
-			case 0x06:
-			case 0x16:
-			case 0x0e:
-			case 0x1e:
+		case 0x06:
+		case 0x16:
+		case 0x0e:
+		case 0x1e:
                     		asl(cpu, opcode.mode);
-			break;
+		break;
 
-			/* LSR */
-			case 0x4a:
-				lsr_accumulator(cpu);
-			break;
+		/* LSR */
+		case 0x4a:
+			lsr_accumulator(cpu);
+		break;
 
                 	/* LSR */
-			case 0x46:
-			case 0x56:
-			case 0x4e:
-			case 0x5e:
+		case 0x46:
+		case 0x56:
+		case 0x4e:
+		case 0x5e:
                     		lsr(cpu, opcode.mode);
-			break;
+		break;
 
-			/*ROL*/
-			case 0x2a:
-				rol_accumulator(cpu);
-			break;
+		/*ROL*/
+		case 0x2a:
+			rol_accumulator(cpu);
+		break;
 
                 	/* ROL */
-			case 0x26:
-			case 0x36:
-			case 0x2e:
-			case 0x3e:
+		case 0x26:
+		case 0x36:
+		case 0x2e:
+		case 0x3e:
                     		rol(cpu, opcode.mode);
-		    	break;
+	    	break;
 
                 	/* ROR */
-			case 0x6a:
-				ror_accumulator(cpu);
-		    	break;
+		case 0x6a:
+			ror_accumulator(cpu);
+	    	break;
 
                 	/* ROR */
-			case 0x66:
-			case 0x76:
-			case 0x6e:
-			case 0x7e:
+		case 0x66:
+		case 0x76:
+		case 0x6e:
+		case 0x7e:
                     		ror(cpu, opcode.mode);
-		    	break;
-
-			/* INC */
-			case 0xE6:
-			case 0xF6:
-			case 0xEE:
-			case 0xFE:
-				inc(cpu, opcode.mode);
-			break;
+	    	break;
+
+		/* INC */
+		case 0xE6:
+		case 0xF6:
+		case 0xEE:
+		case 0xFE:
+			inc(cpu, opcode.mode);
+		break;
 
-			/* INX */
-			case 0xE8:
-				inx(cpu);
-			break;
+		/* INX */
+		case 0xE8:
+			inx(cpu);
+		break;
 
-			/* INY */
-			case 0xC8:
-				inx(cpu);
-			break;
+		/* INY */
+		case 0xC8:
+			iny(cpu);
+		break;
 
-			/* DEC */
-			case 0xc6:
-			case 0xd6 :
-			case 0xce:
-			case 0xde:
-			    	dec(cpu, opcode.mode);
-			break;
+		/* DEC */
+		case 0xc6:
+		case 0xd6 :
+		case 0xce:
+		case 0xde:
+		    	dec(cpu, opcode.mode);
+		break;
 
-			/* DEX */
-			case 0xca:
-				dex(cpu);
-			break;
+		/* DEX */
+		case 0xca:
+			dex(cpu);
+		break;
 
-			/* DEY */
-			case 0x88:
-				dey(cpu);
-			break;
+		/* DEY */
+		case 0x88:
+			dey(cpu);
+		break;
 
-			/* CMP */
-			case 0xc9:
-			case 0xc5:
-			case 0xd5:
-			case 0xcd:
-			case 0xdd:
-			case 0xd9:
-			case 0xc1:
-			case 0xd1:
-			    	cmp(cpu, opcode.mode);
-			break;
+		/* CMP */
+		case 0xc9:
+		case 0xc5:
+		case 0xd5:
+		case 0xcd:
+		case 0xdd:
+		case 0xd9:
+		case 0xc1:
+		case 0xd1:
+		case 0xD2:
+		    	cmp(cpu, opcode.mode);
+		break;
 
-			/* CPX */
-			case 0xe0:
-			case 0xe4:
-			case 0xec:
-			    	cpx(cpu, opcode.mode);
-			break;
+		/* CPX */
+		case 0xe0:
+		case 0xe4:
+		case 0xec:
+		    	cpx(cpu, opcode.mode);
+		break;
 
-			/* CPY */
-			case 0xc0:
-			case 0xc4:
-			case 0xcc:
-			    	cpy(cpu, opcode.mode);
-			break;
+		/* CPY */
+		case 0xc0:
+		case 0xc4:
+		case 0xcc:
+		    	cpy(cpu, opcode.mode);
+		break;
 
-			/* NOP */
-			case 0xEA:
-			break;
+		/* NOP */
+		case 0xEA:
+		break;
 
-			/* BRK */
-			case 0x00:
-				return;
-			break;
+		/* BRK */
+		case 0x00:
+			return 0;
+		break;
 
-			default:
-				assert(0 && "OPcode non supported yet");
-		}
+		default:
+		unsupported:
+#ifdef CPU_FUZZ
+			cpu->fault = 1;
+			return 0;
+#else
+			assert(0 && "OPcode non supported yet");
+#endif
+	}
 
-		if (program_counter_state == cpu->program_counter) {
-			cpu->program_counter += (uint16_t) (opcode.len - 1);
-		}
+	// control flow returns above with its own program counter
+	cpu->program_counter += (uint16_t) (opcode.len - 1);
+
+	return 1;
+}
+
+static uint8_t step_nmos(CPU *cpu) {
+	return execute(cpu, NMOS_6502);
+}
+
+static uint8_t step_65c02(CPU *cpu) {
+	return execute(cpu, CMOS_65C02);
+}
+
+static uint8_t step_2a03(CPU *cpu) {
+	return execute(cpu, RICOH_2A03);
+}
+
+/// Executes a single instruction, returns 0 on BRK.
+uint8_t step(CPU *cpu) {
+#ifdef CPU_CYCLE_EXACT
+	if (cpu->cycle_exact)
+		return cycle_stepper(cpu->variant)(cpu);
+#endif
+	switch (cpu->variant) {
+		case CMOS_65C02: return step_65c02(cpu);
+		case RICOH_2A03: return step_2a03(cpu);
+		default: return step_nmos(cpu);
 	}
 }
 
@@ -566,10 +1050,10 @@ void update_zero_and_negative_flag(CPU *cpu, uint8_t res) {
 }
 
 /* Arithmetic */
-/// note: ignoring decimal mode
+/// Binary add with carry, decimal mode is handled by add_decimal()
 /// http://www.righto.com/2012/12/the-6502-overflow-flag-explained.html
 void add_to_register_a(CPU *cpu, uint8_t data) {
-	uint16_t sum = (uint16_t) cpu->register_a + (uint16_t) data + (uint16_t) (cpu->status & CARRY) ? 1 : 0;
+	uint16_t sum = (uint16_t) cpu->register_a + (uint16_t) data + (uint16_t) (cpu->status & CARRY ? 1 : 0);
 
 	if (sum > 0xFF) {
 		cpu->status |= CARRY;
@@ -579,55 +1063,158 @@ void add_to_register_a(CPU *cpu, uint8_t data) {
 
 	uint8_t res = (uint8_t) sum;
 	if ((data ^ res) & (res ^ cpu->register_a) & 0x80) {
-		cpu->status &= ~OVERFLOW;
-	} else {
 		cpu->status |= OVERFLOW;
+	} else {
+		cpu->status &= ~OVERFLOW;
 	}
 
 	cpu->register_a = res;
 	update_zero_and_negative_flag(cpu, cpu->register_a);
 }
 
+/// BCD addition, http://www.6502.org/tutorials/decimal_mode.html
+/// NMOS takes N, V and Z from intermediate results, the 65C02 fixes N and Z
+/// at the price of one cycle.
+static inline void add_decimal(CPU *cpu, uint8_t data, const CPU_VARIANT variant) {
+	uint8_t a = cpu->register_a;
+	int carry = cpu->status & CARRY;
+	int lo = (a & 0x0F) + (data & 0x0F) + carry;
+	if (lo >= 0x0A)
+		lo = ((lo + 0x06) & 0x0F) + 0x10;
+	int sum = (a & 0xF0) + (data & 0xF0) + lo;
+	int sign = (int8_t) (a & 0xF0) + (int8_t) (data & 0xF0) + lo;
+
+	uint8_t binary = (uint8_t) (a + data + carry);
+	update_zero_and_negative_flag(cpu, binary);
+	if (sum & NEGATIV) {
+		cpu->status |= NEGATIV;
+	} else {
+		cpu->status &= ~NEGATIV;
+	}
+	if (sign < -128 || sign > 127) {
+		cpu->status |= OVERFLOW;
+	} else {
+		cpu->status &= ~OVERFLOW;
+	}
+
+	if (sum >= 0xA0)
+		sum += 0x60;
+	if (sum >= 0x100) {
+		cpu->status |= CARRY;
+	} else {
+		cpu->status &= ~CARRY;
+	}
+
+	cpu->register_a = (uint8_t) sum;
+	if (variant == CMOS_65C02) {
+		update_zero_and_negative_flag(cpu, cpu->register_a);
+		cpu->cycles += 1;
+	}
+}
+
+/// BCD subtraction, flags come from the binary subtraction except N and Z
+/// on the 65C02.
+static inline void sub_decimal(CPU *cpu, uint8_t data, const CPU_VARIANT variant) {
+	uint8_t a = cpu->register_a;
+	int borrow = !(cpu->status & CARRY);
+	int lo = (a & 0x0F) - (data & 0x0F) - borrow;
+	int res;
+	if (variant == CMOS_65C02) {
+		res = a - data - borrow;
+		if (res < 0)
+			res -= 0x60;
+		if (lo < 0)
+			res -= 0x06;
+	} else {
+		if (lo < 0)
+			lo = ((lo - 0x06) & 0x0F) - 0x10;
+		res = (a & 0xF0) - (data & 0xF0) + lo;
+		if (res < 0)
+			res -= 0x60;
+	}
+
+	int diff = a - data - borrow;
+	uint8_t binary = (uint8_t) diff;
+	update_zero_and_negative_flag(cpu, binary);
+	if ((a ^ data) & (a ^ binary) & 0x80) {
+		cpu->status |= OVERFLOW;
+	} else {
+		cpu->status &= ~OVERFLOW;
+	}
+	if (diff >= 0) {
+		cpu->status |= CARRY;
+	} else {
+		cpu->status &= ~CARRY;
+	}
+
+	cpu->register_a = (uint8_t) res;
+	if (variant == CMOS_65C02) {
+		update_zero_and_negative_flag(cpu, cpu->register_a);
+		cpu->cycles += 1;
+	}
+}
+
+/// The 2A03 has the D flag but no BCD circuitry.
+static inline void adc_variant(CPU *cpu, AddressingMode mode, const CPU_VARIANT variant) {
+	uint8_t value = mem_read(cpu, read_operand_address(cpu, mode));
+	if (variant != RICOH_2A03 && (cpu->status & DECIMAL_MODE)) {
+		add_decimal(cpu, value, variant);
+	} else {
+		add_to_register_a(cpu, value);
+	}
+}
+
+static inline void sbc_variant(CPU *cpu, AddressingMode mode, const CPU_VARIANT variant) {
+	uint8_t value = mem_read(cpu, read_operand_address(cpu, mode));
+	if (variant != RICOH_2A03 && (cpu->status & DECIMAL_MODE)) {
+		sub_decimal(cpu, value, variant);
+	} else {
+		// A - M - (1 - C) == A + ~M + C
+		add_to_register_a(cpu, (uint8_t) ~value);
+	}
+}
+
 void adc(CPU *cpu, AddressingMode mode) {
-	uint8_t value = mem_read(cpu, get_operand_address(cpu, mode));
-	add_to_register_a(cpu, value);
+	adc_variant(cpu, mode, NMOS_6502);
 }
 
 void sbc(CPU *cpu, AddressingMode mode) {
-	uint8_t value = mem_read(cpu, get_operand_address(cpu, mode));
-	add_to_register_a(cpu, (uint8_t) (int8_t) (value - 1));
+	sbc_variant(cpu, mode, NMOS_6502);
 }
 
 void and(CPU *cpu, AddressingMode mode) {
-	uint8_t value = mem_read(cpu, get_operand_address(cpu, mode));
-	add_to_register_a(cpu, value & cpu->register_a);
+	uint8_t value = mem_read(cpu, read_operand_address(cpu, mode));
+	cpu->register_a &= value;
+	update_zero_and_negative_flag(cpu, cpu->register_a);
 }
 
 void eor(CPU *cpu, AddressingMode mode) {
-	uint8_t value = mem_read(cpu, get_operand_address(cpu, mode));
-	add_to_register_a(cpu, value ^ cpu->register_a);
+	uint8_t value = mem_read(cpu, read_operand_address(cpu, mode));
+	cpu->register_a ^= value;
+	update_zero_and_negative_flag(cpu, cpu->register_a);
 }
 
 void ora(CPU *cpu, AddressingMode mode) {
-	uint8_t value = mem_read(cpu, get_operand_address(cpu, mode));
-	add_to_register_a(cpu, value | cpu->register_a);
+	uint8_t value = mem_read(cpu, read_operand_address(cpu, mode));
+	cpu->register_a |= value;
+	update_zero_and_negative_flag(cpu, cpu->register_a);
 }
 
 /* Stores, Loads */
 void lda(CPU *cpu, AddressingMode mode) {
-	uint8_t value = mem_read(cpu, get_operand_address(cpu, mode));
+	uint8_t value = mem_read(cpu, read_operand_address(cpu, mode));
 	cpu->register_a = value;
 	update_zero_and_negative_flag(cpu, cpu->register_a);
 }
 
 void ldx(CPU *cpu, AddressingMode mode) {
-	uint8_t value = mem_read(cpu, get_operand_address(cpu, mode));
+	uint8_t value = mem_read(cpu, read_operand_address(cpu, mode));
 	cpu->register_x = value;
 	update_zero_and_negative_flag(cpu, cpu->register_x);
 }
 
 void ldy(CPU *cpu, AddressingMode mode) {
-	uint8_t value = mem_read(cpu, get_operand_address(cpu, mode));
+	uint8_t value = mem_read(cpu, read_operand_address(cpu, mode));
 	cpu->register_y = value;
 	update_zero_and_negative_flag(cpu, cpu->register_y);
 }
@@ -647,6 +1234,11 @@ void sty(CPU *cpu, AddressingMode mode) {
 	mem_write(cpu, addr, cpu->register_y);
 }
 
+void stz(CPU *cpu, AddressingMode mode) {
+	uint16_t addr = get_operand_address(cpu, mode);
+	mem_write(cpu, addr, 0);
+}
+
 /* Stack */
 void pha(CPU *cpu) {
 	stack_push(cpu, cpu->register_a);
@@ -671,6 +1263,24 @@ void plp(CPU *cpu) {
 	cpu->status |= BREAK2;
 }
 
+void phx(CPU *cpu) {
+	stack_push(cpu, cpu->register_x);
+}
+
+void phy(CPU *cpu) {
+	stack_push(cpu, cpu->register_y);
+}
+
+void plx(CPU *cpu) {
+	cpu->register_x = stack_pop(cpu);
+	update_zero_and_negative_flag(cpu, cpu->register_x);
+}
+
+void ply(CPU *cpu) {
+	cpu->register_y = stack_pop(cpu);
+	update_zero_and_negative_flag(cpu, cpu->register_y);
+}
+
 /* Flags clear */
 void cld(CPU *cpu) {
 	cpu->status &= ~DECIMAL_MODE;
@@ -733,17 +1343,19 @@ void tya(CPU *cpu) {
 /* Branching */
 void jmp_absolute(CPU *cpu) {
 	uint16_t addr = mem_read_u16(cpu, cpu->program_counter);
+	EDGE(cpu, addr);
 	cpu->program_counter = addr;
 }
 
-void jmp_indirect(CPU *cpu) {
+static inline void jmp_indirect_variant(CPU *cpu, const CPU_VARIANT variant) {
 	uint16_t addr = mem_read_u16(cpu, cpu->program_counter);
         // 6502 bug mode with with page boundary:
         //  if address $3000 contains $40, $30FF contains $80, and $3100 contains $50,
         //  the result of JMP ($30FF) will be a transfer of control to $4080 rather than $5080 as you intended
         //  i.e. the 6502 took the low byte of the address from $30FF and the high byte from $3000
+        // the 65C02 fixed it
 	uint16_t ind_ref;
-	if ((addr & 0x00FF) == 0x00FF) {
+	if (variant != CMOS_65C02 && (addr & 0x00FF) == 0x00FF) {
 		uint8_t lo = mem_read(cpu, addr);
 		uint8_t hi = mem_read(cpu, addr & 0xFF00);
 		ind_ref = ((uint16_t) hi) << 8 | (uint16_t) lo;
@@ -751,17 +1363,60 @@ void jmp_indirect(CPU *cpu) {
 		ind_ref = mem_read_u16(cpu, addr);
 	}
 
+	EDGE(cpu, ind_ref);
+	cpu->program_counter = ind_ref;
+}
+
+void jmp_indirect(CPU *cpu) {
+	jmp_indirect_variant(cpu, NMOS_6502);
+}
+
+void jmp_indexed_indirect(CPU *cpu) {
+	uint16_t addr = mem_read_u16(cpu, cpu->program_counter) + (uint16_t) cpu->register_x;
+	uint16_t ind_ref = mem_read_u16(cpu, addr);
+	EDGE(cpu, ind_ref);
 	cpu->program_counter = ind_ref;
 }
 
 void jsr(CPU *cpu) {
 	stack_push_u16(cpu, cpu->program_counter + 2 - 1);
 	uint16_t target_addr = mem_read_u16(cpu, cpu->program_counter);
+	EDGE(cpu, target_addr);
+	PROF_CALL(cpu, target_addr, 2);
+#ifdef CPU_HLE
+	// the trap runs the routine and its rts() natively
+	if (cpu->hle && hle_trap(cpu, target_addr))
+		return;
+#endif
 	cpu->program_counter = target_addr;
 }
 
 void rts(CPU *cpu) {
 	cpu->program_counter = stack_pop_u16(cpu) + 1;
+	EDGE(cpu, cpu->program_counter);
+	PROF_RETURN(cpu);
+}
+
+#ifdef CPU_CYCLE_EXACT
+static void cycle_nmi(CPU *cpu);
+#endif
+
+/// Non maskable interrupt, taken between two instructions: pushes the
+/// return address and the status (B clear) and jumps through $FFFA.
+void nmi(CPU *cpu) {
+#ifdef CPU_CYCLE_EXACT
+	if (cpu->cycle_exact) {
+		cycle_nmi(cpu);
+		return;
+	}
+#endif
+	stack_push_u16(cpu, cpu->program_counter);
+	stack_push(cpu, (cpu->status & ~BREAK) | BREAK2);
+	cpu->status |= INTERRUPT_DISABLE;
+	cpu->program_counter = mem_read_u16(cpu, 0xFFFA);
+	cpu->cycles += 7;
+	EDGE(cpu, cpu->program_counter);
+	PROF_CALL(cpu, cpu->program_counter, 3);
 }
 
 void rti(CPU *cpu) {
@@ -771,14 +1426,24 @@ void rti(CPU *cpu) {
 	cpu->status |= BREAK2;
 
 	cpu->program_counter = stack_pop_u16(cpu);
+	EDGE(cpu, cpu->program_counter);
+	PROF_RETURN(cpu);
 }
 
 void branch(CPU *cpu, uint8_t cond) {
+	// the opcode is one byte back
+	COVER(cpu, cpu->program_counter - 1, cond ? COVER_TAKEN : COVER_NOT_TAKEN);
 	if (cond) {
 		int8_t jump = (int8_t) mem_read(cpu, cpu->program_counter);
 		uint16_t jump_addr = cpu->program_counter + 1 + (uint16_t) jump;
 
+		// +1 if branch succeeds +2 if to a new page
+		cpu->cycles += ((cpu->program_counter + 1) ^ jump_addr) & 0xFF00 ? 2 : 1;
+		EDGE(cpu, jump_addr);
 		cpu->program_counter = jump_addr;
+	} else {
+		cpu->program_counter += 1;
+		EDGE(cpu, cpu->program_counter);
 	}
 }
 
@@ -814,7 +1479,34 @@ void bpl(CPU *cpu) {
 	branch(cpu, !(cpu->status & NEGATIV));
 }
 
+void bra(CPU *cpu) {
+	branch(cpu, 1);
+}
+
 void bit(CPU *cpu, AddressingMode mode) {
+	uint16_t addr = read_operand_address(cpu, mode);
+	uint8_t data = mem_read(cpu, addr);
+	if (cpu->register_a & data) {
+		cpu->status &= ~ZERO;
+	} else {
+		cpu->status |= ZERO;
+	}
+
+	// N and V are copied from the operand
+	cpu->status = (cpu->status & ~(NEGATIV | OVERFLOW)) | (data & (NEGATIV | OVERFLOW));
+}
+
+/// BIT # only touches Z.
+void bit_immediate(CPU *cpu) {
+	uint8_t data = mem_read(cpu, cpu->program_counter);
+	if (cpu->register_a & data) {
+		cpu->status &= ~ZERO;
+	} else {
+		cpu->status |= ZERO;
+	}
+}
+
+void tsb(CPU *cpu, AddressingMode mode) {
 	uint16_t addr = get_operand_address(cpu, mode);
 	uint8_t data = mem_read(cpu, addr);
 	if (cpu->register_a & data) {
@@ -822,9 +1514,18 @@ void bit(CPU *cpu, AddressingMode mode) {
 	} else {
 		cpu->status |= ZERO;
 	}
+	mem_write(cpu, addr, data | cpu->register_a);
+}
 
-	if (data & NEGATIV) cpu->status |= NEGATIV;
-	if (data & OVERFLOW) cpu->status |= OVERFLOW;
+void trb(CPU *cpu, AddressingMode mode) {
+	uint16_t addr = get_operand_address(cpu, mode);
+	uint8_t data = mem_read(cpu, addr);
+	if (cpu->register_a & data) {
+		cpu->status &= ~ZERO;
+	} else {
+		cpu->status |= ZERO;
+	}
+	mem_write(cpu, addr, data & ~cpu->register_a);
 }
 
 /* Shifts */
@@ -922,7 +1623,7 @@ void ror_accumulator(CPU *cpu) {
 	}
 	data >>= 1;
 	if (old_carry)
-		data |= CARRY;
+		data |= 0x80;
 	cpu->register_a = data;
 	update_zero_and_negative_flag(cpu, cpu->register_a);
 }
@@ -938,7 +1639,7 @@ uint8_t ror(CPU *cpu, AddressingMode mode) {
 	}
 	data >>= 1;
 	if (old_carry)
-		data |= CARRY;
+		data |= 0x80;
 	mem_write(cpu, addr, data);
 	update_zero_and_negative_flag(cpu, data);
 	return data;
@@ -954,6 +1655,11 @@ uint8_t inc(CPU *cpu, AddressingMode mode) {
 	return data;
 }
 
+void inc_accumulator(CPU *cpu) {
+	cpu->register_a += 1;
+	update_zero_and_negative_flag(cpu, cpu->register_a);
+}
+
 void inx(CPU *cpu) {
 	cpu->register_x += 1;
 	update_zero_and_negative_flag(cpu, cpu->register_x);
@@ -974,6 +1680,11 @@ uint8_t dec(CPU *cpu, AddressingMode mode) {
 	return data;
 }
 
+void dec_accumulator(CPU *cpu) {
+	cpu->register_a -= 1;
+	update_zero_and_negative_flag(cpu, cpu->register_a);
+}
+
 void dex(CPU *cpu) {
 	cpu->register_x -= 1;
 	update_zero_and_negative_flag(cpu, cpu->register_x);
@@ -985,7 +1696,7 @@ void dey(CPU *cpu) {
 }
 
 void compare(CPU *cpu, AddressingMode mode, uint8_t par) {
-	uint16_t addr = get_operand_address(cpu, mode);
+	uint16_t addr = read_operand_address(cpu, mode);
 	uint8_t data = mem_read(cpu, addr);
 
 	if (data <= par) {
@@ -1008,3 +1719,558 @@ void cpx(CPU *cpu, AddressingMode mode) {
 void cpy(CPU *cpu, AddressingMode mode) {
 	compare(cpu, mode, cpu->register_y);
 }
+
+#ifdef CPU_CYCLE_EXACT
+/* Bus level core, see CPU_CYCLE_EXACT in cpu_6502.h */
+
+typedef enum {
+	ACCESS_READ,
+	ACCESS_WRITE,
+	ACCESS_MODIFY,
+} ACCESS;
+
+static inline void cycle_tick(CPU *cpu, uint16_t add, uint8_t value, uint8_t write) {
+	cpu->cycles += 1;
+	if (cpu->cycle_hook)
+		cpu->cycle_hook(cpu->cycle_data, add, value, write);
+}
+
+static inline uint8_t cycle_read(CPU *cpu, uint16_t add) {
+	uint8_t value = mem_read(cpu, add);
+	cycle_tick(cpu, add, value, 0);
+	return value;
+}
+
+static inline void cycle_write(CPU *cpu, uint16_t add, uint8_t value) {
+	mem_write(cpu, add, value);
+	cycle_tick(cpu, add, value, 1);
+}
+
+/// The byte after the opcode, read and ignored by one byte instructions.
+static inline void cycle_dummy(CPU *cpu) {
+	cycle_read(cpu, cpu->program_counter);
+}
+
+static inline void cycle_push(CPU *cpu, uint8_t value) {
+	cycle_write(cpu, STACK + cpu->stack_pointer, value);
+	cpu->stack_pointer -= 1;
+}
+
+static inline uint8_t cycle_pull(CPU *cpu) {
+	cpu->stack_pointer += 1;
+	return cycle_read(cpu, STACK + cpu->stack_pointer);
+}
+
+/// PLA and co: the next byte and the current stack slot are read before
+/// the stack pointer moves.
+static inline uint8_t cycle_pull_instruction(CPU *cpu) {
+	cycle_dummy(cpu);
+	cycle_read(cpu, STACK + cpu->stack_pointer);
+	return cycle_pull(cpu);
+}
+
+/// base + index. The high byte is fixed a cycle late: that cycle reads
+/// the address without the carry, or the last operand byte on a 65C02
+/// page crossing. Reads only pay for it when they cross a page.
+static inline uint16_t cycle_indexed(CPU *cpu, uint16_t base, uint8_t index, ACCESS access, const CPU_VARIANT variant) {
+	uint16_t add = base + index;
+	uint8_t crossed = (base ^ add) >> 8 != 0;
+	if (crossed || access != ACCESS_READ) {
+		if (variant == CMOS_65C02 && crossed)
+			cycle_read(cpu, cpu->program_counter - 1);
+		else
+			cycle_read(cpu, (base & 0xFF00) | (add & 0x00FF));
+	}
+	return add;
+}
+
+/// Fetches the operand and does every cycle up to the data access,
+/// leaving the program counter on the next instruction.
+static uint16_t cycle_address(CPU *cpu, AddressingMode mode, ACCESS access, const CPU_VARIANT variant) {
+	uint16_t pc = cpu->program_counter;
+
+	switch (mode) {
+		case Immediate:
+			cpu->program_counter += 1;
+			return pc;
+
+		case ZeroPage:
+			cpu->program_counter += 1;
+			return cycle_read(cpu, pc);
+
+		case ZeroPage_X:
+		case ZeroPage_Y: {
+			uint8_t base = cycle_read(cpu, pc);
+			cpu->program_counter += 1;
+			cycle_read(cpu, base);
+			return (uint8_t) (base + (mode == ZeroPage_X ? cpu->register_x : cpu->register_y));
+		}
+
+		case Absolute:
+		case Absolute_X:
+		case Absolute_Y: {
+			uint16_t lo = cycle_read(cpu, pc);
+			uint16_t hi = cycle_read(cpu, pc + 1);
+			cpu->program_counter += 2;
+			if (mode == Absolute)
+				return hi << 8 | lo;
+			return cycle_indexed(cpu, hi << 8 | lo, mode == Absolute_X ? cpu->register_x : cpu->register_y, access, variant);
+		}
+
+		case Indirect_X: {
+			uint8_t ptr = cycle_read(cpu, pc);
+			cpu->program_counter += 1;
+			cycle_read(cpu, ptr);
+			ptr += cpu->register_x;
+			uint16_t lo = cycle_read(cpu, ptr);
+			uint16_t hi = cycle_read(cpu, (uint8_t) (ptr + 1));
+			return hi << 8 | lo;
+		}
+
+		case Indirect_Y:
+		case ZeroPage_Indirect: {
+			uint8_t ptr = cycle_read(cpu, pc);
+			cpu->program_counter += 1;
+			uint16_t lo = cycle_read(cpu, ptr);
+			uint16_t hi = cycle_read(cpu, (uint8_t) (ptr + 1));
+			if (mode == ZeroPage_Indirect)
+				return hi << 8 | lo;
+			return cycle_indexed(cpu, hi << 8 | lo, cpu->register_y, access, variant);
+		}
+
+		case NoneAddressing:
+			assert(0 && "Mode not supported");
+		break;
+	}
+
+	return 0;
+}
+
+static inline uint8_t cycle_load(CPU *cpu, AddressingMode mode, const CPU_VARIANT variant) {
+	return cycle_read(cpu, cycle_address(cpu, mode, ACCESS_READ, variant));
+}
+
+static inline void cycle_store(CPU *cpu, AddressingMode mode, uint8_t value, const CPU_VARIANT variant) {
+	cycle_write(cpu, cycle_address(cpu, mode, ACCESS_WRITE, variant), value);
+}
+
+static inline void cycle_compare(CPU *cpu, uint8_t reg, uint8_t value) {
+	if (value <= reg) {
+		cpu->status |= CARRY;
+	} else {
+		cpu->status &= ~CARRY;
+	}
+	update_zero_and_negative_flag(cpu, reg - value);
+}
+
+static inline void cycle_add(CPU *cpu, AddressingMode mode, uint8_t subtract, const CPU_VARIANT variant) {
+	uint16_t add = cycle_address(cpu, mode, ACCESS_READ, variant);
+	uint8_t value = cycle_read(cpu, add);
+	if (variant == RICOH_2A03 || !(cpu->status & DECIMAL_MODE)) {
+		add_to_register_a(cpu, subtract ? (uint8_t) ~value : value);
+		return;
+	}
+	if (subtract)
+		sub_decimal(cpu, value, variant);
+	else
+		add_decimal(cpu, value, variant);
+	// the 65C02's extra cycle, counted by *_decimal(), reads the operand again
+	if (variant == CMOS_65C02) {
+		cpu->cycles -= 1;
+		cycle_read(cpu, add);
+	}
+}
+
+/// Read-modify-write through `op`, the accumulator version of the
+/// instruction run on a borrowed A.
+static inline void cycle_modify(CPU *cpu, AddressingMode mode, void (*op)(CPU *cpu), const CPU_VARIANT variant) {
+	uint16_t add = cycle_address(cpu, mode, ACCESS_MODIFY, variant);
+	uint8_t value = cycle_read(cpu, add);
+	if (variant == CMOS_65C02)
+		cycle_read(cpu, add);
+	else
+		cycle_write(cpu, add, value);
+
+	uint8_t a = cpu->register_a;
+	cpu->register_a = value;
+	op(cpu);
+	value = cpu->register_a;
+	cpu->register_a = a;
+	cycle_write(cpu, add, value);
+}
+
+/// TSB and TRB, 65C02 only.
+static inline void cycle_test_bits(CPU *cpu, AddressingMode mode, uint8_t reset, const CPU_VARIANT variant) {
+	uint16_t add = cycle_address(cpu, mode, ACCESS_MODIFY, variant);
+	uint8_t value = cycle_read(cpu, add);
+	cycle_read(cpu, add);
+	if (cpu->register_a & value) {
+		cpu->status &= ~ZERO;
+	} else {
+		cpu->status |= ZERO;
+	}
+	cycle_write(cpu, add, reset ? value & ~cpu->register_a : value | cpu->register_a);
+}
+
+static inline void cycle_bit(CPU *cpu, uint8_t value, uint8_t immediate) {
+	if (cpu->register_a & value) {
+		cpu->status &= ~ZERO;
+	} else {
+		cpu->status |= ZERO;
+	}
+	if (!immediate)
+		cpu->status = (cpu->status & ~(NEGATIV | OVERFLOW)) | (value & (NEGATIV | OVERFLOW));
+}
+
+/// Taken branches read the next opcode while adding the offset, and the
+/// address without the carry when it crosses a page.
+static inline void cycle_branch(CPU *cpu, uint8_t cond) {
+	COVER(cpu, cpu->program_counter - 1, cond ? COVER_TAKEN : COVER_NOT_TAKEN);
+	int8_t jump = (int8_t) cycle_read(cpu, cpu->program_counter);
+	cpu->program_counter += 1;
+	if (cond) {
+		uint16_t next = cpu->program_counter;
+		uint16_t target = next + (uint16_t) jump;
+		cycle_read(cpu, next);
+		if ((next ^ target) & 0xFF00)
+			cycle_read(cpu, (next & 0xFF00) | (target & 0x00FF));
+		cpu->program_counter = target;
+	}
+	EDGE(cpu, cpu->program_counter);
+}
+
+static inline uint16_t cycle_fetch_u16(CPU *cpu) {
+	uint16_t lo = cycle_read(cpu, cpu->program_counter);
+	uint16_t hi = cycle_read(cpu, cpu->program_counter + 1);
+	cpu->program_counter += 2;
+	return hi << 8 | lo;
+}
+
+static inline void cycle_jump(CPU *cpu, uint16_t target) {
+	EDGE(cpu, target);
+	cpu->program_counter = target;
+}
+
+static void cycle_nmi(CPU *cpu) {
+	cycle_dummy(cpu);
+	cycle_dummy(cpu);
+	cycle_push(cpu, (uint8_t) (cpu->program_counter >> 8));
+	cycle_push(cpu, (uint8_t) cpu->program_counter);
+	cycle_push(cpu, (cpu->status & ~BREAK) | BREAK2);
+	cpu->status |= INTERRUPT_DISABLE;
+	uint16_t lo = cycle_read(cpu, 0xFFFA);
+	uint16_t hi = cycle_read(cpu, 0xFFFB);
+	cycle_jump(cpu, hi << 8 | lo);
+	PROF_CALL(cpu, cpu->program_counter, 3);
+}
+
+/// execute() one bus cycle at a time, returns 0 on BRK.
+static inline __attribute__((always_inline)) uint8_t cycle_execute(CPU *cpu, const CPU_VARIANT variant) {
+	HEAT(cpu, cpu->program_counter, HEAT_EXEC);
+	COVER(cpu, cpu->program_counter, COVER_EXEC);
+	uint16_t pc = cpu->program_counter;
+	uint8_t code = bus_read(cpu, pc);
+	cycle_tick(cpu, pc, code, 0);
+	cpu->program_counter += 1;
+
+	OPCODE opcode = variant_opcodes(variant)[code];
+	if (!opcode.len)
+		goto unsupported;
+
+	switch (code) {
+		/* ADC, SBC */
+		case 0x69: case 0x65: case 0x75: case 0x6D: case 0x7D: case 0x79: case 0x61: case 0x71: case 0x72:
+			cycle_add(cpu, opcode.mode, 0, variant);
+		break;
+
+		case 0xE9: case 0xE5: case 0xF5: case 0xED: case 0xFD: case 0xF9: case 0xE1: case 0xF1: case 0xF2:
+			cycle_add(cpu, opcode.mode, 1, variant);
+		break;
+
+		/* AND, EOR, ORA */
+		case 0x29: case 0x25: case 0x35: case 0x2D: case 0x3D: case 0x39: case 0x21: case 0x31: case 0x32:
+			cpu->register_a &= cycle_load(cpu, opcode.mode, variant);
+			update_zero_and_negative_flag(cpu, cpu->register_a);
+		break;
+
+		case 0x49: case 0x45: case 0x55: case 0x4D: case 0x5D: case 0x59: case 0x41: case 0x51: case 0x52:
+			cpu->register_a ^= cycle_load(cpu, opcode.mode, variant);
+			update_zero_and_negative_flag(cpu, cpu->register_a);
+		break;
+
+		case 0x09: case 0x05: case 0x15: case 0x0D: case 0x1D: case 0x19: case 0x01: case 0x11: case 0x12:
+			cpu->register_a |= cycle_load(cpu, opcode.mode, variant);
+			update_zero_and_negative_flag(cpu, cpu->register_a);
+		break;
+
+		/* LDA, LDX, LDY */
+		case 0xA9: case 0xA5: case 0xB5: case 0xAD: case 0xBD: case 0xB9: case 0xA1: case 0xB1: case 0xB2:
+			cpu->register_a = cycle_load(cpu, opcode.mode, variant);
+			update_zero_and_negative_flag(cpu, cpu->register_a);
+		break;
+
+		case 0xA2: case 0xA6: case 0xB6: case 0xAE: case 0xBE:
+			cpu->register_x = cycle_load(cpu, opcode.mode, variant);
+			update_zero_and_negative_flag(cpu, cpu->register_x);
+		break;
+
+		case 0xA0: case 0xA4: case 0xB4: case 0xAC: case 0xBC:
+			cpu->register_y = cycle_load(cpu, opcode.mode, variant);
+			update_zero_and_negative_flag(cpu, cpu->register_y);
+		break;
+
+		/* CMP, CPX, CPY */
+		case 0xC9: case 0xC5: case 0xD5: case 0xCD: case 0xDD: case 0xD9: case 0xC1: case 0xD1: case 0xD2:
+			cycle_compare(cpu, cpu->register_a, cycle_load(cpu, opcode.mode, variant));
+		break;
+
+		case 0xE0: case 0xE4: case 0xEC:
+			cycle_compare(cpu, cpu->register_x, cycle_load(cpu, opcode.mode, variant));
+		break;
+
+		case 0xC0: case 0xC4: case 0xCC:
+			cycle_compare(cpu, cpu->register_y, cycle_load(cpu, opcode.mode, variant));
+		break;
+
+		/* BIT */
+		case 0x24: case 0x2C: case 0x34: case 0x3C:
+			cycle_bit(cpu, cycle_load(cpu, opcode.mode, variant), 0);
+		break;
+
+		case 0x89:
+			cycle_bit(cpu, cycle_load(cpu, Immediate, variant), 1);
+		break;
+
+		/* STA, STX, STY, STZ */
+		case 0x85: case 0x95: case 0x8D: case 0x9D: case 0x99: case 0x81: case 0x91: case 0x92:
+			cycle_store(cpu, opcode.mode, cpu->register_a, variant);
+		break;
+
+		case 0x86: case 0x96: case 0x8E:
+			cycle_store(cpu, opcode.mode, cpu->register_x, variant);
+		break;
+
+		case 0x84: case 0x94: case 0x8C:
+			cycle_store(cpu, opcode.mode, cpu->register_y, variant);
+		break;
+
+		case 0x64: case 0x74: case 0x9C: case 0x9E:
+			cycle_store(cpu, opcode.mode, 0, variant);
+		break;
+
+		/* Read-modify-write */
+		case 0x06: case 0x16: case 0x0E: case 0x1E:
+			cycle_modify(cpu, opcode.mode, asl_accumulator, variant);
+		break;
+
+		case 0x46: case 0x56: case 0x4E: case 0x5E:
+			cycle_modify(cpu, opcode.mode, lsr_accumulator, variant);
+		break;
+
+		case 0x26: case 0x36: case 0x2E: case 0x3E:
+			cycle_modify(cpu, opcode.mode, rol_accumulator, variant);
+		break;
+
+		case 0x66: case 0x76: case 0x6E: case 0x7E:
+			cycle_modify(cpu, opcode.mode, ror_accumulator, variant);
+		break;
+
+		case 0xE6: case 0xF6: case 0xEE: case 0xFE:
+			cycle_modify(cpu, opcode.mode, inc_accumulator, variant);
+		break;
+
+		case 0xC6: case 0xD6: case 0xCE: case 0xDE:
+			cycle_modify(cpu, opcode.mode, dec_accumulator, variant);
+		break;
+
+		case 0x04: case 0x0C:
+			cycle_test_bits(cpu, opcode.mode, 0, variant);
+		break;
+
+		case 0x14: case 0x1C:
+			cycle_test_bits(cpu, opcode.mode, 1, variant);
+		break;
+
+		/* Push, pull */
+		case 0x48:
+			cycle_dummy(cpu);
+			cycle_push(cpu, cpu->register_a);
+		break;
+
+		case 0x08:
+			cycle_dummy(cpu);
+			cycle_push(cpu, cpu->status | BREAK | BREAK2);
+		break;
+
+		case 0xDA:
+			cycle_dummy(cpu);
+			cycle_push(cpu, cpu->register_x);
+		break;
+
+		case 0x5A:
+			cycle_dummy(cpu);
+			cycle_push(cpu, cpu->register_y);
+		break;
+
+		case 0x68:
+			cpu->register_a = cycle_pull_instruction(cpu);
+			update_zero_and_negative_flag(cpu, cpu->register_a);
+		break;
+
+		case 0x28:
+			cpu->status = (cycle_pull_instruction(cpu) & ~BREAK) | BREAK2;
+		break;
+
+		case 0xFA:
+			cpu->register_x = cycle_pull_instruction(cpu);
+			update_zero_and_negative_flag(cpu, cpu->register_x);
+		break;
+
+		case 0x7A:
+			cpu->register_y = cycle_pull_instruction(cpu);
+			update_zero_and_negative_flag(cpu, cpu->register_y);
+		break;
+
+		/* Implied and accumulator, no bus access of their own */
+		case 0xD8: cycle_dummy(cpu); cld(cpu); break;
+		case 0x58: cycle_dummy(cpu); cli(cpu); break;
+		case 0xB8: cycle_dummy(cpu); clv(cpu); break;
+		case 0x18: cycle_dummy(cpu); clc(cpu); break;
+		case 0x38: cycle_dummy(cpu); sec(cpu); break;
+		case 0x78: cycle_dummy(cpu); sei(cpu); break;
+		case 0xF8: cycle_dummy(cpu); sed(cpu); break;
+		case 0xAA: cycle_dummy(cpu); tax(cpu); break;
+		case 0xA8: cycle_dummy(cpu); tay(cpu); break;
+		case 0xBA: cycle_dummy(cpu); tsx(cpu); break;
+		case 0x8A: cycle_dummy(cpu); txa(cpu); break;
+		case 0x9A: cycle_dummy(cpu); txs(cpu); break;
+		case 0x98: cycle_dummy(cpu); tya(cpu); break;
+		case 0xE8: cycle_dummy(cpu); inx(cpu); break;
+		case 0xC8: cycle_dummy(cpu); iny(cpu); break;
+		case 0xCA: cycle_dummy(cpu); dex(cpu); break;
+		case 0x88: cycle_dummy(cpu); dey(cpu); break;
+		case 0x1A: cycle_dummy(cpu); inc_accumulator(cpu); break;
+		case 0x3A: cycle_dummy(cpu); dec_accumulator(cpu); break;
+		case 0x0A: cycle_dummy(cpu); asl_accumulator(cpu); break;
+		case 0x4A: cycle_dummy(cpu); lsr_accumulator(cpu); break;
+		case 0x2A: cycle_dummy(cpu); rol_accumulator(cpu); break;
+		case 0x6A: cycle_dummy(cpu); ror_accumulator(cpu); break;
+		case 0xEA: cycle_dummy(cpu); break;
+
+		/* JMP */
+		case 0x4C:
+			cycle_jump(cpu, cycle_fetch_u16(cpu));
+		break;
+
+		case 0x6C: {
+			uint16_t ptr = cycle_fetch_u16(cpu);
+			uint16_t lo, hi;
+			if (variant == CMOS_65C02) {
+				cycle_read(cpu, cpu->program_counter - 1);
+				lo = cycle_read(cpu, ptr);
+				hi = cycle_read(cpu, ptr + 1);
+			} else {
+				// the high byte comes from the same page, see jmp_indirect_variant()
+				lo = cycle_read(cpu, ptr);
+				hi = cycle_read(cpu, (ptr & 0xFF00) | ((ptr + 1) & 0x00FF));
+			}
+			cycle_jump(cpu, hi << 8 | lo);
+		} break;
+
+		case 0x7C: {
+			uint16_t ptr = cycle_fetch_u16(cpu) + cpu->register_x;
+			cycle_read(cpu, cpu->program_counter - 1);
+			uint16_t lo = cycle_read(cpu, ptr);
+			uint16_t hi = cycle_read(cpu, ptr + 1);
+			cycle_jump(cpu, hi << 8 | lo);
+		} break;
+
+		/* JSR, RTS, RTI */
+		case 0x20: {
+			uint16_t lo = cycle_read(cpu, cpu->program_counter);
+			cpu->program_counter += 1;
+			cycle_read(cpu, STACK + cpu->stack_pointer);
+			// the return address is the last operand byte, still to be read
+			cycle_push(cpu, (uint8_t) (cpu->program_counter >> 8));
+			cycle_push(cpu, (uint8_t) cpu->program_counter);
+			uint16_t target = (uint16_t) (cycle_read(cpu, cpu->program_counter) << 8) | lo;
+			EDGE(cpu, target);
+			PROF_CALL(cpu, target, 2);
+#ifdef CPU_HLE
+			if (cpu->hle && hle_trap(cpu, target))
+				break;
+#endif
+			cpu->program_counter = target;
+		} break;
+
+		case 0x60: {
+			cycle_dummy(cpu);
+			cycle_read(cpu, STACK + cpu->stack_pointer);
+			uint16_t lo = cycle_pull(cpu);
+			uint16_t hi = cycle_pull(cpu);
+			cpu->program_counter = hi << 8 | lo;
+			cycle_dummy(cpu);
+			cycle_jump(cpu, cpu->program_counter + 1);
+			PROF_RETURN(cpu);
+		} break;
+
+		case 0x40: {
+			cycle_dummy(cpu);
+			cycle_read(cpu, STACK + cpu->stack_pointer);
+			cpu->status = (cycle_pull(cpu) & ~BREAK) | BREAK2;
+			uint16_t lo = cycle_pull(cpu);
+			uint16_t hi = cycle_pull(cpu);
+			cycle_jump(cpu, hi << 8 | lo);
+			PROF_RETURN(cpu);
+		} break;
+
+		/* Branches */
+		case 0x80: cycle_branch(cpu, 1); break;
+		case 0xD0: cycle_branch(cpu, !(cpu->status & ZERO)); break;
+		case 0x70: cycle_branch(cpu, cpu->status & OVERFLOW); break;
+		case 0x50: cycle_branch(cpu, !(cpu->status & OVERFLOW)); break;
+		case 0x10: cycle_branch(cpu, !(cpu->status & NEGATIV)); break;
+		case 0x30: cycle_branch(cpu, cpu->status & NEGATIV); break;
+		case 0xF0: cycle_branch(cpu, cpu->status & ZERO); break;
+		case 0xB0: cycle_branch(cpu, cpu->status & CARRY); break;
+		case 0x90: cycle_branch(cpu, !(cpu->status & CARRY)); break;
+
+		/* BRK halts like on the fast core, after its padding byte */
+		case 0x00:
+			cycle_dummy(cpu);
+			cpu->cycles += opcode.cycles - 2;
+			return 0;
+
+		default:
+		unsupported:
+#ifdef CPU_FUZZ
+			cpu->fault = 1;
+			return 0;
+#else
+			assert(0 && "OPcode non supported yet");
+#endif
+	}
+
+	return 1;
+}
+
+static uint8_t cycle_step_nmos(CPU *cpu) {
+	return cycle_execute(cpu, NMOS_6502);
+}
+
+static uint8_t cycle_step_65c02(CPU *cpu) {
+	return cycle_execute(cpu, CMOS_65C02);
+}
+
+static uint8_t cycle_step_2a03(CPU *cpu) {
+	return cycle_execute(cpu, RICOH_2A03);
+}
+
+static STEP_FN cycle_stepper(CPU_VARIANT variant) {
+	switch (variant) {
+		case CMOS_65C02: return cycle_step_65c02;
+		case RICOH_2A03: return cycle_step_2a03;
+		default: return cycle_step_nmos;
+	}
+}
+#endif
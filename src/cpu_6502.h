@@ -1,9 +1,27 @@
+#ifndef CPU_6502_H
+#define CPU_6502_H
+
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
 
 #define STACK		0x0100
 #define STACK_RESET 	0xFD
+#define MEMORY_SIZE	0x10000
+
+/* Heatmap counters, see CPU_HEATMAP */
+#define HEAT_READ	0
+#define HEAT_WRITE	1
+#define HEAT_EXEC	2
+
+/* Coverage bitmaps, see CPU_COVERAGE */
+#define COVER_EXEC	0
+#define COVER_TAKEN	1
+#define COVER_NOT_TAKEN	2
+#define COVER_WORDS	(MEMORY_SIZE / 64)
+
+/* Edge coverage map, see CPU_FUZZ */
+#define EDGE_MAP_SIZE	(1 << 16)
 
 /// # Status Register (P) http://wiki.nesdev.com/w/index.php/Status_flags
 ///
@@ -28,6 +46,81 @@ typedef enum __attribute__((__packed__)) {
         NEGATIV			= 1 << 7,
 } CPUFLAGS;
 
+/// # Variants
+///
+/// NMOS_6502: decimal mode, JMP ($xxFF) reads the high byte from $xx00
+/// CMOS_65C02: decimal mode with valid N/Z (+1 cycle), JMP ($xxFF) fixed,
+///             BRA, PHX/PHY/PLX/PLY, STZ, TSB/TRB, INC/DEC A, BIT #/zp,X/abs,X,
+///             (zp) addressing and JMP (abs,X)
+/// RICOH_2A03: NMOS without decimal mode (the D flag is kept but ignored)
+///
+/// The interpreter is compiled once per variant; step() and the run loops
+/// pick the specialization from `variant` before executing anything.
+///
+typedef enum {
+	NMOS_6502,
+	CMOS_65C02,
+	RICOH_2A03,
+} CPU_VARIANT;
+
+/// # Resumable execution
+///
+/// With CPU_IO, resume() runs until the program touches I/O and says why
+/// it stopped, so one thread can drive any number of machines from an
+/// event loop:
+///
+///  - YIELD_INPUT: the program read `io_input` with nothing fed since the
+///    last read. The instruction is rolled back; io_feed() then resume()
+///    runs it again with the data.
+///  - YIELD_OUTPUT: the instruction wrote between `io_out_lo` and
+///    `io_out_hi`. It has completed, `io_addr` and `io_value` hold the
+///    last such write.
+///  - YIELD_BRK, YIELD_BUDGET: BRK, or the cycle budget ran out.
+///
+typedef enum {
+	YIELD_NONE,
+	YIELD_BRK,
+	YIELD_INPUT,
+	YIELD_OUTPUT,
+	YIELD_BUDGET,
+} YIELD_REASON;
+
+/// # Bus level core
+///
+/// With CPU_CYCLE_EXACT a second interpreter is compiled in next to the
+/// fast one, for software that depends on what the bus does within an
+/// instruction. createCPUCycleExact() picks it for one machine; step(),
+/// run(), run_cycles(), resume() and nmi() then go through it. It makes
+/// one mem_read() or mem_write() per cycle, in hardware order and
+/// including the ones whose value is thrown away:
+///
+///  - indexed reads crossing a page first read the address without the
+///    carry (on the 65C02 the last operand byte again), indexed stores,
+///    read-modify-write and (zp),Y stores always do
+///  - read-modify-write writes the old value back before the new one
+///    (the 65C02 reads it twice instead)
+///  - implied instructions read the next byte, pulls and RTS/RTI read the
+///    stack, taken branches read the next opcode
+///
+/// Each cycle adds one to `cycles` and calls `cycle_hook` when set, so a
+/// machine can advance its other chips in step. Instructions end up with
+/// the same registers, memory and cycle count as on the fast core. BRK
+/// still halts: its two fetches are real, the rest is only counted.
+///
+/// Without the flag none of this exists and the fast core is unchanged.
+///
+/// # Memory mapped devices
+///
+/// With CPU_MMIO a page can be handed to a device: mem_read() and
+/// mem_write() on it call the device instead of touching memory. Opcode
+/// fetches still read memory, code is not expected to run from I/O.
+///
+typedef struct {
+	uint8_t (*read)(void *data, uint16_t add);
+	void (*write)(void *data, uint16_t add, uint8_t value);
+	void *data;
+} DEVICE;
+
 typedef struct {
 	uint8_t register_a;
 	uint8_t register_x;
@@ -35,7 +128,72 @@ typedef struct {
 	uint8_t status;
 	uint16_t program_counter;
 	uint8_t stack_pointer;
-	uint8_t memory[0xFFFF];
+	uint64_t cycles;
+	uint8_t variant;
+#ifdef CPU_DIRTY_PAGES
+	/* One bit per 256 byte page written since the last snapshot() */
+	uint64_t dirty[4];
+#endif
+#ifdef CPU_FUZZ
+	/* AFL style edge hit counts, updated on every control transfer */
+	uint8_t *edge_map;
+	uint16_t prev_loc;
+	/* Set when the program executes an unsupported opcode */
+	uint8_t fault;
+#endif
+#ifdef CPU_WATCH
+	/* Address whose writes set watch_hit, -1 for none */
+	int32_t watch;
+	uint8_t watch_hit;
+#endif
+#ifdef CPU_HEATMAP
+	/* Read, write and execute counters per page and optionally per byte,
+	 * indexed by HEAT_*, see heatmap.h */
+	uint64_t (*heat_pages)[3];
+	uint64_t (*heat_bytes)[3];
+#endif
+#ifdef CPU_COVERAGE
+	/* One bit per address for instructions executed and branches taken
+	 * or not, indexed by COVER_*, see coverage.h */
+	uint64_t (*coverage)[COVER_WORDS];
+#endif
+#ifdef CPU_HLE
+	/* Native subroutine traps checked by jsr(), see hle.h */
+	struct HLE *hle;
+#endif
+#ifdef CPU_PROFILE
+	/* Shadow call stack updated by jsr(), rts() and rti(), see profile.h */
+	struct PROFILER *profiler;
+#endif
+#ifdef CPU_IO
+	/* Devices seen by resume(), see io_attach() */
+	int32_t io_input;
+	uint8_t io_pending;
+	uint16_t io_out_lo;
+	uint16_t io_out_hi;
+	/* YIELD_REASON raised by the bus during the current instruction */
+	uint8_t io_yield;
+	uint16_t io_addr;
+	uint8_t io_value;
+#endif
+#ifdef CPU_MMIO
+	/* Device owning each page, NULL for plain memory, see map_device() */
+	const DEVICE *devices[0x100];
+#endif
+#ifdef CPU_CYCLE_EXACT
+	/* Executed by the bus level core, see createCPUCycleExact() */
+	uint8_t cycle_exact;
+	/* Called after each bus cycle, NULL for none */
+	void (*cycle_hook)(void *data, uint16_t add, uint8_t value, uint8_t write);
+	void *cycle_data;
+#endif
+#ifdef CPU_SHARED_BUS
+	/* Per page pointers, either into memory or into a region shared
+	 * with other cores, see system.h */
+	uint8_t *read_pages[0x100];
+	uint8_t *write_pages[0x100];
+#endif
+	uint8_t memory[MEMORY_SIZE];
 } CPU;
 
 typedef enum {
@@ -49,6 +207,8 @@ typedef enum {
 	Indirect_X,
 	Indirect_Y,
 	NoneAddressing,
+	/* 65C02 only */
+	ZeroPage_Indirect,
 } AddressingMode;
 
 typedef struct {
@@ -59,7 +219,30 @@ typedef struct {
 	const AddressingMode mode;
 } OPCODE;
 
+/// Register trace filled by run_steps(), one array per register so a
+/// scripting layer can wrap each one without copying. Row i holds the state
+/// before instruction i executed. Any array may be NULL to skip it.
+typedef struct {
+	uint16_t *program_counter;
+	uint8_t *register_a;
+	uint8_t *register_x;
+	uint8_t *register_y;
+	uint8_t *status;
+	uint8_t *stack_pointer;
+	uint64_t *cycles;
+
+	/* Stop before executing this address, -1 for none */
+	int32_t stop_pc;
+	/* Stop after an instruction when this returns non zero */
+	uint8_t (*stop)(CPU *cpu, void *data);
+	void *data;
+} TRACE;
+
 void createCPU(CPU *cpu);
+void createCPUVariant(CPU *cpu, CPU_VARIANT variant);
+#ifdef CPU_CYCLE_EXACT
+void createCPUCycleExact(CPU *cpu, CPU_VARIANT variant);
+#endif
 void destroyCPU(CPU *cpu);
 
 uint8_t mem_read(CPU *cpu, uint16_t add);
@@ -77,7 +260,28 @@ uint16_t get_operand_address(CPU *cpu, AddressingMode mode);
 void load_and_run(CPU *cpu, uint8_t *program, size_t len);
 void load(CPU *cpu, uint8_t *program, size_t len);
 void reset(CPU *cpu);
+void snapshot(CPU *cpu, CPU *snap);
+void restore(CPU *cpu, CPU *snap);
 void run(CPU *cpu);
+uint8_t run_cycles(CPU *cpu, uint64_t budget);
+uint8_t step(CPU *cpu);
+size_t run_steps(CPU *cpu, size_t n, TRACE *out);
+void nmi(CPU *cpu);
+#ifdef CPU_MMIO
+void map_device(CPU *cpu, uint8_t first_page, uint16_t pages, const DEVICE *device);
+#endif
+#ifdef CPU_IO
+void io_attach(CPU *cpu, int32_t input, uint16_t out_lo, uint16_t out_hi);
+void io_feed(CPU *cpu, uint8_t value);
+YIELD_REASON resume(CPU *cpu, uint64_t budget);
+#endif
+#ifdef CPU_HLE
+uint8_t hle_trap(CPU *cpu, uint16_t target);
+#endif
+#ifdef CPU_PROFILE
+void prof_call(CPU *cpu, uint16_t target, uint8_t pushed);
+void prof_return(CPU *cpu);
+#endif
 
 void update_zero_and_negative_flag(CPU *cpu, uint8_t res);
 
@@ -96,12 +300,17 @@ void ldy(CPU *cpu, AddressingMode mode);
 void sta(CPU *cpu, AddressingMode mode);
 void stx(CPU *cpu, AddressingMode mode);
 void sty(CPU *cpu, AddressingMode mode);
+void stz(CPU *cpu, AddressingMode mode);
 
 /* Stack */
 void pha(CPU *cpu);
 void pla(CPU *cpu);
 void php(CPU *cpu);
 void plp(CPU *cpu);
+void phx(CPU *cpu);
+void phy(CPU *cpu);
+void plx(CPU *cpu);
+void ply(CPU *cpu);
 
 /* Flags clear */
 void cld(CPU *cpu);
@@ -122,8 +331,12 @@ void tya(CPU *cpu);
 /* Branching */
 void branch(CPU *cpu, uint8_t cond);
 void bit(CPU *cpu, AddressingMode mode);
+void bit_immediate(CPU *cpu);
+void tsb(CPU *cpu, AddressingMode mode);
+void trb(CPU *cpu, AddressingMode mode);
 void jmp_absolute(CPU *cpu);
 void jmp_indirect(CPU *cpu);
+void jmp_indexed_indirect(CPU *cpu);
 void jsr(CPU *cpu);
 void rts(CPU *cpu);
 void rti(CPU *cpu);
@@ -135,6 +348,7 @@ void beq(CPU *cpu);
 void bcs(CPU *cpu);
 void bcc(CPU *cpu);
 void bpl(CPU *cpu);
+void bra(CPU *cpu);
 
 /* Shifts */
 void asl_accumulator(CPU *cpu);
@@ -147,9 +361,11 @@ void ror_accumulator(CPU *cpu);
 uint8_t ror(CPU *cpu, AddressingMode mode);
 
 uint8_t inc(CPU *cpu, AddressingMode mode);
+void inc_accumulator(CPU *cpu);
 void inx(CPU *cpu);
 void iny(CPU *cpu);
 uint8_t dec(CPU *cpu, AddressingMode mode);
+void dec_accumulator(CPU *cpu);
 void dex(CPU *cpu);
 void dey(CPU *cpu);
 
@@ -230,11 +446,11 @@ static const OPCODE opcode_lookup_table[256] = {
 	{ 0 },
 	{ 0 },
 	{ 0x45, "EOR", 2, 3, ZeroPage },
-	{ 0x46, "LRS", 2, 5, ZeroPage },
+	{ 0x46, "LSR", 2, 5, ZeroPage },
 	{ 0 },
 	{ 0x48, "PHA", 1, 3, NoneAddressing },
 	{ 0x49, "EOR", 2, 2, Immediate },
-	{ 0x4A, "LRS", 1, 2, NoneAddressing },
+	{ 0x4A, "LSR", 1, 2, NoneAddressing },
 	{ 0 },
 	{ 0x4C, "JMP", 3, 3, NoneAddressing }, //AddressingMode that acts as Immediate
 	{ 0x4D, "EOR", 3, 4, Absolute },
@@ -246,7 +462,7 @@ static const OPCODE opcode_lookup_table[256] = {
 	{ 0 },
 	{ 0 },
 	{ 0x55, "EOR", 2, 4, ZeroPage_X },
-	{ 0x56, "LRS", 2, 6, ZeroPage_X },
+	{ 0x56, "LSR", 2, 6, ZeroPage_X },
 	{ 0 },
 	{ 0x58, "CLI", 1, 2, NoneAddressing },
 	{ 0x59, "EOR", 3, 4 /* +1 if page crossed */, Absolute_Y },
@@ -254,7 +470,7 @@ static const OPCODE opcode_lookup_table[256] = {
 	{ 0 },
 	{ 0 },
 	{ 0x5D, "EOR", 3, 4 /* +1 if page crossed */, Absolute_X},
-	{ 0x5E, "SLR", 3, 7, Absolute_X },
+	{ 0x5E, "LSR", 3, 7, Absolute_X },
 	{ 0 },
 	{ 0x60, "RTS", 1, 6, NoneAddressing },
 	{ 0x61, "ADC", 2, 6, Indirect_X },
@@ -352,11 +568,11 @@ static const OPCODE opcode_lookup_table[256] = {
 	{ 0xBD, "LDA", 3, 4 /* +1 if page crossed */, Absolute_X },
 	{ 0xBE, "LDX", 3, 4 /* +1 if page crossed */, Absolute_Y },
 	{ 0 },
-	{ 0xC0, "CPX", 2, 2, Immediate },
+	{ 0xC0, "CPY", 2, 2, Immediate },
 	{ 0xC1, "CMP", 2, 6, Indirect_X },
 	{ 0 },
 	{ 0 },
-	{ 0xC4, "CPX", 2, 3, ZeroPage },
+	{ 0xC4, "CPY", 2, 3, ZeroPage },
 	{ 0xC5, "CMP", 2, 3, ZeroPage },
 	{ 0xC6, "DEC", 2, 5, ZeroPage },
 	{ 0 },
@@ -364,12 +580,12 @@ static const OPCODE opcode_lookup_table[256] = {
 	{ 0xC9, "CMP", 2, 2, Immediate },
 	{ 0xCA, "DEX", 1, 2, NoneAddressing },
 	{ 0 },
-	{ 0xCC, "CPX", 3, 4, Absolute },
+	{ 0xCC, "CPY", 3, 4, Absolute },
 	{ 0xCD, "CMP", 3, 4, Absolute },
 	{ 0xCE, "DEC", 3, 6, Absolute },
 	{ 0 },
 	{ 0xD0, "BNE", 2, 2 /* +1 if branch succeeds +2 if to a new page */, NoneAddressing},
-	{ 0xD1, "CMP", 2, 5 /* +1 if page crossed */, Absolute_Y },
+	{ 0xD1, "CMP", 2, 5 /* +1 if page crossed */, Indirect_Y },
 	{ 0 },
 	{ 0 },
 	{ 0 },
@@ -384,11 +600,11 @@ static const OPCODE opcode_lookup_table[256] = {
 	{ 0xDD, "CMP", 3, 4 /* +1 if page crossed */, Absolute_X },
 	{ 0xDE, "DEC", 3, 7, Absolute_X },
 	{ 0 },
-	{ 0xE0, "CPY", 2, 2, Immediate },
+	{ 0xE0, "CPX", 2, 2, Immediate },
 	{ 0xE1, "SBC", 2, 6, Indirect_X },
 	{ 0 },
 	{ 0 },
-	{ 0xE4, "CPY", 2, 3, ZeroPage },
+	{ 0xE4, "CPX", 2, 3, ZeroPage },
 	{ 0xE5, "SBC", 2, 3, ZeroPage },
 	{ 0xE6, "INC", 2, 5, ZeroPage },
 	{ 0 },
@@ -396,7 +612,7 @@ static const OPCODE opcode_lookup_table[256] = {
 	{ 0xE9, "SBC", 2, 2, Immediate },
 	{ 0xEA, "NOP", 1, 2, NoneAddressing },
 	{ 0 },
-	{ 0xEC, "CPY", 3, 4, Absolute },
+	{ 0xEC, "CPX", 3, 4, Absolute },
 	{ 0xED, "SBC", 3, 4, Absolute },
 	{ 0xEE, "INC", 3, 6, Absolute },
 	{ 0 },
@@ -417,3 +633,270 @@ static const OPCODE opcode_lookup_table[256] = {
 	{ 0xFE, "INC", 3, 7, Absolute_X },
 	{ 0 },
 };
+
+/// 65C02: the NMOS table plus the new opcodes and the (zp) mode, with
+/// JMP (abs) fixed and one cycle longer.
+static const OPCODE cmos_opcode_lookup_table[256] = {
+	{ 0x00, "BRK", 1, 7, NoneAddressing },
+	{ 0x01, "ORA", 2, 6, Indirect_X },
+	{ 0 },
+	{ 0 },
+	{ 0x04, "TSB", 2, 5, ZeroPage },
+	{ 0x05, "ORA", 2, 3, ZeroPage },
+	{ 0x06, "ASL", 2, 5, ZeroPage },
+	{ 0 },
+	{ 0x08, "PHP", 1, 3, NoneAddressing },
+	{ 0x09, "ORA", 2, 2, Immediate },
+	{ 0x0A, "ASL", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0x0C, "TSB", 3, 6, Absolute },
+	{ 0x0D, "ORA", 3, 4, Absolute },
+	{ 0x0E, "ASL", 3, 6, Absolute },
+	{ 0 },
+	{ 0x10, "BPL", 2, 2 /* +1 if branch succeeds +2 if to a new page */, NoneAddressing },
+	{ 0x11, "ORA", 2, 5 /* +1 if page crossed */, Indirect_Y },
+	{ 0x12, "ORA", 2, 5, ZeroPage_Indirect },
+	{ 0 },
+	{ 0x14, "TRB", 2, 5, ZeroPage },
+	{ 0x15, "ORA", 2, 4, ZeroPage_X },
+	{ 0x16, "ASL", 2, 6, ZeroPage_X },
+	{ 0 },
+	{ 0x18, "CLC", 1, 2, NoneAddressing },
+	{ 0x19, "ORA", 3, 4 /* +1 if page crossed */, Absolute_Y },
+	{ 0x1A, "INC", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0x1C, "TRB", 3, 6, Absolute },
+	{ 0x1D, "ORA", 3, 4 /* +1 if page crossed */, Absolute_X },
+	{ 0x1E, "ASL", 3, 7, Absolute_X },
+	{ 0 },
+	{ 0x20, "JSR", 3, 6, NoneAddressing },
+	{ 0x21, "AND", 2, 6, Indirect_X },
+	{ 0 },
+	{ 0 },
+	{ 0x24, "BIT", 2, 3, ZeroPage },
+	{ 0x25, "AND", 2, 3, ZeroPage },
+	{ 0x26, "ROL", 2, 5, ZeroPage },
+	{ 0 },
+	{ 0x28, "PLP", 1, 4, NoneAddressing },
+	{ 0x29, "AND", 2, 2, Immediate },
+	{ 0x2A, "ROL", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0x2C, "BIT", 3, 4, Absolute },
+	{ 0x2D, "AND", 3, 4, Absolute },
+	{ 0x2E, "ROL", 3, 6, Absolute },
+	{ 0 },
+	{ 0x30, "BMI", 2, 2 /* +1 if branch succeeds +2 if to a new page */, NoneAddressing },
+	{ 0x31, "AND", 2, 5 /* +1 if page crossed */, Indirect_Y },
+	{ 0x32, "AND", 2, 5, ZeroPage_Indirect },
+	{ 0 },
+	{ 0x34, "BIT", 2, 4, ZeroPage_X },
+	{ 0x35, "AND", 2, 4, ZeroPage_X },
+	{ 0x36, "ROL", 2, 6, ZeroPage_X },
+	{ 0 },
+	{ 0x38, "SEC", 1, 2, NoneAddressing },
+	{ 0x39, "AND", 3, 4 /* +1 if page crossed */, Absolute_Y },
+	{ 0x3A, "DEC", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0x3C, "BIT", 3, 4 /* +1 if page crossed */, Absolute_X },
+	{ 0x3D, "AND", 3, 4 /* +1 if page crossed */, Absolute_X },
+	{ 0x3E, "ROL", 3, 7, Absolute_X },
+	{ 0 },
+	{ 0x40, "RTI", 1, 6, NoneAddressing },
+	{ 0x41, "EOR", 2, 6, Indirect_X },
+	{ 0 },
+	{ 0 },
+	{ 0 },
+	{ 0x45, "EOR", 2, 3, ZeroPage },
+	{ 0x46, "LSR", 2, 5, ZeroPage },
+	{ 0 },
+	{ 0x48, "PHA", 1, 3, NoneAddressing },
+	{ 0x49, "EOR", 2, 2, Immediate },
+	{ 0x4A, "LSR", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0x4C, "JMP", 3, 3, NoneAddressing }, //AddressingMode that acts as Immediate
+	{ 0x4D, "EOR", 3, 4, Absolute },
+	{ 0x4E, "LSR", 3, 6, Absolute },
+	{ 0 },
+	{ 0x50, "BVC", 2, 2 /* +1 if branch succeeds +2 if to a new page */, NoneAddressing },
+	{ 0x51, "EOR", 2, 5 /* +1 if page crossed */, Indirect_Y },
+	{ 0x52, "EOR", 2, 5, ZeroPage_Indirect },
+	{ 0 },
+	{ 0 },
+	{ 0x55, "EOR", 2, 4, ZeroPage_X },
+	{ 0x56, "LSR", 2, 6, ZeroPage_X },
+	{ 0 },
+	{ 0x58, "CLI", 1, 2, NoneAddressing },
+	{ 0x59, "EOR", 3, 4 /* +1 if page crossed */, Absolute_Y },
+	{ 0x5A, "PHY", 1, 3, NoneAddressing },
+	{ 0 },
+	{ 0 },
+	{ 0x5D, "EOR", 3, 4 /* +1 if page crossed */, Absolute_X},
+	{ 0x5E, "LSR", 3, 7, Absolute_X },
+	{ 0 },
+	{ 0x60, "RTS", 1, 6, NoneAddressing },
+	{ 0x61, "ADC", 2, 6, Indirect_X },
+	{ 0 },
+	{ 0 },
+	{ 0x64, "STZ", 2, 3, ZeroPage },
+	{ 0x65, "ADC", 2, 3, ZeroPage },
+	{ 0x66, "ROR", 2, 5, ZeroPage },
+	{ 0 },
+	{ 0x68, "PLA", 1, 4, NoneAddressing },
+	{ 0x69, "ADC", 2, 2, Immediate },
+	{ 0x6A, "ROR", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0x6C, "JMP", 3, 6, NoneAddressing }, //AddressingMode:Indirect, page wrap fixed
+	{ 0x6D, "ADC", 3, 4, Absolute },
+	{ 0x6E, "ROR", 3, 6, Absolute },
+	{ 0 },
+	{ 0x70, "BVS", 2, 2 /* +1 if branch succeeds +2 if to a new page */, NoneAddressing },
+	{ 0x71, "ADC", 2, 5, Indirect_Y },
+	{ 0x72, "ADC", 2, 5, ZeroPage_Indirect },
+	{ 0 },
+	{ 0x74, "STZ", 2, 4, ZeroPage_X },
+	{ 0x75, "ADC", 2, 4, ZeroPage_X },
+	{ 0x76, "ROR", 2, 6, ZeroPage_X},
+	{ 0 },
+	{ 0x78, "SEI", 1, 2, NoneAddressing },
+	{ 0x79, "ADC", 3, 4 /* +1 if page crossed */, Absolute_Y },
+	{ 0x7A, "PLY", 1, 4, NoneAddressing },
+	{ 0 },
+	{ 0x7C, "JMP", 3, 6, NoneAddressing }, //AddressingMode:Absolute_X indirect
+	{ 0x7D, "ADC", 3, 4 /* +1 if page crossed */, Absolute_X },
+	{ 0x7E, "ROR", 3, 7, Absolute_X },
+	{ 0 },
+	{ 0x80, "BRA", 2, 2 /* +1 +2 if to a new page */, NoneAddressing },
+	{ 0x81, "STA", 2, 6, Indirect_X },
+	{ 0 },
+	{ 0 },
+	{ 0x84, "STY", 2, 3, ZeroPage },
+	{ 0x85, "STA", 2, 3, ZeroPage },
+	{ 0x86, "STX", 2, 3, ZeroPage },
+	{ 0 },
+	{ 0x88, "DEY", 1, 2, NoneAddressing },
+	{ 0x89, "BIT", 2, 2, Immediate },
+	{ 0x8A, "TXA", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0x8C, "STY", 3, 4, Absolute },
+	{ 0x8D, "STA", 3, 4, Absolute },
+	{ 0x8E, "STX", 3, 4, Absolute },
+	{ 0 },
+	{ 0x90, "BCC", 2, 2 /* +1 if branch succeeds +2 if to a new page */, NoneAddressing },
+	{ 0x91, "STA", 2, 6, Indirect_Y },
+	{ 0x92, "STA", 2, 5, ZeroPage_Indirect },
+	{ 0 },
+	{ 0x94, "STY", 2, 4, ZeroPage_X },
+	{ 0x95, "STA", 2, 4, ZeroPage_X },
+	{ 0x96, "STX", 2, 4, ZeroPage_Y },
+	{ 0 },
+	{ 0x98, "TYA", 1, 2, NoneAddressing },
+	{ 0x99, "STA", 3, 5, Absolute_Y },
+	{ 0x9A, "TXS", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0x9C, "STZ", 3, 4, Absolute },
+	{ 0x9D, "STA", 3, 5, Absolute_X },
+	{ 0x9E, "STZ", 3, 5, Absolute_X },
+	{ 0 },
+	{ 0xA0, "LDY", 2, 2, Immediate },
+	{ 0xA1, "LDA", 2, 6, Indirect_X},
+	{ 0xA2, "LDX", 2, 2, Immediate },
+	{ 0 },
+	{ 0xA4, "LDY", 2, 3, ZeroPage },
+	{ 0xA5, "LDA", 2, 3, ZeroPage },
+	{ 0xA6, "LDX", 2, 3, ZeroPage },
+	{ 0 },
+	{ 0xA8, "TAY", 1, 2, NoneAddressing },
+	{ 0xA9, "LDA", 2, 2, Immediate },
+	{ 0xAA, "TAX", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0xAC, "LDY", 3, 4, Absolute },
+	{ 0xAD, "LDA", 3, 4, Absolute },
+	{ 0xAE, "LDX", 3, 4, Absolute },
+	{ 0 },
+	{ 0xB0, "BCS", 2, 2 /* +1 if branch succeeds +2 if to a new page */, NoneAddressing },
+	{ 0xB1, "LDA", 2, 5 /* +1 if page crossed */, Indirect_Y },
+	{ 0xB2, "LDA", 2, 5, ZeroPage_Indirect },
+	{ 0 },
+	{ 0xB4, "LDY", 2, 4, ZeroPage_X },
+	{ 0xB5, "LDA", 2, 4, ZeroPage_X },
+	{ 0xB6, "LDX", 2, 4, ZeroPage_Y },
+	{ 0 },
+	{ 0xB8, "CLV", 1, 2, NoneAddressing },
+	{ 0xB9, "LDA", 3, 4 /* +1 if page crossed */, Absolute_Y },
+	{ 0xBA, "TSX", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0xBC, "LDY", 3, 4 /* +1 if page crossed */, Absolute_X },
+	{ 0xBD, "LDA", 3, 4 /* +1 if page crossed */, Absolute_X },
+	{ 0xBE, "LDX", 3, 4 /* +1 if page crossed */, Absolute_Y },
+	{ 0 },
+	{ 0xC0, "CPY", 2, 2, Immediate },
+	{ 0xC1, "CMP", 2, 6, Indirect_X },
+	{ 0 },
+	{ 0 },
+	{ 0xC4, "CPY", 2, 3, ZeroPage },
+	{ 0xC5, "CMP", 2, 3, ZeroPage },
+	{ 0xC6, "DEC", 2, 5, ZeroPage },
+	{ 0 },
+	{ 0xC8, "INY", 1, 2, NoneAddressing },
+	{ 0xC9, "CMP", 2, 2, Immediate },
+	{ 0xCA, "DEX", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0xCC, "CPY", 3, 4, Absolute },
+	{ 0xCD, "CMP", 3, 4, Absolute },
+	{ 0xCE, "DEC", 3, 6, Absolute },
+	{ 0 },
+	{ 0xD0, "BNE", 2, 2 /* +1 if branch succeeds +2 if to a new page */, NoneAddressing},
+	{ 0xD1, "CMP", 2, 5 /* +1 if page crossed */, Indirect_Y },
+	{ 0xD2, "CMP", 2, 5, ZeroPage_Indirect },
+	{ 0 },
+	{ 0 },
+	{ 0xD5, "CMP", 2, 4, ZeroPage_X },
+	{ 0xD6, "DEC", 2, 6, ZeroPage_X },
+	{ 0 },
+	{ 0xD8, "CLD", 1, 2, NoneAddressing },
+	{ 0xD9, "CMP", 3, 4 /* +1 if page crossed */, Absolute_Y },
+	{ 0xDA, "PHX", 1, 3, NoneAddressing },
+	{ 0 },
+	{ 0 },
+	{ 0xDD, "CMP", 3, 4 /* +1 if page crossed */, Absolute_X },
+	{ 0xDE, "DEC", 3, 7, Absolute_X },
+	{ 0 },
+	{ 0xE0, "CPX", 2, 2, Immediate },
+	{ 0xE1, "SBC", 2, 6, Indirect_X },
+	{ 0 },
+	{ 0 },
+	{ 0xE4, "CPX", 2, 3, ZeroPage },
+	{ 0xE5, "SBC", 2, 3, ZeroPage },
+	{ 0xE6, "INC", 2, 5, ZeroPage },
+	{ 0 },
+	{ 0xE8, "INX", 1, 2, NoneAddressing },
+	{ 0xE9, "SBC", 2, 2, Immediate },
+	{ 0xEA, "NOP", 1, 2, NoneAddressing },
+	{ 0 },
+	{ 0xEC, "CPX", 3, 4, Absolute },
+	{ 0xED, "SBC", 3, 4, Absolute },
+	{ 0xEE, "INC", 3, 6, Absolute },
+	{ 0 },
+	{ 0xF0, "BEQ", 2, 2 /* +1 if branch succeeds +2 if to a new page */, NoneAddressing },
+	{ 0xF1, "SBC", 2, 5 /* +1 if page crossed */, Indirect_Y },
+	{ 0xF2, "SBC", 2, 5, ZeroPage_Indirect },
+	{ 0 },
+	{ 0 },
+	{ 0xF5, "SBC", 2, 4, ZeroPage_X },
+	{ 0xF6, "INC", 2, 6, ZeroPage_X },
+	{ 0 },
+	{ 0xF8, "SED", 1, 2, NoneAddressing },
+	{ 0xF9, "SBC", 3, 4 /* +1 if page crossed */, Absolute_Y },
+	{ 0xFA, "PLX", 1, 4, NoneAddressing },
+	{ 0 },
+	{ 0 },
+	{ 0xFD, "SBC", 3, 4 /* +1 if page crossed */, Absolute_X },
+	{ 0xFE, "INC", 3, 7, Absolute_X },
+	{ 0 },
+};
+
+static inline const OPCODE *variant_opcodes(CPU_VARIANT variant) {
+	return variant == CMOS_65C02 ? cmos_opcode_lookup_table : opcode_lookup_table;
+}
+
+#endif
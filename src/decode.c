@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "decode.h"
+
+#define FNV_OFFSET	0xCBF29CE484222325ULL
+#define FNV_PRIME	0x100000001B3ULL
+
+static size_t dcache_size(uint32_t nblocks, uint32_t nhot) {
+	return sizeof(DCACHE_HEADER) + MEMORY_SIZE * sizeof(INSN_INFO) + MEMORY_SIZE * sizeof(uint16_t)
+		+ nblocks * sizeof(BLOCK) + nhot * sizeof(uint16_t);
+}
+
+/// Points the section pointers into one contiguous buffer laid out as the file.
+static void dcache_layout(DCACHE *cache, uint8_t *base) {
+	cache->header = (DCACHE_HEADER *) base;
+	cache->insns = (INSN_INFO *) (base + sizeof(DCACHE_HEADER));
+	cache->block_at = (uint16_t *) (cache->insns + MEMORY_SIZE);
+	cache->blocks = (BLOCK *) (cache->block_at + MEMORY_SIZE);
+	cache->hot = (uint16_t *) (cache->blocks + cache->header->nblocks);
+}
+
+static void dcache_path(char *path, size_t size, const char *dir, uint64_t hash) {
+	snprintf(path, size, "%s/%016lx.dcache", dir, hash);
+}
+
+static const uint16_t vector_addrs[] = { 0xFFFC, 0xFFFA, 0xFFFE };
+
+/// FNV-1a over the decoder version, load address, vectors and image bytes,
+/// `image` being what was loaded at `load` in `cpu`.
+uint64_t image_hash(CPU *cpu, uint8_t *image, size_t len, uint16_t load) {
+	uint64_t hash = FNV_OFFSET;
+	uint8_t prefix[9] = { DCACHE_VERSION, (uint8_t) load, (uint8_t) (load >> 8) };
+	for (size_t i = 0; i < 3; ++i) {
+		uint16_t vector = mem_read_u16(cpu, vector_addrs[i]);
+		prefix[3 + 2 * i] = (uint8_t) vector;
+		prefix[4 + 2 * i] = (uint8_t) (vector >> 8);
+	}
+
+	for (size_t i = 0; i < sizeof(prefix); ++i)
+		hash = (hash ^ prefix[i]) * FNV_PRIME;
+	for (size_t i = 0; i < len; ++i)
+		hash = (hash ^ image[i]) * FNV_PRIME;
+	return hash;
+}
+
+void createDCACHE(DCACHE *cache) {
+	cache->header = NULL;
+	cache->insns = NULL;
+	cache->block_at = NULL;
+	cache->blocks = NULL;
+	cache->hot = NULL;
+	cache->map = NULL;
+	cache->map_len = 0;
+	cache->mapped = 0;
+}
+
+void destroyDCACHE(DCACHE *cache) {
+	if (cache->mapped)
+		munmap(cache->map, cache->map_len);
+	else
+		free(cache->map);
+	createDCACHE(cache);
+}
+
+static uint8_t is_branch(uint8_t code) {
+	return (code & 0x1F) == 0x10;
+}
+
+/// Instructions after which execution does not simply continue with the next one.
+static uint8_t ends_block(uint8_t code) {
+	return is_branch(code) || code == 0x4C || code == 0x6C || code == 0x20
+		|| code == 0x60 || code == 0x40 || code == 0x00;
+}
+
+/// Follows control flow from the reset, NMI and IRQ vectors and groups the
+/// instructions found into basic blocks.
+void decode_image(DCACHE *cache, CPU *cpu, uint8_t *image, size_t len, uint16_t load) {
+	INSN_INFO *insns = calloc(MEMORY_SIZE, sizeof(INSN_INFO));
+	uint16_t *work = malloc((MEMORY_SIZE * 2 + 4) * sizeof(uint16_t));
+	size_t nwork = 0;
+
+	for (size_t i = 0; i < 3; ++i) {
+		uint16_t addr = mem_read_u16(cpu, vector_addrs[i]);
+		if (addr)
+			work[nwork++] = addr;
+	}
+
+	while (nwork) {
+		uint16_t addr = work[--nwork];
+		insns[addr].flags |= INSN_LEADER;
+
+		while (!(insns[addr].flags & INSN_DECODED)) {
+			uint8_t code = mem_read(cpu, addr);
+			OPCODE op = opcode_lookup_table[code];
+			if (!op.len)
+				break;
+
+			insns[addr] = (INSN_INFO) { code, op.len, op.cycles, insns[addr].flags | INSN_DECODED };
+			uint16_t next = addr + op.len;
+			if (!ends_block(code)) {
+				addr = next;
+				continue;
+			}
+
+			insns[addr].flags |= INSN_END;
+			if (is_branch(code)) {
+				work[nwork++] = next + (uint16_t) (int8_t) mem_read(cpu, addr + 1);
+				work[nwork++] = next;
+			} else if (code == 0x4C) {
+				work[nwork++] = mem_read_u16(cpu, addr + 1);
+			} else if (code == 0x20) {
+				work[nwork++] = mem_read_u16(cpu, addr + 1);
+				work[nwork++] = next;
+			}
+			break;
+		}
+	}
+	free(work);
+
+	uint32_t nblocks = 0;
+	for (uint32_t addr = 0; addr < MEMORY_SIZE; ++addr)
+		nblocks += (insns[addr].flags & (INSN_LEADER | INSN_DECODED)) == (INSN_LEADER | INSN_DECODED);
+	// block_at stores index + 1 in 16 bits
+	if (nblocks > 0xFFFF) nblocks = 0xFFFF;
+
+	destroyDCACHE(cache);
+	cache->map_len = dcache_size(nblocks, 0);
+	cache->map = calloc(1, cache->map_len);
+	DCACHE_HEADER *header = cache->map;
+	memcpy(header->magic, DCACHE_MAGIC, sizeof(DCACHE_MAGIC));
+	header->version = DCACHE_VERSION;
+	header->image_len = (uint32_t) len;
+	header->hash = image_hash(cpu, image, len, load);
+	header->load = load;
+	for (size_t i = 0; i < 3; ++i)
+		header->vectors[i] = mem_read_u16(cpu, vector_addrs[i]);
+	header->nblocks = nblocks;
+	header->nhot = 0;
+	dcache_layout(cache, cache->map);
+	memcpy(cache->insns, insns, MEMORY_SIZE * sizeof(INSN_INFO));
+
+	uint32_t b = 0;
+	for (uint32_t start = 0; start < MEMORY_SIZE && b < nblocks; ++start) {
+		if ((insns[start].flags & (INSN_LEADER | INSN_DECODED)) != (INSN_LEADER | INSN_DECODED))
+			continue;
+
+		BLOCK *block = &cache->blocks[b];
+		block->start = (uint16_t) start;
+		block->ninsns = 0;
+		block->cycles = 0;
+		uint16_t addr = (uint16_t) start;
+		do {
+			block->ninsns += 1;
+			block->cycles += insns[addr].cycles;
+			if (insns[addr].flags & INSN_END)
+				break;
+			addr += insns[addr].len;
+		} while ((insns[addr].flags & (INSN_DECODED | INSN_LEADER)) == INSN_DECODED);
+		cache->block_at[start] = (uint16_t) ++b;
+	}
+	free(insns);
+}
+
+static uint8_t same_vectors(DCACHE_HEADER *header, CPU *cpu) {
+	for (size_t i = 0; i < 3; ++i)
+		if (header->vectors[i] != mem_read_u16(cpu, vector_addrs[i]))
+			return 0;
+	return 1;
+}
+
+/// Maps the cache file for this image, or decodes and saves it when the file
+/// is missing or stale. Returns 1 on a cache hit.
+uint8_t dcache_open(DCACHE *cache, const char *dir, CPU *cpu, uint8_t *image, size_t len, uint16_t load) {
+	char path[4096];
+	uint64_t hash = image_hash(cpu, image, len, load);
+	dcache_path(path, sizeof(path), dir, hash);
+
+	int fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		struct stat st;
+		void *map = MAP_FAILED;
+		if (!fstat(fd, &st) && (size_t) st.st_size >= sizeof(DCACHE_HEADER))
+			map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+
+		if (map != MAP_FAILED) {
+			DCACHE_HEADER *header = map;
+			if (!memcmp(header->magic, DCACHE_MAGIC, sizeof(DCACHE_MAGIC))
+					&& header->version == DCACHE_VERSION && header->hash == hash
+					&& header->image_len == len && header->load == load
+					&& same_vectors(header, cpu)
+					&& (size_t) st.st_size == dcache_size(header->nblocks, header->nhot)) {
+				destroyDCACHE(cache);
+				cache->map = map;
+				cache->map_len = (size_t) st.st_size;
+				cache->mapped = 1;
+				dcache_layout(cache, map);
+				return 1;
+			}
+			munmap(map, (size_t) st.st_size);
+		}
+	}
+
+	decode_image(cache, cpu, image, len, load);
+	dcache_save(cache, dir);
+	return 0;
+}
+
+/// Writes the cache through a temporary file so concurrent readers never
+/// map a partial file.
+uint8_t dcache_save(DCACHE *cache, const char *dir) {
+	char path[4096], tmp[4200];
+	dcache_path(path, sizeof(path), dir, cache->header->hash);
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+
+	mkdir(dir, 0755);
+	FILE *f = fopen(tmp, "wb");
+	if (!f)
+		return 0;
+	size_t written = fwrite(cache->map, 1, cache->map_len, f);
+	if (fclose(f) || written != cache->map_len || rename(tmp, path)) {
+		unlink(tmp);
+		return 0;
+	}
+	return 1;
+}
+
+/// Replaces the hot list with the most executed blocks of `counts`.
+/// Returns 0 if it is the same list, so there is nothing to save.
+uint8_t dcache_update_hot(DCACHE *cache, uint64_t *counts) {
+	uint32_t nblocks = cache->header->nblocks;
+	uint16_t hot[MAX_HOT_BLOCKS];
+	uint32_t nhot = 0;
+
+	// insertion into a small sorted list, the block count is tiny
+	for (uint32_t b = 0; b < nblocks; ++b) {
+		if (!counts[b])
+			continue;
+		uint32_t pos = nhot < MAX_HOT_BLOCKS ? nhot++ : MAX_HOT_BLOCKS;
+		while (pos > 0 && counts[hot[pos - 1]] < counts[b]) {
+			if (pos < MAX_HOT_BLOCKS) hot[pos] = hot[pos - 1];
+			pos -= 1;
+		}
+		if (pos < MAX_HOT_BLOCKS) hot[pos] = (uint16_t) b;
+	}
+
+	if (nhot == cache->header->nhot && !memcmp(hot, cache->hot, nhot * sizeof(uint16_t)))
+		return 0;
+
+	size_t map_len = dcache_size(nblocks, nhot);
+	uint8_t *map = malloc(map_len);
+	memcpy(map, cache->map, dcache_size(nblocks, 0));
+	destroyDCACHE(cache);
+	cache->map = map;
+	cache->map_len = map_len;
+	cache->header = (DCACHE_HEADER *) map;
+	cache->header->nhot = nhot;
+	dcache_layout(cache, map);
+	memcpy(cache->hot, hot, nhot * sizeof(uint16_t));
+	return 1;
+}
+
+/// Runs until BRK, counting how often each known block is entered.
+uint8_t run_profiled(CPU *cpu, DCACHE *cache, uint64_t *counts) {
+	while (1) {
+		uint16_t b = cache->block_at[cpu->program_counter];
+		if (b)
+			counts[b - 1] += 1;
+		if (!step(cpu))
+			return 0;
+	}
+}
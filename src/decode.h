@@ -0,0 +1,84 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdint.h>
+
+#include "cpu_6502.h"
+
+#define DCACHE_MAGIC	"6502DC"
+#define DCACHE_VERSION	2
+#define MAX_HOT_BLOCKS	256
+
+/* INSN_INFO flags */
+#define INSN_DECODED	(1 << 0)
+#define INSN_LEADER	(1 << 1)
+#define INSN_END	(1 << 2)
+
+/// # Decode cache
+///
+/// Result of decoding a loaded image: instruction boundaries found by
+/// following control flow from the vectors, the basic blocks they form and
+/// the blocks that were hottest in the last profiled run. It is saved to
+/// `<dir>/<hash>.dcache`, keyed by a hash of the image, its load address and
+/// the vectors, and memory-mapped back on the next start. A file whose header
+/// does not match the image is rebuilt.
+///
+/// The interpreter itself decodes nothing ahead of time, what a start saves
+/// is the decode pass and the profiled run that finds the hot blocks: once
+/// a file has a hot list, `emu --cache` runs at full speed and `aot -d`
+/// translates the hot blocks without decoding the image again.
+///
+/// File layout: DCACHE_HEADER, INSN_INFO[0x10000], uint16_t block_at[0x10000],
+/// BLOCK[nblocks], uint16_t hot[nhot]
+///
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t image_len;
+	uint64_t hash;
+	uint16_t load;
+	/* Reset, NMI and IRQ */
+	uint16_t vectors[3];
+	uint32_t nblocks;
+	uint32_t nhot;
+} DCACHE_HEADER;
+
+typedef struct {
+	uint8_t code;
+	uint8_t len;
+	uint8_t cycles;
+	uint8_t flags;
+} INSN_INFO;
+
+typedef struct {
+	uint16_t start;
+	uint16_t ninsns;
+	uint32_t cycles;
+} BLOCK;
+
+typedef struct {
+	DCACHE_HEADER *header;
+	INSN_INFO *insns;
+	/* Block index + 1 for every block start address, 0 elsewhere */
+	uint16_t *block_at;
+	BLOCK *blocks;
+	uint16_t *hot;
+
+	void *map;
+	size_t map_len;
+	uint8_t mapped;
+} DCACHE;
+
+uint64_t image_hash(CPU *cpu, uint8_t *image, size_t len, uint16_t load);
+
+void createDCACHE(DCACHE *cache);
+void destroyDCACHE(DCACHE *cache);
+
+void decode_image(DCACHE *cache, CPU *cpu, uint8_t *image, size_t len, uint16_t load);
+uint8_t dcache_open(DCACHE *cache, const char *dir, CPU *cpu, uint8_t *image, size_t len, uint16_t load);
+uint8_t dcache_save(DCACHE *cache, const char *dir);
+uint8_t dcache_update_hot(DCACHE *cache, uint64_t *counts);
+
+uint8_t run_profiled(CPU *cpu, DCACHE *cache, uint64_t *counts);
+
+#endif
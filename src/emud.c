@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "server.h"
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+	(void) sig;
+	stop = 1;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-s socket] [-j workers] [-n max_sessions]\n", name);
+}
+
+int main(int argc, char **argv) {
+	const char *path = "/tmp/6502.sock";
+	size_t workers = (size_t) sysconf(_SC_NPROCESSORS_ONLN);
+	size_t max_sessions = 65536;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "s:j:n:")) != -1) {
+		switch (opt) {
+			case 's': path = optarg; break;
+			case 'j': workers = strtoull(optarg, NULL, 0); break;
+			case 'n': max_sessions = strtoull(optarg, NULL, 0); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (!workers || !max_sessions || max_sessions > UINT32_MAX || optind != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	// no SA_RESTART, epoll_wait has to return
+	struct sigaction sa = { .sa_handler = on_signal };
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	SERVER server;
+	if (!createSERVER(&server, path, workers, max_sessions)) {
+		perror(path);
+		return 1;
+	}
+	fprintf(stderr, "listening on %s with %lu workers\n", path, workers);
+	server_run(&server, &stop);
+	destroySERVER(&server);
+	return 0;
+}
@@ -0,0 +1,171 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "env.h"
+#include "snake.h"
+#include "util.h"
+
+typedef struct {
+	ENV *env;
+	size_t index;
+} ENV_THREAD;
+
+/// Restores the boot snapshot with the apple somewhere else, the game
+/// placed it before any random byte was fed.
+static void restart(ENV *env, size_t i) {
+	CPU *cpu = &env->cpus[i];
+	uint8_t random = (uint8_t) xorshift(&env->rng[i]);
+
+	restore(cpu, env->boot);
+	mem_write(cpu, SNAKE_APPLE, random);
+	mem_write(cpu, SNAKE_APPLE + 1, (random & 3) + (DISPLAY_START >> 8));
+}
+
+static void reset_one(void *arg, size_t i) {
+	ENV *env = arg;
+	restart(env, i);
+	env->rewards[i] = 0;
+	env->dones[i] = 0;
+	memcpy(&env->screens[i * DISPLAY_SIZE], &env->cpus[i].memory[DISPLAY_START], DISPLAY_SIZE);
+}
+
+static void step_one(void *arg, size_t i) {
+	ENV *env = arg;
+	CPU *cpu = &env->cpus[i];
+	uint8_t length = cpu->memory[SNAKE_LENGTH];
+	float reward = 0;
+	uint8_t done = 0;
+
+	mem_write(cpu, SNAKE_RANDOM, (uint8_t) xorshift(&env->rng[i]));
+	io_feed(cpu, snake_keys[env->actions[i] % ENV_ACTIONS]);
+	YIELD_REASON reason = resume(cpu, ENV_FRAME_BUDGET);
+	if (reason != YIELD_INPUT) {
+		reward = reason == YIELD_BRK ? -1 : 0;
+		done = 1;
+		restart(env, i);
+	} else if (cpu->memory[SNAKE_LENGTH] != length) {
+		reward = 1;
+	}
+
+	env->rewards[i] = reward;
+	env->dones[i] = done;
+	memcpy(&env->screens[i * DISPLAY_SIZE], &cpu->memory[DISPLAY_START], DISPLAY_SIZE);
+}
+
+static void run_range(ENV *env, size_t index) {
+	size_t first = env->n * index / env->nthreads;
+	size_t last = env->n * (index + 1) / env->nthreads;
+	for (size_t i = first; i < last; ++i)
+		env->job(env, i);
+}
+
+static void *env_thread(void *arg) {
+	ENV_THREAD thread = *(ENV_THREAD *) arg;
+	free(arg);
+
+	for (;;) {
+		pthread_barrier_wait(&thread.env->start);
+		if (thread.env->quit)
+			break;
+		run_range(thread.env, thread.index);
+		pthread_barrier_wait(&thread.env->done);
+	}
+	return NULL;
+}
+
+/// Runs `job` over every instance, the calling thread takes the first share.
+static void run_job(ENV *env, void (*job)(void *env, size_t i)) {
+	env->job = job;
+	if (env->nthreads == 1) {
+		run_range(env, 0);
+		return;
+	}
+	pthread_barrier_wait(&env->start);
+	run_range(env, 0);
+	pthread_barrier_wait(&env->done);
+}
+
+/// Boots the game once and makes `n` instances of it. Returns 0 if the
+/// game never asked for a key.
+uint8_t createENV(ENV *env, size_t n, size_t threads, uint64_t seed) {
+	env->boot = malloc(sizeof(CPU));
+	createCPU(env->boot);
+	snake_load(env->boot);
+	reset(env->boot);
+	io_attach(env->boot, SNAKE_KEY, 1, 0);
+	if (resume(env->boot, ENV_FRAME_BUDGET) != YIELD_INPUT) {
+		destroyCPU(env->boot);
+		free(env->boot);
+		return 0;
+	}
+	// the copies start with no page to restore
+	memset(env->boot->dirty, 0, sizeof(env->boot->dirty));
+
+	env->n = n;
+	env->cpus = malloc(n * sizeof(CPU));
+	env->rng = malloc(n * sizeof(uint64_t));
+	for (size_t i = 0; i < n; ++i) {
+		memcpy(&env->cpus[i], env->boot, sizeof(CPU));
+		env->rng[i] = (seed + i + 1) * 0x9E3779B97F4A7C15ULL;
+	}
+	env->screens = malloc(n * DISPLAY_SIZE);
+	env->rewards = malloc(n * sizeof(float));
+	env->dones = malloc(n);
+	env->actions = NULL;
+	env->steps = 0;
+	env->episodes = 0;
+
+	env->nthreads = threads < 1 ? 1 : threads > n ? n : threads;
+	env->quit = 0;
+	env->threads = malloc(env->nthreads * sizeof(pthread_t));
+	if (env->nthreads > 1) {
+		pthread_barrier_init(&env->start, NULL, (unsigned) env->nthreads);
+		pthread_barrier_init(&env->done, NULL, (unsigned) env->nthreads);
+		for (size_t i = 1; i < env->nthreads; ++i) {
+			ENV_THREAD *thread = malloc(sizeof(ENV_THREAD));
+			thread->env = env;
+			thread->index = i;
+			pthread_create(&env->threads[i], NULL, env_thread, thread);
+		}
+	}
+
+	env_reset(env);
+	return 1;
+}
+
+void destroyENV(ENV *env) {
+	if (env->nthreads > 1) {
+		env->quit = 1;
+		pthread_barrier_wait(&env->start);
+		for (size_t i = 1; i < env->nthreads; ++i)
+			pthread_join(env->threads[i], NULL);
+		pthread_barrier_destroy(&env->start);
+		pthread_barrier_destroy(&env->done);
+	}
+	free(env->threads);
+
+	for (size_t i = 0; i < env->n; ++i)
+		destroyCPU(&env->cpus[i]);
+	free(env->cpus);
+	destroyCPU(env->boot);
+	free(env->boot);
+	free(env->rng);
+	free(env->screens);
+	free(env->rewards);
+	free(env->dones);
+}
+
+/// Starts a new game in every instance.
+void env_reset(ENV *env) {
+	run_job(env, reset_one);
+}
+
+/// Plays `actions[i]` for one frame in instance i.
+void env_step(ENV *env, const uint8_t *actions) {
+	env->actions = actions;
+	run_job(env, step_one);
+
+	env->steps += env->n;
+	for (size_t i = 0; i < env->n; ++i)
+		env->episodes += env->dones[i];
+}
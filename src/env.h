@@ -0,0 +1,63 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "cpu_6502.h"
+#include "render.h"
+
+#define ENV_ACTIONS		4
+#define ENV_FRAME_BUDGET	1000000
+
+/// # Snake environment
+///
+/// N copies of the snake game stepped together, one frame per step, for
+/// reinforcement learning. Needs CPU_IO and CPU_DIRTY_PAGES.
+///
+/// A frame ends when the game polls the key again. env_step() writes each
+/// action (an index into snake_keys) as that key, runs every instance to
+/// its next poll and fills the arrays below, laid out contiguously so
+/// they can be wrapped without copying:
+///
+///  - screens: n x DISPLAY_SIZE bytes, the $0200-$05FF display
+///  - rewards: 1 when the snake ate, -1 when it died, 0 otherwise
+///  - dones: 1 when the game ended (or ran past ENV_FRAME_BUDGET cycles)
+///
+/// An instance that is done is reset right away, so its screen is already
+/// the first frame of the next game. Resetting restores a snapshot taken
+/// at the first poll after boot, only copying back the pages the game
+/// wrote. The instances are split over `threads` threads, the caller's
+/// included.
+///
+typedef struct {
+	size_t n;
+	CPU *cpus;
+	/* Waiting for the first key, what every game starts from */
+	CPU *boot;
+	uint64_t *rng;
+
+	uint8_t *screens;
+	float *rewards;
+	uint8_t *dones;
+	const uint8_t *actions;
+	uint64_t steps;
+	uint64_t episodes;
+
+	/* What the threads do to each instance, step or reset */
+	void (*job)(void *env, size_t i);
+	pthread_t *threads;
+	size_t nthreads;
+	pthread_barrier_t start;
+	pthread_barrier_t done;
+	uint8_t quit;
+} ENV;
+
+uint8_t createENV(ENV *env, size_t n, size_t threads, uint64_t seed);
+void destroyENV(ENV *env);
+
+void env_reset(ENV *env);
+void env_step(ENV *env, const uint8_t *actions);
+
+#endif
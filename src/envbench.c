@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "env.h"
+#include "util.h"
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-n envs] [-j threads] [-t seconds] [-s seed]\n"
+			"\tsteps the snake environment with random actions\n", name);
+}
+
+int main(int argc, char **argv) {
+	size_t n = 256;
+	size_t threads = (size_t) sysconf(_SC_NPROCESSORS_ONLN);
+	double seconds = 5;
+	uint64_t seed = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:j:t:s:")) != -1) {
+		switch (opt) {
+			case 'n': n = strtoull(optarg, NULL, 0); break;
+			case 'j': threads = strtoull(optarg, NULL, 0); break;
+			case 't': seconds = strtod(optarg, NULL); break;
+			case 's': seed = strtoull(optarg, NULL, 0); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (!n || optind != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ENV env;
+	if (!createENV(&env, n, threads, seed)) {
+		fprintf(stderr, "the game did not boot\n");
+		return 1;
+	}
+
+	uint8_t *actions = malloc(n);
+	uint64_t rng = seed * 2 + 1;
+	double reward = 0;
+	double start = now(), elapsed;
+	do {
+		for (int round = 0; round < 16; ++round) {
+			for (size_t i = 0; i < n; ++i) {
+				rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+				actions[i] = (uint8_t) (rng >> 62);
+			}
+			env_step(&env, actions);
+			for (size_t i = 0; i < n; ++i)
+				reward += env.rewards[i];
+		}
+		elapsed = now() - start;
+	} while (elapsed < seconds);
+
+	printf("%lu envs on %lu threads: %lu steps in %.2fs, %.0f steps/s\n",
+		n, env.nthreads, env.steps, elapsed, (double) env.steps / elapsed);
+	printf("%lu episodes, %.2f mean reward\n", env.episodes,
+		env.episodes ? reward / (double) env.episodes : 0.0);
+
+	free(actions);
+	destroyENV(&env);
+	return 0;
+}
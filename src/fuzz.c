@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "fuzz.h"
+#include "util.h"
+
+static const uint8_t interesting_8[] = { 0x00, 0x01, 0x10, 0x20, 0x40, 0x7F, 0x80, 0x81, 0xFE, 0xFF };
+
+/// AFL hit count buckets: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+
+static uint8_t count_class[256];
+
+static volatile sig_atomic_t stop;
+
+static void on_sigint(int sig) {
+	(void) sig;
+	stop = 1;
+}
+
+static void init_count_class(void) {
+	for (int i = 0; i < 256; ++i) {
+		if (i == 0) count_class[i] = 0;
+		else if (i == 1) count_class[i] = 1;
+		else if (i == 2) count_class[i] = 2;
+		else if (i == 3) count_class[i] = 4;
+		else if (i < 8) count_class[i] = 8;
+		else if (i < 16) count_class[i] = 16;
+		else if (i < 32) count_class[i] = 32;
+		else if (i < 128) count_class[i] = 64;
+		else count_class[i] = 128;
+	}
+}
+
+static void write_file(const char *dir, const char *kind, uint32_t id, uint8_t *data, size_t len) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s/id_%06u", dir, kind, id);
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return;
+	fwrite(data, 1, len, f);
+	fclose(f);
+}
+
+static void add_to_corpus(FUZZER *fuzzer, uint8_t *data, size_t len) {
+	if (fuzzer->corpus_len == fuzzer->corpus_cap) {
+		fuzzer->corpus_cap = fuzzer->corpus_cap ? fuzzer->corpus_cap * 2 : 64;
+		fuzzer->corpus = realloc(fuzzer->corpus, fuzzer->corpus_cap * sizeof(ENTRY));
+	}
+	ENTRY *entry = &fuzzer->corpus[fuzzer->corpus_len++];
+	entry->data = malloc(len ? len : 1);
+	memcpy(entry->data, data, len);
+	entry->len = len;
+}
+
+void createFUZZER(FUZZER *fuzzer, uint8_t *image, size_t len) {
+	init_count_class();
+
+	createCPU(&fuzzer->snap);
+	load(&fuzzer->snap, image, len);
+	reset(&fuzzer->snap);
+
+	fuzzer->input_addr = 0x0200;
+	fuzzer->len_addr = -1;
+	fuzzer->max_len = 256;
+	fuzzer->cycle_limit = 1000000;
+	fuzzer->out_dir = NULL;
+
+	fuzzer->corpus = NULL;
+	fuzzer->corpus_len = 0;
+	fuzzer->corpus_cap = 0;
+	memset(fuzzer->virgin, 0xFF, sizeof(fuzzer->virgin));
+	pthread_mutex_init(&fuzzer->lock, NULL);
+
+	atomic_init(&fuzzer->execs, 0);
+	atomic_init(&fuzzer->crashes, 0);
+	atomic_init(&fuzzer->hangs, 0);
+	fuzzer->edges = 0;
+}
+
+void destroyFUZZER(FUZZER *fuzzer) {
+	for (size_t i = 0; i < fuzzer->corpus_len; ++i)
+		free(fuzzer->corpus[i].data);
+	free(fuzzer->corpus);
+	pthread_mutex_destroy(&fuzzer->lock);
+	destroyCPU(&fuzzer->snap);
+}
+
+/// Runs the firmware's own initialisation up to `entry` and keeps that state
+/// as the snapshot every execution starts from.
+uint8_t fuzz_init(FUZZER *fuzzer, uint16_t entry) {
+	uint64_t start = fuzzer->snap.cycles;
+	uint8_t ret = 1;
+
+	// coverage of the initialisation is not interesting, but step() needs a map
+	fuzzer->snap.edge_map = malloc(EDGE_MAP_SIZE);
+	while (fuzzer->snap.program_counter != entry) {
+		if (!step(&fuzzer->snap) || fuzzer->snap.cycles - start > fuzzer->cycle_limit) {
+			ret = 0;
+			break;
+		}
+	}
+	free(fuzzer->snap.edge_map);
+	fuzzer->snap.edge_map = NULL;
+	fuzzer->snap.prev_loc = 0;
+	return ret;
+}
+
+/// Executes one input from the snapshot and returns FUZZ_OK, FUZZ_CRASH or FUZZ_HANG.
+/// Edge counts land in `trace`.
+FUZZ_RESULT fuzz_exec(FUZZER *fuzzer, CPU *cpu, uint8_t *trace, uint8_t *data, size_t len) {
+	restore(cpu, &fuzzer->snap);
+	memset(trace, 0, EDGE_MAP_SIZE);
+	cpu->edge_map = trace;
+
+	for (size_t i = 0; i < len; ++i)
+		mem_write(cpu, fuzzer->input_addr + (uint16_t) i, data[i]);
+	if (fuzzer->len_addr >= 0)
+		mem_write(cpu, (uint16_t) fuzzer->len_addr, (uint8_t) len);
+
+	uint8_t budget_left = run_cycles(cpu, fuzzer->cycle_limit);
+	if (cpu->fault)
+		return FUZZ_CRASH;
+	if (budget_left)
+		return FUZZ_HANG;
+	return FUZZ_OK;
+}
+
+/// Replaces raw hit counts with their bucket.
+static void classify_counts(uint8_t *trace) {
+	uint64_t *t = (uint64_t *) trace;
+
+	for (size_t i = 0; i < EDGE_MAP_SIZE / 8; ++i) {
+		if (!t[i])
+			continue;
+		for (size_t j = i * 8; j < i * 8 + 8; ++j)
+			trace[j] = count_class[trace[j]];
+	}
+}
+
+/// Reports whether the classified `trace` holds a bit not yet cleared from
+/// `virgin`, clearing those bits.
+static uint8_t has_new_bits(uint8_t *trace, uint8_t *virgin) {
+	uint64_t *t = (uint64_t *) trace;
+	uint64_t *v = (uint64_t *) virgin;
+	uint8_t ret = 0;
+
+	for (size_t i = 0; i < EDGE_MAP_SIZE / 8; ++i) {
+		if (t[i] & v[i]) {
+			v[i] &= ~t[i];
+			ret = 1;
+		}
+	}
+
+	return ret;
+}
+
+static size_t mutate(uint64_t *rng, uint8_t *buf, size_t len, size_t max_len) {
+	uint32_t stacking = 1u << (1 + xorshift(rng) % 5);
+
+	for (uint32_t i = 0; i < stacking; ++i) {
+		uint64_t r = xorshift(rng);
+		switch (r % 7) {
+			/* Flip a bit */
+			case 0:
+				if (len) buf[(r >> 8) % len] ^= 1 << ((r >> 3) & 7);
+			break;
+
+			/* Interesting value */
+			case 1:
+				if (len) buf[(r >> 8) % len] = interesting_8[(r >> 3) % sizeof(interesting_8)];
+			break;
+
+			/* Random byte */
+			case 2:
+				if (len) buf[(r >> 8) % len] = (uint8_t) (r >> 40);
+			break;
+
+			/* Small add / sub */
+			case 3:
+				if (len) buf[(r >> 8) % len] += (uint8_t) ((r >> 3) % 35) - 17;
+			break;
+
+			/* Delete a block */
+			case 4:
+				if (len > 1) {
+					size_t del = 1 + (r >> 8) % (len / 2);
+					size_t pos = (r >> 24) % (len - del + 1);
+					memmove(buf + pos, buf + pos + del, len - pos - del);
+					len -= del;
+				}
+			break;
+
+			/* Insert a block of random bytes */
+			case 5:
+				if (len < max_len) {
+					size_t ins = 1 + (r >> 8) % 16;
+					if (ins > max_len - len) ins = max_len - len;
+					size_t pos = (r >> 24) % (len + 1);
+					memmove(buf + pos + ins, buf + pos, len - pos);
+					for (size_t j = 0; j < ins; ++j)
+						buf[pos + j] = (uint8_t) xorshift(rng);
+					len += ins;
+				}
+			break;
+
+			/* Copy a block inside the input */
+			case 6:
+				if (len > 1) {
+					size_t cnt = 1 + (r >> 8) % (len / 2);
+					size_t from = (r >> 24) % (len - cnt + 1);
+					size_t to = (r >> 40) % (len - cnt + 1);
+					memmove(buf + to, buf + from, cnt);
+				}
+			break;
+		}
+	}
+
+	return len;
+}
+
+typedef struct {
+	FUZZER *fuzzer;
+	uint64_t seed;
+} WORKER;
+
+static void *fuzz_worker(void *arg) {
+	WORKER *worker = arg;
+	FUZZER *fuzzer = worker->fuzzer;
+	uint64_t rng = worker->seed;
+
+	CPU *cpu = malloc(sizeof(CPU));
+	memcpy(cpu, &fuzzer->snap, sizeof(CPU));
+	uint8_t *trace = aligned_alloc(64, EDGE_MAP_SIZE);
+	uint8_t (*virgin)[EDGE_MAP_SIZE] = malloc(3 * EDGE_MAP_SIZE);
+	uint8_t *buf = malloc(fuzzer->max_len);
+	uint8_t *parent_data = malloc(fuzzer->max_len);
+	memset(virgin, 0xFF, 3 * EDGE_MAP_SIZE);
+
+	uint64_t execs = 0;
+	while (!stop) {
+		pthread_mutex_lock(&fuzzer->lock);
+		ENTRY *parent = &fuzzer->corpus[xorshift(&rng) % fuzzer->corpus_len];
+		size_t parent_len = parent->len < fuzzer->max_len ? parent->len : fuzzer->max_len;
+		memcpy(parent_data, parent->data, parent_len);
+		pthread_mutex_unlock(&fuzzer->lock);
+
+		for (int round = 0; round < 256 && !stop; ++round) {
+			memcpy(buf, parent_data, parent_len);
+			size_t len = mutate(&rng, buf, parent_len, fuzzer->max_len);
+			FUZZ_RESULT res = fuzz_exec(fuzzer, cpu, trace, buf, len);
+			execs += 1;
+
+			// Cheap check against our own view first, only take the lock
+			// when this thread has not seen the coverage yet.
+			classify_counts(trace);
+			if (!has_new_bits(trace, virgin[res]))
+				continue;
+
+			pthread_mutex_lock(&fuzzer->lock);
+			if (has_new_bits(trace, fuzzer->virgin[res])) {
+				uint32_t id;
+				if (res == FUZZ_CRASH) {
+					id = (uint32_t) atomic_fetch_add(&fuzzer->crashes, 1);
+					if (fuzzer->out_dir) write_file(fuzzer->out_dir, "crashes", id, buf, len);
+				} else if (res == FUZZ_HANG) {
+					id = (uint32_t) atomic_fetch_add(&fuzzer->hangs, 1);
+					if (fuzzer->out_dir) write_file(fuzzer->out_dir, "hangs", id, buf, len);
+				} else {
+					id = (uint32_t) fuzzer->corpus_len;
+					add_to_corpus(fuzzer, buf, len);
+					if (fuzzer->out_dir) write_file(fuzzer->out_dir, "queue", id, buf, len);
+					fuzzer->edges = 0;
+					for (size_t i = 0; i < EDGE_MAP_SIZE; ++i)
+						fuzzer->edges += fuzzer->virgin[FUZZ_OK][i] != 0xFF;
+				}
+			}
+			pthread_mutex_unlock(&fuzzer->lock);
+		}
+
+		atomic_fetch_add(&fuzzer->execs, execs);
+		execs = 0;
+	}
+
+	free(parent_data);
+	free(buf);
+	free(virgin);
+	free(trace);
+	free(cpu);
+	return NULL;
+}
+
+void load_corpus(FUZZER *fuzzer, const char *dir) {
+	DIR *d = dir ? opendir(dir) : NULL;
+	if (d) {
+		struct dirent *ent;
+		while ((ent = readdir(d))) {
+			if (ent->d_name[0] == '.')
+				continue;
+			char path[4096];
+			size_t len;
+			snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+			uint8_t *data = read_file(path, &len);
+			if (!data)
+				continue;
+			add_to_corpus(fuzzer, data, len < fuzzer->max_len ? len : fuzzer->max_len);
+			free(data);
+		}
+		closedir(d);
+	}
+
+	if (!fuzzer->corpus_len) {
+		uint8_t zero = 0;
+		add_to_corpus(fuzzer, &zero, 1);
+	}
+}
+
+void fuzz(FUZZER *fuzzer, uint32_t jobs, uint32_t seconds) {
+	pthread_t threads[jobs];
+	WORKER workers[jobs];
+
+	if (fuzzer->out_dir) {
+		char path[4096];
+		mkdir(fuzzer->out_dir, 0755);
+		snprintf(path, sizeof(path), "%s/queue", fuzzer->out_dir);
+		mkdir(path, 0755);
+		snprintf(path, sizeof(path), "%s/crashes", fuzzer->out_dir);
+		mkdir(path, 0755);
+		snprintf(path, sizeof(path), "%s/hangs", fuzzer->out_dir);
+		mkdir(path, 0755);
+	}
+
+	for (uint32_t i = 0; i < jobs; ++i) {
+		workers[i].fuzzer = fuzzer;
+		workers[i].seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+		pthread_create(&threads[i], NULL, fuzz_worker, &workers[i]);
+	}
+
+	uint64_t last = 0;
+	for (uint32_t t = 1; !stop; ++t) {
+		sleep(1);
+		uint64_t execs = atomic_load(&fuzzer->execs);
+		pthread_mutex_lock(&fuzzer->lock);
+		printf("[%us] execs: %lu (%lu/s), corpus: %lu, edges: %lu, crashes: %lu, hangs: %lu\n",
+			t, execs, execs - last, fuzzer->corpus_len, fuzzer->edges,
+			(uint64_t) atomic_load(&fuzzer->crashes), (uint64_t) atomic_load(&fuzzer->hangs));
+		pthread_mutex_unlock(&fuzzer->lock);
+		fflush(stdout);
+		last = execs;
+		if (seconds && t >= seconds)
+			stop = 1;
+	}
+
+	for (uint32_t i = 0; i < jobs; ++i)
+		pthread_join(threads[i], NULL);
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-i seed_dir] [-o out_dir] [-a input_addr] [-L len_addr] [-n max_len]\n"
+			"\t[-e entry] [-c cycle_limit] [-j jobs] [-t seconds] image.bin\n", name);
+}
+
+int main(int argc, char **argv) {
+	const char *seed_dir = NULL;
+	const char *out_dir = NULL;
+	long input_addr = 0x0200, len_addr = -1, entry = -1;
+	size_t max_len = 256;
+	uint64_t cycle_limit = 1000000;
+	uint32_t jobs = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t seconds = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "i:o:a:L:n:e:c:j:t:")) != -1) {
+		switch (opt) {
+			case 'i': seed_dir = optarg; break;
+			case 'o': out_dir = optarg; break;
+			case 'a': input_addr = strtol(optarg, NULL, 0); break;
+			case 'L': len_addr = strtol(optarg, NULL, 0); break;
+			case 'n': max_len = strtoul(optarg, NULL, 0); break;
+			case 'e': entry = strtol(optarg, NULL, 0); break;
+			case 'c': cycle_limit = strtoull(optarg, NULL, 0); break;
+			case 'j': jobs = (uint32_t) strtoul(optarg, NULL, 0); break;
+			case 't': seconds = (uint32_t) strtoul(optarg, NULL, 0); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (optind >= argc || !jobs || !max_len) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	size_t len;
+	uint8_t *image = read_file(argv[optind], &len);
+	if (!image) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	static FUZZER fuzzer;
+	createFUZZER(&fuzzer, image, len);
+	free(image);
+	fuzzer.input_addr = (uint16_t) input_addr;
+	fuzzer.len_addr = (int32_t) len_addr;
+	fuzzer.max_len = max_len;
+	fuzzer.cycle_limit = cycle_limit;
+	fuzzer.out_dir = out_dir;
+
+	if (entry >= 0 && !fuzz_init(&fuzzer, (uint16_t) entry)) {
+		fprintf(stderr, "Program never reached entry 0x%04lX\n", entry);
+		return 1;
+	}
+	load_corpus(&fuzzer, seed_dir);
+
+	signal(SIGINT, on_sigint);
+	fuzz(&fuzzer, jobs, seconds);
+	destroyFUZZER(&fuzzer);
+
+	return 0;
+}
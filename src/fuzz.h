@@ -0,0 +1,60 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "cpu_6502.h"
+
+/// # Fuzzer
+///
+/// Coverage guided fuzzing of 6502 firmware, built with CPU_FUZZ and
+/// CPU_DIRTY_PAGES. The firmware is loaded and run once up to its entry
+/// point; that state is kept as `snap` and every execution restores it
+/// (dirty pages only) before writing the input at `input_addr`.
+///
+typedef enum {
+	FUZZ_OK,
+	FUZZ_CRASH,
+	FUZZ_HANG,
+} FUZZ_RESULT;
+
+typedef struct {
+	uint8_t *data;
+	size_t len;
+} ENTRY;
+
+typedef struct {
+	CPU snap;
+
+	uint16_t input_addr;
+	int32_t len_addr;	/* -1 if the length is not written */
+	size_t max_len;
+	uint64_t cycle_limit;
+	const char *out_dir;
+
+	/* Shared state, guarded by lock */
+	pthread_mutex_t lock;
+	ENTRY *corpus;
+	size_t corpus_len;
+	size_t corpus_cap;
+	/* Edges not seen yet, per FUZZ_RESULT: the queue, crashes and hangs
+	 * are kept apart so one does not hide the others */
+	uint8_t virgin[3][EDGE_MAP_SIZE];
+	uint64_t edges;
+
+	atomic_uint_fast64_t execs;
+	atomic_uint_fast64_t crashes;
+	atomic_uint_fast64_t hangs;
+} FUZZER;
+
+void createFUZZER(FUZZER *fuzzer, uint8_t *image, size_t len);
+void destroyFUZZER(FUZZER *fuzzer);
+
+uint8_t fuzz_init(FUZZER *fuzzer, uint16_t entry);
+FUZZ_RESULT fuzz_exec(FUZZER *fuzzer, CPU *cpu, uint8_t *trace, uint8_t *data, size_t len);
+void load_corpus(FUZZER *fuzzer, const char *dir);
+void fuzz(FUZZER *fuzzer, uint32_t jobs, uint32_t seconds);
+
+#endif
@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "heatmap.h"
+
+void createHEATMAP(HEATMAP *heatmap, CPU *cpu, uint8_t per_byte) {
+	memset(heatmap->pages, 0, sizeof(heatmap->pages));
+	heatmap->bytes = per_byte ? calloc(MEMORY_SIZE, sizeof(*heatmap->bytes)) : NULL;
+	cpu->heat_pages = heatmap->pages;
+	cpu->heat_bytes = heatmap->bytes;
+}
+
+void destroyHEATMAP(HEATMAP *heatmap, CPU *cpu) {
+	cpu->heat_pages = NULL;
+	cpu->heat_bytes = NULL;
+	free(heatmap->bytes);
+	heatmap->bytes = NULL;
+}
+
+/// One row per byte with any access when byte counters exist, else one per page.
+void heatmap_csv(HEATMAP *heatmap, FILE *out) {
+	if (heatmap->bytes) {
+		fprintf(out, "address,reads,writes,execs\n");
+		for (uint32_t add = 0; add < MEMORY_SIZE; ++add) {
+			uint64_t *c = heatmap->bytes[add];
+			if (c[HEAT_READ] || c[HEAT_WRITE] || c[HEAT_EXEC])
+				fprintf(out, "0x%04X,%lu,%lu,%lu\n", add, c[HEAT_READ], c[HEAT_WRITE], c[HEAT_EXEC]);
+		}
+		return;
+	}
+
+	fprintf(out, "page,reads,writes,execs\n");
+	for (uint32_t page = 0; page < 0x100; ++page) {
+		uint64_t *c = heatmap->pages[page];
+		if (c[HEAT_READ] || c[HEAT_WRITE] || c[HEAT_EXEC])
+			fprintf(out, "0x%02X,%lu,%lu,%lu\n", page, c[HEAT_READ], c[HEAT_WRITE], c[HEAT_EXEC]);
+	}
+}
+
+static uint64_t count_at(HEATMAP *heatmap, uint32_t add, int kind) {
+	if (heatmap->bytes)
+		return heatmap->bytes[add][kind];
+	return heatmap->pages[add >> 8][kind];
+}
+
+/// 256x256 binary PPM, one pixel per address (row = page). Writes are red,
+/// reads green and execution blue, each on a log scale of its own maximum.
+void heatmap_ppm(HEATMAP *heatmap, FILE *out) {
+	static const int channel[3] = { 1, 0, 2 };
+	double scale[3];
+
+	for (int kind = 0; kind < 3; ++kind) {
+		uint64_t max = 0;
+		for (uint32_t add = 0; add < MEMORY_SIZE; ++add) {
+			uint64_t c = count_at(heatmap, add, kind);
+			if (c > max) max = c;
+		}
+		scale[kind] = max ? 255.0 / log1p((double) max) : 0;
+	}
+
+	fprintf(out, "P6\n256 256\n255\n");
+	for (uint32_t add = 0; add < MEMORY_SIZE; ++add) {
+		uint8_t rgb[3];
+		for (int kind = 0; kind < 3; ++kind)
+			rgb[channel[kind]] = (uint8_t) (log1p((double) count_at(heatmap, add, kind)) * scale[kind]);
+		fwrite(rgb, 1, 3, out);
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cpu_6502.h"
+
+/// # Heatmap
+///
+/// Read/write/execute counters for a cpu built with CPU_HEATMAP; without the
+/// flag the hooks in mem_read(), mem_write() and the opcode fetch compile to
+/// nothing. Page counters are always kept, byte counters only on request.
+/// Operand bytes are counted as reads of the code page.
+///
+typedef struct {
+	uint64_t pages[0x100][3];
+	uint64_t (*bytes)[3];
+} HEATMAP;
+
+void createHEATMAP(HEATMAP *heatmap, CPU *cpu, uint8_t per_byte);
+void destroyHEATMAP(HEATMAP *heatmap, CPU *cpu);
+
+void heatmap_csv(HEATMAP *heatmap, FILE *out);
+void heatmap_ppm(HEATMAP *heatmap, FILE *out);
+
+#endif
@@ -0,0 +1,275 @@
+#include <stdlib.h>
+
+#include "hle.h"
+
+#define CYCLES(code) ((uint64_t) opcode_lookup_table[code].cycles)
+#define ANY -1
+
+/// Extra cycles of a taken branch whose next instruction is at `next`.
+static uint64_t taken(uint16_t next, uint16_t target) {
+	return ((next ^ target) & 0xFF00) ? 2 : 1;
+}
+
+/* Built in routines */
+
+/// loop: DEX / STA abs,X / BNE loop / RTS
+/// Stores A into abs+X-1 down to abs, X = 0 fills 256 bytes.
+static uint8_t hle_fill(CPU *cpu, uint16_t addr) {
+	uint16_t base = mem_read_u16(cpu, addr + 2);
+	uint16_t n = cpu->register_x ? cpu->register_x : 256;
+
+	for (uint16_t x = n; x--;)
+		mem_write(cpu, (uint16_t) (base + x), cpu->register_a);
+
+	cpu->cycles += n * (CYCLES(0xCA) + CYCLES(0x9D) + CYCLES(0xD0))
+		+ (n - 1) * taken(addr + 6, addr);
+	cpu->register_x = 0;
+	cpu->status = (cpu->status & ~NEGATIV) | ZERO;
+	return 1;
+}
+
+/// loop: LDA src,X / STA dst,X / INX / BNE loop / RTS
+/// Copies from offset X up to 255, byte by byte so overlaps behave the same.
+static uint8_t hle_copy(CPU *cpu, uint16_t addr) {
+	uint16_t src = mem_read_u16(cpu, addr + 1);
+	uint16_t dst = mem_read_u16(cpu, addr + 4);
+	uint16_t n = 256 - cpu->register_x;
+	uint8_t x = cpu->register_x;
+	uint64_t crossed = 0;
+
+	do {
+		cpu->register_a = mem_read(cpu, (uint16_t) (src + x));
+		mem_write(cpu, (uint16_t) (dst + x), cpu->register_a);
+		// LDA abs,X pays for crossing a page, STA abs,X always does
+		crossed += (src & 0xFF) + x > 0xFF;
+	} while (++x);
+
+	cpu->cycles += n * (CYCLES(0xBD) + CYCLES(0x9D) + CYCLES(0xE8) + CYCLES(0xD0))
+		+ (n - 1) * taken(addr + 9, addr) + crossed;
+	cpu->register_x = 0;
+	cpu->status = (cpu->status & ~NEGATIV) | ZERO;
+	return 1;
+}
+
+/// Shift and add 8x8 multiply, f1 * f2 -> A (high), f1 (low):
+///     LDA #0 / LDX #8 / LSR f1
+/// loop: BCC skip / CLC / ADC f2
+/// skip: ROR A / ROR f1 / DEX / BNE loop / RTS
+static uint8_t hle_mul8(CPU *cpu, uint16_t addr) {
+	uint8_t f1_addr = mem_read(cpu, addr + 5);
+	uint8_t f2_addr = mem_read(cpu, addr + 10);
+
+	if (mem_read(cpu, addr + 13) != f1_addr || (cpu->status & DECIMAL_MODE))
+		return 0;
+
+	uint8_t f1 = mem_read(cpu, f1_addr);
+	uint8_t f2 = mem_read(cpu, f2_addr);
+	uint8_t a = 0;
+	uint8_t c = f1 & 1;
+	uint8_t v = cpu->status & OVERFLOW;
+	uint64_t cycles = CYCLES(0xA9) + CYCLES(0xA2) + CYCLES(0x46);
+
+	f1 >>= 1;
+	for (uint8_t x = 8; x;) {
+		cycles += CYCLES(0x90);
+		if (c) {
+			uint16_t sum = (uint16_t) a + f2;
+			v = (~(a ^ f2) & (a ^ sum) & 0x80) ? OVERFLOW : 0;
+			c = sum >> 8;
+			a = (uint8_t) sum;
+			cycles += CYCLES(0x18) + CYCLES(0x65);
+		} else {
+			cycles += taken(addr + 8, addr + 11);
+		}
+
+		uint8_t ror = (uint8_t) ((a >> 1) | (c << 7));
+		c = a & 1;
+		a = ror;
+		ror = (uint8_t) ((f1 >> 1) | (c << 7));
+		c = f1 & 1;
+		f1 = ror;
+
+		cycles += CYCLES(0x6A) + CYCLES(0x66) + CYCLES(0xCA) + CYCLES(0xD0);
+		if (--x)
+			cycles += taken(addr + 17, addr + 6);
+	}
+
+	mem_write(cpu, f1_addr, f1);
+	cpu->register_a = a;
+	cpu->register_x = 0;
+	cpu->status = (cpu->status & ~(CARRY | OVERFLOW | NEGATIV)) | ZERO | c | v;
+	cpu->cycles += cycles;
+	return 1;
+}
+
+typedef struct {
+	const char *name;
+	HLE_FN fn;
+	uint8_t len;
+	int16_t code[24];
+} SIGNATURE;
+
+static const SIGNATURE builtins[] = {
+	{ "fill", hle_fill, 7, { 0xCA, 0x9D, ANY, ANY, 0xD0, 0xFA, 0x60 } },
+	{ "copy", hle_copy, 10, { 0xBD, ANY, ANY, 0x9D, ANY, ANY, 0xE8, 0xD0, 0xF7, 0x60 } },
+	{ "mul8", hle_mul8, 18, { 0xA9, 0x00, 0xA2, 0x08, 0x46, ANY, 0x90, 0x03, 0x18,
+		0x65, ANY, 0x6A, 0x66, ANY, 0xCA, 0xD0, 0xF5, 0x60 } },
+};
+#define NBUILTINS (sizeof(builtins) / sizeof(builtins[0]))
+
+void createHLE(HLE *hle, CPU *cpu, uint8_t verify) {
+	memset(hle->index, 0, sizeof(hle->index));
+	hle->nroutines = 0;
+	hle->verify = verify;
+	hle->busy = 0;
+	hle->shadow = verify ? malloc(sizeof(CPU)) : NULL;
+	cpu->hle = hle;
+}
+
+void destroyHLE(HLE *hle, CPU *cpu) {
+	cpu->hle = NULL;
+	free(hle->shadow);
+	hle->shadow = NULL;
+}
+
+/// Places the built in routine `name` at `addr`. Returns 0 if the name is
+/// unknown, the address is taken or the table is full.
+uint8_t hle_register(HLE *hle, const char *name, uint16_t addr) {
+	if (hle->index[addr] || hle->nroutines == HLE_MAX_ROUTINES)
+		return 0;
+
+	for (size_t i = 0; i < NBUILTINS; ++i) {
+		if (strcmp(builtins[i].name, name))
+			continue;
+		HLE_ROUTINE *r = &hle->routines[hle->nroutines++];
+		r->name = builtins[i].name;
+		r->fn = builtins[i].fn;
+		r->addr = addr;
+		r->enabled = 1;
+		r->calls = 0;
+		r->mismatches = 0;
+		hle->index[addr] = (uint8_t) hle->nroutines;
+		return 1;
+	}
+	return 0;
+}
+
+/// Registers every match of a built in signature in memory.
+/// Returns the number of routines found.
+size_t hle_scan(HLE *hle, CPU *cpu) {
+	size_t found = 0;
+
+	for (uint32_t addr = 0; addr < MEMORY_SIZE; ++addr) {
+		for (size_t i = 0; i < NBUILTINS; ++i) {
+			const SIGNATURE *sig = &builtins[i];
+			uint8_t len;
+			if (addr + sig->len > MEMORY_SIZE)
+				continue;
+			for (len = 0; len < sig->len; ++len) {
+				if (sig->code[len] != ANY && sig->code[len] != cpu->memory[addr + len])
+					break;
+			}
+			if (len == sig->len && hle_register(hle, sig->name, (uint16_t) addr))
+				found += 1;
+		}
+	}
+	return found;
+}
+
+/// Switches all routines called `name` on or off, returns how many.
+size_t hle_enable(HLE *hle, const char *name, uint8_t on) {
+	size_t n = 0;
+	for (size_t i = 0; i < hle->nroutines; ++i) {
+		if (!strcmp(hle->routines[i].name, name)) {
+			hle->routines[i].enabled = on;
+			n += 1;
+		}
+	}
+	return n;
+}
+
+static uint8_t same_state(CPU *a, CPU *b) {
+	return a->register_a == b->register_a && a->register_x == b->register_x
+		&& a->register_y == b->register_y && a->status == b->status
+		&& a->program_counter == b->program_counter
+		&& a->stack_pointer == b->stack_pointer && a->cycles == b->cycles
+		&& !memcmp(a->memory, b->memory, MEMORY_SIZE);
+}
+
+static void report(HLE_ROUTINE *r, CPU *native, CPU *interp) {
+	fprintf(stderr, "hle: %s at $%04X differs, disabled\n", r->name, r->addr);
+	fprintf(stderr, "  native: A=%02X X=%02X Y=%02X P=%02X SP=%02X PC=%04X cycles=%lu\n",
+		native->register_a, native->register_x, native->register_y, native->status,
+		native->stack_pointer, native->program_counter, native->cycles);
+	fprintf(stderr, "  interp: A=%02X X=%02X Y=%02X P=%02X SP=%02X PC=%04X cycles=%lu\n",
+		interp->register_a, interp->register_x, interp->register_y, interp->status,
+		interp->stack_pointer, interp->program_counter, interp->cycles);
+	for (uint32_t add = 0; add < MEMORY_SIZE; ++add) {
+		if (native->memory[add] != interp->memory[add]) {
+			fprintf(stderr, "  memory: first difference at $%04X (%02X, %02X)\n",
+				add, native->memory[add], interp->memory[add]);
+			break;
+		}
+	}
+}
+
+/// Called by jsr() after pushing the return address. Returns 1 when the
+/// routine (and its rts) ran, 0 to let the cpu interpret it.
+uint8_t hle_trap(CPU *cpu, uint16_t target) {
+	HLE *hle = cpu->hle;
+	uint8_t id = hle->index[target];
+
+	if (!id || hle->busy)
+		return 0;
+	HLE_ROUTINE *r = &hle->routines[id - 1];
+	if (!r->enabled)
+		return 0;
+
+	if (!hle->verify) {
+		cpu->program_counter = target;
+		if (!r->fn(cpu, target))
+			return 0;
+		rts(cpu);
+		cpu->cycles += CYCLES(0x60);
+		r->calls += 1;
+		return 1;
+	}
+
+	CPU *shadow = hle->shadow;
+	memcpy(shadow, cpu, sizeof(CPU));
+	shadow->program_counter = target;
+	if (!r->fn(shadow, target))
+		return 0;
+	rts(shadow);
+	shadow->cycles += CYCLES(0x60);
+	r->calls += 1;
+
+	/* Interpret the same call, nested traps off, until it returns */
+	uint8_t sp = cpu->stack_pointer + 2;
+	uint32_t limit = HLE_VERIFY_STEPS;
+	hle->busy = 1;
+	cpu->program_counter = target;
+	while (--limit && step(cpu)) {
+		if (cpu->program_counter == shadow->program_counter && cpu->stack_pointer == sp)
+			break;
+	}
+	hle->busy = 0;
+
+	if (!same_state(shadow, cpu)) {
+		report(r, shadow, cpu);
+		r->mismatches += 1;
+		r->enabled = 0;
+	}
+	return 1;
+}
+
+void print_hle_stats(HLE *hle, FILE *out) {
+	for (size_t i = 0; i < hle->nroutines; ++i) {
+		HLE_ROUTINE *r = &hle->routines[i];
+		fprintf(out, "%-6s $%04X %-3s calls: %lu", r->name, r->addr,
+			r->enabled ? "on" : "off", r->calls);
+		if (hle->verify)
+			fprintf(out, " mismatches: %lu", r->mismatches);
+		fprintf(out, "\n");
+	}
+}
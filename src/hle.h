@@ -0,0 +1,60 @@
+#ifndef HLE_H
+#define HLE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cpu_6502.h"
+
+#define HLE_MAX_ROUTINES	255
+#define HLE_VERIFY_STEPS	(1 << 24)
+
+/// Native body of a subroutine. Called with the return address already
+/// pushed and `program_counter` at the routine; must leave registers, flags,
+/// memory and cycles as the 6502 code would just before its RTS. Returns 0 to
+/// decline (e.g. unsupported inputs), the routine is then interpreted.
+typedef uint8_t (*HLE_FN)(CPU *cpu, uint16_t addr);
+
+typedef struct {
+	const char *name;
+	HLE_FN fn;
+	uint16_t addr;
+	uint8_t enabled;
+
+	/* Statistics */
+	uint64_t calls;
+	uint64_t mismatches;
+} HLE_ROUTINE;
+
+/// # High level emulation
+///
+/// Trap table for cpus built with CPU_HLE: jsr() looks up its target in
+/// `index` and, when an enabled routine is registered there, runs the native
+/// version and the rts() instead of interpreting it. Routines are placed by
+/// name and address or found by hle_scan(), which matches the code bytes of
+/// the built in routines (operands that may differ are wildcards).
+///
+/// In verify mode the native version runs on a copy of the cpu while the
+/// real one interprets the routine; any difference in registers, flags,
+/// cycles or memory is reported and the routine is disabled.
+///
+typedef struct HLE {
+	/* Routine number + 1 for every address, 0 for none */
+	uint8_t index[MEMORY_SIZE];
+	HLE_ROUTINE routines[HLE_MAX_ROUTINES];
+	size_t nroutines;
+
+	uint8_t verify;
+	uint8_t busy;
+	CPU *shadow;
+} HLE;
+
+void createHLE(HLE *hle, CPU *cpu, uint8_t verify);
+void destroyHLE(HLE *hle, CPU *cpu);
+
+uint8_t hle_register(HLE *hle, const char *name, uint16_t addr);
+size_t hle_scan(HLE *hle, CPU *cpu);
+size_t hle_enable(HLE *hle, const char *name, uint8_t on);
+void print_hle_stats(HLE *hle, FILE *out);
+
+#endif
@@ -0,0 +1,130 @@
+#include <stdlib.h>
+
+#include "lockstep.h"
+
+/// Starts the reference from the current state of `cpu`.
+void createLOCKSTEP(LOCKSTEP *ls, CPU *cpu) {
+	ls->ref = malloc(sizeof(CPU));
+	memcpy(ls->ref, cpu, sizeof(CPU));
+	memset(ls->window, 0, sizeof(ls->window));
+	ls->instructions = 0;
+	ls->syncs = 0;
+	ls->memory_every = LOCKSTEP_MEMORY_EVERY;
+#ifdef CPU_DIRTY_PAGES
+	memset(cpu->dirty, 0, sizeof(cpu->dirty));
+	memset(ls->ref->dirty, 0, sizeof(ls->ref->dirty));
+#endif
+}
+
+void destroyLOCKSTEP(LOCKSTEP *ls) {
+	free(ls->ref);
+	ls->ref = NULL;
+}
+
+/// The reference backend itself, for checking the checker.
+uint8_t step_backend(CPU *cpu, void *data) {
+	(void) data;
+	return step(cpu);
+}
+
+static uint8_t ref_step(LOCKSTEP *ls) {
+	CPU *ref = ls->ref;
+	STEP_RECORD *r = &ls->window[ls->instructions++ % LOCKSTEP_WINDOW];
+
+	*r = (STEP_RECORD) {
+		ref->program_counter, ref->memory[ref->program_counter], ref->register_a,
+		ref->register_x, ref->register_y, ref->status, ref->stack_pointer, ref->cycles
+	};
+	return step(ref);
+}
+
+/// First differing address, -1 when equal. `all` compares everything,
+/// otherwise only pages written by either side since the last sync.
+static int32_t memory_diff(CPU *a, CPU *b, uint8_t all) {
+#ifdef CPU_DIRTY_PAGES
+	if (!all) {
+		for (int i = 0; i < 4; ++i) {
+			uint64_t dirty = a->dirty[i] | b->dirty[i];
+			while (dirty) {
+				uint32_t page = (uint32_t) (i * 64 + __builtin_ctzll(dirty));
+				if (memcmp(&a->memory[page << 8], &b->memory[page << 8], 0x100))
+					for (uint32_t add = page << 8; ; ++add)
+						if (a->memory[add] != b->memory[add])
+							return (int32_t) add;
+				dirty &= dirty - 1;
+			}
+		}
+		memset(a->dirty, 0, sizeof(a->dirty));
+		memset(b->dirty, 0, sizeof(b->dirty));
+		return -1;
+	}
+#endif
+	if (!all || !memcmp(a->memory, b->memory, MEMORY_SIZE))
+		return -1;
+	for (uint32_t add = 0; ; ++add)
+		if (a->memory[add] != b->memory[add])
+			return (int32_t) add;
+}
+
+static void print_state(FILE *out, const char *name, CPU *cpu) {
+	fprintf(out, "  %-10s PC=%04X A=%02X X=%02X Y=%02X P=%02X SP=%02X cycles=%lu\n", name,
+		cpu->program_counter, cpu->register_a, cpu->register_x, cpu->register_y,
+		cpu->status, cpu->stack_pointer, cpu->cycles);
+}
+
+static void report_divergence(LOCKSTEP *ls, CPU *cpu, BACKEND *backend, FILE *out,
+	const char *what, int32_t add) {
+	fprintf(out, "%s diverges from the reference after %lu instructions: %s\n",
+		backend->name, ls->instructions, what);
+	print_state(out, "reference", ls->ref);
+	print_state(out, backend->name, cpu);
+	if (add >= 0)
+		fprintf(out, "  memory $%04X: reference %02X, %s %02X\n", add,
+			ls->ref->memory[add], backend->name, cpu->memory[add]);
+
+	uint64_t n = ls->instructions < LOCKSTEP_WINDOW ? ls->instructions : LOCKSTEP_WINDOW;
+	fprintf(out, "last %lu reference instructions:\n", n);
+	for (uint64_t i = ls->instructions - n; i < ls->instructions; ++i) {
+		STEP_RECORD *r = &ls->window[i % LOCKSTEP_WINDOW];
+		fprintf(out, "  %04X  %-3s  A=%02X X=%02X Y=%02X P=%02X SP=%02X cycles=%lu\n",
+			r->program_counter, opcode_lookup_table[r->code].mnemonic, r->register_a,
+			r->register_x, r->register_y, r->status, r->stack_pointer, r->cycles);
+	}
+}
+
+/// Runs both until BRK. Returns 1 if they agreed all the way.
+uint8_t lockstep_run(LOCKSTEP *ls, CPU *cpu, BACKEND *backend, FILE *report) {
+	CPU *ref = ls->ref;
+
+	for (;;) {
+		uint8_t alive = backend->advance(cpu, backend->data);
+		uint8_t ref_alive;
+		do {
+			ref_alive = ref_step(ls);
+		} while (ref_alive && ref->cycles < cpu->cycles);
+		ls->syncs += 1;
+
+		const char *what = NULL;
+		int32_t add = -1;
+		if (ref->cycles != cpu->cycles)
+			what = "cycle count";
+		else if (ref->program_counter != cpu->program_counter)
+			what = "program counter";
+		else if (ref->register_a != cpu->register_a || ref->register_x != cpu->register_x
+				|| ref->register_y != cpu->register_y || ref->stack_pointer != cpu->stack_pointer)
+			what = "registers";
+		else if (ref->status != cpu->status)
+			what = "status";
+		else if (alive != ref_alive)
+			what = "halt";
+		else if ((add = memory_diff(ref, cpu, !alive || !(ls->syncs % ls->memory_every))) >= 0)
+			what = "memory";
+
+		if (what) {
+			report_divergence(ls, cpu, backend, report, what, add);
+			return 0;
+		}
+		if (!alive)
+			return 1;
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cpu_6502.h"
+
+#define LOCKSTEP_WINDOW		32
+#define LOCKSTEP_MEMORY_EVERY	64
+
+/// Execution backend under test. `advance` runs at least one instruction
+/// of `cpu` (a block, a batch...) and returns 0 on BRK like step().
+typedef struct {
+	const char *name;
+	uint8_t (*advance)(CPU *cpu, void *data);
+	void *data;
+} BACKEND;
+
+typedef struct {
+	uint16_t program_counter;
+	uint8_t code;
+	uint8_t register_a;
+	uint8_t register_x;
+	uint8_t register_y;
+	uint8_t status;
+	uint8_t stack_pointer;
+	uint64_t cycles;
+} STEP_RECORD;
+
+/// # Lockstep
+///
+/// Runs a backend next to the reference step() on a private copy of the
+/// same machine. After every advance of the backend the reference steps
+/// until it has used as many cycles, then registers and cycles must match.
+/// Memory is compared every LOCKSTEP_MEMORY_EVERY syncs; with
+/// CPU_DIRTY_PAGES also every page either side wrote since the last sync.
+/// The first divergence is printed with the last LOCKSTEP_WINDOW reference
+/// instructions.
+///
+typedef struct {
+	CPU *ref;
+	STEP_RECORD window[LOCKSTEP_WINDOW];
+	uint64_t instructions;
+	uint64_t syncs;
+	uint32_t memory_every;
+} LOCKSTEP;
+
+void createLOCKSTEP(LOCKSTEP *ls, CPU *cpu);
+void destroyLOCKSTEP(LOCKSTEP *ls);
+
+uint8_t lockstep_run(LOCKSTEP *ls, CPU *cpu, BACKEND *backend, FILE *report);
+uint8_t step_backend(CPU *cpu, void *data);
+
+#endif
@@ -1,6 +1,78 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "cpu_6502.h"
+#include "pacer.h"
+#include "decode.h"
+#include "asm.h"
+#include "render.h"
+#include "shm.h"
+#include "snake.h"
+#ifdef CPU_HEATMAP
+#include "heatmap.h"
+
+/// Writes `<prefix>.csv` and `<prefix>.ppm` and detaches the counters.
+void dump_heatmap(HEATMAP *heatmap, CPU *cpu, const char *prefix) {
+	char path[4096];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s.csv", prefix);
+	if ((f = fopen(path, "w"))) {
+		heatmap_csv(heatmap, f);
+		fclose(f);
+	} else {
+		perror(path);
+	}
+	snprintf(path, sizeof(path), "%s.ppm", prefix);
+	if ((f = fopen(path, "wb"))) {
+		heatmap_ppm(heatmap, f);
+		fclose(f);
+	} else {
+		perror(path);
+	}
+	destroyHEATMAP(heatmap, cpu);
+}
+#endif
+#ifdef CPU_HLE
+#include "hle.h"
+
+#define MAX_HLE_ARGS 16
+
+/// Attaches the trap table: --trap name@addr routines first, then the
+/// signature scan, then --hle-off names switched off.
+void setup_hle(HLE *hle, CPU *cpu, uint8_t verify, const char **traps, int ntraps,
+	const char **off, int noff) {
+	createHLE(hle, cpu, verify);
+	for (int i = 0; i < ntraps; ++i) {
+		char name[16];
+		unsigned addr;
+		if (sscanf(traps[i], "%15[^@]@%x", name, &addr) != 2
+			|| !hle_register(hle, name, (uint16_t) addr))
+			fprintf(stderr, "Bad trap %s\n", traps[i]);
+	}
+	size_t found = hle_scan(hle, cpu);
+	for (int i = 0; i < noff; ++i)
+		hle_enable(hle, off[i], 0);
+	printf("HLE: %lu routines found by signature, %lu total\n", found, hle->nroutines);
+}
+#endif
+#ifdef CPU_PROFILE
+#include "profile.h"
+
+/// Unwinds the shadow stack and writes the callgrind file.
+void dump_profile(PROFILER *prof, CPU *cpu, const char *path, const char *cmd) {
+	profile_finish(prof, cpu);
+	FILE *f = fopen(path, "w");
+	if (f) {
+		profile_callgrind(prof, f, cmd);
+		fclose(f);
+	} else {
+		perror(path);
+	}
+	destroyPROFILER(prof, cpu);
+}
+#endif
 
 void binaryprint(uint8_t n) {
 	int count = 0;
@@ -42,46 +114,218 @@ void test_lookuptable(void) {
 
 int main(int argc, char **argv) {
 
-	(void) argc;
-	(void) argv;
-
-	uint8_t program[] = {
-		0x20, 0x06, 0x06, 0x20, 0x38, 0x06, 0x20, 0x0d, 0x06, 0x20, 0x2a, 0x06, 0x60, 0xa9, 0x02, 0x85,
-		0x02, 0xa9, 0x04, 0x85, 0x03, 0xa9, 0x11, 0x85, 0x10, 0xa9, 0x10, 0x85, 0x12, 0xa9, 0x0f, 0x85,
-		0x14, 0xa9, 0x04, 0x85, 0x11, 0x85, 0x13, 0x85, 0x15, 0x60, 0xa5, 0xfe, 0x85, 0x00, 0xa5, 0xfe,
-		0x29, 0x03, 0x18, 0x69, 0x02, 0x85, 0x01, 0x60, 0x20, 0x4d, 0x06, 0x20, 0x8d, 0x06, 0x20, 0xc3,
-		0x06, 0x20, 0x19, 0x07, 0x20, 0x20, 0x07, 0x20, 0x2d, 0x07, 0x4c, 0x38, 0x06, 0xa5, 0xff, 0xc9,
-		0x77, 0xf0, 0x0d, 0xc9, 0x64, 0xf0, 0x14, 0xc9, 0x73, 0xf0, 0x1b, 0xc9, 0x61, 0xf0, 0x22, 0x60,
-		0xa9, 0x04, 0x24, 0x02, 0xd0, 0x26, 0xa9, 0x01, 0x85, 0x02, 0x60, 0xa9, 0x08, 0x24, 0x02, 0xd0,
-		0x1b, 0xa9, 0x02, 0x85, 0x02, 0x60, 0xa9, 0x01, 0x24, 0x02, 0xd0, 0x10, 0xa9, 0x04, 0x85, 0x02,
-		0x60, 0xa9, 0x02, 0x24, 0x02, 0xd0, 0x05, 0xa9, 0x08, 0x85, 0x02, 0x60, 0x60, 0x20, 0x94, 0x06,
-		0x20, 0xa8, 0x06, 0x60, 0xa5, 0x00, 0xc5, 0x10, 0xd0, 0x0d, 0xa5, 0x01, 0xc5, 0x11, 0xd0, 0x07,
-		0xe6, 0x03, 0xe6, 0x03, 0x20, 0x2a, 0x06, 0x60, 0xa2, 0x02, 0xb5, 0x10, 0xc5, 0x10, 0xd0, 0x06,
-		0xb5, 0x11, 0xc5, 0x11, 0xf0, 0x09, 0xe8, 0xe8, 0xe4, 0x03, 0xf0, 0x06, 0x4c, 0xaa, 0x06, 0x4c,
-		0x35, 0x07, 0x60, 0xa6, 0x03, 0xca, 0x8a, 0xb5, 0x10, 0x95, 0x12, 0xca, 0x10, 0xf9, 0xa5, 0x02,
-		0x4a, 0xb0, 0x09, 0x4a, 0xb0, 0x19, 0x4a, 0xb0, 0x1f, 0x4a, 0xb0, 0x2f, 0xa5, 0x10, 0x38, 0xe9,
-		0x20, 0x85, 0x10, 0x90, 0x01, 0x60, 0xc6, 0x11, 0xa9, 0x01, 0xc5, 0x11, 0xf0, 0x28, 0x60, 0xe6,
-		0x10, 0xa9, 0x1f, 0x24, 0x10, 0xf0, 0x1f, 0x60, 0xa5, 0x10, 0x18, 0x69, 0x20, 0x85, 0x10, 0xb0,
-		0x01, 0x60, 0xe6, 0x11, 0xa9, 0x06, 0xc5, 0x11, 0xf0, 0x0c, 0x60, 0xc6, 0x10, 0xa5, 0x10, 0x29,
-		0x1f, 0xc9, 0x1f, 0xf0, 0x01, 0x60, 0x4c, 0x35, 0x07, 0xa0, 0x00, 0xa5, 0xfe, 0x91, 0x00, 0x60,
-		0xa6, 0x03, 0xa9, 0x00, 0x81, 0x10, 0xa2, 0x00, 0xa9, 0x01, 0x81, 0x10, 0x60, 0xa2, 0x00, 0xea,
-		0xea, 0xca, 0xd0, 0xfb, 0x60
-	};
-	size_t len = sizeof(program) / sizeof(program[0]);
-
-	CPU cpu;
-	createCPU(&cpu);
-	load_and_run(&cpu, program, len);
+	uint32_t clock_hz = 0;
+	const char *cache_dir = NULL;
+	const char *asm_file = NULL;
+	const char *heatmap_prefix = NULL;
+	const char *video_file = NULL;
+	const char *hle_mode = NULL;
+	const char *profile_file = NULL;
+	const char *shm_name = NULL;
+	CPU_VARIANT variant = NMOS_6502;
+#ifdef CPU_HLE
+	const char *traps[MAX_HLE_ARGS];
+	const char *hle_off[MAX_HLE_ARGS];
+	int ntraps = 0;
+	int noff = 0;
+#endif
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "--paced"))
+			clock_hz = (uint32_t) strtoul(argv[i + 1], NULL, 0);
+		else if (!strcmp(argv[i], "--cache"))
+			cache_dir = argv[i + 1];
+		else if (!strcmp(argv[i], "--asm"))
+			asm_file = argv[i + 1];
+		else if (!strcmp(argv[i], "--heatmap"))
+			heatmap_prefix = argv[i + 1];
+		else if (!strcmp(argv[i], "--video"))
+			video_file = argv[i + 1];
+		else if (!strcmp(argv[i], "--shm"))
+			shm_name = argv[i + 1];
+		else if (!strcmp(argv[i], "--profile"))
+			profile_file = argv[i + 1];
+		else if (!strcmp(argv[i], "--hle"))
+			hle_mode = argv[i + 1];
+		else if (!strcmp(argv[i], "--variant"))
+			variant = !strcmp(argv[i + 1], "65c02") ? CMOS_65C02 : !strcmp(argv[i + 1], "2a03") ? RICOH_2A03 : NMOS_6502;
+#ifdef CPU_HLE
+		else if (!strcmp(argv[i], "--trap") && ntraps < MAX_HLE_ARGS)
+			traps[ntraps++] = argv[i + 1];
+		else if (!strcmp(argv[i], "--hle-off") && noff < MAX_HLE_ARGS)
+			hle_off[noff++] = argv[i + 1];
+#endif
+	}
+#ifndef CPU_PROFILE
+	if (profile_file)
+		fprintf(stderr, "--profile needs a build with CPU_PROFILE (make prof)\n");
+#endif
+#ifndef CPU_HLE
+	if (hle_mode)
+		fprintf(stderr, "--hle needs a build with CPU_HLE (make hle)\n");
+#endif
+#ifndef CPU_HEATMAP
+	if (heatmap_prefix)
+		fprintf(stderr, "--heatmap needs a build with CPU_HEATMAP (make heatmap)\n");
+#endif
+
+	// the run modes below are one chain: --paced drives at most one of
+	// --video and --shm, and --cache keeps its own loop
+	if ((video_file && shm_name) || (cache_dir && (clock_hz || video_file || shm_name))) {
+		fprintf(stderr, "--video and --shm exclude each other, --cache excludes --paced, --video and --shm\n");
+		return 1;
+	}
+
+	static CPU local_cpu;
+	CPU *cpu = &local_cpu;
+	SHM_STATE shm;
+	if (shm_name) {
+		if (!(cpu = createSHM(&shm, shm_name))) {
+			perror(shm_name);
+			return 1;
+		}
+		if (!shm.name[0])
+			printf("State exported at /proc/%d/fd/%d\n", getpid(), shm.fd);
+		fflush(stdout);
+		cpu->variant = variant;
+	} else {
+		createCPUVariant(cpu, variant);
+	}
+#ifdef CPU_HEATMAP
+	HEATMAP heatmap;
+	if (heatmap_prefix)
+		createHEATMAP(&heatmap, cpu, 1);
+#endif
+#ifdef CPU_PROFILE
+	static PROFILER prof;
+#endif
+#ifdef CPU_HLE
+	HLE hle;
+	uint8_t verify = hle_mode && !strcmp(hle_mode, "verify");
+#endif
+
+	/* The program: the --asm source, the snake otherwise */
+	uint8_t *program;
+	size_t len;
+	uint16_t origin;
+	if (asm_file) {
+		ASSEMBLER as;
+		char error[ASM_MAX_ERROR + 32];
+		createASSEMBLER(&as);
+		if (!assemble_file(&as, asm_file, cpu->memory, error, sizeof(error))) {
+			fprintf(stderr, "%s: %s\n", asm_file, error);
+			return 1;
+		}
+		printf("Assembled %lu bytes at $%04X-$%04X\n", as.bytes, as.start, as.end);
+		// a copy, for the decode cache's key, before the program runs
+		origin = as.start;
+		len = as.bytes ? (size_t) (as.end - as.start) + 1 : 0;
+		program = malloc(len ? len : 1);
+		memcpy(program, &cpu->memory[as.start], len);
+		destroyASSEMBLER(&as);
+	} else {
+		snake_load(cpu);
+		origin = SNAKE_ORIGIN;
+		len = sizeof(snake_program);
+		program = malloc(len);
+		memcpy(program, snake_program, len);
+	}
+
+#ifdef CPU_HLE
+	if (hle_mode)
+		setup_hle(&hle, cpu, verify, traps, ntraps, hle_off, noff);
+#endif
+	reset(cpu);
+#ifdef CPU_PROFILE
+	if (profile_file)
+		createPROFILER(&prof, cpu);
+#endif
+
+	FILE *video = NULL;
+	RENDER render;
+	if (video_file) {
+		if (!(video = fopen(video_file, "wb"))) {
+			perror(video_file);
+			return 1;
+		}
+		createRENDER(&render, video, RENDER_SCALE);
+	}
+
+	if (clock_hz) {
+		PACER pacer;
+		createPACER(&pacer, clock_hz, FRAME_HZ);
+		if (video) {
+			pacer.on_frame = render_frame;
+			pacer.data = &render;
+		} else if (shm_name) {
+			pacer.on_frame = shm_frame;
+			pacer.data = &shm;
+		}
+		run_paced(cpu, &pacer, 0);
+		print_pacer_stats(&pacer, stdout);
+		destroyPACER(&pacer);
+	} else if (video) {
+		/* Unpaced: a frame every 1/60 s of emulated time, as fast as we can */
+		while (run_cycles(cpu, NTSC_CLOCK_HZ / FRAME_HZ))
+			render_publish(&render, cpu);
+		render_publish(&render, cpu);
+	} else if (cache_dir) {
+		DCACHE cache;
+		createDCACHE(&cache);
+		uint8_t hit = dcache_open(&cache, cache_dir, cpu, program, len, origin);
+		// only a start without a hot list pays for counting blocks
+		if (hit && cache.header->nhot) {
+			run(cpu);
+		} else {
+			uint64_t *counts = calloc(cache.header->nblocks + 1, sizeof(uint64_t));
+			run_profiled(cpu, &cache, counts);
+			if (dcache_update_hot(&cache, counts))
+				dcache_save(&cache, cache_dir);
+			free(counts);
+		}
+		printf("Decode cache %s: %u blocks, %u hot\n", hit ? "hit" : "miss",
+			cache.header->nblocks, cache.header->nhot);
+		destroyDCACHE(&cache);
+	} else if (shm_name) {
+		run_published(cpu, &shm);
+	} else {
+		run(cpu);
+	}
+	if (video) {
+		destroyRENDER(&render);
+		fclose(video);
+		printf("Video: %lu frames published, %lu written, %lu dropped\n",
+			render.published, render.written, render.dropped);
+	}
 	printf("Length of program: %lu\n", len);
-	printf("register_a: %u\n", cpu.register_a);
-	printf("register_x: %u\n", cpu.register_x);
-	printf("register_y: %u\n", cpu.register_y);
+	printf("register_a: %u\n", cpu->register_a);
+	printf("register_x: %u\n", cpu->register_x);
+	printf("register_y: %u\n", cpu->register_y);
 	printf("State Flag: ");
-	binaryprint(cpu.status);
-	destroyCPU(&cpu);
+	binaryprint(cpu->status);
+#ifdef CPU_HEATMAP
+	if (heatmap_prefix)
+		dump_heatmap(&heatmap, cpu, heatmap_prefix);
+#endif
+#ifdef CPU_HLE
+	if (hle_mode) {
+		print_hle_stats(&hle, stdout);
+		destroyHLE(&hle, cpu);
+	}
+#endif
+#ifdef CPU_PROFILE
+	if (profile_file)
+		dump_profile(&prof, cpu, profile_file, asm_file ? asm_file : argv[0]);
+#endif
+	destroyCPU(cpu);
+	if (shm_name)
+		destroySHM(&shm);
 
-	printf("Assembly Trascription of program:\n");
-	programprint(program, len);
+	// an assembled source may mix code and data, only the snake is listed
+	if (!asm_file) {
+		printf("Assembly Trascription of program:\n");
+		programprint(program, len);
+	}
+	free(program);
 
 	return 0;
 }
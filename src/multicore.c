@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "system.h"
+#include "util.h"
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-q quantum] [-c cycles] [-t] [-s first_page:pages]... [-m page] image.bin...\n"
+			"\tone core per image, -m adds a mailbox between the first two cores\n", name);
+}
+
+int main(int argc, char **argv) {
+	uint64_t quantum = DEFAULT_QUANTUM;
+	uint64_t cycles = 10000000;
+	uint8_t threaded = 0;
+	long shared_page[MAX_SHARED], shared_pages[MAX_SHARED], mailbox_page = -1;
+	size_t nshared = 0;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "q:c:ts:m:")) != -1) {
+		switch (opt) {
+			case 'q': quantum = strtoull(optarg, NULL, 0); break;
+			case 'c': cycles = strtoull(optarg, NULL, 0); break;
+			case 't': threaded = 1; break;
+			case 's': {
+				char *end;
+				if (nshared == MAX_SHARED) {
+					fprintf(stderr, "at most %d shared regions\n", MAX_SHARED);
+					return 1;
+				}
+				shared_page[nshared] = strtol(optarg, &end, 0);
+				shared_pages[nshared] = *end == ':' ? strtol(end + 1, NULL, 0) : 1;
+				nshared += 1;
+			} break;
+			case 'm': mailbox_page = strtol(optarg, NULL, 0); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	size_t ncores = (size_t) (argc - optind);
+	if (!ncores || ncores > MAX_CORES || !quantum || (mailbox_page >= 0 && ncores < 2)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	SYSTEM system;
+	createSYSTEM(&system, quantum);
+	for (size_t i = 0; i < ncores; ++i) {
+		size_t len;
+		uint8_t *image = read_file(argv[optind + i], &len);
+		if (!image) {
+			perror(argv[optind + i]);
+			return 1;
+		}
+		CPU *cpu = malloc(sizeof(CPU));
+		createCPU(cpu);
+		load(cpu, image, len);
+		reset(cpu);
+		add_core(&system, cpu);
+		free(image);
+	}
+	for (size_t i = 0; i < nshared; ++i) {
+		if (shared_page[i] < 0 || shared_page[i] > 0xFF || shared_pages[i] < 0 || shared_pages[i] > 0x100
+				|| !map_shared(&system, (uint8_t) shared_page[i], (uint16_t) shared_pages[i])) {
+			fprintf(stderr, "cannot share %ld pages from page %ld\n", shared_pages[i], shared_page[i]);
+			return 1;
+		}
+	}
+	if (mailbox_page >= 0 && (mailbox_page > 0xFF || !map_mailbox(&system, (uint8_t) mailbox_page, 0, 1))) {
+		fprintf(stderr, "cannot make page %ld a mailbox\n", mailbox_page);
+		return 1;
+	}
+
+	double start = now();
+	if (threaded)
+		system_run_threaded(&system, cycles);
+	else
+		system_run(&system, cycles);
+	double secs = now() - start;
+	uint64_t total = 0;
+	for (size_t i = 0; i < ncores; ++i) {
+		CPU *cpu = system.cores[i];
+		printf("core %lu: a=%02X x=%02X y=%02X p=%02X pc=%04X cycles=%lu%s\n", i,
+			cpu->register_a, cpu->register_x, cpu->register_y, cpu->status,
+			cpu->program_counter, cpu->cycles, system.halted[i] ? " (halted)" : "");
+		total += cpu->cycles;
+	}
+	printf("%.1f emulated MHz over %lu cores (%s, quantum %lu)\n", (double) total / secs / 1e6,
+		ncores, threaded ? "threaded" : "serial", quantum);
+
+	for (size_t i = 0; i < ncores; ++i) {
+		destroyCPU(system.cores[i]);
+		free(system.cores[i]);
+	}
+	destroySYSTEM(&system);
+	return 0;
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cpu_6502.h"
+#include "render.h"
+#include "snake.h"
+#include "util.h"
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-n sessions] [-q quantum] [-t seconds]\n"
+			"\tplays snake in every session from one thread, feeding random keys\n", name);
+}
+
+int main(int argc, char **argv) {
+	size_t sessions = 1024;
+	uint64_t quantum = 10000;
+	double seconds = 5;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:q:t:")) != -1) {
+		switch (opt) {
+			case 'n': sessions = strtoull(optarg, NULL, 0); break;
+			case 'q': quantum = strtoull(optarg, NULL, 0); break;
+			case 't': seconds = strtod(optarg, NULL); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (!sessions || optind != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	CPU *boot = malloc(sizeof(CPU));
+	createCPU(boot);
+	snake_load(boot);
+	reset(boot);
+	io_attach(boot, SNAKE_KEY, DISPLAY_START, DISPLAY_START + DISPLAY_SIZE - 1);
+
+	CPU *cpus = malloc(sessions * sizeof(CPU));
+	for (size_t i = 0; i < sessions; ++i)
+		snapshot(boot, &cpus[i]);
+
+	// Every session runs until it yields, then the next one gets the thread;
+	// a session never blocks the others, waiting on input included.
+	uint64_t rng = 0x9E3779B97F4A7C15ULL;
+	uint64_t yields[YIELD_BUDGET + 1] = { 0 };
+	uint64_t cycles = 0;
+	double start = now(), elapsed;
+	do {
+		for (int round = 0; round < 16; ++round) {
+			for (size_t i = 0; i < sessions; ++i) {
+				CPU *cpu = &cpus[i];
+				uint64_t before = cpu->cycles;
+				YIELD_REASON reason = resume(cpu, quantum);
+				cycles += cpu->cycles - before;
+				yields[reason] += 1;
+				switch (reason) {
+					case YIELD_INPUT:
+						cpu->memory[SNAKE_RANDOM] = (uint8_t) xorshift(&rng);
+						io_feed(cpu, snake_keys[xorshift(&rng) & 3]);
+					break;
+
+					case YIELD_BRK:
+						restore(cpu, boot);
+					break;
+
+					default: break;
+				}
+			}
+		}
+		elapsed = now() - start;
+	} while (elapsed < seconds);
+
+	uint64_t total = 0;
+	for (int i = 0; i <= YIELD_BUDGET; ++i)
+		total += yields[i];
+	printf("%lu sessions, %.2fs: %lu yields (%.0f/s), %lu input, %lu output, %lu games over, %lu budget\n",
+		sessions, elapsed, total, (double) total / elapsed, yields[YIELD_INPUT],
+		yields[YIELD_OUTPUT], yields[YIELD_BRK], yields[YIELD_BUDGET]);
+	printf("%.1f emulated MHz in one thread\n", (double) cycles / elapsed / 1e6);
+
+	for (size_t i = 0; i < sessions; ++i)
+		destroyCPU(&cpus[i]);
+	free(cpus);
+	destroyCPU(boot);
+	free(boot);
+	return 0;
+}
@@ -0,0 +1,147 @@
+#include <string.h>
+
+#include "nes.h"
+
+/* RAM mirrors */
+
+static uint8_t ram_read(void *data, uint16_t add) {
+	NES *nes = data;
+	return nes->cpu.memory[add & (NES_RAM - 1)];
+}
+
+static void ram_write(void *data, uint16_t add, uint8_t value) {
+	NES *nes = data;
+	nes->cpu.memory[add & (NES_RAM - 1)] = value;
+}
+
+/* PPU registers */
+
+static uint8_t registers_read(void *data, uint16_t add) {
+	NES *nes = data;
+	return ppu_read(&nes->ppu, add);
+}
+
+static void registers_write(void *data, uint16_t add, uint8_t value) {
+	NES *nes = data;
+	ppu_write(&nes->ppu, add, value);
+}
+
+/* OAM DMA and controllers */
+
+static uint8_t io_read(void *data, uint16_t add) {
+	NES *nes = data;
+	if (add != NES_PAD1 && add != NES_PAD2)
+		return 0x40;
+
+	int pad = add - NES_PAD1;
+	// while strobing the shift register keeps reloading, A is all you get
+	if (nes->strobe)
+		return 0x40 | (nes->buttons[pad] & 1);
+	uint8_t bit = nes->shift[pad] & 1;
+	nes->shift[pad] = (uint8_t) (nes->shift[pad] >> 1 | 0x80);
+	return 0x40 | bit;
+}
+
+static void io_write(void *data, uint16_t add, uint8_t value) {
+	NES *nes = data;
+	if (add == NES_OAM_DMA) {
+		uint16_t page = (uint16_t) (value << 8);
+		if (page < 0x2000)
+			page &= NES_RAM - 1;
+		ppu_oam_dma(&nes->ppu, &nes->cpu.memory[page]);
+		// the cpu is halted for the copy, one more cycle on an odd one
+		nes->cpu.cycles += 513 + (nes->cpu.cycles & 1);
+	} else if (add == NES_PAD1) {
+		nes->strobe = value & 1;
+		if (nes->strobe) {
+			nes->shift[0] = nes->buttons[0];
+			nes->shift[1] = nes->buttons[1];
+		}
+	}
+}
+
+/* PRG ROM */
+
+static uint8_t rom_read(void *data, uint16_t add) {
+	NES *nes = data;
+	return nes->cpu.memory[add];
+}
+
+static void rom_write(void *data, uint16_t add, uint8_t value) {
+	// NROM has no mapper registers, the cartridge ignores the write
+	(void) data;
+	(void) add;
+	(void) value;
+}
+
+/// Loads an iNES image. Returns 0 with `error` set when it is not one or
+/// needs a mapper other than 0.
+uint8_t createNES(NES *nes, const uint8_t *rom, size_t len, const char **error) {
+	if (len < INES_HEADER || memcmp(rom, "NES\x1A", 4)) {
+		*error = "not an iNES image";
+		return 0;
+	}
+	size_t prg_len = (size_t) rom[4] * 0x4000, chr_len = (size_t) rom[5] * 0x2000;
+	uint8_t mapper = (rom[6] >> 4) | (rom[7] & 0xF0);
+	// skip the trainer
+	const uint8_t *prg = rom + INES_HEADER + (rom[6] & 0x04 ? 512 : 0);
+	if (mapper) {
+		*error = "only mapper 0 is supported";
+		return 0;
+	}
+	if ((prg_len != 0x4000 && prg_len != 0x8000) || chr_len > 0x2000) {
+		*error = "bad PRG or CHR size for mapper 0";
+		return 0;
+	}
+	if ((size_t) (prg - rom) + prg_len + chr_len > len) {
+		*error = "image is truncated";
+		return 0;
+	}
+
+	createCPUVariant(&nes->cpu, RICOH_2A03);
+	memcpy(&nes->cpu.memory[0x8000], prg, prg_len);
+	memcpy(&nes->cpu.memory[0xC000], prg + prg_len - 0x4000, 0x4000);
+	createPPU(&nes->ppu, prg + prg_len, chr_len, rom[6] & 0x01 ? MIRROR_VERTICAL : MIRROR_HORIZONTAL);
+
+	nes->buttons[0] = nes->buttons[1] = 0;
+	nes->shift[0] = nes->shift[1] = 0;
+	nes->strobe = 0;
+
+	nes->ram = (DEVICE) { ram_read, ram_write, nes };
+	nes->registers = (DEVICE) { registers_read, registers_write, nes };
+	nes->io = (DEVICE) { io_read, io_write, nes };
+	nes->rom = (DEVICE) { rom_read, rom_write, nes };
+	map_device(&nes->cpu, 0x08, 0x18, &nes->ram);
+	map_device(&nes->cpu, 0x20, 0x20, &nes->registers);
+	map_device(&nes->cpu, 0x40, 0x01, &nes->io);
+	map_device(&nes->cpu, 0x80, 0x80, &nes->rom);
+
+	reset(&nes->cpu);
+	nes->dots = nes->cpu.cycles * 3;
+	return 1;
+}
+
+void destroyNES(NES *nes) {
+	destroyPPU(&nes->ppu);
+	destroyCPU(&nes->cpu);
+}
+
+/// Runs one frame, from the pre-render line to the end of vblank.
+/// Returns 0 if the program hit BRK.
+uint8_t nes_frame(NES *nes) {
+	for (uint16_t i = 0; i < PPU_LINES; ++i) {
+		// start on the pre-render line so the frame ends with vblank
+		uint16_t line = (uint16_t) ((i + PPU_LINES - 1) % PPU_LINES);
+		ppu_scanline(&nes->ppu, line);
+		if (nes->ppu.nmi_pending) {
+			nes->ppu.nmi_pending = 0;
+			nmi(&nes->cpu);
+		}
+
+		nes->dots += PPU_DOTS;
+		uint64_t target = nes->dots / 3;
+		if (target > nes->cpu.cycles && !run_cycles(&nes->cpu, target - nes->cpu.cycles))
+			return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,65 @@
+#ifndef NES_H
+#define NES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cpu_6502.h"
+#include "ppu.h"
+
+#define INES_HEADER	16
+#define NES_RAM		0x800
+#define NES_OAM_DMA	0x4014
+#define NES_PAD1	0x4016
+#define NES_PAD2	0x4017
+
+/* Controller bits, in the order they are shifted out */
+#define BUTTON_A	0x01
+#define BUTTON_B	0x02
+#define BUTTON_SELECT	0x04
+#define BUTTON_START	0x08
+#define BUTTON_UP	0x10
+#define BUTTON_DOWN	0x20
+#define BUTTON_LEFT	0x40
+#define BUTTON_RIGHT	0x80
+
+/// # NES
+///
+/// A 2A03 and a PPU on one bus, needs CPU_MMIO. Only mapper 0 (NROM)
+/// cartridges: 16 or 32 KiB of PRG ROM at $8000 (16 KiB mirrored at
+/// $C000), 8 KiB of CHR ROM or CHR RAM, fixed mirroring. There is no APU,
+/// its registers read open bus and ignore writes.
+///
+/// Devices on the cpu bus:
+///
+///  - $0800-$1FFF: mirrors of the 2 KiB of RAM at $0000
+///  - $2000-$3FFF: the 8 PPU registers, mirrored
+///  - $4000-$40FF: OAM DMA and the controllers
+///  - $8000-$FFFF: PRG ROM, reads come from cpu memory, writes are ignored
+///
+/// nes_frame() alternates one PPU scanline and the 341/3 cpu cycles it
+/// lasts, taking the NMI at the start of vblank.
+///
+typedef struct {
+	CPU cpu;
+	PPU ppu;
+
+	uint8_t buttons[2];
+	uint8_t shift[2];
+	uint8_t strobe;
+
+	/* Elapsed time in PPU dots, 3 per cpu cycle */
+	uint64_t dots;
+
+	DEVICE ram;
+	DEVICE registers;
+	DEVICE io;
+	DEVICE rom;
+} NES;
+
+uint8_t createNES(NES *nes, const uint8_t *rom, size_t len, const char **error);
+void destroyNES(NES *nes);
+
+uint8_t nes_frame(NES *nes);
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "nes.h"
+#include "util.h"
+
+/// Draws the current state again `frames` times, PPU only, and returns
+/// the seconds per frame.
+static double render_bench(NES *nes, uint64_t frames) {
+	PPU *ppu = malloc(sizeof(PPU));
+	double start = now();
+	for (uint64_t i = 0; i < frames; ++i) {
+		// a copy so the real PPU state is left alone
+		*ppu = nes->ppu;
+		for (uint16_t line = 0; line < PPU_HEIGHT; ++line)
+			ppu_scanline(ppu, line);
+	}
+	double elapsed = now() - start;
+	free(ppu);
+	return elapsed / (double) frames;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-x] [-f frames] [-p buttons] [-o last.ppm] [-v video.ppm] [-r render_frames] rom.nes\n"
+			"\truns an NROM image for some frames with the buttons held, -x on the bus level core,\n"
+			"\t-v writes every frame (ffmpeg -f image2pipe reads it), -r times the PPU alone\n", name);
+}
+
+int main(int argc, char **argv) {
+	uint64_t frames = 600, render_frames = 0;
+	uint8_t buttons = 0, exact = 0;
+	const char *out_file = NULL, *video_file = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "xf:p:o:v:r:")) != -1) {
+		switch (opt) {
+			case 'x': exact = 1; break;
+			case 'f': frames = strtoull(optarg, NULL, 0); break;
+			case 'p': buttons = (uint8_t) strtoul(optarg, NULL, 0); break;
+			case 'o': out_file = optarg; break;
+			case 'v': video_file = optarg; break;
+			case 'r': render_frames = strtoull(optarg, NULL, 0); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	size_t len;
+	uint8_t *rom = read_file(argv[optind], &len);
+	if (!rom) {
+		perror(argv[optind]);
+		return 1;
+	}
+	NES *nes = malloc(sizeof(NES));
+	const char *error;
+	if (!createNES(nes, rom, len, &error)) {
+		fprintf(stderr, "%s: %s\n", argv[optind], error);
+		return 1;
+	}
+	free(rom);
+
+	FILE *video = NULL;
+	if (video_file && !(video = fopen(video_file, "wb"))) {
+		perror(video_file);
+		return 1;
+	}
+
+	// the PPU registers see every dummy read
+	nes->cpu.cycle_exact = exact;
+	nes->buttons[0] = buttons;
+	uint64_t frame = 0;
+	double start = now();
+	for (; frame < frames; ++frame) {
+		if (!nes_frame(nes)) {
+			fprintf(stderr, "BRK at $%04X\n", nes->cpu.program_counter);
+			break;
+		}
+		if (video)
+			ppu_ppm(&nes->ppu, video);
+	}
+	double elapsed = now() - start;
+	if (video)
+		fclose(video);
+
+	printf("%lu frames, %lu cycles in %.3fs: %.0f fps, %.1fx real time\n", frame, nes->cpu.cycles,
+		elapsed, (double) frame / elapsed, (double) frame / elapsed / 60.0988);
+
+	if (render_frames) {
+		double per_frame = render_bench(nes, render_frames);
+		printf("PPU alone: %.1f us/frame, %.0fx real time\n", per_frame * 1e6, 1.0 / 60.0988 / per_frame);
+	}
+
+	if (out_file) {
+		FILE *f = fopen(out_file, "wb");
+		if (!f) {
+			perror(out_file);
+			return 1;
+		}
+		ppu_ppm(&nes->ppu, f);
+		fclose(f);
+	}
+
+	destroyNES(nes);
+	free(nes);
+	return 0;
+}
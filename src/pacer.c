@@ -0,0 +1,115 @@
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+
+#include "pacer.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline) {
+	struct timespec ts;
+	ts.tv_sec = (time_t) (deadline / NSEC_PER_SEC);
+	ts.tv_nsec = (long) (deadline % NSEC_PER_SEC);
+	// returns the error rather than setting errno, only a signal is worth retrying
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+/// frame n ends at start + n / frame_hz seconds
+static uint64_t frame_deadline(PACER *pacer, uint64_t n) {
+	return pacer->start_ns + n * NSEC_PER_SEC / pacer->frame_hz;
+}
+
+/// frame n ends after n * clock_hz / frame_hz cycles
+static uint64_t frame_cycles(PACER *pacer, uint64_t n) {
+	return pacer->start_cycles + n * pacer->clock_hz / pacer->frame_hz;
+}
+
+void createPACER(PACER *pacer, uint32_t clock_hz, uint32_t frame_hz) {
+	assert(clock_hz && frame_hz);
+	pacer->clock_hz = clock_hz;
+	pacer->frame_hz = frame_hz;
+	pacer->max_catchup = MAX_CATCHUP;
+	pacer->on_frame = NULL;
+	pacer->data = NULL;
+	pacer->start_ns = 0;
+	pacer->start_cycles = 0;
+	pacer->frames = 0;
+	pacer->overruns = 0;
+	pacer->resyncs = 0;
+	pacer->sleeps = 0;
+	pacer->jitter_min_ns = INT64_MAX;
+	pacer->jitter_max_ns = INT64_MIN;
+	pacer->jitter_sum = 0;
+	pacer->jitter_sq_sum = 0;
+}
+
+void destroyPACER(PACER *pacer) {
+	(void) pacer;
+	return;
+}
+
+/// Runs `frames` frames (0 = until BRK) at the pacer's clock rate.
+/// Returns 0 if the program hit BRK.
+uint8_t run_paced(CPU *cpu, PACER *pacer, uint64_t frames) {
+	uint64_t period = NSEC_PER_SEC / pacer->frame_hz;
+	uint64_t n = 0;
+	uint64_t done = 0;
+
+	pacer->start_ns = now_ns();
+	pacer->start_cycles = cpu->cycles;
+
+	while (!frames || done < frames) {
+		n += 1;
+		done += 1;
+
+		uint64_t target = frame_cycles(pacer, n);
+		if (cpu->cycles < target && !run_cycles(cpu, target - cpu->cycles))
+			return 0;
+		if (pacer->on_frame)
+			pacer->on_frame(cpu, pacer->data);
+		pacer->frames += 1;
+
+		uint64_t deadline = frame_deadline(pacer, n);
+		uint64_t now = now_ns();
+		if (now > deadline) {
+			pacer->overruns += 1;
+			// Too far behind to catch up: restart the time base at the
+			// current frame so the following frames are paced again.
+			if (now - deadline > pacer->max_catchup * period) {
+				pacer->resyncs += 1;
+				pacer->start_ns = now;
+				pacer->start_cycles = cpu->cycles;
+				n = 0;
+			}
+			continue;
+		}
+
+		sleep_until(deadline);
+		int64_t late = (int64_t) (now_ns() - deadline);
+		if (late < pacer->jitter_min_ns) pacer->jitter_min_ns = late;
+		if (late > pacer->jitter_max_ns) pacer->jitter_max_ns = late;
+		pacer->jitter_sum += (double) late;
+		pacer->jitter_sq_sum += (double) late * (double) late;
+		pacer->sleeps += 1;
+	}
+
+	return 1;
+}
+
+void print_pacer_stats(PACER *pacer, FILE *out) {
+	fprintf(out, "Frames: %lu (%u Hz, %u Hz clock)\n", pacer->frames, pacer->frame_hz, pacer->clock_hz);
+	fprintf(out, "Overruns: %lu, resyncs: %lu\n", pacer->overruns, pacer->resyncs);
+	if (!pacer->sleeps)
+		return;
+
+	double mean = pacer->jitter_sum / (double) pacer->sleeps;
+	double var = pacer->jitter_sq_sum / (double) pacer->sleeps - mean * mean;
+	fprintf(out, "Wakeup jitter: min %ld ns, max %ld ns, mean %.0f ns, stddev %.0f ns\n",
+		pacer->jitter_min_ns, pacer->jitter_max_ns, mean, var > 0 ? sqrt(var) : 0);
+}
@@ -0,0 +1,52 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cpu_6502.h"
+
+#define NTSC_CLOCK_HZ	1789773
+#define PAL_CLOCK_HZ	1662607
+#define FRAME_HZ	60
+#define MAX_CATCHUP	4
+
+/// # Pacer
+///
+/// Runs the cpu at a fixed clock rate by executing cycle-budgeted slices,
+/// one per frame, and sleeping until the absolute deadline of the next frame.
+/// Deadlines and cycle targets are derived from the frame index, so rounding
+/// never accumulates. A frame that finishes late is followed immediately by
+/// the next one (catch up); if we fall more than `max_catchup` frames behind
+/// the time base is moved forward instead (resync).
+///
+typedef struct {
+	uint32_t clock_hz;
+	uint32_t frame_hz;
+	uint32_t max_catchup;
+
+	/* Called once per frame after the slice ran, e.g. input/display */
+	void (*on_frame)(CPU *cpu, void *data);
+	void *data;
+
+	uint64_t start_ns;
+	uint64_t start_cycles;
+	uint64_t frames;
+
+	/* Statistics */
+	uint64_t overruns;
+	uint64_t resyncs;
+	uint64_t sleeps;
+	int64_t jitter_min_ns;
+	int64_t jitter_max_ns;
+	double jitter_sum;
+	double jitter_sq_sum;
+} PACER;
+
+void createPACER(PACER *pacer, uint32_t clock_hz, uint32_t frame_hz);
+void destroyPACER(PACER *pacer);
+
+uint8_t run_paced(CPU *cpu, PACER *pacer, uint64_t frames);
+void print_pacer_stats(PACER *pacer, FILE *out);
+
+#endif
@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ftw.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "util.h"
+
+typedef struct {
+	char *path;
+	char *name;
+} FOUND;
+
+/* What nftw() collects, it takes no user pointer */
+static FOUND *found;
+static size_t nfound, found_cap;
+static size_t root_len;
+
+static uint8_t has_suffix(const char *path, const char *suffix) {
+	size_t len = strlen(path), slen = strlen(suffix);
+	return len > slen && !strcasecmp(path + len - slen, suffix);
+}
+
+static int collect(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+	(void) st;
+	(void) ftw;
+	if (type != FTW_F || !(has_suffix(path, ".bin") || has_suffix(path, ".prg")))
+		return 0;
+	if (nfound == found_cap) {
+		found_cap = found_cap ? found_cap * 2 : 256;
+		found = realloc(found, found_cap * sizeof(FOUND));
+	}
+	found[nfound].path = strdup(path);
+	// named relative to the directory given, a file given alone by its path
+	const char *name = path + root_len;
+	while (*name == '/')
+		name += 1;
+	found[nfound].name = strdup(*name ? name : path);
+	nfound += 1;
+	return 0;
+}
+
+static int by_name(const void *a, const void *b) {
+	return strcmp(((const FOUND *) a)->name, ((const FOUND *) b)->name);
+}
+
+static int list(const char *path) {
+	ARCHIVE archive;
+	if (!createARCHIVE(&archive, path)) {
+		fprintf(stderr, "%s: not a program archive\n", path);
+		return 1;
+	}
+	printf("%8s %5s %5s %6s  %2s %2s %2s %2s %2s  %s\n", "index", "load", "entry", "length", "A", "X", "Y", "P", "S", "name");
+	for (uint32_t i = 0; i < archive.count; ++i) {
+		const ARCHIVE_ENTRY *e = &archive.entries[i];
+		printf("%8u %04X  %04X  %6u  %02X %02X %02X %02X %02X  %s\n", i, e->load, e->entry, e->length,
+			e->register_a, e->register_x, e->register_y, e->status, e->stack_pointer, archive_name(&archive, i));
+	}
+	printf("%u programs, %lu bytes\n", archive.count, archive.size);
+	destroyARCHIVE(&archive);
+	return 0;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s -o out.pak [-b bin_load] [-e entry] [-r A,X,Y,P,S] dir_or_file...\n"
+			"       %s -t archive.pak\n"
+			"\tpacks every .bin (loaded at bin_load, $8000 by default) and .prg (load\n"
+			"\taddress in its first two bytes) found into one archive, sorted by name.\n"
+			"\tPrograms start at their load address unless -e is given, with the\n"
+			"\tregisters reset() sets unless -r is\n", name, name);
+}
+
+int main(int argc, char **argv) {
+	const char *out_file = NULL;
+	long bin_load = 0x8000, entry = -1;
+	unsigned regs[5] = { 0, 0, 0, NEGATIV | INTERRUPT_DISABLE, STACK_RESET };
+
+	int opt;
+	while ((opt = getopt(argc, argv, "o:b:e:r:t:")) != -1) {
+		switch (opt) {
+			case 'o': out_file = optarg; break;
+			case 'b': bin_load = strtol(optarg, NULL, 0) & 0xFFFF; break;
+			case 'e': entry = strtol(optarg, NULL, 0) & 0xFFFF; break;
+			case 'r':
+				if (sscanf(optarg, "%x,%x,%x,%x,%x", &regs[0], &regs[1], &regs[2], &regs[3], &regs[4]) != 5) {
+					usage(argv[0]);
+					return 1;
+				}
+			break;
+			case 't': return list(optarg);
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (!out_file || optind == argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (int i = optind; i < argc; ++i) {
+		root_len = strlen(argv[i]);
+		if (nftw(argv[i], collect, 16, FTW_PHYS)) {
+			perror(argv[i]);
+			return 1;
+		}
+	}
+	qsort(found, nfound, sizeof(FOUND), by_name);
+
+	ARCHIVE_PROGRAM *programs = calloc(nfound ? nfound : 1, sizeof(ARCHIVE_PROGRAM));
+	uint8_t **images = calloc(nfound ? nfound : 1, sizeof(uint8_t *));
+	size_t skipped = 0, bytes = 0, n = 0;
+	for (size_t i = 0; i < nfound; ++i) {
+		size_t len;
+		uint8_t *data = images[n] = read_file(found[i].path, &len);
+		ARCHIVE_PROGRAM *p = &programs[n];
+		if (!data) {
+			perror(found[i].path);
+			return 1;
+		}
+
+		p->name = found[i].name;
+		if (has_suffix(found[i].path, ".prg")) {
+			p->load = len >= 2 ? (uint16_t) (data[0] | data[1] << 8) : 0;
+			p->image = data + 2;
+			p->length = len >= 2 ? (uint32_t) (len - 2) : 0;
+		} else {
+			p->load = (uint16_t) bin_load;
+			p->image = data;
+			p->length = (uint32_t) len;
+		}
+		if ((has_suffix(found[i].path, ".prg") && len < 2) || p->load + p->length > MEMORY_SIZE) {
+			fprintf(stderr, len < 2 ? "%s: no load address, skipped\n" : "%s: does not fit at $%04X, skipped\n",
+				found[i].path, p->load);
+			free(data);
+			skipped += 1;
+			continue;
+		}
+		p->entry = entry >= 0 ? (uint16_t) entry : p->load;
+		p->register_a = (uint8_t) regs[0];
+		p->register_x = (uint8_t) regs[1];
+		p->register_y = (uint8_t) regs[2];
+		p->status = (uint8_t) regs[3];
+		p->stack_pointer = (uint8_t) regs[4];
+		bytes += p->length;
+		n += 1;
+	}
+
+	if (!archive_write(out_file, programs, (uint32_t) n)) {
+		perror(out_file);
+		return 1;
+	}
+	printf("%lu programs, %lu bytes of images in %s", n, bytes, out_file);
+	if (skipped)
+		printf(", %lu skipped", skipped);
+	printf("\n");
+
+	for (size_t i = 0; i < n; ++i)
+		free(images[i]);
+	for (size_t i = 0; i < nfound; ++i) {
+		free(found[i].path);
+		free(found[i].name);
+	}
+	free(images);
+	free(programs);
+	free(found);
+	return 0;
+}
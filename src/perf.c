@@ -0,0 +1,90 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perf.h"
+
+static const struct {
+	uint64_t config;
+	const char *name;
+} events[PERF_COUNTERS] = {
+	[PERF_INSTRUCTIONS] = { PERF_COUNT_HW_INSTRUCTIONS, "instructions" },
+	[PERF_CYCLES] = { PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+	[PERF_BRANCH_MISSES] = { PERF_COUNT_HW_BRANCH_MISSES, "branch-misses" },
+	[PERF_CACHE_MISSES] = { PERF_COUNT_HW_CACHE_MISSES, "cache-misses" },
+};
+
+/// Returns 0 with `error` set when no counter at all could be opened.
+uint8_t createPERF(PERF *perf) {
+	uint8_t any = 0;
+
+	perf->error = 0;
+	for (int i = 0; i < PERF_COUNTERS; ++i) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = events[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		perf->fds[i] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (perf->fds[i] < 0)
+			perf->error = errno;
+		else
+			any = 1;
+		perf->counts[i] = 0;
+	}
+	return any;
+}
+
+void destroyPERF(PERF *perf) {
+	for (int i = 0; i < PERF_COUNTERS; ++i) {
+		if (perf->fds[i] >= 0)
+			close(perf->fds[i]);
+		perf->fds[i] = -1;
+	}
+}
+
+void perf_start(PERF *perf) {
+	for (int i = 0; i < PERF_COUNTERS; ++i) {
+		if (perf->fds[i] < 0)
+			continue;
+		ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+void perf_stop(PERF *perf) {
+	for (int i = 0; i < PERF_COUNTERS; ++i) {
+		if (perf->fds[i] >= 0)
+			ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+	for (int i = 0; i < PERF_COUNTERS; ++i) {
+		/* value, time enabled, time running */
+		uint64_t read_data[3];
+		if (perf->fds[i] < 0 || read(perf->fds[i], read_data, sizeof(read_data)) != sizeof(read_data))
+			continue;
+		if (read_data[2] && read_data[2] < read_data[1])
+			read_data[0] = (uint64_t) ((double) read_data[0] * (double) read_data[1] / (double) read_data[2]);
+		perf->counts[i] += read_data[2] ? read_data[0] : 0;
+	}
+}
+
+void perf_clear(PERF *perf) {
+	memset(perf->counts, 0, sizeof(perf->counts));
+}
+
+uint8_t perf_available(PERF *perf, PERF_COUNTER counter) {
+	return perf->fds[counter] >= 0;
+}
+
+const char *perf_name(PERF_COUNTER counter) {
+	return events[counter].name;
+}
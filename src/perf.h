@@ -0,0 +1,42 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+typedef enum {
+	PERF_INSTRUCTIONS,
+	PERF_CYCLES,
+	PERF_BRANCH_MISSES,
+	PERF_CACHE_MISSES,
+	PERF_COUNTERS,
+} PERF_COUNTER;
+
+/// # Hardware counters
+///
+/// The host PMU counters above through perf_event_open(), for the calling
+/// thread in user space only. Each counter is opened on its own, so one
+/// the machine lacks (a VM without a PMU, cache misses on some cores)
+/// only loses that one: `fds` is -1 and perf_available() says no. When
+/// the kernel multiplexes them the counts are scaled by the time each
+/// one actually ran.
+///
+/// perf_start() and perf_stop() bracket a measurement, perf_stop() adds
+/// to `counts`, so several runs of a workload accumulate.
+///
+typedef struct {
+	int fds[PERF_COUNTERS];
+	uint64_t counts[PERF_COUNTERS];
+	/* errno of the last counter that could not be opened */
+	int error;
+} PERF;
+
+uint8_t createPERF(PERF *perf);
+void destroyPERF(PERF *perf);
+
+void perf_start(PERF *perf);
+void perf_stop(PERF *perf);
+void perf_clear(PERF *perf);
+uint8_t perf_available(PERF *perf, PERF_COUNTER counter);
+const char *perf_name(PERF_COUNTER counter);
+
+#endif
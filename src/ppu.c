@@ -0,0 +1,372 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ppu.h"
+
+typedef uint8_t V16 __attribute__((vector_size(16)));
+
+/* NES colour numbers to RGB */
+static const uint8_t nes_rgb[64][3] = {
+	{ 0x7C, 0x7C, 0x7C }, { 0x00, 0x00, 0xFC }, { 0x00, 0x00, 0xBC }, { 0x44, 0x28, 0xBC },
+	{ 0x94, 0x00, 0x84 }, { 0xA8, 0x00, 0x20 }, { 0xA8, 0x10, 0x00 }, { 0x88, 0x14, 0x00 },
+	{ 0x50, 0x30, 0x00 }, { 0x00, 0x78, 0x00 }, { 0x00, 0x68, 0x00 }, { 0x00, 0x58, 0x00 },
+	{ 0x00, 0x40, 0x58 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+	{ 0xBC, 0xBC, 0xBC }, { 0x00, 0x78, 0xF8 }, { 0x00, 0x58, 0xF8 }, { 0x68, 0x44, 0xFC },
+	{ 0xD8, 0x00, 0xCC }, { 0xE4, 0x00, 0x58 }, { 0xF8, 0x38, 0x00 }, { 0xE4, 0x5C, 0x10 },
+	{ 0xAC, 0x7C, 0x00 }, { 0x00, 0xB8, 0x00 }, { 0x00, 0xA8, 0x00 }, { 0x00, 0xA8, 0x44 },
+	{ 0x00, 0x88, 0x88 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+	{ 0xF8, 0xF8, 0xF8 }, { 0x3C, 0xBC, 0xFC }, { 0x68, 0x88, 0xFC }, { 0x98, 0x78, 0xF8 },
+	{ 0xF8, 0x78, 0xF8 }, { 0xF8, 0x58, 0x98 }, { 0xF8, 0x78, 0x58 }, { 0xFC, 0xA0, 0x44 },
+	{ 0xF8, 0xB8, 0x00 }, { 0xB8, 0xF8, 0x18 }, { 0x58, 0xD8, 0x54 }, { 0x58, 0xF8, 0x98 },
+	{ 0x00, 0xE8, 0xD8 }, { 0x78, 0x78, 0x78 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+	{ 0xFC, 0xFC, 0xFC }, { 0xA4, 0xE4, 0xFC }, { 0xB8, 0xB8, 0xF8 }, { 0xD8, 0xB8, 0xF8 },
+	{ 0xF8, 0xB8, 0xF8 }, { 0xF8, 0xA4, 0xC0 }, { 0xF0, 0xD0, 0xB0 }, { 0xFC, 0xE0, 0xA8 },
+	{ 0xF8, 0xD8, 0x78 }, { 0xD8, 0xF8, 0x78 }, { 0xB8, 0xF8, 0xB8 }, { 0xB8, 0xF8, 0xD8 },
+	{ 0x00, 0xFC, 0xFC }, { 0xF8, 0xD8, 0xF8 }, { 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00 },
+};
+
+/* Byte i holds bit 7 - i of the index, one bitplane row spread out */
+static uint64_t spread[256];
+
+#define BYTES(b)	((uint64_t) (b) * 0x0101010101010101ULL)
+
+/* Sprite line buffer: palette entry (16-31) in the low bits */
+#define SPRITE_BEHIND	0x40
+#define SPRITE_ZERO	0x80
+
+void createPPU(PPU *ppu, const uint8_t *chr, size_t chr_len, PPU_MIRRORING mirroring) {
+	for (int b = 0; b < 256; ++b) {
+		spread[b] = 0;
+		for (int i = 0; i < 8; ++i)
+			spread[b] |= (uint64_t) ((b >> (7 - i)) & 1) << (i * 8);
+	}
+
+	ppu->ctrl = 0;
+	ppu->mask = 0;
+	ppu->status = 0;
+	ppu->oam_addr = 0;
+	ppu->v = 0;
+	ppu->t = 0;
+	ppu->x = 0;
+	ppu->w = 0;
+	ppu->read_buffer = 0;
+	ppu->open_bus = 0;
+
+	// no CHR ROM means 8 KiB of CHR RAM
+	memset(ppu->chr, 0, sizeof(ppu->chr));
+	memcpy(ppu->chr, chr, chr_len < sizeof(ppu->chr) ? chr_len : sizeof(ppu->chr));
+	ppu->chr_writable = !chr_len;
+	memset(ppu->vram, 0, sizeof(ppu->vram));
+	memset(ppu->palette, 0, sizeof(ppu->palette));
+	memset(ppu->oam, 0, sizeof(ppu->oam));
+	ppu->mirroring = mirroring;
+
+	memset(ppu->stale, 0xFF, sizeof(ppu->stale));
+	ppu->nmi_pending = 0;
+	ppu->frames = 0;
+	memset(ppu->frame, 0, sizeof(ppu->frame));
+}
+
+void destroyPPU(PPU *ppu) {
+	(void) ppu;
+}
+
+/* VRAM */
+
+static inline uint16_t nametable_index(PPU *ppu, uint16_t add) {
+	if (ppu->mirroring == MIRROR_VERTICAL)
+		return add & 0x07FF;
+	return ((add >> 1) & 0x0400) | (add & 0x03FF);
+}
+
+/// $3F10, $3F14, $3F18 and $3F1C are the same bytes as $3F00, $3F04...
+static inline uint8_t palette_index(uint16_t add) {
+	add &= 0x1F;
+	return (add & 0x13) == 0x10 ? add & 0x0F : add;
+}
+
+static uint8_t vram_read(PPU *ppu, uint16_t add) {
+	add &= 0x3FFF;
+	if (add < 0x2000)
+		return ppu->chr[add];
+	if (add < 0x3F00)
+		return ppu->vram[nametable_index(ppu, add)];
+	return ppu->palette[palette_index(add)];
+}
+
+static void vram_write(PPU *ppu, uint16_t add, uint8_t value) {
+	add &= 0x3FFF;
+	if (add < 0x2000) {
+		if (ppu->chr_writable) {
+			ppu->chr[add] = value;
+			ppu->stale[add >> 10] |= 1ULL << ((add >> 4) & 63);
+		}
+	} else if (add < 0x3F00) {
+		ppu->vram[nametable_index(ppu, add)] = value;
+	} else {
+		ppu->palette[palette_index(add)] = value & 0x3F;
+	}
+}
+
+/* Registers */
+
+/// `reg` is the CPU address, only its low 3 bits matter.
+uint8_t ppu_read(PPU *ppu, uint16_t reg) {
+	uint8_t value = ppu->open_bus;
+
+	switch (reg & 7) {
+		case 2:
+			value = (ppu->status & 0xE0) | (ppu->open_bus & 0x1F);
+			ppu->status &= ~PPUSTATUS_VBLANK;
+			ppu->w = 0;
+		break;
+
+		case 4:
+			value = ppu->oam[ppu->oam_addr];
+		break;
+
+		case 7: {
+			uint16_t add = ppu->v & 0x3FFF;
+			// reads lag one behind, except palette reads which refill the
+			// buffer with the nametable byte underneath
+			if (add >= 0x3F00) {
+				value = vram_read(ppu, add);
+				ppu->read_buffer = vram_read(ppu, add - 0x1000);
+			} else {
+				value = ppu->read_buffer;
+				ppu->read_buffer = vram_read(ppu, add);
+			}
+			ppu->v += ppu->ctrl & PPUCTRL_INCREMENT ? 32 : 1;
+		} break;
+	}
+	return value;
+}
+
+void ppu_write(PPU *ppu, uint16_t reg, uint8_t value) {
+	ppu->open_bus = value;
+
+	switch (reg & 7) {
+		case 0:
+			// enabling NMI during vblank fires it right away
+			if (!(ppu->ctrl & PPUCTRL_NMI) && (value & PPUCTRL_NMI) && (ppu->status & PPUSTATUS_VBLANK))
+				ppu->nmi_pending = 1;
+			ppu->ctrl = value;
+			ppu->t = (ppu->t & ~0x0C00) | (uint16_t) ((value & 3) << 10);
+		break;
+
+		case 1:
+			ppu->mask = value;
+		break;
+
+		case 3:
+			ppu->oam_addr = value;
+		break;
+
+		case 4:
+			ppu->oam[ppu->oam_addr++] = value;
+		break;
+
+		case 5:
+			if (!ppu->w) {
+				ppu->t = (ppu->t & ~0x001F) | (value >> 3);
+				ppu->x = value & 7;
+			} else {
+				ppu->t = (ppu->t & ~0x73E0) | (uint16_t) ((value & 0x07) << 12) | (uint16_t) ((value & 0xF8) << 2);
+			}
+			ppu->w ^= 1;
+		break;
+
+		case 6:
+			if (!ppu->w) {
+				ppu->t = (ppu->t & 0x00FF) | (uint16_t) ((value & 0x3F) << 8);
+			} else {
+				ppu->t = (ppu->t & 0xFF00) | value;
+				ppu->v = ppu->t;
+			}
+			ppu->w ^= 1;
+		break;
+
+		case 7:
+			vram_write(ppu, ppu->v, value);
+			ppu->v += ppu->ctrl & PPUCTRL_INCREMENT ? 32 : 1;
+		break;
+	}
+}
+
+/// $4014: copies a 256 byte CPU page into OAM from OAMADDR on.
+void ppu_oam_dma(PPU *ppu, const uint8_t *page) {
+	for (int i = 0; i < 256; ++i)
+		ppu->oam[(uint8_t) (ppu->oam_addr + i)] = page[i];
+}
+
+/* Rendering */
+
+static void decode_stale(PPU *ppu) {
+	for (int i = 0; i < PPU_TILES / 64; ++i) {
+		while (ppu->stale[i]) {
+			int tile = i * 64 + __builtin_ctzll(ppu->stale[i]);
+			const uint8_t *planes = &ppu->chr[tile * 16];
+			for (int row = 0; row < 8; ++row)
+				ppu->tiles[tile][row] = spread[planes[row]] | spread[planes[row + 8]] << 1;
+			ppu->stale[i] &= ppu->stale[i] - 1;
+		}
+	}
+}
+
+/// Background palette entries (0-15, 0 where transparent) for the 33
+/// tiles a line can touch, starting at the left edge of the first one.
+static void background_line(PPU *ppu, uint8_t *out) {
+	uint16_t v = ppu->v;
+	uint64_t (*tiles)[8] = &ppu->tiles[ppu->ctrl & PPUCTRL_BG_TABLE ? 256 : 0];
+	uint16_t fine_y = (v >> 12) & 7;
+
+	for (int i = 0; i < 33; ++i) {
+		uint8_t tile = ppu->vram[nametable_index(ppu, v & 0x0FFF)];
+		uint16_t attr_add = 0x03C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07);
+		uint8_t shift = ((v >> 4) & 4) | (v & 2);
+		uint8_t attr = (ppu->vram[nametable_index(ppu, attr_add)] >> shift) & 3;
+
+		// the palette bits go on opaque pixels only
+		uint64_t row = tiles[tile][fine_y];
+		uint64_t opaque = ((row | row >> 1) & BYTES(1)) * 0xFF;
+		row |= BYTES(attr << 2) & opaque;
+		memcpy(&out[i * 8], &row, 8);
+
+		// coarse X, wrapping into the next nametable
+		if ((v & 0x1F) == 31)
+			v = (v & ~0x1F) ^ 0x0400;
+		else
+			v += 1;
+	}
+}
+
+/// Up to 8 sprites on `line`, the lower OAM index winning where they overlap.
+static uint8_t sprite_line(PPU *ppu, uint16_t line, uint8_t *out) {
+	uint8_t height = ppu->ctrl & PPUCTRL_TALL_SPRITES ? 16 : 8;
+	uint8_t count = 0;
+
+	for (int n = 0; n < 64; ++n) {
+		const uint8_t *sprite = &ppu->oam[n * 4];
+		// drawn from the line after its Y
+		uint16_t row = (uint16_t) (line - sprite[0] - 1);
+		if (row >= height)
+			continue;
+		if (count == 8) {
+			ppu->status |= PPUSTATUS_OVERFLOW;
+			break;
+		}
+		count += 1;
+
+		uint8_t attr = sprite[2];
+		if (attr & 0x80)
+			row = height - 1 - row;
+		uint16_t tile = height == 16
+			? (uint16_t) ((sprite[1] & 1) << 8 | ((sprite[1] & 0xFE) + (row >> 3)))
+			: (uint16_t) ((ppu->ctrl & PPUCTRL_SPRITE_TABLE ? 256 : 0) + sprite[1]);
+		uint64_t pixels = ppu->tiles[tile][row & 7];
+		if (attr & 0x40)
+			pixels = __builtin_bswap64(pixels);
+
+		uint8_t flags = (uint8_t) (0x10 | (attr & 3) << 2) | (attr & 0x20 ? SPRITE_BEHIND : 0) | (n == 0 ? SPRITE_ZERO : 0);
+		for (int i = 0; i < 8 && sprite[3] + i < PPU_WIDTH; ++i) {
+			uint8_t colour = (pixels >> (i * 8)) & 3;
+			if (colour && !out[sprite[3] + i])
+				out[sprite[3] + i] = flags | colour;
+		}
+	}
+	return count;
+}
+
+static void render_line(PPU *ppu, uint16_t line) {
+	uint8_t bg[33 * 8 + 16] __attribute__((aligned(16))) = { 0 };
+	uint8_t sprites[PPU_WIDTH] = { 0 };
+	uint8_t *out = ppu->frame[line];
+
+	if (ppu->mask & PPUMASK_BG)
+		background_line(ppu, bg);
+	uint8_t *visible = bg + ppu->x;
+	if (!(ppu->mask & PPUMASK_BG_LEFT))
+		memset(visible, 0, 8);
+
+	// whole line through the background palette, 16 pixels per shuffle
+	V16 palette;
+	memcpy(&palette, ppu->palette, sizeof(palette));
+	for (int i = 0; i < PPU_WIDTH; i += 16) {
+		V16 index;
+		memcpy(&index, visible + i, sizeof(index));
+		V16 colour = __builtin_shuffle(palette, index);
+		memcpy(out + i, &colour, sizeof(colour));
+	}
+
+	if (!(ppu->mask & PPUMASK_SPRITES) || !sprite_line(ppu, line, sprites))
+		return;
+	if (!(ppu->mask & PPUMASK_SPRITES_LEFT))
+		memset(sprites, 0, 8);
+	for (int x = 0; x < PPU_WIDTH; ++x) {
+		uint8_t sprite = sprites[x];
+		if (!sprite)
+			continue;
+		if ((sprite & SPRITE_ZERO) && visible[x] && x != 255)
+			ppu->status |= PPUSTATUS_SPRITE0;
+		if (!(sprite & SPRITE_BEHIND) || !visible[x])
+			out[x] = ppu->palette[sprite & 0x1F];
+	}
+}
+
+/// Fine Y, then coarse Y, wrapping into the next nametable after row 29.
+static void increment_y(PPU *ppu) {
+	uint16_t v = ppu->v;
+	if ((v & 0x7000) != 0x7000) {
+		ppu->v = v + 0x1000;
+		return;
+	}
+	v &= ~0x7000;
+	uint16_t y = (v & 0x03E0) >> 5;
+	if (y == 29) {
+		y = 0;
+		v ^= 0x0800;
+	} else if (y == 31) {
+		y = 0;
+	} else {
+		y += 1;
+	}
+	ppu->v = (v & ~0x03E0) | (uint16_t) (y << 5);
+}
+
+/// Does everything `line` (0-261) does: draws visible lines, starts and
+/// ends vblank. The caller runs the CPU for the line afterwards and takes
+/// the NMI when `nmi_pending` is set.
+void ppu_scanline(PPU *ppu, uint16_t line) {
+	uint8_t rendering = ppu->mask & (PPUMASK_BG | PPUMASK_SPRITES);
+
+	if (line < PPU_HEIGHT) {
+		if (!rendering) {
+			memset(ppu->frame[line], ppu->palette[0], PPU_WIDTH);
+			return;
+		}
+		decode_stale(ppu);
+		ppu->v = (ppu->v & ~0x041F) | (ppu->t & 0x041F);
+		render_line(ppu, line);
+		increment_y(ppu);
+	} else if (line == PPU_VBLANK_LINE) {
+		ppu->status |= PPUSTATUS_VBLANK;
+		ppu->frames += 1;
+		if (ppu->ctrl & PPUCTRL_NMI)
+			ppu->nmi_pending = 1;
+	} else if (line == PPU_LINES - 1) {
+		ppu->status &= ~(PPUSTATUS_VBLANK | PPUSTATUS_SPRITE0 | PPUSTATUS_OVERFLOW);
+		if (rendering)
+			ppu->v = (ppu->v & ~0x7BE0) | (ppu->t & 0x7BE0);
+	}
+}
+
+/// The last frame as a binary PPM.
+void ppu_ppm(PPU *ppu, FILE *out) {
+	static uint8_t rgb[PPU_HEIGHT][PPU_WIDTH][3];
+
+	for (int y = 0; y < PPU_HEIGHT; ++y)
+		for (int x = 0; x < PPU_WIDTH; ++x)
+			memcpy(rgb[y][x], nes_rgb[ppu->frame[y][x] & 0x3F], 3);
+	fprintf(out, "P6\n%d %d\n255\n", PPU_WIDTH, PPU_HEIGHT);
+	fwrite(rgb, 1, sizeof(rgb), out);
+}
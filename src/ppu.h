@@ -0,0 +1,92 @@
+#ifndef PPU_H
+#define PPU_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PPU_WIDTH	256
+#define PPU_HEIGHT	240
+#define PPU_LINES	262
+#define PPU_DOTS	341
+#define PPU_VBLANK_LINE	241
+#define PPU_TILES	512
+
+/* PPUCTRL, PPUMASK and PPUSTATUS bits, see https://www.nesdev.org/wiki/PPU_registers */
+#define PPUCTRL_INCREMENT	0x04
+#define PPUCTRL_SPRITE_TABLE	0x08
+#define PPUCTRL_BG_TABLE	0x10
+#define PPUCTRL_TALL_SPRITES	0x20
+#define PPUCTRL_NMI		0x80
+#define PPUMASK_BG_LEFT		0x02
+#define PPUMASK_SPRITES_LEFT	0x04
+#define PPUMASK_BG		0x08
+#define PPUMASK_SPRITES		0x10
+#define PPUSTATUS_OVERFLOW	0x20
+#define PPUSTATUS_SPRITE0	0x40
+#define PPUSTATUS_VBLANK	0x80
+
+typedef enum {
+	MIRROR_HORIZONTAL,
+	MIRROR_VERTICAL,
+} PPU_MIRRORING;
+
+/// # Picture processing unit
+///
+/// The NES PPU, drawn one scanline at a time: ppu_scanline() renders a
+/// visible line in one go from the scroll registers as they are at its
+/// start, and raises vblank (and NMI when enabled) at line 241. Mid-line
+/// register writes take effect on the next line, sprite 0 hit is known
+/// per line.
+///
+/// Pattern tables are kept decoded: each 8 pixel row of each of the 512
+/// tiles is one uint64_t with a 0-3 colour per byte, leftmost pixel in the
+/// low byte, so horizontal flip is a byte swap. CHR writes only mark the
+/// tile stale and it is decoded again before the next line that draws.
+/// A background line is composed 8 pixels at a time from those rows and
+/// mapped through the palette 16 pixels at a time with a byte shuffle.
+///
+/// `frame` holds NES colour numbers (0-63), ppu_ppm() turns it into RGB.
+///
+typedef struct {
+	/* Registers */
+	uint8_t ctrl;
+	uint8_t mask;
+	uint8_t status;
+	uint8_t oam_addr;
+	/* Current and temporary VRAM address, fine X, write toggle */
+	uint16_t v;
+	uint16_t t;
+	uint8_t x;
+	uint8_t w;
+	uint8_t read_buffer;
+	/* Last value written to any register, what unused bits read back */
+	uint8_t open_bus;
+
+	/* Memory */
+	uint8_t chr[0x2000];
+	uint8_t chr_writable;
+	uint8_t vram[0x800];
+	uint8_t palette[32];
+	uint8_t oam[256];
+	PPU_MIRRORING mirroring;
+
+	/* Decoded pattern tables, see above */
+	uint64_t tiles[PPU_TILES][8];
+	uint64_t stale[PPU_TILES / 64];
+
+	uint8_t nmi_pending;
+	uint64_t frames;
+	uint8_t frame[PPU_HEIGHT][PPU_WIDTH];
+} PPU;
+
+void createPPU(PPU *ppu, const uint8_t *chr, size_t chr_len, PPU_MIRRORING mirroring);
+void destroyPPU(PPU *ppu);
+
+uint8_t ppu_read(PPU *ppu, uint16_t reg);
+void ppu_write(PPU *ppu, uint16_t reg, uint8_t value);
+void ppu_oam_dma(PPU *ppu, const uint8_t *page);
+void ppu_scanline(PPU *ppu, uint16_t line);
+
+void ppu_ppm(PPU *ppu, FILE *out);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+
+#include "profile.h"
+
+/// Charges the cycles since the last event to the routine on top.
+static void charge(PROFILER *prof, CPU *cpu) {
+	prof->exclusive[prof->stack[prof->depth - 1].fn] += cpu->cycles - prof->last_cycles;
+	prof->last_cycles = cpu->cycles;
+}
+
+static CALL_EDGE *edge(PROFILER *prof, uint16_t caller, uint16_t callee) {
+	uint32_t key = ((uint32_t) caller << 16 | callee) + 1;
+	uint32_t slot = (key * 2654435761u) & (PROF_EDGES - 1);
+
+	while (prof->edges[slot].key && prof->edges[slot].key != key)
+		slot = (slot + 1) & (PROF_EDGES - 1);
+	prof->edges[slot].key = key;
+	return &prof->edges[slot];
+}
+
+static void pop(PROFILER *prof, CPU *cpu) {
+	FRAME *frame = &prof->stack[--prof->depth];
+	FRAME *parent = &prof->stack[prof->depth - 1];
+	uint64_t cycles = cpu->cycles - frame->entry_cycles;
+
+	parent->child_cycles += cycles;
+	edge(prof, parent->fn, frame->fn)->cycles += cycles;
+	if (!--prof->active[frame->fn])
+		prof->inclusive[frame->fn] += cycles;
+}
+
+/// Root frame for the routine at the current program counter; attach
+/// right before running.
+void createPROFILER(PROFILER *prof, CPU *cpu) {
+	memset(prof, 0, sizeof(*prof));
+	prof->edges = calloc(PROF_EDGES, sizeof(CALL_EDGE));
+	prof->stack[0] = (FRAME) { cpu->program_counter, 0x100, cpu->cycles, 0 };
+	prof->depth = 1;
+	prof->calls[cpu->program_counter] = 1;
+	prof->active[cpu->program_counter] = 1;
+	prof->last_cycles = cpu->cycles;
+	cpu->profiler = prof;
+}
+
+void destroyPROFILER(PROFILER *prof, CPU *cpu) {
+	cpu->profiler = NULL;
+	free(prof->edges);
+	prof->edges = NULL;
+}
+
+/// Called after a call pushed `pushed` bytes and moved to `target`.
+void prof_call(CPU *cpu, uint16_t target, uint8_t pushed) {
+	PROFILER *prof = cpu->profiler;
+
+	charge(prof, cpu);
+	if (prof->depth == PROF_MAX_DEPTH) {
+		prof->overflows += 1;
+		return;
+	}
+	edge(prof, prof->stack[prof->depth - 1].fn, target)->calls += 1;
+	prof->stack[prof->depth++] = (FRAME) {
+		target, (uint16_t) (cpu->stack_pointer + pushed), cpu->cycles, 0
+	};
+	prof->calls[target] += 1;
+	prof->active[target] += 1;
+}
+
+/// Called after rts()/rti() popped the return address.
+void prof_return(CPU *cpu) {
+	PROFILER *prof = cpu->profiler;
+
+	charge(prof, cpu);
+	while (prof->depth > 1 && prof->stack[prof->depth - 1].sp <= cpu->stack_pointer)
+		pop(prof, cpu);
+}
+
+/// Unwinds what is still on the shadow stack, e.g. after BRK.
+void profile_finish(PROFILER *prof, CPU *cpu) {
+	charge(prof, cpu);
+	while (prof->depth > 1)
+		pop(prof, cpu);
+	FRAME *root = &prof->stack[0];
+	if (prof->active[root->fn]) {
+		prof->active[root->fn] = 0;
+		prof->inclusive[root->fn] += cpu->cycles - root->entry_cycles;
+	}
+}
+
+/// Writes the profile in callgrind format, one function per routine entry
+/// address, for callgrind_annotate or kcachegrind.
+void profile_callgrind(PROFILER *prof, FILE *out, const char *cmd) {
+	uint64_t total = 0;
+	for (uint32_t fn = 0; fn < MEMORY_SIZE; ++fn)
+		total += prof->exclusive[fn];
+
+	fprintf(out, "# callgrind format\nversion: 1\ncreator: 6502emulator\n");
+	fprintf(out, "cmd: %s\npositions: instr\nevents: Cycles\nsummary: %lu\n\n", cmd, total);
+	fprintf(out, "fl=%s\n", cmd);
+
+	for (uint32_t fn = 0; fn < MEMORY_SIZE; ++fn) {
+		if (!prof->calls[fn])
+			continue;
+		fprintf(out, "fn=sub_%04X\n0x%04X %lu\n", fn, fn, prof->exclusive[fn]);
+		for (uint32_t slot = 0; slot < PROF_EDGES; ++slot) {
+			CALL_EDGE *e = &prof->edges[slot];
+			if (!e->key || ((e->key - 1) >> 16) != fn)
+				continue;
+			uint16_t callee = (uint16_t) (e->key - 1);
+			fprintf(out, "cfn=sub_%04X\ncalls=%lu 0x%04X\n0x%04X %lu\n",
+				callee, e->calls, callee, fn, e->cycles);
+		}
+		fprintf(out, "\n");
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cpu_6502.h"
+
+#define PROF_MAX_DEPTH	1024
+#define PROF_EDGES	(1 << 16)
+
+typedef struct {
+	uint16_t fn;
+	/* stack_pointer before the call pushed anything, 0x100 for the root */
+	uint16_t sp;
+	uint64_t entry_cycles;
+	uint64_t child_cycles;
+} FRAME;
+
+typedef struct {
+	/* caller << 16 | callee + 1, 0 for an empty slot */
+	uint32_t key;
+	uint64_t calls;
+	uint64_t cycles;
+} CALL_EDGE;
+
+/// # Call graph profiler
+///
+/// Shadow call stack for cpus built with CPU_PROFILE, pushed by jsr() (and
+/// interrupt entry) and popped by rts()/rti(). A return pops every frame
+/// whose saved stack pointer it reaches, so routines that drop their return
+/// address are unwound too. A return that leaves the stack below the top
+/// frame (pushing an address and RTS as a jump) is not a return and is
+/// charged to the current routine. Exclusive cycles go to the routine
+/// on top of the stack, inclusive cycles are counted once per outermost
+/// activation so recursion is not counted twice.
+///
+typedef struct PROFILER {
+	FRAME stack[PROF_MAX_DEPTH];
+	size_t depth;
+	/* Frames lost because the shadow stack was full */
+	uint64_t overflows;
+
+	uint64_t exclusive[MEMORY_SIZE];
+	uint64_t inclusive[MEMORY_SIZE];
+	uint64_t calls[MEMORY_SIZE];
+	uint32_t active[MEMORY_SIZE];
+	CALL_EDGE *edges;
+	uint64_t last_cycles;
+} PROFILER;
+
+void createPROFILER(PROFILER *prof, CPU *cpu);
+void destroyPROFILER(PROFILER *prof, CPU *cpu);
+
+void profile_finish(PROFILER *prof, CPU *cpu);
+void profile_callgrind(PROFILER *prof, FILE *out, const char *cmd);
+
+#endif
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "render.h"
+
+#define RENDER_FRESH	4
+
+/* Colour indexes 0-15 as used by the snake program's display */
+static const uint8_t palette[16][3] = {
+	{ 0x00, 0x00, 0x00 }, { 0xFF, 0xFF, 0xFF }, { 0x88, 0x00, 0x00 }, { 0xAA, 0xFF, 0xEE },
+	{ 0xCC, 0x44, 0xCC }, { 0x00, 0xCC, 0x55 }, { 0x00, 0x00, 0xAA }, { 0xEE, 0xEE, 0x77 },
+	{ 0xDD, 0x88, 0x55 }, { 0x66, 0x44, 0x00 }, { 0xFF, 0x77, 0x77 }, { 0x33, 0x33, 0x33 },
+	{ 0x77, 0x77, 0x77 }, { 0xAA, 0xFF, 0x66 }, { 0x00, 0x88, 0xFF }, { 0xBB, 0xBB, 0xBB },
+};
+
+static void write_frame(RENDER *render, const uint8_t *frame) {
+	uint32_t width = DISPLAY_WIDTH * render->scale;
+	uint8_t *px = render->rgb;
+
+	for (uint32_t y = 0; y < DISPLAY_HEIGHT; ++y) {
+		uint8_t *row = px;
+		for (uint32_t x = 0; x < DISPLAY_WIDTH; ++x) {
+			const uint8_t *c = palette[frame[y * DISPLAY_WIDTH + x] & 0x0F];
+			for (uint32_t s = 0; s < render->scale; ++s) {
+				*px++ = c[0];
+				*px++ = c[1];
+				*px++ = c[2];
+			}
+		}
+		for (uint32_t s = 1; s < render->scale; ++s, px += width * 3)
+			memcpy(px, row, width * 3);
+	}
+
+	fprintf(render->out, "P6\n%u %u\n255\n", width, DISPLAY_HEIGHT * render->scale);
+	fwrite(render->rgb, 3, (size_t) width * DISPLAY_HEIGHT * render->scale, render->out);
+	render->written += 1;
+}
+
+/// Takes the middle buffer when fresh; returns 0 if there was nothing new.
+static uint8_t take_frame(RENDER *render) {
+	if (!(atomic_load_explicit(&render->middle, memory_order_relaxed) & RENDER_FRESH))
+		return 0;
+	uint32_t old = atomic_exchange_explicit(&render->middle, render->front, memory_order_acq_rel);
+	render->front = old & 3;
+	return 1;
+}
+
+static void *output_thread(void *arg) {
+	RENDER *render = arg;
+	const struct timespec idle = { 0, 1000000 };
+
+	while (atomic_load_explicit(&render->running, memory_order_relaxed)) {
+		if (take_frame(render))
+			write_frame(render, render->frames[render->front]);
+		else
+			nanosleep(&idle, NULL);
+	}
+	/* Flush the last published frame */
+	if (take_frame(render))
+		write_frame(render, render->frames[render->front]);
+	fflush(render->out);
+	return NULL;
+}
+
+void createRENDER(RENDER *render, FILE *out, uint32_t scale) {
+	memset(render->frames, 0, sizeof(render->frames));
+	atomic_init(&render->middle, 1);
+	render->back = 0;
+	render->front = 2;
+	render->scale = scale ? scale : 1;
+	render->out = out;
+	render->rgb = malloc((size_t) DISPLAY_SIZE * 3 * render->scale * render->scale);
+	render->published = 0;
+	render->dropped = 0;
+	render->written = 0;
+	atomic_init(&render->running, 1);
+	pthread_create(&render->thread, NULL, output_thread, render);
+}
+
+/// Stops the output thread after it wrote the last published frame.
+void destroyRENDER(RENDER *render) {
+	atomic_store(&render->running, 0);
+	pthread_join(render->thread, NULL);
+	free(render->rgb);
+	render->rgb = NULL;
+}
+
+/// Called on the cpu thread: one memcpy and one atomic exchange.
+void render_publish(RENDER *render, CPU *cpu) {
+	memcpy(render->frames[render->back], &cpu->memory[DISPLAY_START], DISPLAY_SIZE);
+	uint32_t old = atomic_exchange_explicit(&render->middle, render->back | RENDER_FRESH,
+		memory_order_acq_rel);
+	render->back = old & 3;
+	render->published += 1;
+	if (old & RENDER_FRESH)
+		render->dropped += 1;
+}
+
+/// PACER on_frame callback, `data` is the RENDER.
+void render_frame(CPU *cpu, void *data) {
+	render_publish(data, cpu);
+}
@@ -0,0 +1,52 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "cpu_6502.h"
+
+#define DISPLAY_START	0x0200
+#define DISPLAY_WIDTH	32
+#define DISPLAY_HEIGHT	32
+#define DISPLAY_SIZE	(DISPLAY_WIDTH * DISPLAY_HEIGHT)
+#define RENDER_SCALE	8
+
+/// # Render
+///
+/// Moves frame output off the emulation thread. The cpu thread copies the
+/// display region ($0200-$05FF, one colour index per byte) into the back
+/// buffer of a triple buffer and swaps it with the middle one using a single
+/// atomic exchange; it never waits. The output thread takes the middle buffer
+/// whenever it is marked fresh, scales it and writes it as a binary PPM frame,
+/// so a stream can be piped into `ffmpeg -f image2pipe -c:v ppm -i -`.
+/// If output falls behind, frames are overwritten (dropped), not queued.
+///
+typedef struct {
+	uint8_t frames[3][DISPLAY_SIZE];
+	/* Index of the middle buffer, RENDER_FRESH set when not yet consumed */
+	_Atomic uint32_t middle;
+	uint32_t back;
+	uint32_t front;
+
+	uint32_t scale;
+	FILE *out;
+	uint8_t *rgb;
+	pthread_t thread;
+	_Atomic uint8_t running;
+
+	/* Statistics */
+	uint64_t published;
+	uint64_t dropped;
+	uint64_t written;
+} RENDER;
+
+void createRENDER(RENDER *render, FILE *out, uint32_t scale);
+void destroyRENDER(RENDER *render);
+
+void render_publish(RENDER *render, CPU *cpu);
+void render_frame(CPU *cpu, void *data);
+
+#endif
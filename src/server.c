@@ -0,0 +1,634 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "server.h"
+
+_Static_assert(sizeof(SERVER_MSG) == 12, "SERVER_MSG is part of the protocol");
+_Static_assert(sizeof(SERVER_STATE) == 16, "SERVER_STATE is part of the protocol");
+
+typedef struct CONNECTION {
+	int fd;
+	/* One for the socket thread, one per request in flight */
+	_Atomic uint32_t refs;
+
+	/* Socket thread only */
+	uint8_t *in;
+	size_t in_len;
+	size_t in_cap;
+	struct CONNECTION *prev;
+	struct CONNECTION *next;
+
+	/* Guarded by `lock`, answers not sent yet start at out_pos */
+	pthread_mutex_t lock;
+	uint8_t closed;
+	uint8_t want_write;
+	uint8_t *out;
+	size_t out_len;
+	size_t out_cap;
+	size_t out_pos;
+} CONNECTION;
+
+typedef struct REQUEST {
+	SERVER_MSG msg;
+	/* NULL for the destroy queued when the owner went away */
+	CONNECTION *conn;
+	/* Cycles still to run for SERVER_RUN */
+	uint64_t remaining;
+	struct REQUEST *next;
+	uint8_t payload[];
+} REQUEST;
+
+static void conn_put(CONNECTION *conn) {
+	if (atomic_fetch_sub(&conn->refs, 1) != 1)
+		return;
+	close(conn->fd);
+	pthread_mutex_destroy(&conn->lock);
+	free(conn->in);
+	free(conn->out);
+	free(conn);
+}
+
+static void watch_output(SERVER *server, CONNECTION *conn, uint8_t want) {
+	struct epoll_event ev = { .events = EPOLLIN | (want ? EPOLLOUT : 0), .data.ptr = conn };
+	conn->want_write = want;
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+/// Sends what the socket takes, the socket thread finishes on EPOLLOUT.
+static void flush(SERVER *server, CONNECTION *conn) {
+	pthread_mutex_lock(&conn->lock);
+	while (!conn->closed && conn->out_pos < conn->out_len) {
+		ssize_t n = send(conn->fd, conn->out + conn->out_pos, conn->out_len - conn->out_pos,
+			MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n > 0) {
+			conn->out_pos += (size_t) n;
+		} else if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			if (!conn->want_write)
+				watch_output(server, conn, 1);
+			pthread_mutex_unlock(&conn->lock);
+			return;
+		} else {
+			// the socket thread sees the error and closes
+			break;
+		}
+	}
+	conn->out_len = conn->out_pos = 0;
+	if (conn->want_write && !conn->closed)
+		watch_output(server, conn, 0);
+	pthread_mutex_unlock(&conn->lock);
+}
+
+/// Queues an answer to `req` carrying `a` then `b` as payload.
+static void reply(CONNECTION *conn, const SERVER_MSG *req, uint8_t status, uint32_t session,
+		const void *a, uint32_t a_len, const void *b, uint32_t b_len) {
+	if (!conn)
+		return;
+	SERVER_MSG msg = { .length = a_len + b_len, .session = session, .tag = req->tag, .op = req->op, .status = status };
+	size_t len = sizeof(msg) + a_len + b_len;
+
+	pthread_mutex_lock(&conn->lock);
+	if (!conn->closed) {
+		if (conn->out_len + len > conn->out_cap) {
+			while (conn->out_len + len > conn->out_cap)
+				conn->out_cap = conn->out_cap ? conn->out_cap * 2 : 4096;
+			conn->out = realloc(conn->out, conn->out_cap);
+		}
+		memcpy(conn->out + conn->out_len, &msg, sizeof(msg));
+		if (a_len)
+			memcpy(conn->out + conn->out_len + sizeof(msg), a, a_len);
+		if (b_len)
+			memcpy(conn->out + conn->out_len + sizeof(msg) + a_len, b, b_len);
+		conn->out_len += len;
+	}
+	pthread_mutex_unlock(&conn->lock);
+}
+
+static void reply_status(CONNECTION *conn, const SERVER_MSG *req, uint8_t status) {
+	reply(conn, req, status, req->session, NULL, 0, NULL, 0);
+}
+
+/* Worker pool */
+
+/// Copies `len` bytes at `addr`, wrapping around the end of memory.
+static void copy_in(CPU *cpu, uint16_t addr, const uint8_t *data, uint32_t len) {
+	uint32_t room = (uint32_t) (MEMORY_SIZE - addr);
+	uint32_t first = room < len ? room : len;
+	memcpy(&cpu->memory[addr], data, first);
+	memcpy(cpu->memory, data + first, len - first);
+}
+
+static void reply_state(SESSION *session, REQUEST *req) {
+	CPU *cpu = &session->cpu;
+	SERVER_STATE state = {
+		.cycles = cpu->cycles,
+		.program_counter = cpu->program_counter,
+		.register_a = cpu->register_a,
+		.register_x = cpu->register_x,
+		.register_y = cpu->register_y,
+		.status = cpu->status,
+		.stack_pointer = cpu->stack_pointer,
+		.halted = session->halted,
+	};
+	reply(req->conn, &req->msg, SERVER_OK, session->id, &state, sizeof(state), NULL, 0);
+}
+
+/// Carries out one request. Returns 0 when it is a run with cycles left
+/// after this slice.
+static uint8_t execute_request(SESSION *session, REQUEST *req) {
+	CPU *cpu = &session->cpu;
+	uint32_t len = req->msg.length;
+	uint8_t *data = req->payload;
+	uint16_t addr = len >= 2 ? (uint16_t) (data[0] | data[1] << 8) : 0;
+
+	switch (req->msg.op) {
+		case SERVER_LOAD:
+			if (len < 2 || len - 2 > MEMORY_SIZE) {
+				reply_status(req->conn, &req->msg, SERVER_BAD_REQUEST);
+				break;
+			}
+			copy_in(cpu, addr, data + 2, len - 2);
+			mem_write_u16(cpu, 0xFFFC, addr);
+			reset(cpu);
+			session->halted = 0;
+			reply_status(req->conn, &req->msg, SERVER_OK);
+		break;
+
+		case SERVER_RUN:
+			if (!session->halted && req->remaining) {
+				uint64_t before = cpu->cycles;
+				uint64_t slice = req->remaining < SERVER_SLICE ? req->remaining : SERVER_SLICE;
+				if (!run_cycles(cpu, slice))
+					session->halted = 1;
+				uint64_t ran = cpu->cycles - before;
+				req->remaining = ran < req->remaining ? req->remaining - ran : 0;
+				if (req->remaining && !session->halted)
+					return 0;
+			}
+			reply_state(session, req);
+		break;
+
+		case SERVER_READ: {
+			uint32_t n = 0;
+			if (len == 6)
+				memcpy(&n, data + 2, sizeof(n));
+			if (len != 6 || n > MEMORY_SIZE) {
+				reply_status(req->conn, &req->msg, SERVER_BAD_REQUEST);
+				break;
+			}
+			uint32_t room = (uint32_t) (MEMORY_SIZE - addr);
+			uint32_t first = room < n ? room : n;
+			reply(req->conn, &req->msg, SERVER_OK, session->id, &cpu->memory[addr], first, cpu->memory, n - first);
+		} break;
+
+		case SERVER_WRITE:
+			if (len < 2 || len - 2 > MEMORY_SIZE) {
+				reply_status(req->conn, &req->msg, SERVER_BAD_REQUEST);
+				break;
+			}
+			copy_in(cpu, addr, data + 2, len - 2);
+			reply_status(req->conn, &req->msg, SERVER_OK);
+		break;
+
+		case SERVER_SNAPSHOT:
+			if (!session->snap)
+				session->snap = malloc(sizeof(CPU));
+			snapshot(cpu, session->snap);
+			session->snap_halted = session->halted;
+			reply_status(req->conn, &req->msg, SERVER_OK);
+		break;
+
+		case SERVER_RESTORE:
+			if (!session->snap) {
+				reply_status(req->conn, &req->msg, SERVER_NO_SNAPSHOT);
+				break;
+			}
+			restore(cpu, session->snap);
+			session->halted = session->snap_halted;
+			reply_status(req->conn, &req->msg, SERVER_OK);
+		break;
+
+		case SERVER_DESTROY:
+			free(session->snap);
+			session->snap = NULL;
+			destroyCPU(cpu);
+			reply_status(req->conn, &req->msg, SERVER_OK);
+		break;
+
+		default:
+			reply_status(req->conn, &req->msg, SERVER_BAD_REQUEST);
+		break;
+	}
+	return 1;
+}
+
+/// Runs `*batch` in order and leaves in it what is still to do, a run that
+/// used up its slice and whatever came after. Returns 1 when the session
+/// was destroyed.
+static uint8_t run_batch(SERVER *server, SESSION *session, REQUEST **batch) {
+	REQUEST *done = NULL, **done_tail = &done;
+	CONNECTION *conn = NULL;
+	uint8_t destroyed = 0;
+
+	while (*batch) {
+		REQUEST *req = *batch;
+		if (!execute_request(session, req))
+			break;
+		if (req->conn)
+			conn = req->conn;
+		destroyed |= req->msg.op == SERVER_DESTROY;
+		*batch = req->next;
+		req->next = NULL;
+		*done_tail = req;
+		done_tail = &req->next;
+	}
+
+	// one send for the whole batch, the requests keep the connection alive
+	if (conn)
+		flush(server, conn);
+	while (done) {
+		REQUEST *next = done->next;
+		if (done->conn)
+			conn_put(done->conn);
+		free(done);
+		done = next;
+	}
+	return destroyed;
+}
+
+static void push_ready(SERVER *server, SESSION *session) {
+	session->next = NULL;
+	if (server->queue_tail)
+		server->queue_tail->next = session;
+	else
+		server->queue_head = session;
+	server->queue_tail = session;
+}
+
+static void *server_worker(void *arg) {
+	SERVER *server = arg;
+
+	pthread_mutex_lock(&server->lock);
+	for (;;) {
+		while (!server->queue_head && !server->stop)
+			pthread_cond_wait(&server->ready, &server->lock);
+		if (server->stop)
+			break;
+
+		SESSION *session = server->queue_head;
+		server->queue_head = session->next;
+		if (!server->queue_head)
+			server->queue_tail = NULL;
+		REQUEST *batch = session->head;
+		session->head = session->tail = NULL;
+		pthread_mutex_unlock(&server->lock);
+
+		uint8_t destroyed = run_batch(server, session, &batch);
+
+		pthread_mutex_lock(&server->lock);
+		if (destroyed) {
+			// the socket thread owns the id, it frees the session
+			session->next = server->reaped;
+			server->reaped = session;
+			uint64_t one = 1;
+			if (write(server->event_fd, &one, sizeof(one)) < 0)
+				perror("eventfd");
+			continue;
+		}
+		if (batch) {
+			REQUEST *last = batch;
+			while (last->next)
+				last = last->next;
+			last->next = session->head;
+			if (!session->head)
+				session->tail = last;
+			session->head = batch;
+		}
+		if (session->head)
+			push_ready(server, session);
+		else
+			session->queued = 0;
+	}
+	pthread_mutex_unlock(&server->lock);
+	return NULL;
+}
+
+/* Socket thread */
+
+static void enqueue(SERVER *server, SESSION *session, REQUEST *req) {
+	pthread_mutex_lock(&server->lock);
+	req->next = NULL;
+	if (session->tail)
+		session->tail->next = req;
+	else
+		session->head = req;
+	session->tail = req;
+	if (!session->queued) {
+		session->queued = 1;
+		push_ready(server, session);
+		pthread_cond_signal(&server->ready);
+	}
+	pthread_mutex_unlock(&server->lock);
+}
+
+static void destroy_session(SERVER *server, SESSION *session) {
+	REQUEST *req = malloc(sizeof(REQUEST));
+	memset(req, 0, sizeof(REQUEST));
+	req->msg.session = session->id;
+	req->msg.op = SERVER_DESTROY;
+	session->closing = 1;
+	session->owner = NULL;
+	enqueue(server, session, req);
+}
+
+static void create_session(SERVER *server, CONNECTION *conn, const SERVER_MSG *msg, const uint8_t *data) {
+	uint8_t variant = msg->length ? data[0] : NMOS_6502;
+
+	if (msg->length > 1 || variant > RICOH_2A03) {
+		reply_status(conn, msg, SERVER_BAD_REQUEST);
+		return;
+	}
+	if (!server->nfree) {
+		reply_status(conn, msg, SERVER_FULL);
+		return;
+	}
+
+	SESSION *session = malloc(sizeof(SESSION));
+	createCPUVariant(&session->cpu, (CPU_VARIANT) variant);
+	session->snap = NULL;
+	session->snap_halted = 0;
+	session->id = server->free_ids[--server->nfree];
+	session->owner = conn;
+	session->halted = 0;
+	session->head = session->tail = NULL;
+	session->queued = 0;
+	session->next = NULL;
+	session->closing = 0;
+	server->sessions[session->id - 1] = session;
+	server->nsessions += 1;
+	reply(conn, msg, SERVER_OK, session->id, NULL, 0, NULL, 0);
+}
+
+/// Hands one request to its session. Checks everything that does not need
+/// the session's state, so workers only see well formed requests.
+static void route(SERVER *server, CONNECTION *conn, const SERVER_MSG *msg, const uint8_t *data) {
+	if (msg->op == SERVER_CREATE) {
+		create_session(server, conn, msg, data);
+		return;
+	}
+
+	SESSION *session = msg->session && msg->session <= server->max_sessions ? server->sessions[msg->session - 1] : NULL;
+	if (!session || session->closing || session->owner != conn) {
+		reply_status(conn, msg, SERVER_BAD_SESSION);
+		return;
+	}
+	if (msg->op > SERVER_DESTROY || (msg->op == SERVER_RUN && msg->length != sizeof(uint64_t))) {
+		reply_status(conn, msg, SERVER_BAD_REQUEST);
+		return;
+	}
+
+	REQUEST *req = malloc(sizeof(REQUEST) + msg->length);
+	req->msg = *msg;
+	memcpy(req->payload, data, msg->length);
+	req->remaining = 0;
+	if (msg->op == SERVER_RUN)
+		memcpy(&req->remaining, data, sizeof(uint64_t));
+	req->conn = conn;
+	atomic_fetch_add(&conn->refs, 1);
+	if (msg->op == SERVER_DESTROY)
+		session->closing = 1;
+	enqueue(server, session, req);
+}
+
+/// Reads and routes everything available. Returns 0 when the connection
+/// has to be closed.
+static uint8_t conn_read(SERVER *server, CONNECTION *conn) {
+	for (;;) {
+		if (conn->in_cap - conn->in_len < SERVER_READ_SIZE) {
+			conn->in_cap = conn->in_len + SERVER_READ_SIZE;
+			conn->in = realloc(conn->in, conn->in_cap);
+		}
+		ssize_t n = recv(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len, 0);
+		if (n == 0)
+			return 0;
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		conn->in_len += (size_t) n;
+
+		size_t pos = 0;
+		while (conn->in_len - pos >= sizeof(SERVER_MSG)) {
+			SERVER_MSG msg;
+			memcpy(&msg, conn->in + pos, sizeof(msg));
+			if (msg.length > SERVER_MAX_PAYLOAD)
+				return 0;
+			if (conn->in_len - pos < sizeof(msg) + msg.length)
+				break;
+			route(server, conn, &msg, conn->in + pos + sizeof(msg));
+			pos += sizeof(msg) + msg.length;
+		}
+		memmove(conn->in, conn->in + pos, conn->in_len - pos);
+		conn->in_len -= pos;
+		// answers given right away, errors and creates
+		flush(server, conn);
+	}
+}
+
+static void accept_connections(SERVER *server) {
+	for (;;) {
+		int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+			return;
+
+		CONNECTION *conn = calloc(1, sizeof(CONNECTION));
+		conn->fd = fd;
+		atomic_init(&conn->refs, 1);
+		pthread_mutex_init(&conn->lock, NULL);
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+		if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			conn_put(conn);
+			continue;
+		}
+		conn->next = server->connections;
+		if (conn->next)
+			conn->next->prev = conn;
+		server->connections = conn;
+	}
+}
+
+static void close_connection(SERVER *server, CONNECTION *conn) {
+	pthread_mutex_lock(&conn->lock);
+	conn->closed = 1;
+	pthread_mutex_unlock(&conn->lock);
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+	shutdown(conn->fd, SHUT_RDWR);
+
+	for (size_t i = 0; i < server->max_sessions; ++i) {
+		SESSION *session = server->sessions[i];
+		if (session && !session->closing && session->owner == conn)
+			destroy_session(server, session);
+	}
+
+	if (conn->prev)
+		conn->prev->next = conn->next;
+	else
+		server->connections = conn->next;
+	if (conn->next)
+		conn->next->prev = conn->prev;
+	conn_put(conn);
+}
+
+static void reap_sessions(SERVER *server) {
+	uint64_t count;
+	if (read(server->event_fd, &count, sizeof(count)) < 0)
+		return;
+
+	pthread_mutex_lock(&server->lock);
+	SESSION *session = server->reaped;
+	server->reaped = NULL;
+	pthread_mutex_unlock(&server->lock);
+
+	while (session) {
+		SESSION *next = session->next;
+		server->sessions[session->id - 1] = NULL;
+		server->free_ids[server->nfree++] = session->id;
+		server->nsessions -= 1;
+		free(session);
+		session = next;
+	}
+}
+
+uint8_t createSERVER(SERVER *server, const char *path, size_t workers, size_t max_sessions) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return 0;
+	}
+	strcpy(addr.sun_path, path);
+	strcpy(server->path, path);
+
+	server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (server->listen_fd < 0)
+		return 0;
+	unlink(path);
+	if (bind(server->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+			|| listen(server->listen_fd, SOMAXCONN) < 0) {
+		close(server->listen_fd);
+		return 0;
+	}
+
+	server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	server->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &server->listen_fd };
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &ev);
+	ev.data.ptr = &server->event_fd;
+	epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->event_fd, &ev);
+
+	server->max_sessions = max_sessions;
+	server->sessions = calloc(max_sessions, sizeof(SESSION *));
+	server->free_ids = malloc(max_sessions * sizeof(uint32_t));
+	// lowest ids first
+	for (size_t i = 0; i < max_sessions; ++i)
+		server->free_ids[i] = (uint32_t) (max_sessions - i);
+	server->nfree = max_sessions;
+	server->nsessions = 0;
+	server->connections = NULL;
+
+	pthread_mutex_init(&server->lock, NULL);
+	pthread_cond_init(&server->ready, NULL);
+	server->queue_head = server->queue_tail = NULL;
+	server->reaped = NULL;
+	server->stop = 0;
+
+	server->nworkers = workers;
+	server->workers = malloc(workers * sizeof(pthread_t));
+	for (size_t i = 0; i < workers; ++i)
+		pthread_create(&server->workers[i], NULL, server_worker, server);
+	return 1;
+}
+
+void destroySERVER(SERVER *server) {
+	pthread_mutex_lock(&server->lock);
+	server->stop = 1;
+	pthread_cond_broadcast(&server->ready);
+	pthread_mutex_unlock(&server->lock);
+	for (size_t i = 0; i < server->nworkers; ++i)
+		pthread_join(server->workers[i], NULL);
+	free(server->workers);
+
+	for (size_t i = 0; i < server->max_sessions; ++i) {
+		SESSION *session = server->sessions[i];
+		if (!session)
+			continue;
+		while (session->head) {
+			REQUEST *next = session->head->next;
+			if (session->head->conn)
+				conn_put(session->head->conn);
+			free(session->head);
+			session->head = next;
+		}
+		free(session->snap);
+		free(session);
+	}
+	while (server->reaped) {
+		SESSION *next = server->reaped->next;
+		free(server->reaped);
+		server->reaped = next;
+	}
+	while (server->connections) {
+		CONNECTION *next = server->connections->next;
+		conn_put(server->connections);
+		server->connections = next;
+	}
+	free(server->sessions);
+	free(server->free_ids);
+
+	pthread_cond_destroy(&server->ready);
+	pthread_mutex_destroy(&server->lock);
+	close(server->event_fd);
+	close(server->epoll_fd);
+	close(server->listen_fd);
+	unlink(server->path);
+}
+
+void server_run(SERVER *server, volatile sig_atomic_t *stop) {
+	struct epoll_event events[64];
+
+	while (!*stop) {
+		int n = epoll_wait(server->epoll_fd, events, 64, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			return;
+		}
+
+		for (int i = 0; i < n; ++i) {
+			void *ptr = events[i].data.ptr;
+			if (ptr == &server->listen_fd) {
+				accept_connections(server);
+			} else if (ptr == &server->event_fd) {
+				reap_sessions(server);
+			} else {
+				CONNECTION *conn = ptr;
+				if (events[i].events & EPOLLOUT)
+					flush(server, conn);
+				if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+					if (!conn_read(server, conn))
+						close_connection(server, conn);
+			}
+		}
+	}
+}
@@ -0,0 +1,137 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "cpu_6502.h"
+
+#define SERVER_SLICE		100000
+#define SERVER_MAX_PAYLOAD	(MEMORY_SIZE + 16)
+#define SERVER_READ_SIZE	(1 << 16)
+
+/// # Emulation server
+///
+/// Hosts any number of CPU sessions behind a Unix stream socket. Each
+/// message is a SERVER_MSG header followed by `length` payload bytes, in
+/// the host's byte order since the socket is local:
+///
+///  - SERVER_CREATE [variant u8]: new session, its id comes back in `session`
+///  - SERVER_LOAD addr u16, bytes: writes the image at `addr`, points the
+///    reset vector at it and resets
+///  - SERVER_RUN cycles u64: runs at least that many cycles, or until BRK,
+///    answers SERVER_STATE (cycles 0 just reports)
+///  - SERVER_READ addr u16, len u32: answers `len` bytes from `addr`
+///  - SERVER_WRITE addr u16, bytes: writes them at `addr`
+///  - SERVER_SNAPSHOT, SERVER_RESTORE: saves or goes back to a full copy of
+///    the session, kept in the server
+///  - SERVER_DESTROY: frees the session
+///
+/// Answers echo `session`, `tag` and `op` with a SERVER_STATUS. Requests to
+/// one session run in order; answers to different sessions can overtake
+/// each other, `tag` is there to match them. Sessions belong to the
+/// connection that created them and go away with it.
+///
+/// One thread owns the socket (epoll, non-blocking) and routes requests to
+/// their session. Sessions with work wait in a queue for the worker pool,
+/// and a worker takes everything pending for a session at once, so clients
+/// pipelining many small requests cost one wakeup per batch. Long runs go
+/// SERVER_SLICE cycles at a time, then the session goes back to the end of
+/// the queue.
+///
+typedef enum {
+	SERVER_CREATE,
+	SERVER_LOAD,
+	SERVER_RUN,
+	SERVER_READ,
+	SERVER_WRITE,
+	SERVER_SNAPSHOT,
+	SERVER_RESTORE,
+	SERVER_DESTROY,
+} SERVER_OP;
+
+typedef enum {
+	SERVER_OK,
+	SERVER_BAD_SESSION,
+	SERVER_BAD_REQUEST,
+	SERVER_NO_SNAPSHOT,
+	SERVER_FULL,
+} SERVER_STATUS;
+
+typedef struct {
+	uint32_t length;
+	uint32_t session;
+	uint16_t tag;
+	uint8_t op;
+	/* SERVER_STATUS in answers */
+	uint8_t status;
+} SERVER_MSG;
+
+typedef struct {
+	uint64_t cycles;
+	uint16_t program_counter;
+	uint8_t register_a;
+	uint8_t register_x;
+	uint8_t register_y;
+	uint8_t status;
+	uint8_t stack_pointer;
+	uint8_t halted;
+} SERVER_STATE;
+
+struct CONNECTION;
+struct REQUEST;
+
+typedef struct SESSION {
+	CPU cpu;
+	CPU *snap;
+	uint8_t snap_halted;
+	uint32_t id;
+	struct CONNECTION *owner;
+	uint8_t halted;
+
+	/* Guarded by the server lock */
+	struct REQUEST *head;
+	struct REQUEST *tail;
+	/* Waiting in the run queue or held by a worker */
+	uint8_t queued;
+	struct SESSION *next;
+
+	/* Seen by the socket thread only: no request is routed here anymore */
+	uint8_t closing;
+} SESSION;
+
+typedef struct {
+	int listen_fd;
+	int epoll_fd;
+	/* Wakes the socket thread up to free destroyed sessions */
+	int event_fd;
+	char path[108];
+
+	/* Session ids are slots + 1, owned by the socket thread */
+	SESSION **sessions;
+	size_t nsessions;
+	size_t max_sessions;
+	uint32_t *free_ids;
+	size_t nfree;
+
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	SESSION *queue_head;
+	SESSION *queue_tail;
+	SESSION *reaped;
+	uint8_t stop;
+
+	pthread_t *workers;
+	size_t nworkers;
+
+	/* Open connections, owned by the socket thread */
+	struct CONNECTION *connections;
+} SERVER;
+
+uint8_t createSERVER(SERVER *server, const char *path, size_t workers, size_t max_sessions);
+void destroySERVER(SERVER *server);
+void server_run(SERVER *server, volatile sig_atomic_t *stop);
+
+#endif
@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm.h"
+
+static size_t segment_size(void) {
+	return SHM_CPU_OFFSET + sizeof(CPU);
+}
+
+/// Creates the segment and a fresh CPU inside it: an anonymous memfd when
+/// `name` is "memfd" (readers use /proc/<pid>/fd/<fd>), otherwise the POSIX
+/// shared memory object `/name`. Returns NULL on failure.
+CPU *createSHM(SHM_STATE *shm, const char *name) {
+	shm->map = NULL;
+	shm->name[0] = 0;
+
+	if (!strcmp(name, "memfd")) {
+		shm->fd = memfd_create("6502", MFD_CLOEXEC);
+	} else {
+		snprintf(shm->name, sizeof(shm->name), "/%s", name);
+		shm->fd = shm_open(shm->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	}
+	if (shm->fd < 0)
+		return NULL;
+
+	shm->map_len = segment_size();
+	if (ftruncate(shm->fd, (off_t) shm->map_len)) {
+		destroySHM(shm);
+		return NULL;
+	}
+	shm->map = mmap(NULL, shm->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+	if (shm->map == MAP_FAILED) {
+		shm->map = NULL;
+		destroySHM(shm);
+		return NULL;
+	}
+
+	shm->header = shm->map;
+	shm->cpu = (CPU *) ((uint8_t *) shm->map + SHM_CPU_OFFSET);
+	memcpy(shm->header->magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+	shm->header->version = SHM_VERSION;
+	shm->header->cpu_offset = SHM_CPU_OFFSET;
+	shm->header->cpu_size = sizeof(CPU);
+	shm->header->memory_offset = SHM_CPU_OFFSET + offsetof(CPU, memory);
+	shm->header->pid = (uint32_t) getpid();
+	shm->header->halted = 0;
+	atomic_init(&shm->header->seq, 0);
+	createCPU(shm->cpu);
+	shm_publish(shm);
+	return shm->cpu;
+}
+
+void destroySHM(SHM_STATE *shm) {
+	if (shm->map)
+		munmap(shm->map, shm->map_len);
+	if (shm->fd >= 0)
+		close(shm->fd);
+	if (shm->name[0])
+		shm_unlink(shm->name);
+	shm->map = NULL;
+	shm->fd = -1;
+	shm->name[0] = 0;
+}
+
+/// Copies the registers into the header under the sequence counter.
+void shm_publish(SHM_STATE *shm) {
+	SHM_HEADER *h = shm->header;
+	CPU *cpu = shm->cpu;
+	uint64_t seq = atomic_load_explicit(&h->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&h->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	h->cycles = cpu->cycles;
+	h->program_counter = cpu->program_counter;
+	h->register_a = cpu->register_a;
+	h->register_x = cpu->register_x;
+	h->register_y = cpu->register_y;
+	h->status = cpu->status;
+	h->stack_pointer = cpu->stack_pointer;
+	atomic_store_explicit(&h->seq, seq + 2, memory_order_release);
+}
+
+/// run() in SHM_SLICE cycle slices, publishing after each one.
+uint8_t run_published(CPU *cpu, SHM_STATE *shm) {
+	while (run_cycles(cpu, SHM_SLICE))
+		shm_publish(shm);
+	shm->header->halted = 1;
+	shm_publish(shm);
+	return 0;
+}
+
+/// PACER on_frame callback, `data` is the SHM_STATE.
+void shm_frame(CPU *cpu, void *data) {
+	(void) cpu;
+	shm_publish(data);
+}
+
+/// Maps a segment read-only: `name` is a path such as /proc/<pid>/fd/<fd>
+/// for a memfd, or a POSIX shared memory name.
+uint8_t shm_attach(SHM_STATE *shm, const char *name) {
+	struct stat st;
+	char object[256];
+
+	shm->map = NULL;
+	shm->name[0] = 0;
+	if (strchr(name + 1, '/')) {
+		shm->fd = open(name, O_RDONLY);
+	} else {
+		snprintf(object, sizeof(object), "/%s", name[0] == '/' ? name + 1 : name);
+		shm->fd = shm_open(object, O_RDONLY, 0);
+	}
+	if (shm->fd < 0)
+		return 0;
+
+	if (fstat(shm->fd, &st) || (size_t) st.st_size < sizeof(SHM_HEADER)) {
+		shm_detach(shm);
+		return 0;
+	}
+	shm->map_len = (size_t) st.st_size;
+	shm->map = mmap(NULL, shm->map_len, PROT_READ, MAP_SHARED, shm->fd, 0);
+	if (shm->map == MAP_FAILED) {
+		shm->map = NULL;
+		shm_detach(shm);
+		return 0;
+	}
+
+	shm->header = shm->map;
+	if (memcmp(shm->header->magic, SHM_MAGIC, sizeof(SHM_MAGIC)) || shm->header->version != SHM_VERSION
+			|| shm->map_len < (size_t) shm->header->cpu_offset + shm->header->cpu_size) {
+		shm_detach(shm);
+		return 0;
+	}
+	shm->cpu = (CPU *) ((uint8_t *) shm->map + shm->header->cpu_offset);
+	return 1;
+}
+
+void shm_detach(SHM_STATE *shm) {
+	destroySHM(shm);
+}
+
+/// Consistent copy of the last published registers.
+void shm_read(SHM_STATE *shm, SHM_HEADER *out) {
+	SHM_HEADER *h = shm->header;
+	uint64_t seq;
+
+	do {
+		while ((seq = atomic_load_explicit(&h->seq, memory_order_acquire)) & 1);
+		out->cycles = h->cycles;
+		out->program_counter = h->program_counter;
+		out->register_a = h->register_a;
+		out->register_x = h->register_x;
+		out->register_y = h->register_y;
+		out->status = h->status;
+		out->stack_pointer = h->stack_pointer;
+		out->halted = h->halted;
+		atomic_thread_fence(memory_order_acquire);
+	} while (atomic_load_explicit(&h->seq, memory_order_relaxed) != seq);
+	atomic_init(&out->seq, seq);
+}
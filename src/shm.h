@@ -0,0 +1,64 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "cpu_6502.h"
+
+#define SHM_MAGIC	"6502SHM"
+#define SHM_VERSION	1
+#define SHM_CPU_OFFSET	4096
+#define SHM_SLICE	10000
+
+/// # Shared state
+///
+/// Puts the CPU struct itself (registers and memory) in a memfd or POSIX
+/// shared memory segment so other processes can map it read-only. Memory is
+/// live. The registers keep changing during a slice, so a copy of them is
+/// published every SHM_SLICE cycles under a sequence counter (a seqlock):
+/// `seq` is odd while the copy is written, and readers retry when it was
+/// odd or changed while they read.
+///
+/// Segment layout: SHM_HEADER, padding up to SHM_CPU_OFFSET, CPU
+///
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t cpu_offset;
+	uint32_t cpu_size;
+	uint32_t memory_offset;
+	uint32_t pid;
+	uint8_t halted;
+
+	_Atomic uint64_t seq;
+	uint64_t cycles;
+	uint16_t program_counter;
+	uint8_t register_a;
+	uint8_t register_x;
+	uint8_t register_y;
+	uint8_t status;
+	uint8_t stack_pointer;
+} SHM_HEADER;
+
+typedef struct {
+	SHM_HEADER *header;
+	CPU *cpu;
+	void *map;
+	size_t map_len;
+	int fd;
+	/* shm_open() name to unlink, empty for memfd or readers */
+	char name[256];
+} SHM_STATE;
+
+CPU *createSHM(SHM_STATE *shm, const char *name);
+void destroySHM(SHM_STATE *shm);
+void shm_publish(SHM_STATE *shm);
+uint8_t run_published(CPU *cpu, SHM_STATE *shm);
+void shm_frame(CPU *cpu, void *data);
+
+uint8_t shm_attach(SHM_STATE *shm, const char *name);
+void shm_detach(SHM_STATE *shm);
+void shm_read(SHM_STATE *shm, SHM_HEADER *out);
+
+#endif
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm.h"
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-1] [-p page] [-i ms] <name | /proc/<pid>/fd/<fd>>\n", name);
+}
+
+static void print_state(SHM_STATE *shm, int page) {
+	SHM_HEADER regs;
+	shm_read(shm, &regs);
+
+	printf("seq %lu%s  PC=%04X A=%02X X=%02X Y=%02X P=%02X SP=%02X cycles=%lu\n",
+		(uint64_t) regs.seq / 2, regs.halted ? " (halted)" : "", regs.program_counter,
+		regs.register_a, regs.register_x, regs.register_y, regs.status,
+		regs.stack_pointer, regs.cycles);
+	if (page < 0)
+		return;
+
+	const uint8_t *memory = (const uint8_t *) shm->map + shm->header->memory_offset;
+	for (int row = 0; row < 16; ++row) {
+		printf("%04X:", (page << 8) | (row << 4));
+		for (int col = 0; col < 16; ++col)
+			printf(" %02X", memory[(page << 8) | (row << 4) | col]);
+		printf("\n");
+	}
+}
+
+/// Read-only viewer for state exported with --shm.
+int main(int argc, char **argv) {
+	int once = 0;
+	int page = -1;
+	long interval_ms = 200;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "1p:i:")) != -1) {
+		switch (opt) {
+			case '1': once = 1; break;
+			case 'p': page = (int) (strtol(optarg, NULL, 0) & 0xFF); break;
+			case 'i': interval_ms = strtol(optarg, NULL, 0); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	SHM_STATE shm;
+	if (!shm_attach(&shm, argv[optind])) {
+		fprintf(stderr, "%s: not an emulator state segment\n", argv[optind]);
+		return 1;
+	}
+
+	const struct timespec wait = { interval_ms / 1000, (interval_ms % 1000) * 1000000 };
+	do {
+		print_state(&shm, page);
+		if (shm.header->halted)
+			break;
+	} while (!once && !nanosleep(&wait, NULL));
+
+	shm_detach(&shm);
+	return 0;
+}
@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "cpu_6502.h"
+#include "util.h"
+
+/// # Superoptimizer
+///
+/// Searches for the shortest sequence of register-only instructions that
+/// behaves like the target snippet. Candidates are built from the implied
+/// and immediate opcodes of `opcode_lookup_table`, run through the cpu core
+/// against a batch of random inputs to reject them quickly, and survivors
+/// are confirmed over every A/X/Y/carry combination the snippets touch, in
+/// binary and decimal mode since ADC and SBC differ between the two.
+///
+
+#define ORIGIN		0x0600
+#define MAX_INSNS	8
+#define MAX_IMMEDIATES	32
+
+#define R_A		(1 << 0)
+#define R_X		(1 << 1)
+#define R_Y		(1 << 2)
+#define R_C		(1 << 3)
+
+typedef struct {
+	uint8_t code;
+	uint8_t operand;
+} INSN;
+
+typedef struct {
+	uint8_t a;
+	uint8_t x;
+	uint8_t y;
+	uint8_t p;
+} STATE;
+
+/// Registers an instruction reads or writes, by mnemonic
+typedef struct {
+	const char mnemonic[4];
+	uint8_t regs;
+} REGS;
+
+static const REGS regs_table[] = {
+	{ "ADC", R_A | R_C }, { "SBC", R_A | R_C }, { "AND", R_A }, { "EOR", R_A }, { "ORA", R_A },
+	{ "CMP", R_A }, { "CPX", R_X }, { "CPY", R_Y },
+	{ "LDA", R_A }, { "LDX", R_X }, { "LDY", R_Y },
+	{ "TAX", R_A | R_X }, { "TAY", R_A | R_Y }, { "TXA", R_A | R_X }, { "TYA", R_A | R_Y },
+	{ "INX", R_X }, { "INY", R_Y }, { "DEX", R_X }, { "DEY", R_Y },
+	{ "ASL", R_A }, { "LSR", R_A }, { "ROL", R_A | R_C }, { "ROR", R_A | R_C },
+	{ "CLC", R_C }, { "SEC", R_C }, { "CLV", 0 },
+};
+
+typedef struct {
+	INSN target[MAX_INSNS];
+	size_t target_len;
+	uint8_t flag_mask;
+	size_t tests;
+
+	INSN alphabet[256 * MAX_IMMEDIATES];
+	size_t alphabet_len;
+
+	/* Current search */
+	size_t len;
+	atomic_size_t next_prefix;
+	size_t prefixes;
+
+	pthread_mutex_t lock;
+	INSN (*found)[MAX_INSNS];
+	size_t found_len;
+	size_t found_cap;
+	atomic_uint_fast64_t candidates;
+} SEARCH;
+
+static int regs_of(uint8_t code) {
+	for (size_t i = 0; i < sizeof(regs_table) / sizeof(regs_table[0]); ++i)
+		if (!memcmp(regs_table[i].mnemonic, opcode_lookup_table[code].mnemonic, 4))
+			return regs_table[i].regs;
+	return -1;
+}
+
+/// Only opcodes that neither touch memory nor transfer control qualify.
+static uint8_t is_candidate(uint8_t code) {
+	OPCODE op = opcode_lookup_table[code];
+	if (!op.len || (op.mode != Immediate && !(op.mode == NoneAddressing && op.len == 1)))
+		return 0;
+	return regs_of(code) >= 0;
+}
+
+static uint8_t regs_used(INSN *insns, size_t len) {
+	uint8_t regs = 0;
+	for (size_t i = 0; i < len; ++i)
+		regs |= (uint8_t) regs_of(insns[i].code);
+	return regs;
+}
+
+static uint32_t cycles_of(INSN *insns, size_t len) {
+	uint32_t cycles = 0;
+	for (size_t i = 0; i < len; ++i)
+		cycles += opcode_lookup_table[insns[i].code].cycles;
+	return cycles;
+}
+
+static uint32_t bytes_of(INSN *insns, size_t len) {
+	uint32_t bytes = 0;
+	for (size_t i = 0; i < len; ++i)
+		bytes += opcode_lookup_table[insns[i].code].len;
+	return bytes;
+}
+
+static void place(CPU *cpu, INSN *insns, size_t len) {
+	uint16_t pc = ORIGIN;
+	for (size_t i = 0; i < len; ++i) {
+		mem_write(cpu, pc++, insns[i].code);
+		if (opcode_lookup_table[insns[i].code].len == 2)
+			mem_write(cpu, pc++, insns[i].operand);
+	}
+	mem_write(cpu, pc, 0x00);
+}
+
+static void exec(CPU *cpu, STATE *in, STATE *out) {
+	cpu->register_a = in->a;
+	cpu->register_x = in->x;
+	cpu->register_y = in->y;
+	cpu->status = in->p;
+	cpu->stack_pointer = STACK_RESET;
+	cpu->program_counter = ORIGIN;
+	run(cpu);
+	out->a = cpu->register_a;
+	out->x = cpu->register_x;
+	out->y = cpu->register_y;
+	out->p = cpu->status;
+}
+
+static uint8_t same(SEARCH *search, STATE *a, STATE *b) {
+	return a->a == b->a && a->x == b->x && a->y == b->y && !((a->p ^ b->p) & search->flag_mask);
+}
+
+/// Runs both snippets over every value of the registers either one uses,
+/// both carry values, both settings of the other arithmetic flags and both
+/// settings of the decimal flag.
+static uint8_t confirm(SEARCH *search, CPU *target, CPU *cand, INSN *insns) {
+	uint8_t regs = regs_used(search->target, search->target_len) | regs_used(insns, search->len);
+	uint32_t a_max = regs & R_A ? 256 : 1;
+	uint32_t x_max = regs & R_X ? 256 : 1;
+	uint32_t y_max = regs & R_Y ? 256 : 1;
+	STATE in, out_target, out_cand;
+
+	for (uint32_t flags = 0; flags < 8; ++flags)
+	for (uint32_t a = 0; a < a_max; ++a)
+	for (uint32_t x = 0; x < x_max; ++x)
+	for (uint32_t y = 0; y < y_max; ++y) {
+		in.a = (uint8_t) a;
+		in.x = (uint8_t) x;
+		in.y = (uint8_t) y;
+		in.p = BREAK2 | INTERRUPT_DISABLE | (flags & 1 ? CARRY : 0) | (flags & 2 ? NEGATIV | OVERFLOW | ZERO : 0)
+			| (flags & 4 ? DECIMAL_MODE : 0);
+		exec(target, &in, &out_target);
+		exec(cand, &in, &out_cand);
+		if (!same(search, &out_target, &out_cand))
+			return 0;
+	}
+
+	return 1;
+}
+
+static void record(SEARCH *search, INSN *insns) {
+	pthread_mutex_lock(&search->lock);
+	if (search->found_len == search->found_cap) {
+		search->found_cap = search->found_cap ? search->found_cap * 2 : 16;
+		search->found = realloc(search->found, search->found_cap * sizeof(*search->found));
+	}
+	memcpy(search->found[search->found_len++], insns, search->len * sizeof(INSN));
+	pthread_mutex_unlock(&search->lock);
+}
+
+static void *search_worker(void *arg) {
+	SEARCH *search = arg;
+	CPU *target = malloc(sizeof(CPU));
+	CPU *cand = malloc(sizeof(CPU));
+	STATE *tests = malloc(search->tests * sizeof(STATE));
+	STATE *expected = malloc(search->tests * sizeof(STATE));
+	uint64_t rng = 0x2545F4914F6CDD1DULL;
+
+	createCPU(target);
+	createCPU(cand);
+	place(target, search->target, search->target_len);
+
+	for (size_t i = 0; i < search->tests; ++i) {
+		xorshift(&rng);
+		tests[i].a = (uint8_t) rng;
+		tests[i].x = (uint8_t) (rng >> 8);
+		tests[i].y = (uint8_t) (rng >> 16);
+		tests[i].p = (uint8_t) ((rng >> 24) & (NEGATIV | OVERFLOW | ZERO | CARRY | DECIMAL_MODE)) | BREAK2 | INTERRUPT_DISABLE;
+		exec(target, &tests[i], &expected[i]);
+	}
+
+	size_t n = search->alphabet_len;
+	size_t fixed = search->len < 2 ? search->len : 2;
+	size_t digits[MAX_INSNS];
+	INSN insns[MAX_INSNS];
+	uint64_t candidates = 0;
+
+	size_t prefix;
+	while ((prefix = atomic_fetch_add(&search->next_prefix, 1)) < search->prefixes) {
+		// the first `fixed` instructions come from the prefix, the rest
+		// are enumerated here like an odometer
+		size_t p = prefix;
+		for (size_t i = 0; i < fixed; ++i) {
+			digits[i] = p % n;
+			p /= n;
+		}
+		for (size_t i = fixed; i < search->len; ++i)
+			digits[i] = 0;
+
+		do {
+			for (size_t i = 0; i < search->len; ++i)
+				insns[i] = search->alphabet[digits[i]];
+			candidates += 1;
+
+			place(cand, insns, search->len);
+			uint8_t ok = 1;
+			for (size_t i = 0; i < search->tests && ok; ++i) {
+				STATE out;
+				exec(cand, &tests[i], &out);
+				ok = same(search, &out, &expected[i]);
+			}
+			if (ok && confirm(search, target, cand, insns))
+				record(search, insns);
+
+			size_t i = fixed;
+			while (i < search->len && ++digits[i] == n)
+				digits[i++] = 0;
+			if (i == search->len)
+				break;
+		} while (1);
+	}
+
+	atomic_fetch_add(&search->candidates, candidates);
+	destroyCPU(cand);
+	destroyCPU(target);
+	free(expected);
+	free(tests);
+	free(cand);
+	free(target);
+	return NULL;
+}
+
+static void build_alphabet(SEARCH *search) {
+	uint8_t imm[MAX_IMMEDIATES];
+	size_t imm_len = 0;
+	uint8_t seed[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF };
+
+	// a few useful constants plus the target's own immediates and neighbours
+	for (size_t i = 0; i < sizeof(seed); ++i)
+		imm[imm_len++] = seed[i];
+	for (size_t i = 0; i < search->target_len; ++i) {
+		if (opcode_lookup_table[search->target[i].code].mode != Immediate)
+			continue;
+		for (int d = -1; d <= 1; ++d) {
+			uint8_t v = (uint8_t) (search->target[i].operand + d);
+			uint8_t dup = 0;
+			for (size_t j = 0; j < imm_len; ++j)
+				dup |= imm[j] == v;
+			if (!dup && imm_len < MAX_IMMEDIATES)
+				imm[imm_len++] = v;
+		}
+	}
+
+	search->alphabet_len = 0;
+	for (int code = 0; code < 256; ++code) {
+		if (!is_candidate((uint8_t) code))
+			continue;
+		if (opcode_lookup_table[code].mode == Immediate) {
+			for (size_t i = 0; i < imm_len; ++i)
+				search->alphabet[search->alphabet_len++] = (INSN) { (uint8_t) code, imm[i] };
+		} else {
+			search->alphabet[search->alphabet_len++] = (INSN) { (uint8_t) code, 0 };
+		}
+	}
+}
+
+static void print_insns(INSN *insns, size_t len) {
+	for (size_t i = 0; i < len; ++i) {
+		OPCODE op = opcode_lookup_table[insns[i].code];
+		if (op.mode == Immediate)
+			printf("%s #$%02X; ", op.mnemonic, insns[i].operand);
+		else
+			printf("%s; ", op.mnemonic);
+	}
+	printf("(%u bytes, %u cycles)\n", bytes_of(insns, len), cycles_of(insns, len));
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-n max_insns] [-j jobs] [-t tests] [-f flag_mask] hex bytes...\n"
+			"\te.g. %s 18 69 01  (CLC; ADC #$01)\n", name, name);
+}
+
+int main(int argc, char **argv) {
+	static SEARCH search;
+	size_t max_insns = 0;
+	uint32_t jobs = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+
+	search.flag_mask = NEGATIV | OVERFLOW | ZERO | CARRY;
+	search.tests = 64;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:j:t:f:")) != -1) {
+		switch (opt) {
+			case 'n': max_insns = strtoul(optarg, NULL, 0); break;
+			case 'j': jobs = (uint32_t) strtoul(optarg, NULL, 0); break;
+			case 't': search.tests = strtoul(optarg, NULL, 0); break;
+			case 'f': search.flag_mask = (uint8_t) strtoul(optarg, NULL, 0); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (optind >= argc || !jobs || !search.tests) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	uint8_t bytes[MAX_INSNS * 2];
+	size_t nbytes = 0;
+	for (int i = optind; i < argc && nbytes < sizeof(bytes); ++i)
+		bytes[nbytes++] = (uint8_t) strtoul(argv[i], NULL, 16);
+
+	for (size_t pos = 0; pos < nbytes; ) {
+		uint8_t code = bytes[pos];
+		if (!is_candidate(code) || pos + opcode_lookup_table[code].len > nbytes || search.target_len == MAX_INSNS) {
+			fprintf(stderr, "Unsupported instruction 0x%02X at offset %lu\n", code, pos);
+			return 1;
+		}
+		search.target[search.target_len++] = (INSN) { code, opcode_lookup_table[code].len == 2 ? bytes[pos + 1] : 0 };
+		pos += opcode_lookup_table[code].len;
+	}
+	if (!max_insns || max_insns > search.target_len)
+		max_insns = search.target_len;
+
+	build_alphabet(&search);
+	pthread_mutex_init(&search.lock, NULL);
+
+	printf("Target: ");
+	print_insns(search.target, search.target_len);
+	printf("Alphabet: %lu instructions, %u threads\n", search.alphabet_len, jobs);
+
+	for (search.len = 1; search.len <= max_insns; ++search.len) {
+		pthread_t threads[jobs];
+
+		search.prefixes = search.len == 1 ? search.alphabet_len : search.alphabet_len * search.alphabet_len;
+		atomic_store(&search.next_prefix, 0);
+		for (uint32_t i = 0; i < jobs; ++i)
+			pthread_create(&threads[i], NULL, search_worker, &search);
+		for (uint32_t i = 0; i < jobs; ++i)
+			pthread_join(threads[i], NULL);
+
+		printf("Length %lu: %lu candidates, %lu equivalent\n", search.len,
+			(uint64_t) atomic_load(&search.candidates), search.found_len);
+		atomic_store(&search.candidates, 0);
+
+		// list the equivalents that are no slower than the target
+		uint32_t target_cycles = cycles_of(search.target, search.target_len);
+		for (size_t i = 0; i < search.found_len; ++i) {
+			if (cycles_of(search.found[i], search.len) <= target_cycles)
+				print_insns(search.found[i], search.len);
+		}
+		if (search.found_len)
+			break;
+	}
+
+	free(search.found);
+	pthread_mutex_destroy(&search.lock);
+	return 0;
+}
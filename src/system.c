@@ -0,0 +1,181 @@
+#include <stdlib.h>
+
+#include "system.h"
+
+void createSYSTEM(SYSTEM *system, uint64_t quantum) {
+	assert(quantum);
+	system->ncores = 0;
+	system->quantum = quantum;
+	system->cycles = 0;
+	system->nshared = 0;
+	system->nmailboxes = 0;
+	system->target = 0;
+	system->done = 0;
+}
+
+void destroySYSTEM(SYSTEM *system) {
+	for (size_t i = 0; i < system->nshared; ++i)
+		free(system->shared[i]);
+	system->nshared = 0;
+}
+
+/// Returns the index of the new core.
+size_t add_core(SYSTEM *system, CPU *cpu) {
+	assert(system->ncores < MAX_CORES);
+	system->cores[system->ncores] = cpu;
+	system->halted[system->ncores] = 0;
+	return system->ncores++;
+}
+
+/// Whether any core has `page` mapped somewhere else than its own memory.
+static uint8_t page_remapped(SYSTEM *system, uint16_t page) {
+	for (size_t i = 0; i < system->ncores; ++i) {
+		CPU *cpu = system->cores[i];
+		if (cpu->read_pages[page] != &cpu->memory[page << 8] || cpu->write_pages[page] != &cpu->memory[page << 8])
+			return 1;
+	}
+	return 0;
+}
+
+/// Maps `pages` pages from `first_page` on to the same memory in all cores
+/// added so far. The current content of the first core is kept. Returns 0
+/// if the range is empty, out of the address space, already mapped to
+/// something else, or MAX_SHARED regions are mapped already.
+uint8_t map_shared(SYSTEM *system, uint8_t first_page, uint16_t pages) {
+	assert(system->ncores);
+	if (!pages || first_page + pages > 0x100 || system->nshared == MAX_SHARED)
+		return 0;
+	for (uint16_t page = first_page; page < first_page + pages; ++page)
+		if (page_remapped(system, page))
+			return 0;
+	CPU *first = system->cores[0];
+
+	uint8_t *shared = system->shared[system->nshared++] = malloc((size_t) pages << 8);
+	memcpy(shared, &first->memory[first_page << 8], (size_t) pages << 8);
+
+	for (size_t i = 0; i < system->ncores; ++i) {
+		for (uint16_t page = 0; page < pages; ++page) {
+			system->cores[i]->read_pages[first_page + page] = &shared[page << 8];
+			system->cores[i]->write_pages[first_page + page] = &shared[page << 8];
+		}
+	}
+	return 1;
+}
+
+/// Makes `page` a mailbox between cores `a` and `b`. Returns 0 if the page
+/// is already shared or a mailbox, or MAX_MAILBOXES are mapped already.
+uint8_t map_mailbox(SYSTEM *system, uint8_t page, size_t a, size_t b) {
+	assert(a < system->ncores && b < system->ncores && a != b);
+	if (system->nmailboxes == MAX_MAILBOXES || page_remapped(system, page))
+		return 0;
+	MAILBOX *box = &system->mailboxes[system->nmailboxes++];
+	box->page = page;
+	box->a = a;
+	box->b = b;
+	memset(box->out, 0, sizeof(box->out));
+	memset(box->in, 0, sizeof(box->in));
+
+	system->cores[a]->write_pages[page] = box->out[0];
+	system->cores[a]->read_pages[page] = box->in[0];
+	system->cores[b]->write_pages[page] = box->out[1];
+	system->cores[b]->read_pages[page] = box->in[1];
+	return 1;
+}
+
+/// Delivers what each side of every mailbox wrote during the last quantum.
+static void sync_mailboxes(SYSTEM *system) {
+	for (size_t i = 0; i < system->nmailboxes; ++i) {
+		MAILBOX *box = &system->mailboxes[i];
+		memcpy(box->in[0], box->out[1], 0x100);
+		memcpy(box->in[1], box->out[0], 0x100);
+	}
+}
+
+/// Runs core `i` up to the system's absolute cycle target.
+static void run_slice(SYSTEM *system, size_t i, uint64_t target) {
+	CPU *cpu = system->cores[i];
+	if (!system->halted[i] && cpu->cycles < target)
+		system->halted[i] = !run_cycles(cpu, target - cpu->cycles);
+}
+
+static uint8_t all_halted(SYSTEM *system) {
+	for (size_t i = 0; i < system->ncores; ++i)
+		if (!system->halted[i])
+			return 0;
+	return 1;
+}
+
+/// Runs every core for `cycles` cycles, one quantum at a time on the
+/// calling thread. Returns 0 once all cores hit BRK.
+uint8_t system_run(SYSTEM *system, uint64_t cycles) {
+	uint64_t end = system->cycles + cycles;
+
+	while (system->cycles < end && !all_halted(system)) {
+		uint64_t target = system->cycles + system->quantum;
+		if (target > end) target = end;
+
+		for (size_t i = 0; i < system->ncores; ++i)
+			run_slice(system, i, target);
+		sync_mailboxes(system);
+		system->cycles = target;
+	}
+
+	return !all_halted(system);
+}
+
+typedef struct {
+	SYSTEM *system;
+	size_t core;
+	uint64_t end;
+} CORE_THREAD;
+
+static void *core_thread(void *arg) {
+	CORE_THREAD *ct = arg;
+	SYSTEM *system = ct->system;
+
+	while (1) {
+		run_slice(system, ct->core, system->target);
+
+		// everyone finished the quantum, one thread does the bookkeeping
+		// while the others wait at the second barrier
+		if (pthread_barrier_wait(&system->barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+			sync_mailboxes(system);
+			system->cycles = system->target;
+			system->target = system->cycles + system->quantum;
+			if (system->target > ct->end) system->target = ct->end;
+			system->done = system->cycles >= ct->end || all_halted(system);
+		}
+		pthread_barrier_wait(&system->barrier);
+
+		if (system->done)
+			break;
+	}
+
+	return NULL;
+}
+
+/// Same as system_run() with every core on its own host thread.
+uint8_t system_run_threaded(SYSTEM *system, uint64_t cycles) {
+	pthread_t threads[MAX_CORES];
+	CORE_THREAD args[MAX_CORES];
+	uint64_t end = system->cycles + cycles;
+
+	if (!cycles || all_halted(system))
+		return !all_halted(system);
+
+	system->target = system->cycles + system->quantum;
+	if (system->target > end) system->target = end;
+	pthread_barrier_init(&system->barrier, NULL, (unsigned) system->ncores);
+
+	for (size_t i = 0; i < system->ncores; ++i) {
+		args[i].system = system;
+		args[i].core = i;
+		args[i].end = end;
+		pthread_create(&threads[i], NULL, core_thread, &args[i]);
+	}
+	for (size_t i = 0; i < system->ncores; ++i)
+		pthread_join(threads[i], NULL);
+
+	pthread_barrier_destroy(&system->barrier);
+	return !all_halted(system);
+}
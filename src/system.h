@@ -0,0 +1,65 @@
+#ifndef SYSTEM_H
+#define SYSTEM_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "cpu_6502.h"
+
+#define MAX_CORES	8
+#define MAX_MAILBOXES	16
+#define MAX_SHARED	16
+#define DEFAULT_QUANTUM	64
+
+/// # System
+///
+/// Several cores built with CPU_SHARED_BUS, synchronised every `quantum`
+/// cycles. Pages can be mapped as:
+///
+///  - shared: every core reads and writes the same bytes. With threads the
+///    order of accesses inside a quantum is not deterministic. Several
+///    regions can be shared as long as they do not overlap.
+///  - mailbox: between two cores, each one writes its own outbox and reads
+///    the other's, as seen at the last synchronisation. Deterministic with
+///    or without threads.
+///
+/// A page is mapped once: shared, or a single mailbox.
+///
+typedef struct {
+	uint8_t page;
+	size_t a;
+	size_t b;
+	/* out[i] is written by core i, in[i] is what core i reads */
+	uint8_t out[2][0x100];
+	uint8_t in[2][0x100];
+} MAILBOX;
+
+typedef struct {
+	CPU *cores[MAX_CORES];
+	uint8_t halted[MAX_CORES];
+	size_t ncores;
+	uint64_t quantum;
+	uint64_t cycles;
+
+	uint8_t *shared[MAX_SHARED];
+	size_t nshared;
+	MAILBOX mailboxes[MAX_MAILBOXES];
+	size_t nmailboxes;
+
+	/* Threaded runs */
+	pthread_barrier_t barrier;
+	uint64_t target;
+	uint8_t done;
+} SYSTEM;
+
+void createSYSTEM(SYSTEM *system, uint64_t quantum);
+void destroySYSTEM(SYSTEM *system);
+
+size_t add_core(SYSTEM *system, CPU *cpu);
+uint8_t map_shared(SYSTEM *system, uint8_t first_page, uint16_t pages);
+uint8_t map_mailbox(SYSTEM *system, uint8_t page, size_t a, size_t b);
+
+uint8_t system_run(SYSTEM *system, uint64_t cycles);
+uint8_t system_run_threaded(SYSTEM *system, uint64_t cycles);
+
+#endif
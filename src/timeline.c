@@ -0,0 +1,216 @@
+#include <stdlib.h>
+
+#include "timeline.h"
+
+#define PAGE_SIZE 0x100
+
+static uint8_t page_dirty(uint64_t *bits, int page) {
+	return (bits[page >> 6] >> (page & 63)) & 1;
+}
+
+static void take_keyframe(TIMELINE *tl) {
+	CPU *cpu = tl->cpu;
+
+	if (tl->nkeyframes == tl->keyframes_cap) {
+		tl->keyframes_cap = tl->keyframes_cap ? tl->keyframes_cap * 2 : 64;
+		tl->keyframes = realloc(tl->keyframes, tl->keyframes_cap * sizeof(KEYFRAME));
+	}
+	KEYFRAME *prev = tl->nkeyframes ? &tl->keyframes[tl->nkeyframes - 1] : NULL;
+	KEYFRAME *key = &tl->keyframes[tl->nkeyframes++];
+
+	key->step = tl->now;
+	key->register_a = cpu->register_a;
+	key->register_x = cpu->register_x;
+	key->register_y = cpu->register_y;
+	key->status = cpu->status;
+	key->program_counter = cpu->program_counter;
+	key->stack_pointer = cpu->stack_pointer;
+	key->cycles = cpu->cycles;
+	memset(key->owned, 0, sizeof(key->owned));
+
+	for (int page = 0; page < 0x100; ++page) {
+		if (prev && !page_dirty(cpu->dirty, page)) {
+			key->pages[page] = prev->pages[page];
+			continue;
+		}
+		key->pages[page] = malloc(PAGE_SIZE);
+		memcpy(key->pages[page], &cpu->memory[page << 8], PAGE_SIZE);
+		key->owned[page >> 6] |= 1ULL << (page & 63);
+	}
+	memset(cpu->dirty, 0, sizeof(cpu->dirty));
+}
+
+static void free_keyframe(KEYFRAME *key) {
+	for (int page = 0; page < 0x100; ++page)
+		if (page_dirty(key->owned, page))
+			free(key->pages[page]);
+}
+
+static void restore_keyframe(TIMELINE *tl, KEYFRAME *key) {
+	CPU *cpu = tl->cpu;
+
+	cpu->register_a = key->register_a;
+	cpu->register_x = key->register_x;
+	cpu->register_y = key->register_y;
+	cpu->status = key->status;
+	cpu->program_counter = key->program_counter;
+	cpu->stack_pointer = key->stack_pointer;
+	cpu->cycles = key->cycles;
+	for (int page = 0; page < 0x100; ++page)
+		memcpy(&cpu->memory[page << 8], key->pages[page], PAGE_SIZE);
+	// memory now equals this keyframe, so anything written from here on is
+	// a superset of what changed since the latest keyframe
+	memset(cpu->dirty, 0, sizeof(cpu->dirty));
+
+	tl->now = key->step;
+	// inputs of the keyframe's own step were applied before it was taken
+	size_t lo = 0, hi = tl->ninputs;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (tl->inputs[mid].step <= key->step) lo = mid + 1;
+		else hi = mid;
+	}
+	tl->next_input = lo;
+}
+
+/// Index of the latest keyframe at or before `step`.
+static size_t find_keyframe(TIMELINE *tl, uint64_t step) {
+	size_t lo = 0, hi = tl->nkeyframes;
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (tl->keyframes[mid].step <= step) lo = mid;
+		else hi = mid;
+	}
+	return lo;
+}
+
+/// Forgets everything recorded after the current instruction, used when the
+/// host changes the past.
+static void truncate_history(TIMELINE *tl) {
+	while (tl->nkeyframes > 1 && tl->keyframes[tl->nkeyframes - 1].step > tl->now)
+		free_keyframe(&tl->keyframes[--tl->nkeyframes]);
+	while (tl->ninputs && tl->inputs[tl->ninputs - 1].step >= tl->now)
+		tl->ninputs -= 1;
+	tl->next_input = tl->ninputs;
+	tl->end = tl->now;
+}
+
+/// Starts recording `cpu` as it is now, which is step 0.
+void createTIMELINE(TIMELINE *tl, CPU *cpu, uint64_t interval) {
+	assert(interval);
+	tl->cpu = cpu;
+	tl->interval = interval;
+	tl->now = 0;
+	tl->end = 0;
+	tl->keyframes = NULL;
+	tl->nkeyframes = 0;
+	tl->keyframes_cap = 0;
+	tl->inputs = NULL;
+	tl->ninputs = 0;
+	tl->inputs_cap = 0;
+	tl->next_input = 0;
+	take_keyframe(tl);
+}
+
+void destroyTIMELINE(TIMELINE *tl) {
+	for (size_t i = 0; i < tl->nkeyframes; ++i)
+		free_keyframe(&tl->keyframes[i]);
+	free(tl->keyframes);
+	free(tl->inputs);
+}
+
+/// Executes one instruction, replaying recorded inputs when re-executing.
+/// Afterwards watch_hit tells whether the instruction itself wrote the
+/// watched address. Returns 0 on BRK.
+uint8_t timeline_step(TIMELINE *tl) {
+	while (tl->next_input < tl->ninputs && tl->inputs[tl->next_input].step == tl->now) {
+		mem_write(tl->cpu, tl->inputs[tl->next_input].addr, tl->inputs[tl->next_input].data);
+		tl->next_input += 1;
+	}
+	// a replayed poke is the host's write, not the instruction's
+	tl->cpu->watch_hit = 0;
+	if (tl->now % tl->interval == 0 && tl->keyframes[tl->nkeyframes - 1].step < tl->now)
+		take_keyframe(tl);
+
+	uint8_t res = step(tl->cpu);
+	tl->now += 1;
+	if (tl->now > tl->end)
+		tl->end = tl->now;
+	return res;
+}
+
+uint8_t timeline_run(TIMELINE *tl, uint64_t steps) {
+	for (uint64_t i = 0; i < steps; ++i)
+		if (!timeline_step(tl))
+			return 0;
+	return 1;
+}
+
+/// Host write into memory, recorded so re-execution repeats it.
+void timeline_poke(TIMELINE *tl, uint16_t addr, uint8_t data) {
+	if (tl->now < tl->end)
+		truncate_history(tl);
+	if (tl->ninputs == tl->inputs_cap) {
+		tl->inputs_cap = tl->inputs_cap ? tl->inputs_cap * 2 : 64;
+		tl->inputs = realloc(tl->inputs, tl->inputs_cap * sizeof(INPUT));
+	}
+	tl->inputs[tl->ninputs++] = (INPUT) { tl->now, addr, data };
+	tl->next_input = tl->ninputs;
+	mem_write(tl->cpu, addr, data);
+
+	// a keyframe of this step, at least step 0's, was taken before the poke
+	// and replays skip the inputs it is assumed to hold, so it takes the poke
+	KEYFRAME *key = &tl->keyframes[tl->nkeyframes - 1];
+	int page = addr >> 8;
+	if (key->step == tl->now) {
+		if (!page_dirty(key->owned, page)) {
+			key->pages[page] = malloc(PAGE_SIZE);
+			key->owned[page >> 6] |= 1ULL << (page & 63);
+		}
+		memcpy(key->pages[page], &tl->cpu->memory[page << 8], PAGE_SIZE);
+	}
+}
+
+/// Moves to the state before instruction `step` executes, re-executing from
+/// the closest keyframe when going backwards. Returns 0 if BRK stopped it.
+uint8_t timeline_seek(TIMELINE *tl, uint64_t step) {
+	KEYFRAME *key = &tl->keyframes[find_keyframe(tl, step)];
+	if (step < tl->now || key->step > tl->now)
+		restore_keyframe(tl, key);
+	return timeline_run(tl, step - tl->now);
+}
+
+uint8_t reverse_step(TIMELINE *tl) {
+	if (!tl->now)
+		return 0;
+	return timeline_seek(tl, tl->now - 1);
+}
+
+/// Moves back to just before the latest instruction that wrote `addr`.
+/// Returns 0, staying put, if no earlier instruction did.
+uint8_t reverse_to_write(TIMELINE *tl, uint16_t addr) {
+	uint64_t from = tl->now;
+	if (!from)
+		return 0;
+
+	for (size_t k = find_keyframe(tl, from - 1) + 1; k-- > 0; ) {
+		uint64_t stop = k + 1 < tl->nkeyframes && tl->keyframes[k + 1].step < from
+			? tl->keyframes[k + 1].step : from;
+		uint64_t last = UINT64_MAX;
+
+		restore_keyframe(tl, &tl->keyframes[k]);
+		tl->cpu->watch = addr;
+		while (tl->now < stop) {
+			timeline_step(tl);
+			if (tl->cpu->watch_hit)
+				last = tl->now - 1;
+		}
+		tl->cpu->watch = -1;
+
+		if (last != UINT64_MAX)
+			return timeline_seek(tl, last);
+	}
+
+	timeline_seek(tl, from);
+	return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdint.h>
+
+#include "cpu_6502.h"
+
+#define KEYFRAME_INTERVAL	(1 << 20)
+
+/// # Timeline
+///
+/// Time travel for a cpu built with CPU_DIRTY_PAGES and CPU_WATCH. Every
+/// `interval` instructions a keyframe is taken; pages not written since the
+/// previous keyframe are shared with it rather than copied. Any earlier
+/// instruction is reached by restoring the closest keyframe before it and
+/// re-executing forward. Writes made by the host (input) must go through
+/// timeline_poke() so that re-execution sees them at the same instruction.
+///
+typedef struct {
+	uint64_t step;
+	uint8_t register_a;
+	uint8_t register_x;
+	uint8_t register_y;
+	uint8_t status;
+	uint16_t program_counter;
+	uint8_t stack_pointer;
+	uint64_t cycles;
+	uint8_t *pages[0x100];
+	/* Pages allocated by this keyframe, the rest belong to earlier ones */
+	uint64_t owned[4];
+} KEYFRAME;
+
+typedef struct {
+	uint64_t step;
+	uint16_t addr;
+	uint8_t data;
+} INPUT;
+
+typedef struct {
+	CPU *cpu;
+	uint64_t interval;
+	/* Instructions executed so far, and the furthest point recorded */
+	uint64_t now;
+	uint64_t end;
+
+	KEYFRAME *keyframes;
+	size_t nkeyframes;
+	size_t keyframes_cap;
+
+	INPUT *inputs;
+	size_t ninputs;
+	size_t inputs_cap;
+	size_t next_input;
+} TIMELINE;
+
+void createTIMELINE(TIMELINE *tl, CPU *cpu, uint64_t interval);
+void destroyTIMELINE(TIMELINE *tl);
+
+uint8_t timeline_step(TIMELINE *tl);
+uint8_t timeline_run(TIMELINE *tl, uint64_t steps);
+void timeline_poke(TIMELINE *tl, uint16_t addr, uint8_t data);
+uint8_t timeline_seek(TIMELINE *tl, uint64_t step);
+uint8_t reverse_step(TIMELINE *tl);
+uint8_t reverse_to_write(TIMELINE *tl, uint16_t addr);
+
+#endif
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "timeline.h"
+#include "util.h"
+
+static void print_state(TIMELINE *tl, double ms) {
+	CPU *cpu = tl->cpu;
+	OPCODE op = opcode_lookup_table[cpu->memory[cpu->program_counter]];
+	printf("step %lu/%lu pc=%04X a=%02X x=%02X y=%02X p=%02X sp=%02X cycles=%lu next: %s (%.2f ms)\n",
+		tl->now, tl->end, cpu->program_counter, cpu->register_a, cpu->register_x,
+		cpu->register_y, cpu->status, cpu->stack_pointer, cpu->cycles,
+		op.len ? op.mnemonic : "???", ms);
+}
+
+static void help(void) {
+	printf("s [n]         step n instructions\n"
+	       "rs [n]        reverse step n instructions\n"
+	       "g <step>      go to instruction <step>\n"
+	       "rw <addr>     run back to the last write of <addr>\n"
+	       "p <addr> <v>  write <v> to <addr> as input\n"
+	       "m <addr>      dump 16 bytes at <addr>\n"
+	       "q             quit\n");
+}
+
+int main(int argc, char **argv) {
+	uint64_t interval = KEYFRAME_INTERVAL;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s image.bin [keyframe_interval]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		interval = strtoull(argv[2], NULL, 0);
+
+	size_t len;
+	uint8_t *image = read_file(argv[1], &len);
+	if (!image) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	static CPU cpu;
+	createCPU(&cpu);
+	load(&cpu, image, len);
+	reset(&cpu);
+	free(image);
+
+	TIMELINE tl;
+	createTIMELINE(&tl, &cpu, interval ? interval : KEYFRAME_INTERVAL);
+	print_state(&tl, 0);
+
+	char line[256];
+	while (printf("> "), fflush(stdout), fgets(line, sizeof(line), stdin)) {
+		char cmd[8] = "";
+		long long a = 1, b = 0;
+		int n = sscanf(line, "%7s %lli %lli", cmd, &a, &b);
+		if (n < 1)
+			continue;
+		if (n < 2)
+			a = 1;
+
+		double start = now();
+		if (!strcmp(cmd, "s")) {
+			if (!timeline_run(&tl, (uint64_t) a)) printf("BRK\n");
+		} else if (!strcmp(cmd, "rs")) {
+			timeline_seek(&tl, tl.now > (uint64_t) a ? tl.now - (uint64_t) a : 0);
+		} else if (!strcmp(cmd, "g") && n > 1) {
+			if (!timeline_seek(&tl, (uint64_t) a)) printf("BRK\n");
+		} else if (!strcmp(cmd, "rw") && n > 1) {
+			if (!reverse_to_write(&tl, (uint16_t) a)) printf("No earlier write to %04llX\n", a);
+		} else if (!strcmp(cmd, "p") && n > 2) {
+			timeline_poke(&tl, (uint16_t) a, (uint8_t) b);
+		} else if (!strcmp(cmd, "m") && n > 1) {
+			for (int i = 0; i < 16; ++i)
+				printf("%02X ", cpu.memory[(uint16_t) (a + i)]);
+			printf("\n");
+			continue;
+		} else if (!strcmp(cmd, "q")) {
+			break;
+		} else {
+			help();
+			continue;
+		}
+		print_state(&tl, (now() - start) * 1e3);
+	}
+
+	destroyTIMELINE(&tl);
+	destroyCPU(&cpu);
+	return 0;
+}
@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "util.h"
+
+/// Reads all of `path`, NUL terminated so sources can be used as strings.
+/// Returns NULL if it cannot be opened.
+uint8_t *read_file(const char *path, size_t *len) {
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *buf = malloc(size > 0 ? (size_t) size + 1 : 1);
+	*len = fread(buf, 1, size > 0 ? (size_t) size : 0, f);
+	buf[*len] = 0;
+	fclose(f);
+	return buf;
+}
+
+double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,24 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// # Tool helpers
+///
+/// The bits every command line tool needs: whole files, a monotonic clock
+/// in seconds and a cheap random number generator.
+///
+uint8_t *read_file(const char *path, size_t *len);
+double now(void);
+
+/// xorshift64, `state` must not start at 0.
+static inline uint64_t xorshift(uint64_t *state) {
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+#endif
@@ -0,0 +1,1178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "cpu_6502.h"
+#include "lockstep.h"
+#include "util.h"
+
+/// # Opcode verification
+///
+/// Runs every opcode of a variant through a backend and compares each
+/// instruction with an independent reference model:
+///
+///  - value sweep: every operand value against every value of the register
+///    the instruction works on (A, X, Y, P or S), with and without carry,
+///    and decimal mode for ADC/SBC
+///  - address sweep: every index register value against every base of the
+///    mode (four high bytes for the absolute indexed ones)
+///  - implied, stack and flow instructions: their register against every
+///    status, stack pointer, branch offset or target
+///
+/// The reference decodes opcodes from their bit fields, not from
+/// opcode_lookup_table, and computes LANES cases at a time as plain loops
+/// over arrays which the compiler vectorizes. Batches are spread over
+/// threads, each with its own machine. Memory holds pattern(), where zero
+/// page pointers land in $2020-$302E, and the instruction sits at ORIGIN.
+/// Memory is checked at the addresses the reference writes.
+///
+
+#define LANES		256
+#define ORIGIN		0x0400
+#define REPORTS		2
+
+#define F_C		0x01
+#define F_Z		0x02
+#define F_I		0x04
+#define F_D		0x08
+#define F_B		0x10
+#define F_U		0x20
+#define F_V		0x40
+#define F_N		0x80
+
+/* Registers, also what a sweep varies across lanes */
+enum { R_A, R_X, R_Y, R_P, R_S, R_OP1, R_ZERO };
+
+typedef enum {
+	M_IMP, M_ACC, M_IMM, M_ZP, M_ZPX, M_ZPY, M_ABS, M_ABX, M_ABY,
+	M_IZX, M_IZY, M_IZP, M_REL, M_IND, M_IAX,
+} REF_MODE;
+
+typedef enum {
+	K_ORA, K_AND, K_EOR, K_ADC, K_ST, K_LD, K_CMP, K_SBC,
+	K_ASL, K_ROL, K_LSR, K_ROR, K_DEC, K_INC, K_TSB, K_TRB,
+	K_BIT, K_INR, K_DER, K_XFER, K_FLAG, K_PUSH, K_PULL, K_NOP,
+	K_JMP, K_JSR, K_RTS, K_RTI, K_BRANCH, K_BRK,
+} REF_KIND;
+
+typedef enum {
+	C_OTHER, C_READ, C_STORE, C_RMW,
+} REF_CLASS;
+
+typedef struct {
+	uint8_t code;
+	uint8_t kind;
+	uint8_t mode;
+	uint8_t cls;
+	uint8_t reg;	/* register read or written, destination of transfers */
+	uint8_t src;	/* source of transfers */
+	uint8_t mask;	/* flag tested by branches, changed by flag ops */
+	uint8_t value;	/* taken / set value of that flag */
+} REF_OP;
+
+/// One batch: all lanes share everything but the `lane` register, which
+/// is the lane index. With `poke` the operand is `value`, stored at the
+/// effective address before running.
+typedef struct {
+	uint8_t lane;
+	uint8_t base[R_OP1 + 1];
+	uint8_t op2;
+	uint8_t poke;
+	uint8_t value;
+} BATCH;
+
+typedef struct {
+	uint8_t in[R_OP1 + 1][LANES];
+	uint8_t out[R_S + 1][LANES];
+	uint8_t m[LANES];
+	uint16_t ea[LANES];
+	uint16_t pc[LANES];
+	uint8_t cycles[LANES];
+	uint8_t halt[LANES];
+	uint8_t writes[LANES];
+	uint16_t wa[2][LANES];
+	uint8_t wv[2][LANES];
+} REF_LANES;
+
+typedef struct {
+	uint8_t code;
+	uint32_t batch;
+} ITEM;
+
+typedef struct {
+	CPU_VARIANT variant;
+	const BACKEND *backend;
+	REF_OP ops[256];
+
+	ITEM *items;
+	size_t nitems;
+	_Atomic size_t next;
+	_Atomic uint64_t cases;
+	_Atomic uint64_t failures[256];
+
+	pthread_mutex_t lock;
+	uint8_t reported[256];
+	FILE *report;
+} SWEEP;
+
+typedef struct {
+	SWEEP *sweep;
+	CPU *cpu;
+	REF_LANES lanes;
+#ifdef CPU_FUZZ
+	/* Fuzz builds count every edge */
+	uint8_t edges[1 << 16];
+#endif
+} WORKER;
+
+/* Memory image */
+static inline uint8_t pattern(uint16_t addr) {
+	uint8_t h = (uint8_t) ((addr * 0x9D) ^ ((addr >> 8) * 0x3B) ^ 0x5A);
+	return addr < 0x100 ? (uint8_t) (0x20 | (h & 0x0F)) : h;
+}
+
+static inline uint8_t view(uint16_t addr, uint8_t code, uint8_t op1, uint8_t op2) {
+	return addr == ORIGIN ? code : addr == ORIGIN + 1 ? op1 : addr == ORIGIN + 2 ? op2 : pattern(addr);
+}
+
+static inline uint8_t nz(uint8_t v) {
+	return (uint8_t) ((v & F_N) | (v ? 0 : F_Z));
+}
+
+static inline uint8_t hash8(uint32_t n, uint32_t salt) {
+	uint32_t h = (n + 1) * 0x9E3779B1u ^ salt * 0x85EBCA6Bu;
+	return (uint8_t) (h >> 24 ^ h >> 11);
+}
+
+/* Reference decoder, from the aaabbbcc fields */
+static const uint8_t group1_kinds[8] = { K_ORA, K_AND, K_EOR, K_ADC, K_ST, K_LD, K_CMP, K_SBC };
+static const uint8_t group1_modes[8] = { M_IZX, M_ZP, M_IMM, M_ABS, M_IZY, M_ZPX, M_ABY, M_ABX };
+static const uint8_t group2_kinds[8] = { K_ASL, K_ROL, K_LSR, K_ROR, K_ST, K_LD, K_DEC, K_INC };
+static const uint8_t branch_flags[4] = { F_N, F_V, F_C, F_Z };
+static const uint8_t flag_ops[8][2] = {
+	{ F_C, 0 }, { F_C, F_C }, { F_I, 0 }, { F_I, F_I }, { 0, 0 }, { F_V, 0 }, { F_D, 0 }, { F_D, F_D },
+};
+
+static void set_op(REF_OP *op, uint8_t kind, uint8_t mode, uint8_t reg) {
+	op->kind = kind;
+	op->mode = mode;
+	op->reg = reg;
+	switch (kind) {
+		case K_ORA: case K_AND: case K_EOR: case K_ADC: case K_SBC:
+		case K_LD: case K_CMP: case K_BIT:
+			op->cls = C_READ;
+		break;
+		case K_ST:
+			op->cls = C_STORE;
+		break;
+		case K_ASL: case K_ROL: case K_LSR: case K_ROR:
+		case K_DEC: case K_INC: case K_TSB: case K_TRB:
+			op->cls = mode == M_ACC ? C_OTHER : C_RMW;
+		break;
+		default:
+			op->cls = C_OTHER;
+	}
+}
+
+/// Fills `op` and returns 1 if `code` exists on `variant`.
+static uint8_t ref_decode(uint8_t code, CPU_VARIANT variant, REF_OP *op) {
+	uint8_t aaa = code >> 5, bbb = (code >> 2) & 7, cc = code & 3;
+	uint8_t cmos = variant == CMOS_65C02;
+
+	memset(op, 0, sizeof(*op));
+	op->code = code;
+
+	if (cc == 1) {
+		if (code == 0x89) {
+			if (!cmos)
+				return 0;
+			set_op(op, K_BIT, M_IMM, R_A);
+			return 1;
+		}
+		set_op(op, group1_kinds[aaa], group1_modes[bbb], R_A);
+		return 1;
+	}
+
+	if (cc == 2) {
+		uint8_t kind = group2_kinds[aaa];
+		uint8_t reg = aaa == 4 || aaa == 5 ? R_X : R_A;
+		switch (bbb) {
+			case 0:
+				if (aaa != 5)
+					return 0;
+				set_op(op, K_LD, M_IMM, R_X);
+				return 1;
+			case 1:
+				set_op(op, kind, M_ZP, reg);
+				return 1;
+			case 2:
+				switch (aaa) {
+					case 4: set_op(op, K_XFER, M_IMP, R_A); op->src = R_X; return 1;
+					case 5: set_op(op, K_XFER, M_IMP, R_X); op->src = R_A; return 1;
+					case 6: set_op(op, K_DER, M_IMP, R_X); return 1;
+					case 7: set_op(op, K_NOP, M_IMP, R_P); return 1;
+					default: set_op(op, kind, M_ACC, R_A); return 1;
+				}
+			case 3:
+				set_op(op, kind, M_ABS, reg);
+				return 1;
+			case 4:
+				if (!cmos)
+					return 0;
+				set_op(op, group1_kinds[aaa], M_IZP, R_A);
+				return 1;
+			case 5:
+				set_op(op, kind, aaa == 4 || aaa == 5 ? M_ZPY : M_ZPX, reg);
+				return 1;
+			case 6:
+				switch (aaa) {
+					case 4: set_op(op, K_XFER, M_IMP, R_S); op->src = R_X; return 1;
+					case 5: set_op(op, K_XFER, M_IMP, R_X); op->src = R_S; return 1;
+				}
+				if (!cmos)
+					return 0;
+				switch (aaa) {
+					case 0: set_op(op, K_INC, M_ACC, R_A); return 1;
+					case 1: set_op(op, K_DEC, M_ACC, R_A); return 1;
+					case 2: set_op(op, K_PUSH, M_IMP, R_Y); return 1;
+					case 3: set_op(op, K_PULL, M_IMP, R_Y); return 1;
+					case 6: set_op(op, K_PUSH, M_IMP, R_X); return 1;
+					default: set_op(op, K_PULL, M_IMP, R_X); return 1;
+				}
+			default:
+				if (aaa == 4) {
+					if (!cmos)
+						return 0;
+					set_op(op, K_ST, M_ABX, R_ZERO);
+					return 1;
+				}
+				set_op(op, kind, aaa == 5 ? M_ABY : M_ABX, reg);
+				return 1;
+		}
+	}
+
+	if (cc == 0) {
+		static const uint8_t yxops[4] = { K_ST, K_LD, K_CMP, K_CMP };
+		uint8_t yx = aaa >= 4;
+		uint8_t reg = aaa == 7 ? R_X : R_Y;
+		switch (bbb) {
+			case 0:
+				switch (aaa) {
+					case 0: set_op(op, K_BRK, M_IMP, R_P); return 1;
+					case 1: set_op(op, K_JSR, M_ABS, R_S); return 1;
+					case 2: set_op(op, K_RTI, M_IMP, R_S); return 1;
+					case 3: set_op(op, K_RTS, M_IMP, R_S); return 1;
+					case 4:
+						if (!cmos)
+							return 0;
+						set_op(op, K_BRANCH, M_REL, R_P);
+						return 1;
+					default: set_op(op, yxops[aaa - 4], M_IMM, reg); return 1;
+				}
+			case 1:
+			case 3:
+				if (yx) {
+					set_op(op, yxops[aaa - 4], bbb == 1 ? M_ZP : M_ABS, reg);
+					return 1;
+				}
+				switch (aaa) {
+					case 0:
+						if (!cmos)
+							return 0;
+						set_op(op, K_TSB, bbb == 1 ? M_ZP : M_ABS, R_A);
+						return 1;
+					case 1: set_op(op, K_BIT, bbb == 1 ? M_ZP : M_ABS, R_A); return 1;
+					case 2:
+						if (bbb == 1)
+							return 0;
+						set_op(op, K_JMP, M_ABS, R_P);
+						return 1;
+					default:
+						if (bbb == 3) {
+							set_op(op, K_JMP, M_IND, R_P);
+							return 1;
+						}
+						if (!cmos)
+							return 0;
+						set_op(op, K_ST, M_ZP, R_ZERO);
+						return 1;
+				}
+			case 2:
+				switch (aaa) {
+					case 0: set_op(op, K_PUSH, M_IMP, R_P); return 1;
+					case 1: set_op(op, K_PULL, M_IMP, R_P); return 1;
+					case 2: set_op(op, K_PUSH, M_IMP, R_A); return 1;
+					case 3: set_op(op, K_PULL, M_IMP, R_A); return 1;
+					case 4: set_op(op, K_DER, M_IMP, R_Y); return 1;
+					case 5: set_op(op, K_XFER, M_IMP, R_Y); op->src = R_A; return 1;
+					case 6: set_op(op, K_INR, M_IMP, R_Y); return 1;
+					default: set_op(op, K_INR, M_IMP, R_X); return 1;
+				}
+			case 4:
+				set_op(op, K_BRANCH, M_REL, R_P);
+				op->mask = branch_flags[aaa >> 1];
+				op->value = aaa & 1 ? op->mask : 0;
+				return 1;
+			case 5:
+				if (aaa == 4 || aaa == 5) {
+					set_op(op, yxops[aaa - 4], M_ZPX, R_Y);
+					return 1;
+				}
+				if (!cmos)
+					return 0;
+				switch (aaa) {
+					case 0: set_op(op, K_TRB, M_ZP, R_A); return 1;
+					case 1: set_op(op, K_BIT, M_ZPX, R_A); return 1;
+					case 3: set_op(op, K_ST, M_ZPX, R_ZERO); return 1;
+					default: return 0;
+				}
+			case 6:
+				if (aaa == 4) {
+					set_op(op, K_XFER, M_IMP, R_A);
+					op->src = R_Y;
+					return 1;
+				}
+				set_op(op, K_FLAG, M_IMP, R_P);
+				op->mask = flag_ops[aaa][0];
+				op->value = flag_ops[aaa][1];
+				return 1;
+			default:
+				if (aaa == 5) {
+					set_op(op, K_LD, M_ABX, R_Y);
+					return 1;
+				}
+				if (!cmos)
+					return 0;
+				switch (aaa) {
+					case 0: set_op(op, K_TRB, M_ABS, R_A); return 1;
+					case 1: set_op(op, K_BIT, M_ABX, R_A); return 1;
+					case 3: set_op(op, K_JMP, M_IAX, R_P); return 1;
+					case 4: set_op(op, K_ST, M_ABS, R_ZERO); return 1;
+					default: return 0;
+				}
+		}
+	}
+
+	return 0;
+}
+
+static uint8_t mode_len(uint8_t mode) {
+	switch (mode) {
+		case M_IMP: case M_ACC: return 1;
+		case M_ABS: case M_ABX: case M_ABY: case M_IND: case M_IAX: return 3;
+		default: return 2;
+	}
+}
+
+/// Documented cycle counts, page crossings and taken branches aside.
+static uint8_t ref_cycles(const REF_OP *op, CPU_VARIANT variant) {
+	static const uint8_t read[] = {
+		[M_IMM] = 2, [M_ZP] = 3, [M_ZPX] = 4, [M_ZPY] = 4, [M_ABS] = 4, [M_ABX] = 4,
+		[M_ABY] = 4, [M_IZX] = 6, [M_IZY] = 5, [M_IZP] = 5,
+	};
+	static const uint8_t store[] = {
+		[M_ZP] = 3, [M_ZPX] = 4, [M_ZPY] = 4, [M_ABS] = 4, [M_ABX] = 5,
+		[M_ABY] = 5, [M_IZX] = 6, [M_IZY] = 6, [M_IZP] = 5,
+	};
+	static const uint8_t rmw[] = {
+		[M_ZP] = 5, [M_ZPX] = 6, [M_ABS] = 6, [M_ABX] = 7,
+	};
+
+	switch (op->cls) {
+		case C_READ: return read[op->mode];
+		case C_STORE: return store[op->mode];
+		case C_RMW: return rmw[op->mode];
+	}
+	switch (op->kind) {
+		case K_PUSH: return 3;
+		case K_PULL: return 4;
+		case K_JSR: case K_RTS: case K_RTI: return 6;
+		case K_BRK: return 7;
+		case K_JMP:
+			if (op->mode == M_ABS)
+				return 3;
+			return op->mode == M_IND && variant != CMOS_65C02 ? 5 : 6;
+		default: return 2;
+	}
+}
+
+/* Reference model, every loop runs across the lanes of one batch */
+static void ref_address(const REF_OP *op, const BATCH *b, REF_LANES *restrict l, uint8_t base_cycles) {
+	const uint8_t *op1 = l->in[R_OP1], *x = l->in[R_X], *y = l->in[R_Y];
+	uint16_t hi = (uint16_t) (b->op2 << 8);
+	uint16_t start = ORIGIN + mode_len(op->mode);
+	uint8_t paged = op->cls == C_READ;
+
+	for (int i = 0; i < LANES; ++i) {
+		l->cycles[i] = base_cycles;
+		l->pc[i] = start;
+		l->halt[i] = 0;
+		l->writes[i] = 0;
+	}
+
+	switch (op->mode) {
+		case M_IMM:
+			for (int i = 0; i < LANES; ++i)
+				l->ea[i] = ORIGIN + 1;
+		break;
+		case M_ZP:
+		case M_IZP:
+			for (int i = 0; i < LANES; ++i)
+				l->ea[i] = op1[i];
+		break;
+		case M_ZPX:
+			for (int i = 0; i < LANES; ++i)
+				l->ea[i] = (uint8_t) (op1[i] + x[i]);
+		break;
+		case M_ZPY:
+			for (int i = 0; i < LANES; ++i)
+				l->ea[i] = (uint8_t) (op1[i] + y[i]);
+		break;
+		case M_ABS:
+			for (int i = 0; i < LANES; ++i)
+				l->ea[i] = hi | op1[i];
+		break;
+		case M_ABX:
+		case M_ABY:
+			for (int i = 0; i < LANES; ++i) {
+				uint16_t base = hi | op1[i];
+				l->ea[i] = (uint16_t) (base + (op->mode == M_ABX ? x[i] : y[i]));
+				l->cycles[i] += paged & ((base ^ l->ea[i]) >> 8 != 0);
+			}
+		break;
+		case M_IZX:
+			for (int i = 0; i < LANES; ++i) {
+				uint8_t ptr = (uint8_t) (op1[i] + x[i]);
+				l->ea[i] = (uint16_t) (pattern(ptr) | pattern((uint8_t) (ptr + 1)) << 8);
+			}
+		break;
+		case M_IZY:
+			for (int i = 0; i < LANES; ++i) {
+				uint16_t base = (uint16_t) (pattern(op1[i]) | pattern((uint8_t) (op1[i] + 1)) << 8);
+				l->ea[i] = (uint16_t) (base + y[i]);
+				l->cycles[i] += paged & ((base ^ l->ea[i]) >> 8 != 0);
+			}
+		break;
+		default:
+			for (int i = 0; i < LANES; ++i)
+				l->ea[i] = 0;
+	}
+
+	if (op->mode == M_IZP) {
+		for (int i = 0; i < LANES; ++i)
+			l->ea[i] = (uint16_t) (pattern(op1[i]) | pattern((uint8_t) (op1[i] + 1)) << 8);
+	}
+
+	if (op->cls == C_READ || op->cls == C_RMW) {
+		if (op->mode == M_IMM) {
+			for (int i = 0; i < LANES; ++i)
+				l->m[i] = op1[i];
+		} else if (b->poke) {
+			for (int i = 0; i < LANES; ++i)
+				l->m[i] = b->value;
+		} else {
+			for (int i = 0; i < LANES; ++i)
+				l->m[i] = view(l->ea[i], op->code, op1[i], b->op2);
+		}
+	}
+}
+
+static inline void write1(REF_LANES *restrict l, int i, uint16_t addr, uint8_t v) {
+	l->wa[0][i] = addr;
+	l->wv[0][i] = v;
+	l->writes[i] = 1;
+}
+
+static void ref_adc(REF_LANES *restrict l, CPU_VARIANT variant, uint8_t subtract) {
+	uint8_t *a = l->out[R_A], *p = l->out[R_P];
+	uint8_t bcd = variant != RICOH_2A03;
+	uint8_t cmos = variant == CMOS_65C02;
+
+	for (int i = 0; i < LANES; ++i) {
+		uint32_t av = a[i], m = l->m[i], c = p[i] & F_C;
+		uint32_t operand = subtract ? (~m & 0xFF) : m;
+		uint32_t sum = av + operand + c;
+		uint8_t res = (uint8_t) sum;
+		uint8_t flags = (uint8_t) ((p[i] & ~(F_N | F_V | F_Z | F_C)) | nz(res) | (sum >> 8)
+			| (((av ^ res) & (operand ^ res) & 0x80) ? F_V : 0));
+
+		if (bcd && (p[i] & F_D)) {
+			uint32_t out;
+			if (!subtract) {
+				uint32_t t = (av & 0x0F) + (m & 0x0F) + c;
+				if (t > 0x09)
+					t += 0x06;
+				t = (t & 0x0F) + (av & 0xF0) + (m & 0xF0) + (t > 0x0F ? 0x10 : 0);
+				flags = (uint8_t) ((flags & ~(F_N | F_V | F_C)) | (t & F_N)
+					| (((av ^ t) & 0x80) && !((av ^ m) & 0x80) ? F_V : 0));
+				if ((t & 0x1F0) > 0x90)
+					t += 0x60;
+				flags |= (t & 0xFF0) > 0xF0 ? F_C : 0;
+				out = t;
+			} else if (!cmos) {
+				uint32_t borrow = c ? 0 : 1;
+				uint32_t t = (av & 0x0F) - (m & 0x0F) - borrow;
+				if (t & 0x10)
+					t = ((t - 0x06) & 0x0F) | ((av & 0xF0) - (m & 0xF0) - 0x10);
+				else
+					t = (t & 0x0F) | ((av & 0xF0) - (m & 0xF0));
+				if (t & 0x100)
+					t -= 0x60;
+				out = t;
+			} else {
+				int32_t lo = (int32_t) (av & 0x0F) - (int32_t) (m & 0x0F) + (int32_t) c - 1;
+				int32_t t = (int32_t) av - (int32_t) m + (int32_t) c - 1;
+				if (t < 0)
+					t -= 0x60;
+				if (lo < 0)
+					t -= 0x06;
+				out = (uint32_t) t;
+			}
+			if (cmos) {
+				flags = (uint8_t) ((flags & ~(F_N | F_Z)) | nz((uint8_t) out));
+				l->cycles[i] += 1;
+			}
+			res = (uint8_t) out;
+		}
+		a[i] = res;
+		p[i] = flags;
+	}
+}
+
+static void ref_execute(const REF_OP *op, const BATCH *b, REF_LANES *restrict l, CPU_VARIANT variant) {
+	uint8_t *a = l->out[R_A], *p = l->out[R_P], *s = l->out[R_S];
+	const uint8_t *op1 = l->in[R_OP1];
+
+	for (int r = R_A; r <= R_S; ++r)
+		memcpy(l->out[r], l->in[r], LANES);
+	ref_address(op, b, l, ref_cycles(op, variant));
+
+	switch (op->kind) {
+		case K_ORA:
+			for (int i = 0; i < LANES; ++i) {
+				a[i] |= l->m[i];
+				p[i] = (uint8_t) ((p[i] & ~(F_N | F_Z)) | nz(a[i]));
+			}
+		break;
+		case K_AND:
+			for (int i = 0; i < LANES; ++i) {
+				a[i] &= l->m[i];
+				p[i] = (uint8_t) ((p[i] & ~(F_N | F_Z)) | nz(a[i]));
+			}
+		break;
+		case K_EOR:
+			for (int i = 0; i < LANES; ++i) {
+				a[i] ^= l->m[i];
+				p[i] = (uint8_t) ((p[i] & ~(F_N | F_Z)) | nz(a[i]));
+			}
+		break;
+		case K_ADC:
+		case K_SBC:
+			ref_adc(l, variant, op->kind == K_SBC);
+		break;
+		case K_LD: {
+			uint8_t *r = l->out[op->reg];
+			for (int i = 0; i < LANES; ++i) {
+				r[i] = l->m[i];
+				p[i] = (uint8_t) ((p[i] & ~(F_N | F_Z)) | nz(r[i]));
+			}
+		}
+		break;
+		case K_ST:
+			for (int i = 0; i < LANES; ++i)
+				write1(l, i, l->ea[i], op->reg == R_ZERO ? 0 : l->in[op->reg][i]);
+		break;
+		case K_CMP: {
+			const uint8_t *r = l->in[op->reg];
+			for (int i = 0; i < LANES; ++i)
+				p[i] = (uint8_t) ((p[i] & ~(F_N | F_Z | F_C)) | nz((uint8_t) (r[i] - l->m[i]))
+					| (r[i] >= l->m[i] ? F_C : 0));
+		}
+		break;
+		case K_BIT:
+			for (int i = 0; i < LANES; ++i) {
+				uint8_t z = a[i] & l->m[i] ? 0 : F_Z;
+				if (op->mode == M_IMM)
+					p[i] = (uint8_t) ((p[i] & ~F_Z) | z);
+				else
+					p[i] = (uint8_t) ((p[i] & ~(F_N | F_V | F_Z)) | (l->m[i] & (F_N | F_V)) | z);
+			}
+		break;
+		case K_TSB:
+		case K_TRB:
+			for (int i = 0; i < LANES; ++i) {
+				p[i] = (uint8_t) ((p[i] & ~F_Z) | (a[i] & l->m[i] ? 0 : F_Z));
+				write1(l, i, l->ea[i], op->kind == K_TSB ? l->m[i] | a[i] : l->m[i] & ~a[i]);
+			}
+		break;
+		case K_ASL: case K_ROL: case K_LSR: case K_ROR:
+		case K_INC: case K_DEC:
+			for (int i = 0; i < LANES; ++i) {
+				uint8_t v = op->mode == M_ACC ? a[i] : l->m[i];
+				uint8_t c = p[i] & F_C, res;
+				switch (op->kind) {
+					case K_ASL: c = v >> 7; res = (uint8_t) (v << 1); break;
+					case K_ROL: res = (uint8_t) (v << 1 | c); c = v >> 7; break;
+					case K_LSR: c = v & 1; res = v >> 1; break;
+					case K_ROR: res = (uint8_t) (v >> 1 | c << 7); c = v & 1; break;
+					case K_INC: res = (uint8_t) (v + 1); break;
+					default: res = (uint8_t) (v - 1); break;
+				}
+				p[i] = (uint8_t) ((p[i] & ~(F_N | F_Z | F_C)) | nz(res) | c);
+				if (op->mode == M_ACC)
+					a[i] = res;
+				else
+					write1(l, i, l->ea[i], res);
+			}
+		break;
+		case K_INR:
+		case K_DER: {
+			uint8_t *r = l->out[op->reg];
+			for (int i = 0; i < LANES; ++i) {
+				r[i] = (uint8_t) (r[i] + (op->kind == K_INR ? 1 : -1));
+				p[i] = (uint8_t) ((p[i] & ~(F_N | F_Z)) | nz(r[i]));
+			}
+		}
+		break;
+		case K_XFER: {
+			uint8_t *r = l->out[op->reg];
+			const uint8_t *from = l->in[op->src];
+			for (int i = 0; i < LANES; ++i) {
+				r[i] = from[i];
+				if (op->reg != R_S)
+					p[i] = (uint8_t) ((p[i] & ~(F_N | F_Z)) | nz(r[i]));
+			}
+		}
+		break;
+		case K_FLAG:
+			for (int i = 0; i < LANES; ++i)
+				p[i] = (uint8_t) ((p[i] & ~op->mask) | op->value);
+		break;
+		case K_PUSH: {
+			const uint8_t *r = l->in[op->reg];
+			for (int i = 0; i < LANES; ++i) {
+				write1(l, i, 0x100 | s[i], op->reg == R_P ? r[i] | F_B | F_U : r[i]);
+				s[i] -= 1;
+			}
+		}
+		break;
+		case K_PULL:
+		case K_RTS:
+		case K_RTI:
+			for (int i = 0; i < LANES; ++i) {
+				uint8_t m = b->value;
+				l->ea[i] = 0x100 | (uint8_t) (s[i] + 1);
+				if (op->kind == K_PULL) {
+					s[i] += 1;
+					if (op->reg == R_P) {
+						p[i] = (uint8_t) ((m & ~F_B) | F_U);
+					} else {
+						l->out[op->reg][i] = m;
+						p[i] = (uint8_t) ((p[i] & ~(F_N | F_Z)) | nz(m));
+					}
+				} else if (op->kind == K_RTS) {
+					uint8_t hi = pattern(0x100 | (uint8_t) (s[i] + 2));
+					l->pc[i] = (uint16_t) ((hi << 8 | m) + 1);
+					s[i] += 2;
+				} else {
+					uint8_t lo = pattern(0x100 | (uint8_t) (s[i] + 2));
+					uint8_t hi = pattern(0x100 | (uint8_t) (s[i] + 3));
+					p[i] = (uint8_t) ((m & ~F_B) | F_U);
+					l->pc[i] = (uint16_t) (hi << 8 | lo);
+					s[i] += 3;
+				}
+			}
+		break;
+		case K_JMP:
+			for (int i = 0; i < LANES; ++i) {
+				uint16_t target = (uint16_t) (b->op2 << 8 | op1[i]);
+				if (op->mode == M_IND) {
+					uint16_t hi_addr = variant == CMOS_65C02
+						? (uint16_t) (target + 1) : (uint16_t) ((target & 0xFF00) | (uint8_t) (target + 1));
+					target = (uint16_t) (view(target, op->code, op1[i], b->op2)
+						| view(hi_addr, op->code, op1[i], b->op2) << 8);
+				} else if (op->mode == M_IAX) {
+					uint16_t ptr = (uint16_t) (target + l->in[R_X][i]);
+					target = (uint16_t) (view(ptr, op->code, op1[i], b->op2)
+						| view((uint16_t) (ptr + 1), op->code, op1[i], b->op2) << 8);
+				}
+				l->pc[i] = target;
+			}
+		break;
+		case K_JSR:
+			for (int i = 0; i < LANES; ++i) {
+				uint16_t ret = ORIGIN + 2;
+				l->wa[0][i] = 0x100 | s[i];
+				l->wv[0][i] = (uint8_t) (ret >> 8);
+				l->wa[1][i] = 0x100 | (uint8_t) (s[i] - 1);
+				l->wv[1][i] = (uint8_t) ret;
+				l->writes[i] = 2;
+				s[i] -= 2;
+				l->pc[i] = (uint16_t) (b->op2 << 8 | op1[i]);
+			}
+		break;
+		case K_BRANCH:
+			for (int i = 0; i < LANES; ++i) {
+				uint16_t next = ORIGIN + 2;
+				uint16_t target = (uint16_t) (next + (int8_t) op1[i]);
+				uint8_t taken = (p[i] & op->mask) == op->value;
+				l->pc[i] = taken ? target : next;
+				l->cycles[i] += taken ? ((next ^ target) >> 8 ? 2 : 1) : 0;
+			}
+		break;
+		case K_BRK:
+			// the emulator stops on BRK instead of taking the interrupt
+			for (int i = 0; i < LANES; ++i) {
+				l->pc[i] = ORIGIN + 1;
+				l->halt[i] = 1;
+			}
+		break;
+		default:
+		break;
+	}
+}
+
+/* Sweeps */
+static uint8_t index_reg(uint8_t mode) {
+	switch (mode) {
+		case M_ZPX: case M_ABX: case M_IZX: case M_IAX: return R_X;
+		case M_ZPY: case M_ABY: case M_IZY: return R_Y;
+		default: return R_OP1;
+	}
+}
+
+static uint8_t value_lane(const REF_OP *op) {
+	switch (op->kind) {
+		case K_ORA: case K_AND: case K_EOR: case K_ADC: case K_SBC:
+		case K_BIT: case K_TSB: case K_TRB:
+			return R_A;
+		case K_CMP:
+			return op->reg;
+		case K_ST:
+			return op->reg == R_ZERO ? R_P : op->reg;
+		default:
+			return R_P;
+	}
+}
+
+static uint32_t value_sets(const REF_OP *op) {
+	if (op->kind == K_ADC || op->kind == K_SBC)
+		return 4;
+	return value_lane(op) == R_P ? 1 : 2;
+}
+
+static uint32_t address_batches(const REF_OP *op) {
+	switch (op->mode) {
+		case M_ZP: case M_IZP: return 1;
+		case M_ABS: return 256;
+		case M_ABX: case M_ABY: return 1024;
+		default: return 256;
+	}
+}
+
+static uint8_t is_memory(const REF_OP *op) {
+	return op->cls != C_OTHER;
+}
+
+static uint32_t batch_count(const REF_OP *op) {
+	if (is_memory(op))
+		return 256 * value_sets(op) + (op->mode == M_IMM ? 0 : address_batches(op));
+	if (op->kind == K_BRK)
+		return 1;
+	if (op->kind == K_JMP && op->mode == M_IAX)
+		return 1024;
+	return 256;
+}
+
+static const uint8_t wide_pages[4] = { 0x00, 0x12, 0x7F, 0xFF };
+
+static void make_batch(const REF_OP *op, uint32_t n, BATCH *b) {
+	for (int r = R_A; r <= R_OP1; ++r)
+		b->base[r] = hash8(n, (uint32_t) (op->code << 3 | r));
+	b->op2 = hash8(n, op->code);
+	b->poke = 0;
+	b->value = 0;
+
+	if (is_memory(op)) {
+		uint32_t sets = value_sets(op);
+		if (n < 256 * sets) {
+			// value sweep, from fixed bases
+			b->lane = value_lane(op);
+			b->value = (uint8_t) (n / sets);
+			b->base[R_P] = (uint8_t) ((b->base[R_P] & ~(F_C | F_D)) | ((n % sets) & 1 ? F_C : 0)
+				| ((n % sets) & 2 ? F_D : 0));
+			b->base[R_OP1] = op->mode == M_IMM ? b->value : op->mode == M_ABS || op->mode == M_ABX || op->mode == M_ABY ? 0x34 : 0x80;
+			b->op2 = 0x12;
+			b->poke = op->mode != M_IMM;
+			return;
+		}
+		// address sweep, the index register across the lanes
+		n -= 256 * sets;
+		b->lane = index_reg(op->mode);
+		if (b->lane == R_OP1) {
+			b->op2 = (uint8_t) n;
+		} else {
+			b->base[R_OP1] = (uint8_t) n;
+			b->op2 = wide_pages[(n >> 8) & 3];
+		}
+		return;
+	}
+
+	switch (op->kind) {
+		case K_PUSH:
+			b->lane = op->reg;
+			b->base[R_S] = (uint8_t) n;
+		break;
+		case K_PULL:
+		case K_RTS:
+		case K_RTI:
+			b->lane = R_S;
+			b->value = (uint8_t) n;
+			b->poke = 1;
+		break;
+		case K_BRANCH:
+		case K_BRK:
+			b->lane = R_P;
+			b->base[R_OP1] = (uint8_t) n;
+		break;
+		case K_JMP:
+		case K_JSR:
+			if (op->mode == M_IAX) {
+				b->lane = R_X;
+				b->base[R_OP1] = (uint8_t) n;
+				b->op2 = wide_pages[(n >> 8) & 3];
+			} else {
+				b->lane = R_OP1;
+				b->op2 = (uint8_t) n;
+			}
+		break;
+		case K_XFER:
+			b->lane = op->src;
+			b->base[R_P] = (uint8_t) n;
+		break;
+		case K_FLAG:
+		case K_NOP:
+			b->lane = R_P;
+			b->base[R_A] = (uint8_t) n;
+		break;
+		default:
+			// shifts of A, INX and the like
+			b->lane = op->reg;
+			b->base[R_P] = (uint8_t) n;
+		break;
+	}
+}
+
+static void fill_lanes(const BATCH *b, REF_LANES *restrict l) {
+	for (int r = R_A; r <= R_OP1; ++r) {
+		if (r == b->lane) {
+			for (int i = 0; i < LANES; ++i)
+				l->in[r][i] = (uint8_t) i;
+		} else {
+			memset(l->in[r], b->base[r], LANES);
+		}
+	}
+}
+
+/* Backends */
+static uint8_t cycles_backend(CPU *cpu, void *data) {
+	(void) data;
+	return run_cycles(cpu, 1);
+}
+
+static uint8_t trace_stop(CPU *cpu, void *data) {
+	(void) cpu;
+	*(uint8_t *) data = 1;
+	return 1;
+}
+
+static uint8_t trace_backend(CPU *cpu, void *data) {
+	uint8_t stepped = 0;
+	uint16_t pc;
+	TRACE trace = { 0 };
+	(void) data;
+
+	trace.program_counter = &pc;
+	trace.stop_pc = -1;
+	trace.stop = trace_stop;
+	trace.data = &stepped;
+	run_steps(cpu, 1, &trace);
+	return stepped;
+}
+
+#ifdef CPU_CYCLE_EXACT
+static void count_cycle(void *data, uint16_t add, uint8_t value, uint8_t write) {
+	(void) add;
+	(void) value;
+	(void) write;
+	*(uint64_t *) data += 1;
+}
+
+/// The bus level core, which must also make exactly one access per cycle
+/// (BRK aside, it halts without its pushes).
+static uint8_t bus_backend(CPU *cpu, void *data) {
+	uint64_t accesses = 0, start = cpu->cycles;
+	(void) data;
+
+	cpu->cycle_exact = 1;
+	cpu->cycle_hook = count_cycle;
+	cpu->cycle_data = &accesses;
+	uint8_t running = step(cpu);
+	cpu->cycle_exact = 0;
+	cpu->cycle_hook = NULL;
+	if (running && accesses != cpu->cycles - start)
+		cpu->cycles = UINT64_MAX;
+	return running;
+}
+#endif
+
+static const BACKEND backends[] = {
+	{ "step", step_backend, NULL },
+	{ "cycles", cycles_backend, NULL },
+	{ "trace", trace_backend, NULL },
+#ifdef CPU_CYCLE_EXACT
+	{ "bus", bus_backend, NULL },
+#endif
+};
+
+#define BACKENDS	(sizeof(backends) / sizeof(backends[0]))
+
+/* Runner */
+static void report(SWEEP *sweep, const REF_OP *op, const REF_LANES *l, int i,
+		CPU *cpu, uint8_t halted, const BATCH *b) {
+	const OPCODE *table = variant_opcodes(sweep->variant);
+	FILE *out = sweep->report;
+
+	pthread_mutex_lock(&sweep->lock);
+	if (sweep->reported[op->code] < REPORTS) {
+		sweep->reported[op->code] += 1;
+		fprintf(out, "%s $%02X (%s): A=%02X X=%02X Y=%02X P=%02X S=%02X operand=%02X %02X",
+			table[op->code].mnemonic, op->code, sweep->backend->name,
+			l->in[R_A][i], l->in[R_X][i], l->in[R_Y][i], l->in[R_P][i], l->in[R_S][i],
+			l->in[R_OP1][i], b->op2);
+		if (b->poke)
+			fprintf(out, " M=%02X", b->value);
+		fprintf(out, "\n  expected A=%02X X=%02X Y=%02X P=%02X S=%02X PC=%04X cycles=%u%s\n",
+			l->out[R_A][i], l->out[R_X][i], l->out[R_Y][i], l->out[R_P][i], l->out[R_S][i],
+			l->pc[i], l->cycles[i], l->halt[i] ? " halted" : "");
+		fprintf(out, "  got      A=%02X X=%02X Y=%02X P=%02X S=%02X PC=%04X cycles=%lu%s\n",
+			cpu->register_a, cpu->register_x, cpu->register_y, cpu->status, cpu->stack_pointer,
+			cpu->program_counter, cpu->cycles, halted ? " halted" : "");
+		for (int w = 0; w < l->writes[i]; ++w)
+			fprintf(out, "  $%04X: expected %02X, got %02X\n",
+				l->wa[w][i], l->wv[w][i], cpu->memory[l->wa[w][i]]);
+	}
+	pthread_mutex_unlock(&sweep->lock);
+}
+
+static uint64_t run_batch(SWEEP *sweep, CPU *cpu, const REF_OP *op, const BATCH *b, const REF_LANES *l) {
+	uint8_t *memory = cpu->memory;
+	uint64_t failures = 0;
+
+	for (int i = 0; i < LANES; ++i) {
+		memory[ORIGIN] = op->code;
+		memory[ORIGIN + 1] = l->in[R_OP1][i];
+		memory[ORIGIN + 2] = b->op2;
+		if (b->poke)
+			memory[l->ea[i]] = b->value;
+
+		cpu->register_a = l->in[R_A][i];
+		cpu->register_x = l->in[R_X][i];
+		cpu->register_y = l->in[R_Y][i];
+		cpu->status = l->in[R_P][i];
+		cpu->stack_pointer = l->in[R_S][i];
+		cpu->program_counter = ORIGIN;
+		cpu->cycles = 0;
+
+		uint8_t halted = !sweep->backend->advance(cpu, sweep->backend->data);
+		uint8_t same = halted == l->halt[i]
+			&& cpu->register_a == l->out[R_A][i]
+			&& cpu->register_x == l->out[R_X][i]
+			&& cpu->register_y == l->out[R_Y][i]
+			&& cpu->status == l->out[R_P][i]
+			&& cpu->stack_pointer == l->out[R_S][i]
+			&& cpu->program_counter == l->pc[i]
+			&& cpu->cycles == l->cycles[i];
+		for (int w = 0; w < l->writes[i]; ++w)
+			same &= memory[l->wa[w][i]] == l->wv[w][i];
+
+		if (!same) {
+			failures += 1;
+			report(sweep, op, l, i, cpu, halted, b);
+		}
+
+		if (b->poke)
+			memory[l->ea[i]] = pattern(l->ea[i]);
+		for (int w = 0; w < l->writes[i]; ++w)
+			memory[l->wa[w][i]] = pattern(l->wa[w][i]);
+	}
+
+	return failures;
+}
+
+static void *sweep_worker(void *arg) {
+	WORKER *worker = arg;
+	SWEEP *sweep = worker->sweep;
+	CPU *cpu = worker->cpu;
+	REF_LANES *l = &worker->lanes;
+
+	createCPUVariant(cpu, sweep->variant);
+#ifdef CPU_FUZZ
+	cpu->edge_map = worker->edges;
+#endif
+	for (uint32_t addr = 0; addr < MEMORY_SIZE; ++addr)
+		cpu->memory[addr] = pattern((uint16_t) addr);
+
+	for (;;) {
+		size_t n = atomic_fetch_add(&sweep->next, 1);
+		if (n >= sweep->nitems)
+			break;
+
+		const REF_OP *op = &sweep->ops[sweep->items[n].code];
+		BATCH b;
+		make_batch(op, sweep->items[n].batch, &b);
+		fill_lanes(&b, l);
+		ref_execute(op, &b, l, sweep->variant);
+
+		uint64_t failures = run_batch(sweep, cpu, op, &b, l);
+		if (failures)
+			atomic_fetch_add(&sweep->failures[op->code], failures);
+		atomic_fetch_add(&sweep->cases, LANES);
+	}
+
+	destroyCPU(cpu);
+	return NULL;
+}
+
+/// Checks the opcode sets agree, then sweeps every opcode (or only `only`
+/// if not -1). Returns the number of failed cases.
+static uint64_t sweep_run(SWEEP *sweep, int only, unsigned jobs, uint32_t *opcodes) {
+	const OPCODE *table = variant_opcodes(sweep->variant);
+	uint64_t failures = 0;
+
+	sweep->nitems = 0;
+	*opcodes = 0;
+	for (int code = 0; code < 256; ++code) {
+		uint8_t known = ref_decode((uint8_t) code, sweep->variant, &sweep->ops[code]);
+		if (known != (table[code].len != 0)) {
+			fprintf(sweep->report, "$%02X: %s by the core but not by the reference\n",
+				code, known ? "missing" : "defined");
+			failures += 1;
+			sweep->ops[code].code = 0;
+			continue;
+		}
+		if (known && (only < 0 || only == code)) {
+			sweep->nitems += batch_count(&sweep->ops[code]);
+			*opcodes += 1;
+		}
+	}
+
+	sweep->items = malloc(sweep->nitems * sizeof(ITEM));
+	size_t n = 0;
+	for (int code = 0; code < 256; ++code) {
+		if (!(table[code].len && sweep->ops[code].code == code) || (only >= 0 && only != code))
+			continue;
+		for (uint32_t i = 0; i < batch_count(&sweep->ops[code]); ++i)
+			sweep->items[n++] = (ITEM) { (uint8_t) code, i };
+	}
+	sweep->nitems = n;
+
+	pthread_t threads[jobs];
+	WORKER *workers = malloc(jobs * sizeof(WORKER));
+	for (unsigned i = 0; i < jobs; ++i) {
+		workers[i].sweep = sweep;
+		workers[i].cpu = malloc(sizeof(CPU));
+		pthread_create(&threads[i], NULL, sweep_worker, &workers[i]);
+	}
+	for (unsigned i = 0; i < jobs; ++i) {
+		pthread_join(threads[i], NULL);
+		free(workers[i].cpu);
+	}
+	free(workers);
+	free(sweep->items);
+
+	for (int code = 0; code < 256; ++code)
+		failures += sweep->failures[code];
+	return failures;
+}
+
+static void createSWEEP(SWEEP *sweep, CPU_VARIANT variant, const BACKEND *backend, FILE *report) {
+	memset(sweep, 0, sizeof(*sweep));
+	sweep->variant = variant;
+	sweep->backend = backend;
+	sweep->report = report;
+	pthread_mutex_init(&sweep->lock, NULL);
+}
+
+static void destroySWEEP(SWEEP *sweep) {
+	pthread_mutex_destroy(&sweep->lock);
+}
+
+static const char *variant_names[] = { "nmos", "65c02", "2a03" };
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-v nmos|65c02|2a03] [-b step|cycles|trace|bus] [-o opcode] [-j jobs]\n", name);
+	fprintf(stderr, "  every variant and backend by default, exit status 1 on any mismatch\n");
+}
+
+int main(int argc, char **argv) {
+	int variant = -1;
+	int backend = -1;
+	int only = -1;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	int opt;
+	while ((opt = getopt(argc, argv, "v:b:o:j:")) != -1) {
+		switch (opt) {
+			case 'v':
+				for (int i = 0; i < 3; ++i)
+					if (!strcmp(optarg, variant_names[i]))
+						variant = i;
+				if (variant < 0) {
+					usage(argv[0]);
+					return 1;
+				}
+			break;
+			case 'b':
+				for (int i = 0; i < (int) BACKENDS; ++i)
+					if (!strcmp(optarg, backends[i].name))
+						backend = i;
+				if (backend < 0) {
+					usage(argv[0]);
+					return 1;
+				}
+			break;
+			case 'o': only = (int) strtol(optarg, NULL, 16) & 0xFF; break;
+			case 'j': jobs = strtol(optarg, NULL, 0); break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (jobs < 1)
+		jobs = 1;
+
+	uint64_t total = 0;
+	for (int v = 0; v < 3; ++v) {
+		if (variant >= 0 && v != variant)
+			continue;
+		for (int k = 0; k < (int) BACKENDS; ++k) {
+			if (backend >= 0 && k != backend)
+				continue;
+
+			static SWEEP sweep;
+			uint32_t opcodes;
+			createSWEEP(&sweep, (CPU_VARIANT) v, &backends[k], stdout);
+			double start = now();
+			uint64_t failures = sweep_run(&sweep, only, (unsigned) jobs, &opcodes);
+			printf("%s/%s: %u opcodes, %lu cases, %lu failures, %.2f s\n",
+				variant_names[v], backends[k].name, opcodes, (uint64_t) sweep.cases,
+				failures, now() - start);
+			total += failures;
+			destroySWEEP(&sweep);
+		}
+	}
+
+	return total != 0;
+}